@@ -0,0 +1,64 @@
+#include "bench_intf.c"
+
+#define BENCH_NADDRS 1024
+
+struct bench_addr {
+	struct nvm_dev *dev;
+	struct nvm_addr addrs[BENCH_NADDRS];
+	uint64_t devs[BENCH_NADDRS];
+};
+
+static void bench_gen2dev(void *arg, size_t niter)
+{
+	struct bench_addr *ba = arg;
+	uint64_t acc = 0;
+
+	for (size_t i = 0; i < niter; ++i) {
+		for (int idx = 0; idx < BENCH_NADDRS; ++idx)
+			acc += nvm_addr_gen2dev(ba->dev, ba->addrs[idx]);
+	}
+
+	bench_sink += acc;
+}
+
+static void bench_dev2gen(void *arg, size_t niter)
+{
+	struct bench_addr *ba = arg;
+	uint64_t acc = 0;
+
+	for (size_t i = 0; i < niter; ++i) {
+		for (int idx = 0; idx < BENCH_NADDRS; ++idx)
+			acc += nvm_addr_dev2gen(ba->dev, ba->devs[idx]).val;
+	}
+
+	bench_sink += acc;
+}
+
+int main(void)
+{
+	struct bench_addr ba = { 0 };
+	const struct nvm_geo *geo;
+
+	ba.dev = bench_dev_s20();
+	if (!ba.dev) {
+		perror("# bench_dev_s20");
+		return 1;
+	}
+	geo = nvm_dev_get_geo(ba.dev);
+
+	for (int idx = 0; idx < BENCH_NADDRS; ++idx) {
+		ba.addrs[idx].l.pugrp = idx % geo->l.npugrp;
+		ba.addrs[idx].l.punit = (idx / geo->l.npugrp) % geo->l.npunit;
+		ba.addrs[idx].l.chunk = idx % geo->l.nchunk;
+		ba.addrs[idx].l.sectr = (idx * 7) % geo->l.nsectr;
+
+		ba.devs[idx] = nvm_addr_gen2dev(ba.dev, ba.addrs[idx]);
+	}
+
+	bench_run("nvm_addr_gen2dev", bench_gen2dev, &ba, 10000, BENCH_NADDRS);
+	bench_run("nvm_addr_dev2gen", bench_dev2gen, &ba, 10000, BENCH_NADDRS);
+
+	bench_dev_free(ba.dev);
+
+	return bench_report();
+}
@@ -0,0 +1,62 @@
+#include "bench_intf.c"
+
+#define BENCH_BBT_NADDRS 256
+
+struct bench_bbt {
+	struct nvm_dev *dev;
+	struct nvm_addr addrs[BENCH_BBT_NADDRS];
+};
+
+static void bench_get(void *arg, size_t niter)
+{
+	struct bench_bbt *bb = arg;
+	size_t acc = 0;
+
+	for (size_t i = 0; i < niter; ++i) {
+		for (int idx = 0; idx < BENCH_BBT_NADDRS; ++idx) {
+			const struct nvm_bbt *bbt;
+
+			bbt = nvm_bbt_get(bb->dev, bb->addrs[idx], NULL);
+			acc += bbt ? bbt->nbad : 0;
+		}
+	}
+
+	bench_sink += acc;
+}
+
+static void bench_mark(void *arg, size_t niter)
+{
+	struct bench_bbt *bb = arg;
+
+	for (size_t i = 0; i < niter; ++i) {
+		nvm_bbt_mark(bb->dev, bb->addrs, BENCH_BBT_NADDRS,
+			     (i & 1) ? NVM_BBT_FREE : NVM_BBT_HMRK, NULL);
+	}
+}
+
+int main(void)
+{
+	struct bench_bbt bb = { 0 };
+	const struct nvm_geo *geo;
+
+	bb.dev = bench_dev_s12();
+	if (!bb.dev) {
+		perror("# bench_dev_s12");
+		return 1;
+	}
+	geo = nvm_dev_get_geo(bb.dev);
+
+	for (int idx = 0; idx < BENCH_BBT_NADDRS; ++idx) {
+		bb.addrs[idx].g.ch = idx % geo->g.nchannels;
+		bb.addrs[idx].g.lun = (idx / geo->g.nchannels) % geo->g.nluns;
+		bb.addrs[idx].g.blk = (idx * 13) % geo->g.nblocks;
+		bb.addrs[idx].g.pl = idx % geo->g.nplanes;
+	}
+
+	bench_run("nvm_bbt_get", bench_get, &bb, 10000, BENCH_BBT_NADDRS);
+	bench_run("nvm_bbt_mark", bench_mark, &bb, 200, BENCH_BBT_NADDRS);
+
+	bench_dev_free(bb.dev);
+
+	return bench_report();
+}
@@ -0,0 +1,54 @@
+#include "bench_intf.c"
+
+#define BENCH_BUF_NBYTES (1 << 17)
+
+struct bench_buf {
+	char *expected;
+	char *actual;
+};
+
+static void bench_fill(void *arg, size_t niter)
+{
+	struct bench_buf *bb = arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		nvm_buf_fill(bb->actual, BENCH_BUF_NBYTES);
+}
+
+static void bench_diff(void *arg, size_t niter)
+{
+	struct bench_buf *bb = arg;
+	size_t acc = 0;
+
+	for (size_t i = 0; i < niter; ++i)
+		acc += nvm_buf_diff(bb->expected, bb->actual, BENCH_BUF_NBYTES);
+
+	bench_sink += acc;
+}
+
+int main(void)
+{
+	struct bench_buf bb = { 0 };
+	int res = 1;
+
+	bb.expected = nvm_buf_virt_alloc(4096, BENCH_BUF_NBYTES);
+	bb.actual = nvm_buf_virt_alloc(4096, BENCH_BUF_NBYTES);
+	if (!bb.expected || !bb.actual) {
+		perror("# nvm_buf_virt_alloc");
+		goto exit;
+	}
+
+	nvm_buf_fill(bb.expected, BENCH_BUF_NBYTES);
+	nvm_buf_fill(bb.actual, BENCH_BUF_NBYTES);
+
+	bench_run("nvm_buf_fill(128KiB)", bench_fill, &bb, 2000, 1);
+	bench_run("nvm_buf_diff(128KiB)", bench_diff, &bb, 2000, 1);
+
+	res = bench_report();
+
+exit:
+	nvm_buf_virt_free(bb.expected);
+	nvm_buf_virt_free(bb.actual);
+
+	return res;
+}
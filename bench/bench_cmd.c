@@ -0,0 +1,80 @@
+#include "bench_intf.c"
+
+struct bench_cmd {
+	struct nvm_dev *dev;
+	int opcode;
+	int naddrs;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	char *buf;
+};
+
+static void bench_wrap(void *arg, size_t niter)
+{
+	struct bench_cmd *bc = arg;
+
+	for (size_t i = 0; i < niter; ++i) {
+		struct nvm_cmd_wrap *wrap;
+
+		wrap = nvm_cmd_wrap_setup(bc->dev, bc->opcode, bc->buf, NULL,
+					  bc->addrs, NULL, bc->naddrs,
+					  NVM_CMD_VECTOR | NVM_CMD_PRP, NULL);
+		if (!wrap)
+			continue;
+
+		bench_sink += wrap->cmd.addrs;
+		nvm_cmd_wrap_term(wrap);
+	}
+}
+
+static void bench_write(void *arg, size_t niter)
+{
+	struct bench_cmd *bc = arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		nvm_cmd_write(bc->dev, bc->addrs, bc->naddrs, bc->buf, NULL,
+			      NVM_CMD_SYNC | NVM_CMD_VECTOR, NULL);
+}
+
+int main(void)
+{
+	const int naddrs[] = { 1, 8, NVM_NADDR_MAX };
+	struct bench_cmd bc = { 0 };
+	char name[BENCH_NAME_LEN];
+
+	bc.dev = bench_dev_s20();
+	if (!bc.dev) {
+		perror("# bench_dev_s20");
+		return 1;
+	}
+
+	bc.buf = nvm_buf_alloc(bc.dev, NVM_NADDR_MAX * 4096, NULL);
+	if (!bc.buf) {
+		perror("# nvm_buf_alloc");
+		bench_dev_free(bc.dev);
+		return 1;
+	}
+
+	for (int idx = 0; idx < NVM_NADDR_MAX; ++idx) {
+		bc.addrs[idx].l.pugrp = idx % 8;
+		bc.addrs[idx].l.punit = (idx / 8) % 4;
+		bc.addrs[idx].l.sectr = idx;
+	}
+
+	bc.opcode = NVM_DOPC_VECTOR_WRITE;
+	for (size_t i = 0; i < sizeof(naddrs) / sizeof(naddrs[0]); ++i) {
+		bc.naddrs = naddrs[i];
+
+		snprintf(name, sizeof(name), "nvm_cmd_wrap_setup_term(%d)",
+			 bc.naddrs);
+		bench_run(name, bench_wrap, &bc, 200000, 1);
+
+		snprintf(name, sizeof(name), "nvm_cmd_write_null(%d)",
+			 bc.naddrs);
+		bench_run(name, bench_write, &bc, 200000, 1);
+	}
+
+	nvm_buf_free(bc.dev, bc.buf);
+	bench_dev_free(bc.dev);
+
+	return bench_report();
+}
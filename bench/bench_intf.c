@@ -0,0 +1,433 @@
+/*
+ * bench_intf - Micro-benchmark helpers, synthetic device and reporting
+ *
+ * Copyright (C) 2019 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The benchmarks run without a device: a synthetic `struct nvm_dev` is
+ * constructed with a "null" backend which sets up and tears down the command
+ * wrapper, exactly like the real backends, but never submits the command.
+ *
+ * Environment variables:
+ *
+ * NVM_BENCH_NITER	Scale the number of iterations of every benchmark
+ * NVM_BENCH_BASELINE	Path to baseline, compare results against it
+ * NVM_BENCH_THRESHOLD	Allowed regression in percent, default 20
+ * NVM_BENCH_SAVE	Path to file, results are appended as baseline
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <liblightnvm.h>
+#include <liblightnvm_spec.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_cmd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_NAME_LEN 64
+#define BENCH_NRES_MAX 64
+
+struct bench_res {
+	char name[BENCH_NAME_LEN];
+	double nsecs;			///< Nanoseconds per operation
+	double cycles;			///< Cycles per operation
+};
+
+static struct bench_res bench_res[BENCH_NRES_MAX];
+static int bench_nres;
+
+static volatile uint64_t bench_sink;	///< Defeat dead-code elimination
+
+static atomic_size_t bench_ncmds;	///< Commands seen by the null backend
+
+static inline uint64_t _bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_nsec + ts.tv_sec * 1000000000ULL;
+}
+
+static inline uint64_t _bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static size_t bench_niter(size_t niter)
+{
+	char *scale = getenv("NVM_BENCH_NITER");
+
+	if (scale && atof(scale) > 0)
+		niter = niter * atof(scale);
+
+	return niter ? niter : 1;
+}
+
+/**
+ * Emulate the CPU-side of a backend: setup and teardown of the command wrapper
+ */
+static int _bench_be_vector(struct nvm_dev *dev, int opcode,
+			    struct nvm_addr addrs[], struct nvm_addr dst[],
+			    int naddrs, void *data, void *meta, uint16_t flags,
+			    struct nvm_ret *ret)
+{
+	struct nvm_cmd_wrap *wrap;
+
+	wrap = nvm_cmd_wrap_setup(dev, opcode, data, meta, addrs, dst, naddrs,
+				  flags, ret);
+	if (!wrap)
+		return -1;
+
+	bench_sink += wrap->cmd.addrs;
+	atomic_fetch_add_explicit(&bench_ncmds, 1, memory_order_relaxed);
+
+	nvm_cmd_wrap_term(wrap);
+
+	return 0;
+}
+
+static int bench_be_vector_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
+				 int naddrs, void *meta, uint16_t flags,
+				 struct nvm_ret *ret)
+{
+	return _bench_be_vector(dev, NVM_DOPC_VECTOR_ERASE, addrs, NULL, naddrs,
+				NULL, meta, flags, ret);
+}
+
+static int bench_be_vector_write(struct nvm_dev *dev, struct nvm_addr addrs[],
+				 int naddrs, const void *data, const void *meta,
+				 uint16_t flags, struct nvm_ret *ret)
+{
+	return _bench_be_vector(dev, NVM_DOPC_VECTOR_WRITE, addrs, NULL, naddrs,
+				(void *)data, (void *)meta, flags, ret);
+}
+
+static int bench_be_vector_read(struct nvm_dev *dev, struct nvm_addr addrs[],
+				int naddrs, void *data, void *meta,
+				uint16_t flags, struct nvm_ret *ret)
+{
+	return _bench_be_vector(dev, NVM_DOPC_VECTOR_READ, addrs, NULL, naddrs,
+				data, meta, flags, ret);
+}
+
+static int bench_be_vector_copy(struct nvm_dev *dev, struct nvm_addr src[],
+				struct nvm_addr dst[], int naddrs,
+				uint16_t flags, struct nvm_ret *ret)
+{
+	return _bench_be_vector(dev, NVM_DOPC_VECTOR_COPY, src, dst, naddrs,
+				NULL, NULL, flags, ret);
+}
+
+/**
+ * Identity-map buffers, as a DMA-capable backend would translate them, such
+ * that SGL construction is measured without one
+ */
+static int bench_be_vtophys(const struct nvm_dev *NVM_UNUSED(dev), void *buf,
+			    uint64_t *phys)
+{
+	*phys = (uintptr_t)buf;
+
+	return 0;
+}
+
+static struct nvm_be bench_be = {
+	.id = NVM_BE_IOCTL,		// Host-memory buffers
+	.name = "NVM_BE_BENCH",
+
+	.open = nvm_be_nosys_open,
+	.close = nvm_be_nosys_close,
+
+	.pass = nvm_be_nosys_pass,
+	.idfy = nvm_be_nosys_idfy,
+	.rprt = nvm_be_nosys_rprt,
+	.gfeat = nvm_be_nosys_gfeat,
+	.sfeat = nvm_be_nosys_sfeat,
+	.gbbt = nvm_be_nosys_gbbt,
+	.sbbt = nvm_be_nosys_sbbt,
+
+	.scalar_erase = nvm_be_nosys_scalar_erase,
+	.scalar_write = nvm_be_nosys_scalar_write,
+	.scalar_read = nvm_be_nosys_scalar_read,
+
+	.vector_erase = bench_be_vector_erase,
+	.vector_write = bench_be_vector_write,
+	.vector_read = bench_be_vector_read,
+	.vector_copy = bench_be_vector_copy,
+
+	.async_init = nvm_be_nosys_async_init,
+	.async_term = nvm_be_nosys_async_term,
+	.async_poke = nvm_be_nosys_async_poke,
+	.async_wait = nvm_be_nosys_async_wait,
+
+	.vtophys = bench_be_vtophys,
+};
+
+/**
+ * Construct a synthetic OCSSD 2.0 device with 8 groups of 4 parallel units
+ */
+static inline struct nvm_dev *bench_dev_s20(void)
+{
+	struct nvm_dev *dev = calloc(1, sizeof(*dev));
+
+	if (!dev)
+		return NULL;
+
+	strcpy(dev->name, "bench0n1");
+	strcpy(dev->path, "/dev/bench0n1");
+	dev->nsid = 1;
+	dev->verid = NVM_SPEC_VERID_20;
+	dev->be = &bench_be;
+	dev->cmd_opts = NVM_CMD_SYNC | NVM_CMD_VECTOR | NVM_CMD_PRP;
+
+	dev->geo.verid = NVM_SPEC_VERID_20;
+	dev->geo.l.npugrp = 8;
+	dev->geo.l.npunit = 4;
+	dev->geo.l.nchunk = 1000;
+	dev->geo.l.nsectr = 4096;
+	dev->geo.l.nbytes = 4096;
+	dev->geo.l.nbytes_oob = 16;
+	dev->geo.nplanes = 1;
+	dev->geo.tbytes = dev->geo.l.npugrp * dev->geo.l.npunit *
+			  dev->geo.l.nchunk * dev->geo.l.nsectr *
+			  dev->geo.l.nbytes;
+
+	dev->idfy.s20.wrt.ws_min = 4;
+	dev->idfy.s20.wrt.ws_opt = 8;
+	dev->idfy.s20.wrt.mw_cunits = 24;
+
+	dev->lbaf.sectr = 12;
+	dev->lbaf.chunk = 10;
+	dev->lbaf.punit = 2;
+	dev->lbaf.pugrp = 3;
+
+	dev->lbaz.sectr = 0;
+	dev->lbaz.chunk = dev->lbaf.sectr;
+	dev->lbaz.punit = dev->lbaz.chunk + dev->lbaf.chunk;
+	dev->lbaz.pugrp = dev->lbaz.punit + dev->lbaf.punit;
+
+	dev->lbam.sectr = (((uint64_t)1 << dev->lbaf.sectr) - 1) << dev->lbaz.sectr;
+	dev->lbam.chunk = (((uint64_t)1 << dev->lbaf.chunk) - 1) << dev->lbaz.chunk;
+	dev->lbam.punit = (((uint64_t)1 << dev->lbaf.punit) - 1) << dev->lbaz.punit;
+	dev->lbam.pugrp = (((uint64_t)1 << dev->lbaf.pugrp) - 1) << dev->lbaz.pugrp;
+
+	dev->vblk_opts.pmode = NVM_FLAG_PMODE_SNGL;
+	dev->vblk_opts.meta_mode = NVM_META_MODE_NONE;
+	dev->vblk_opts.erase_naddrs_max = NVM_NADDR_MAX;
+	dev->vblk_opts.read_naddrs_max = NVM_NADDR_MAX;
+	dev->vblk_opts.write_naddrs_max = NVM_NADDR_MAX;
+
+	return dev;
+}
+
+/**
+ * Construct a synthetic OCSSD 1.2 device with a cached bad-block-table
+ */
+static inline struct nvm_dev *bench_dev_s12(void)
+{
+	struct nvm_dev *dev = calloc(1, sizeof(*dev));
+	size_t nblks;
+
+	if (!dev)
+		return NULL;
+
+	strcpy(dev->name, "bench0n1");
+	strcpy(dev->path, "/dev/bench0n1");
+	dev->nsid = 1;
+	dev->verid = NVM_SPEC_VERID_12;
+	dev->be = &bench_be;
+	dev->cmd_opts = NVM_CMD_SYNC | NVM_CMD_VECTOR | NVM_CMD_PRP;
+
+	dev->geo.verid = NVM_SPEC_VERID_12;
+	dev->geo.g.nchannels = 16;
+	dev->geo.g.nluns = 8;
+	dev->geo.g.nblocks = 1024;
+	dev->geo.g.nsectors = 4;
+	dev->geo.g.sector_nbytes = 4096;
+	dev->geo.g.meta_nbytes = 16;
+	dev->geo.g.nplanes = 2;
+	dev->geo.g.npages = 512;
+	dev->geo.g.page_nbytes = 16384;
+
+	dev->bbts_cached = 1;
+	dev->nbbts = dev->geo.g.nchannels * dev->geo.g.nluns;
+	dev->bbts = calloc(dev->nbbts, sizeof(*dev->bbts));
+	if (!dev->bbts) {
+		free(dev);
+		return NULL;
+	}
+
+	nblks = dev->geo.g.nblocks * dev->geo.g.nplanes;
+	for (size_t i = 0; i < dev->nbbts; ++i) {
+		struct nvm_bbt *bbt;
+
+		bbt = calloc(1, sizeof(*bbt) + sizeof(*bbt->blks) * nblks);
+		if (!bbt)
+			break;
+
+		bbt->dev = dev;
+		bbt->addr.g.ch = i / dev->geo.g.nluns;
+		bbt->addr.g.lun = i % dev->geo.g.nluns;
+		bbt->nblks = nblks;
+
+		dev->bbts[i] = bbt;
+	}
+
+	return dev;
+}
+
+static inline void bench_dev_free(struct nvm_dev *dev)
+{
+	if (!dev)
+		return;
+
+	for (size_t i = 0; i < dev->nbbts; ++i)
+		free(dev->bbts[i]);
+	free(dev->bbts);
+	free(dev);
+}
+
+/**
+ * Run 'func' for 'niter' iterations, each iteration performs 'nops' operations
+ */
+static void bench_run(const char *name, void (*func)(void *, size_t),
+		      void *arg, size_t niter, size_t nops)
+{
+	struct bench_res *res;
+	uint64_t tbgn, tend, cbgn, cend;
+	double tops;
+
+	niter = bench_niter(niter);
+	tops = (double)niter * (nops ? nops : 1);
+
+	func(arg, 1);				// Warm-up
+
+	tbgn = _bench_clock();
+	cbgn = _bench_cycles();
+	func(arg, niter);
+	cend = _bench_cycles();
+	tend = _bench_clock();
+
+	if (bench_nres >= BENCH_NRES_MAX)
+		return;
+
+	res = &bench_res[bench_nres++];
+	snprintf(res->name, BENCH_NAME_LEN, "%s", name);
+	res->nsecs = (tend - tbgn) / tops;
+	res->cycles = (cend - cbgn) / tops;
+
+	printf("%s: {nops: %.0f, ns_per_op: %.2f, cycles_per_op: %.2f}\n",
+	       res->name, tops, res->nsecs, res->cycles);
+}
+
+/**
+ * Number of commands one iteration of 'func' submits to the null backend, for
+ * benchmarks reporting per command, also runs as a warm-up
+ */
+static inline size_t bench_ncmds_per_iter(void (*func)(void *, size_t),
+					  void *arg)
+{
+	const size_t bgn = atomic_load(&bench_ncmds);
+
+	func(arg, 1);
+
+	return atomic_load(&bench_ncmds) - bgn;
+}
+
+static inline void bench_skip(const char *name, const char *reason)
+{
+	printf("%s: {skipped: '%s'}\n", name, reason);
+}
+
+/**
+ * Compare results against the baseline given by NVM_BENCH_BASELINE and store
+ * results in NVM_BENCH_SAVE
+ *
+ * @return 0 when no result regressed past NVM_BENCH_THRESHOLD, 1 otherwise
+ */
+static int bench_report(void)
+{
+	const char *baseline = getenv("NVM_BENCH_BASELINE");
+	const char *save = getenv("NVM_BENCH_SAVE");
+	const char *thrs = getenv("NVM_BENCH_THRESHOLD");
+	const double threshold = thrs ? atof(thrs) : 20.0;
+	int nregr = 0;
+
+	if (save) {
+		FILE *fp = fopen(save, "a");
+
+		if (!fp) {
+			perror("# NVM_BENCH_SAVE");
+			return 1;
+		}
+		for (int i = 0; i < bench_nres; ++i)
+			fprintf(fp, "%s %.2f\n", bench_res[i].name,
+				bench_res[i].nsecs);
+		fclose(fp);
+	}
+
+	if (baseline) {
+		char name[BENCH_NAME_LEN];
+		double nsecs;
+		FILE *fp;
+
+		fp = fopen(baseline, "r");
+		if (!fp) {
+			perror("# NVM_BENCH_BASELINE");
+			return 1;
+		}
+
+		while (fscanf(fp, "%63s %lf", name, &nsecs) == 2) {
+			for (int i = 0; i < bench_nres; ++i) {
+				double pct;
+
+				if (strcmp(name, bench_res[i].name))
+					continue;
+
+				pct = ((bench_res[i].nsecs - nsecs) / nsecs) *
+				      100.0;
+				if (pct <= threshold)
+					continue;
+
+				printf("# REGRESSION: %s: {baseline: %.2f, "
+				       "ns_per_op: %.2f, pct: %.2f}\n",
+				       name, nsecs, bench_res[i].nsecs, pct);
+				++nregr;
+			}
+		}
+
+		fclose(fp);
+	}
+
+	return nregr ? 1 : 0;
+}
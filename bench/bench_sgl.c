@@ -0,0 +1,59 @@
+#include "bench_intf.c"
+
+#define BENCH_SGL_NDESCR 256
+
+struct bench_sgl {
+	struct nvm_dev *dev;
+	struct nvm_sgl *sgl;
+	char *buf;
+};
+
+static void bench_sgl_add(void *arg, size_t niter)
+{
+	struct bench_sgl *bs = arg;
+
+	for (size_t i = 0; i < niter; ++i) {
+		nvm_sgl_reset(bs->sgl);
+
+		for (int idx = 0; idx < BENCH_SGL_NDESCR; ++idx)
+			nvm_sgl_add(bs->dev, bs->sgl, bs->buf + idx * 4096,
+				    4096);
+	}
+}
+
+int main(void)
+{
+	struct bench_sgl bs = { 0 };
+	int res = 1;
+
+	bs.dev = bench_dev_s20();
+	if (!bs.dev) {
+		perror("# bench_dev_s20");
+		return 1;
+	}
+
+	bs.buf = nvm_buf_alloc(bs.dev, BENCH_SGL_NDESCR * 4096, NULL);
+	bs.sgl = nvm_sgl_create(bs.dev, BENCH_SGL_NDESCR);
+	if (!bs.buf || !bs.sgl) {
+		perror("# nvm_buf_alloc / nvm_sgl_create");
+		goto exit;
+	}
+
+	// SGLs carry physical addresses, the bench backend identity-maps
+	if (nvm_sgl_add(bs.dev, bs.sgl, bs.buf, 4096)) {
+		perror("# nvm_sgl_add");
+		goto exit;
+	}
+
+	bench_run("nvm_sgl_add", bench_sgl_add, &bs, 2000, BENCH_SGL_NDESCR);
+
+	res = bench_report();
+
+exit:
+	if (bs.sgl)
+		nvm_sgl_destroy(bs.dev, bs.sgl);
+	nvm_buf_free(bs.dev, bs.buf);
+	bench_dev_free(bs.dev);
+
+	return res;
+}
@@ -0,0 +1,77 @@
+#include "bench_intf.c"
+#include <inttypes.h>
+#include <nvm_timer.h>
+
+static void bench_clock_monotonic(void *arg, size_t niter)
+{
+	uint64_t acc = 0;
+
+	(void)arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		acc += _clock_monotonic();
+
+	bench_sink += acc;
+}
+
+static void bench_timer_ticks(void *arg, size_t niter)
+{
+	uint64_t acc = 0;
+
+	(void)arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		acc += nvm_timer_ticks();
+
+	bench_sink += acc;
+}
+
+static void bench_timer_ticks_end(void *arg, size_t niter)
+{
+	uint64_t acc = 0;
+
+	(void)arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		acc += nvm_timer_ticks_end();
+
+	bench_sink += acc;
+}
+
+static void bench_timer_start_stop(void *arg, size_t niter)
+{
+	struct nvm_timer *timer = arg;
+	uint64_t acc = 0;
+
+	for (size_t i = 0; i < niter; ++i) {
+		nvm_timer_start(timer);
+		nvm_timer_stop(timer);
+		acc += nvm_timer_elapsed_nsecs(timer);
+	}
+
+	bench_sink += acc;
+}
+
+int main(void)
+{
+	struct nvm_timer timer = { 0 };
+
+	switch (nvm_timer_tsc_calibrate()) {
+	case NVM_TIMER_TSC_INVARIANT:
+		printf("# clock: tsc, hz: %" PRIu64 "\n", nvm_timer_tsc.hz);
+		break;
+	default:
+		printf("# clock: monotonic\n");
+		break;
+	}
+
+	bench_run("clock_gettime_monotonic", bench_clock_monotonic, NULL,
+		  1000000, 1);
+	bench_run("nvm_timer_ticks", bench_timer_ticks, NULL, 1000000, 1);
+	bench_run("nvm_timer_ticks_end", bench_timer_ticks_end, NULL,
+		  1000000, 1);
+	bench_run("nvm_timer_start_stop", bench_timer_start_stop, &timer,
+		  1000000, 1);
+
+	return bench_report();
+}
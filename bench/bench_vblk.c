@@ -0,0 +1,81 @@
+#include "bench_intf.c"
+
+struct bench_vblk {
+	struct nvm_dev *dev;
+	struct nvm_vblk *vblk;
+	size_t nbytes;
+	char *buf;
+};
+
+static void bench_pwrite(void *arg, size_t niter)
+{
+	struct bench_vblk *bv = arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		nvm_vblk_pwrite(bv->vblk, bv->buf, bv->nbytes, 0);
+}
+
+static void bench_pread(void *arg, size_t niter)
+{
+	struct bench_vblk *bv = arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		nvm_vblk_pread(bv->vblk, bv->buf, bv->nbytes, 0);
+}
+
+static void bench_erase(void *arg, size_t niter)
+{
+	struct bench_vblk *bv = arg;
+
+	for (size_t i = 0; i < niter; ++i)
+		nvm_vblk_erase(bv->vblk);
+}
+
+int main(void)
+{
+	struct bench_vblk bv = { 0 };
+	const struct nvm_geo *geo;
+	size_t ws_opt, ncmds;
+	int res = 1;
+
+	bv.dev = bench_dev_s20();
+	if (!bv.dev) {
+		perror("# bench_dev_s20");
+		return 1;
+	}
+	geo = nvm_dev_get_geo(bv.dev);
+	ws_opt = nvm_dev_get_ws_opt(bv.dev);
+
+	bv.vblk = nvm_vblk_alloc_line(bv.dev, 0, geo->l.npugrp - 1, 0,
+				      geo->l.npunit - 1, 0);
+	if (!bv.vblk) {
+		perror("# nvm_vblk_alloc_line");
+		goto exit;
+	}
+
+	// A stripe of 'ws_opt' sectors on every chunk in the line
+	bv.nbytes = nvm_vblk_get_naddrs(bv.vblk) * ws_opt * geo->l.nbytes;
+	bv.buf = nvm_buf_alloc(bv.dev, bv.nbytes, NULL);
+	if (!bv.buf) {
+		perror("# nvm_buf_alloc");
+		goto exit;
+	}
+	nvm_buf_fill(bv.buf, bv.nbytes);
+
+	// Operations are the commands a call splits into, counted by the backend
+	ncmds = bench_ncmds_per_iter(bench_pwrite, &bv);
+	bench_run("nvm_vblk_pwrite_null", bench_pwrite, &bv, 20000, ncmds);
+	ncmds = bench_ncmds_per_iter(bench_pread, &bv);
+	bench_run("nvm_vblk_pread_null", bench_pread, &bv, 20000, ncmds);
+	ncmds = bench_ncmds_per_iter(bench_erase, &bv);
+	bench_run("nvm_vblk_erase_null", bench_erase, &bv, 20000, ncmds);
+
+	res = bench_report();
+
+exit:
+	nvm_buf_free(bv.dev, bv.buf);
+	nvm_vblk_free(bv.vblk);
+	bench_dev_free(bv.dev);
+
+	return res;
+}
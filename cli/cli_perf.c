@@ -0,0 +1,937 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <liblightnvm_cli.h>
+#include <nvm_timer.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_thread_num() 0
+#endif
+
+/**
+ * Workloads, one command in the workload operates on 'stripe' chunks with
+ * 'nsectr' sectors on each chunk, that is, a "row" of the chunk-group
+ */
+enum perf_wl {
+	PERF_WL_ERASE = 0,
+	PERF_WL_SEQ_WRITE,
+	PERF_WL_SEQ_READ,
+	PERF_WL_RAND_WRITE,
+	PERF_WL_RAND_READ,
+	PERF_WL_MIXED,
+};
+
+static const char *perf_wl_name[] = {
+	"erase", "seq_write", "seq_read", "rand_write", "rand_read", "mixed"
+};
+
+enum perf_fmt {
+	PERF_FMT_TEXT = 0,
+	PERF_FMT_CSV,
+	PERF_FMT_JSON,
+};
+
+/**
+ * Workload options, parsed from NVM_CLI_PERF_* environment variables
+ */
+struct perf_opts {
+	int async;		///< NVM_CLI_PERF_ASYNC
+	uint32_t qdepth;	///< NVM_CLI_PERF_QDEPTH
+	int nthreads;		///< NVM_CLI_PERF_NTHREADS
+	int stripe;		///< NVM_CLI_PERF_STRIPE
+	int nsectr;		///< NVM_CLI_PERF_NSECTR
+	size_t nios;		///< NVM_CLI_PERF_NIOS
+	int rwmix;		///< NVM_CLI_PERF_RWMIX
+	int scalar;		///< NVM_CLI_PERF_SCALAR
+	uint64_t seed;		///< NVM_CLI_PERF_SEED
+	enum perf_fmt fmt;	///< NVM_CLI_PERF_FMT
+};
+
+struct perf_io {
+	int write;
+	int group;
+	int row;
+	int gidx;			///< Owned group of a write, -1 otherwise
+};
+
+struct perf_job;
+
+/**
+ * Command slot, one per outstanding command
+ */
+struct perf_slot {
+	struct perf_job *job;
+	struct nvm_ret ret;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	char *buf;
+	uint64_t tsubmit;
+	int gidx;			///< Owned group of a write, -1 otherwise
+};
+
+/**
+ * Shared workload state
+ */
+struct perf {
+	struct nvm_dev *dev;
+	const struct nvm_geo *geo;
+	enum perf_wl wl;
+	struct perf_opts opts;
+
+	struct nvm_addr *chunks;	///< Chunk-set
+	int nchunks;			///< Number of chunks in chunk-set
+	int ngroups;			///< Number of 'stripe' wide chunk-groups
+	int nrows;			///< Number of rows in a chunk-group
+	int mw_rows;			///< Rows to stay behind the write-pointer
+	size_t cmd_nbytes;		///< Bytes transferred per command
+};
+
+/**
+ * Per-thread workload state
+ */
+struct perf_job {
+	struct perf *perf;
+	int tid;
+	uint64_t rng;
+
+	int *groups;			///< Chunk-groups owned by this job
+	int ngroups;
+	int *wp;			///< Rows written, per owned group
+	int *busy;			///< A write is in flight, per owned group
+	int nfull;			///< Number of full groups
+	size_t cur;			///< Number of I/Os generated
+
+	struct nvm_async_ctx *ctx;
+	uint32_t qdepth;
+	struct perf_slot *slots;
+	struct perf_slot **free;
+	uint32_t nfree;
+	char *buf;
+
+	uint64_t *lats;			///< Latency samples in nsecs
+	size_t nlats;
+	size_t lats_max;
+	size_t nbytes;
+	size_t nerr;
+};
+
+static inline uint64_t _perf_clock(void)
+{
+	return _clock_sample();
+}
+
+static inline uint64_t _perf_rand(struct perf_job *job)
+{
+	uint64_t x = job->rng;		// xorshift64*
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	job->rng = x;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline long _perf_evar(const char *name, long def)
+{
+	char *str = getenv(name);
+
+	return str ? strtol(str, NULL, 0) : def;
+}
+
+static int _perf_opts(struct perf *perf)
+{
+	struct perf_opts *opts = &perf->opts;
+	char *fmt;
+
+	opts->async = getenv("NVM_CLI_PERF_ASYNC") ? 1 : 0;
+	opts->qdepth = _perf_evar("NVM_CLI_PERF_QDEPTH", opts->async ? 0 : 1);
+	opts->nthreads = _perf_evar("NVM_CLI_PERF_NTHREADS", 1);
+	opts->stripe = _perf_evar("NVM_CLI_PERF_STRIPE", 1);
+	opts->nsectr = _perf_evar("NVM_CLI_PERF_NSECTR",
+				  nvm_dev_get_ws_opt(perf->dev));
+	opts->nios = _perf_evar("NVM_CLI_PERF_NIOS", 0);
+	opts->rwmix = _perf_evar("NVM_CLI_PERF_RWMIX", 70);
+	opts->scalar = getenv("NVM_CLI_PERF_SCALAR") ? 1 : 0;
+	opts->seed = _perf_evar("NVM_CLI_PERF_SEED", 0x5eed);
+
+	opts->fmt = PERF_FMT_TEXT;
+	if ((fmt = getenv("NVM_CLI_PERF_FMT"))) {
+		if (!strcmp(fmt, "csv")) {
+			opts->fmt = PERF_FMT_CSV;
+		} else if (!strcmp(fmt, "json")) {
+			opts->fmt = PERF_FMT_JSON;
+		} else if (strcmp(fmt, "text")) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+#ifndef _OPENMP
+	if (opts->nthreads > 1) {
+		nvm_cli_info_pr("built without OpenMP, using nthreads: 1");
+		opts->nthreads = 1;
+	}
+#endif
+
+	if ((opts->nthreads < 1) || (opts->stripe < 1) || (opts->nsectr < 1) ||
+	    (opts->rwmix < 0) || (opts->rwmix > 100)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (opts->stripe * opts->nsectr > NVM_NADDR_MAX) {
+		nvm_cli_info_pr("stripe * nsectr exceeds NVM_NADDR_MAX");
+		errno = EINVAL;
+		return -1;
+	}
+	if (opts->scalar && opts->stripe > 1) {
+		nvm_cli_info_pr("NVM_CLI_PERF_SCALAR requires stripe: 1");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _perf_setup(struct perf *perf, struct nvm_cli *cli,
+		       struct nvm_vblk *vblk, enum perf_wl wl)
+{
+	const int ws_min = nvm_dev_get_ws_min(cli->args.dev);
+	int mw_cunits;
+
+	memset(perf, 0, sizeof(*perf));
+
+	perf->dev = cli->args.dev;
+	perf->geo = cli->args.geo;
+	perf->wl = wl;
+
+	if (nvm_dev_get_verid(perf->dev) != NVM_SPEC_VERID_20) {
+		nvm_cli_info_pr("nvm_perf requires an OCSSD 2.0 device");
+		errno = ENOSYS;
+		return -1;
+	}
+
+	if (_perf_opts(perf)) {
+		nvm_cli_perror("NVM_CLI_PERF_*");
+		return -1;
+	}
+
+	perf->chunks = nvm_vblk_get_addrs(vblk);
+	perf->nchunks = nvm_vblk_get_naddrs(vblk);
+
+	if ((perf->nchunks % perf->opts.stripe) ||
+	    (perf->opts.nsectr % ws_min) ||
+	    (perf->geo->l.nsectr % perf->opts.nsectr)) {
+		nvm_cli_info_pr("invalid stripe: %d, nsectr: %d",
+				perf->opts.stripe, perf->opts.nsectr);
+		errno = EINVAL;
+		return -1;
+	}
+
+	perf->ngroups = perf->nchunks / perf->opts.stripe;
+	perf->nrows = perf->geo->l.nsectr / perf->opts.nsectr;
+	perf->cmd_nbytes = perf->opts.stripe * perf->opts.nsectr *
+			   perf->geo->l.nbytes;
+
+	// Reads in 'mixed' must stay behind the last mw_cunits of written data
+	// and behind what is potentially in-flight
+	mw_cunits = nvm_dev_get_mw_cunits(perf->dev);
+	perf->mw_rows = (mw_cunits + perf->opts.nsectr - 1) /
+			perf->opts.nsectr;
+	perf->mw_rows += perf->opts.qdepth ? perf->opts.qdepth : 1;
+
+	if (perf->opts.nthreads > perf->ngroups)
+		perf->opts.nthreads = perf->ngroups;
+
+	return 0;
+}
+
+/**
+ * Pick a random owned group which is not full and has no write in flight, the
+ * rows of a chunk must be written in order
+ *
+ * @return Index of the group, -1 when all are full, -2 when the groups which
+ * are not full all have a write in flight
+ */
+static inline int _perf_group_writable(struct perf_job *job)
+{
+	const int bgn = _perf_rand(job) % job->ngroups;
+
+	if (job->nfull >= job->ngroups)
+		return -1;
+
+	for (int i = 0; i < job->ngroups; ++i) {
+		int gidx = (bgn + i) % job->ngroups;
+
+		if (job->wp[gidx] < job->perf->nrows && !job->busy[gidx])
+			return gidx;
+	}
+
+	return -2;
+}
+
+/**
+ * Pick a random owned group with readable rows, -1 when there are none
+ */
+static inline int _perf_group_readable(struct perf_job *job)
+{
+	const int mw_rows = job->perf->mw_rows;
+	const int bgn = _perf_rand(job) % job->ngroups;
+
+	for (int i = 0; i < job->ngroups; ++i) {
+		int gidx = (bgn + i) % job->ngroups;
+
+		if (job->wp[gidx] >= job->perf->nrows ||
+		    job->wp[gidx] > mw_rows)
+			return gidx;
+	}
+
+	return -1;
+}
+
+static inline void _perf_fetch(struct perf_job *job, int gidx,
+			       struct perf_io *io)
+{
+	int nrows = job->wp[gidx];
+
+	if (nrows < job->perf->nrows)
+		nrows -= job->perf->mw_rows;
+
+	io->write = 0;
+	io->group = job->groups[gidx];
+	io->row = _perf_rand(job) % nrows;
+}
+
+static inline void _perf_append(struct perf_job *job, int gidx,
+				struct perf_io *io)
+{
+	io->write = 1;
+	io->group = job->groups[gidx];
+	io->gidx = gidx;
+	io->row = job->wp[gidx]++;
+	if (job->wp[gidx] == job->perf->nrows)
+		++(job->nfull);
+}
+
+/**
+ * Generate the next I/O of the workload
+ *
+ * @return 1 when 'io' is filled, 0 when the workload is done, -1 when the next
+ * I/O is a write to a group with a write in flight
+ */
+static int _perf_next(struct perf_job *job, struct perf_io *io)
+{
+	struct perf *perf = job->perf;
+	const size_t nios = perf->opts.nios;
+	int gidx;
+
+	io->gidx = -1;
+
+	switch (perf->wl) {
+	case PERF_WL_ERASE:
+		if (job->cur >= (size_t)job->ngroups)
+			return 0;
+
+		io->write = 0;
+		io->group = job->groups[job->cur];
+		io->row = 0;
+		break;
+
+	case PERF_WL_SEQ_WRITE:
+	case PERF_WL_SEQ_READ:
+		if ((job->cur >= (size_t)job->ngroups * perf->nrows) ||
+		    (nios && job->cur >= nios))
+			return 0;
+
+		gidx = job->cur % job->ngroups;
+		if (perf->wl == PERF_WL_SEQ_WRITE && job->busy[gidx])
+			return -1;
+
+		io->write = perf->wl == PERF_WL_SEQ_WRITE;
+		io->group = job->groups[gidx];
+		io->gidx = io->write ? gidx : -1;
+		io->row = job->cur / job->ngroups;
+		break;
+
+	case PERF_WL_RAND_WRITE:
+		if (nios && job->cur >= nios)
+			return 0;
+		if ((gidx = _perf_group_writable(job)) < 0)
+			return gidx == -1 ? 0 : -1;
+
+		_perf_append(job, gidx, io);
+		break;
+
+	case PERF_WL_RAND_READ:
+		if (job->cur >= (nios ? nios : (size_t)job->ngroups * perf->nrows))
+			return 0;
+
+		io->write = 0;
+		io->group = job->groups[_perf_rand(job) % job->ngroups];
+		io->row = _perf_rand(job) % perf->nrows;
+		break;
+
+	case PERF_WL_MIXED:
+		if (job->cur >= (nios ? nios : (size_t)job->ngroups * perf->nrows))
+			return 0;
+
+		if ((int)(_perf_rand(job) % 100) < perf->opts.rwmix) {
+			if ((gidx = _perf_group_readable(job)) >= 0) {
+				_perf_fetch(job, gidx, io);
+				break;
+			}
+		}
+
+		if ((gidx = _perf_group_writable(job)) < 0) {
+			const int busy = gidx == -2;
+
+			if ((gidx = _perf_group_readable(job)) < 0)
+				return busy ? -1 : 0;
+
+			_perf_fetch(job, gidx, io);
+			break;
+		}
+
+		_perf_append(job, gidx, io);
+		break;
+	}
+
+	++(job->cur);
+
+	return 1;
+}
+
+static inline void _perf_lat_add(struct perf_job *job, uint64_t lat)
+{
+	if (job->nlats < job->lats_max)
+		job->lats[job->nlats++] = lat;
+}
+
+static void _perf_callback(struct nvm_ret *ret, void *opaque)
+{
+	struct perf_slot *slot = opaque;
+	struct perf_job *job = slot->job;
+
+	_perf_lat_add(job, _perf_clock() - slot->tsubmit);
+
+	if (ret->status)
+		++(job->nerr);
+
+	if (slot->gidx >= 0)
+		job->busy[slot->gidx] = 0;
+
+	job->free[job->nfree++] = slot;
+}
+
+static int _perf_submit(struct perf_job *job, struct perf_slot *slot,
+			struct perf_io *io)
+{
+	struct perf *perf = job->perf;
+	const int stripe = perf->opts.stripe;
+	const int nsectr = perf->opts.nsectr;
+	struct nvm_addr *chunks = &perf->chunks[io->group * stripe];
+	uint16_t flags = perf->opts.scalar ? NVM_CMD_SCALAR : NVM_CMD_VECTOR;
+	int naddrs = 0;
+	int err;
+
+	flags |= perf->opts.async ? NVM_CMD_ASYNC : NVM_CMD_SYNC;
+
+	memset(&slot->ret, 0, sizeof(slot->ret));
+	if (perf->opts.async) {
+		slot->ret.async.ctx = job->ctx;
+		slot->ret.async.cb = _perf_callback;
+		slot->ret.async.cb_arg = slot;
+	}
+
+	if (perf->wl == PERF_WL_ERASE) {
+		for (int cidx = 0; cidx < stripe; ++cidx)
+			slot->addrs[naddrs++].val = chunks[cidx].val;
+	} else {
+		for (int cidx = 0; cidx < stripe; ++cidx) {
+			for (int sidx = 0; sidx < nsectr; ++sidx) {
+				slot->addrs[naddrs].val = chunks[cidx].val;
+				slot->addrs[naddrs].l.sectr = io->row * nsectr +
+							      sidx;
+				++naddrs;
+			}
+		}
+	}
+
+	slot->tsubmit = _perf_clock();
+
+	if (perf->wl == PERF_WL_ERASE) {
+		err = nvm_cmd_erase(perf->dev, slot->addrs, naddrs, NULL, flags,
+				    &slot->ret);
+	} else if (io->write) {
+		err = nvm_cmd_write(perf->dev, slot->addrs, naddrs, slot->buf,
+				    NULL, flags, &slot->ret);
+	} else {
+		err = nvm_cmd_read(perf->dev, slot->addrs, naddrs, slot->buf,
+				   NULL, flags, &slot->ret);
+	}
+
+	if (err) {
+		++(job->nerr);
+		return -1;
+	}
+
+	job->nbytes += perf->wl == PERF_WL_ERASE ? 0 : perf->cmd_nbytes;
+
+	if (!perf->opts.async)
+		_perf_lat_add(job, _perf_clock() - slot->tsubmit);
+
+	return 0;
+}
+
+static int _perf_job_run(struct perf_job *job)
+{
+	struct perf *perf = job->perf;
+	struct perf_io io;
+
+	if (!perf->opts.async) {
+		while (_perf_next(job, &io) > 0)
+			_perf_submit(job, &job->slots[0], &io);
+
+		return 0;
+	}
+
+	// One write in flight per group, a blocked write waits for completions
+	while (1) {
+		struct perf_slot *slot;
+		int res = job->nfree ? _perf_next(job, &io) : -1;
+
+		if (!res)
+			break;
+
+		if (res < 0) {
+			if (nvm_async_poke(perf->dev, job->ctx, 0) < 0)
+				return -1;
+
+			continue;
+		}
+
+		slot = job->free[--(job->nfree)];
+		slot->gidx = io.gidx;
+		if (slot->gidx >= 0)
+			job->busy[slot->gidx] = 1;
+
+		if (_perf_submit(job, slot, &io)) {
+			if (slot->gidx >= 0)
+				job->busy[slot->gidx] = 0;
+			job->free[job->nfree++] = slot;
+		}
+	}
+
+	return nvm_async_wait(perf->dev, job->ctx) < 0 ? -1 : 0;
+}
+
+static void _perf_job_term(struct perf_job *job)
+{
+	if (job->ctx)
+		nvm_async_term(job->perf->dev, job->ctx);
+	nvm_buf_free(job->perf->dev, job->buf);
+	free(job->slots);
+	free(job->free);
+	free(job->groups);
+	free(job->wp);
+	free(job->busy);
+	free(job->lats);
+}
+
+static int _perf_job_init(struct perf_job *job, struct perf *perf, int tid)
+{
+	const int nthreads = perf->opts.nthreads;
+
+	memset(job, 0, sizeof(*job));
+	job->perf = perf;
+	job->tid = tid;
+	job->rng = perf->opts.seed + (tid + 1) * 0x9E3779B97F4A7C15ULL;
+
+	// Chunk-groups are dealt round-robin to the jobs
+	job->groups = calloc(perf->ngroups, sizeof(*job->groups));
+	job->wp = calloc(perf->ngroups, sizeof(*job->wp));
+	job->busy = calloc(perf->ngroups, sizeof(*job->busy));
+	if (!job->groups || !job->wp || !job->busy)
+		goto failed;
+
+	for (int group = tid; group < perf->ngroups; group += nthreads)
+		job->groups[job->ngroups++] = group;
+
+	// Random workloads read from fully written chunks
+	if (perf->wl == PERF_WL_RAND_READ) {
+		for (int gidx = 0; gidx < job->ngroups; ++gidx)
+			job->wp[gidx] = perf->nrows;
+	}
+
+	job->qdepth = 1;
+	if (perf->opts.async) {
+		job->ctx = nvm_async_init(perf->dev, perf->opts.qdepth, 0);
+		if (!job->ctx)
+			goto failed;
+
+		job->qdepth = nvm_async_get_depth(job->ctx);
+	}
+
+	job->slots = calloc(job->qdepth, sizeof(*job->slots));
+	job->free = calloc(job->qdepth, sizeof(*job->free));
+	job->buf = nvm_buf_alloc(perf->dev, job->qdepth * perf->cmd_nbytes,
+				 NULL);
+	if (!job->slots || !job->free || !job->buf)
+		goto failed;
+
+	nvm_buf_fill(job->buf, job->qdepth * perf->cmd_nbytes);
+
+	for (uint32_t i = 0; i < job->qdepth; ++i) {
+		job->slots[i].job = job;
+		job->slots[i].buf = job->buf + i * perf->cmd_nbytes;
+		job->free[job->nfree++] = &job->slots[i];
+	}
+
+	job->lats_max = perf->opts.nios ? perf->opts.nios :
+			(size_t)job->ngroups * perf->nrows;
+	job->lats = calloc(job->lats_max, sizeof(*job->lats));
+	if (!job->lats)
+		goto failed;
+
+	return 0;
+
+failed:
+	_perf_job_term(job);
+	return -1;
+}
+
+static int _perf_cmp(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static inline double _perf_pct(const uint64_t *lats, size_t nlats, double pct)
+{
+	size_t idx;
+
+	if (!nlats)
+		return 0;
+
+	idx = (size_t)((pct / 100.0) * nlats + 0.5);
+	idx = idx ? idx - 1 : 0;
+
+	return lats[idx < nlats ? idx : nlats - 1] / 1000.0;
+}
+
+static void _perf_report(struct perf *perf, struct perf_job *jobs,
+			 double secs)
+{
+	static const double pcts[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+	static const char *pct_names[] = {"p50", "p90", "p99", "p99_9",
+					  "p99_99"};
+	const int npcts = sizeof(pcts) / sizeof(pcts[0]);
+	const struct perf_opts *opts = &perf->opts;
+	size_t nlats = 0, nbytes = 0, nerr = 0, ofz = 0;
+	uint64_t *lats = NULL;
+	double pvals[npcts];
+	double mean = 0, iops, mbsec;
+
+	for (int tid = 0; tid < opts->nthreads; ++tid) {
+		nlats += jobs[tid].nlats;
+		nbytes += jobs[tid].nbytes;
+		nerr += jobs[tid].nerr;
+	}
+
+	lats = calloc(nlats ? nlats : 1, sizeof(*lats));
+	if (!lats) {
+		nvm_cli_perror("calloc");
+		return;
+	}
+	for (int tid = 0; tid < opts->nthreads; ++tid) {
+		memcpy(lats + ofz, jobs[tid].lats,
+		       jobs[tid].nlats * sizeof(*lats));
+		ofz += jobs[tid].nlats;
+	}
+	qsort(lats, nlats, sizeof(*lats), _perf_cmp);
+
+	for (size_t i = 0; i < nlats; ++i)
+		mean += lats[i];
+	mean = nlats ? (mean / nlats) / 1000.0 : 0;
+
+	for (int i = 0; i < npcts; ++i)
+		pvals[i] = _perf_pct(lats, nlats, pcts[i]);
+
+	iops = secs > 0 ? nlats / secs : 0;
+	mbsec = secs > 0 ? (nbytes / (double)1048576) / secs : 0;
+
+	switch (opts->fmt) {
+	case PERF_FMT_CSV:
+		printf("workload,async,qdepth,nthreads,stripe,nsectr,nios,"
+		       "nbytes,nerr,secs,iops,mbsec,lat_min,lat_mean");
+		for (int i = 0; i < npcts; ++i)
+			printf(",lat_%s", pct_names[i]);
+		printf(",lat_max\n");
+
+		printf("%s,%d,%"PRIu32",%d,%d,%d,%zu,%zu,%zu,%.6f,%.2f,%.2f,"
+		       "%.3f,%.3f", perf_wl_name[perf->wl], opts->async,
+		       jobs[0].qdepth, opts->nthreads, opts->stripe,
+		       opts->nsectr, nlats, nbytes, nerr, secs, iops, mbsec,
+		       nlats ? lats[0] / 1000.0 : 0, mean);
+		for (int i = 0; i < npcts; ++i)
+			printf(",%.3f", pvals[i]);
+		printf(",%.3f\n", nlats ? lats[nlats - 1] / 1000.0 : 0);
+		break;
+
+	case PERF_FMT_JSON:
+		printf("{\"workload\": \"%s\", \"async\": %d, "
+		       "\"qdepth\": %"PRIu32", \"nthreads\": %d, "
+		       "\"stripe\": %d, \"nsectr\": %d, \"nios\": %zu, "
+		       "\"nbytes\": %zu, \"nerr\": %zu, \"secs\": %.6f, "
+		       "\"iops\": %.2f, \"mbsec\": %.2f, \"lat_usecs\": {"
+		       "\"min\": %.3f, \"mean\": %.3f",
+		       perf_wl_name[perf->wl], opts->async, jobs[0].qdepth,
+		       opts->nthreads, opts->stripe, opts->nsectr, nlats,
+		       nbytes, nerr, secs, iops, mbsec,
+		       nlats ? lats[0] / 1000.0 : 0, mean);
+		for (int i = 0; i < npcts; ++i)
+			printf(", \"%s\": %.3f", pct_names[i], pvals[i]);
+		printf(", \"max\": %.3f}}\n",
+		       nlats ? lats[nlats - 1] / 1000.0 : 0);
+		break;
+
+	case PERF_FMT_TEXT:
+		printf("nvm_perf:\n");
+		printf("  workload: %s\n", perf_wl_name[perf->wl]);
+		printf("  async: %d\n", opts->async);
+		printf("  qdepth: %"PRIu32"\n", jobs[0].qdepth);
+		printf("  nthreads: %d\n", opts->nthreads);
+		printf("  stripe: %d\n", opts->stripe);
+		printf("  nsectr: %d\n", opts->nsectr);
+		printf("  nios: %zu\n", nlats);
+		printf("  nbytes: %zu\n", nbytes);
+		printf("  nerr: %zu\n", nerr);
+		printf("  secs: %.6f\n", secs);
+		printf("  iops: %.2f\n", iops);
+		printf("  mbsec: %.2f\n", mbsec);
+		printf("  lat_usecs: {min: %.3f, mean: %.3f",
+		       nlats ? lats[0] / 1000.0 : 0, mean);
+		for (int i = 0; i < npcts; ++i)
+			printf(", %s: %.3f", pct_names[i], pvals[i]);
+		printf(", max: %.3f}\n", nlats ? lats[nlats - 1] / 1000.0 : 0);
+		break;
+	}
+
+	free(lats);
+}
+
+static int _perf_run(struct nvm_cli *cli, struct nvm_vblk *vblk,
+		     enum perf_wl wl)
+{
+	struct perf perf;
+	struct perf_job *jobs;
+	uint64_t tbgn, tend;
+	int nthreads;
+	int err = 0;
+
+	if (_perf_setup(&perf, cli, vblk, wl))
+		return -1;
+
+	if (cli->opts.verbose)
+		nvm_vblk_pr(vblk);
+
+	nthreads = perf.opts.nthreads;
+
+	jobs = calloc(nthreads, sizeof(*jobs));
+	if (!jobs) {
+		nvm_cli_perror("calloc");
+		return -1;
+	}
+
+	for (int tid = 0; tid < nthreads; ++tid) {
+		if (_perf_job_init(&jobs[tid], &perf, tid)) {
+			nvm_cli_perror("_perf_job_init");
+			for (int i = 0; i < tid; ++i)
+				_perf_job_term(&jobs[i]);
+			free(jobs);
+			return -1;
+		}
+	}
+
+	tbgn = _perf_clock();
+
+	#pragma omp parallel num_threads(nthreads) reduction(+:err)
+	{
+		if (_perf_job_run(&jobs[omp_get_thread_num()]))
+			err += 1;
+	}
+
+	tend = _perf_clock();
+
+	if (err)
+		nvm_cli_perror("_perf_job_run");
+
+	_perf_report(&perf, jobs, (tend - tbgn) / (double)1000000000);
+
+	for (int tid = 0; tid < nthreads; ++tid) {
+		if (jobs[tid].nerr)
+			err += 1;
+		_perf_job_term(&jobs[tid]);
+	}
+	free(jobs);
+
+	return err ? -1 : 0;
+}
+
+static int _perf_line(struct nvm_cli *cli, enum perf_wl wl)
+{
+	struct nvm_addr bgn = cli->args.addrs[0],
+			end = cli->args.addrs[1];
+	struct nvm_vblk *vblk = NULL;
+	int res = 0;
+
+	vblk = nvm_vblk_alloc_line(cli->args.dev, bgn.g.ch, end.g.ch, bgn.g.lun,
+				   end.g.lun, bgn.g.blk);
+	if (!vblk) {
+		nvm_cli_perror("nvm_vblk_alloc_line");
+		return -1;
+	}
+
+	res = _perf_run(cli, vblk, wl);
+
+	nvm_vblk_free(vblk);
+
+	return res;
+}
+
+static int _perf_set(struct nvm_cli *cli, enum perf_wl wl)
+{
+	struct nvm_vblk *vblk = NULL;
+	int res = 0;
+
+	vblk = nvm_vblk_alloc(cli->args.dev, cli->args.addrs, cli->args.naddrs);
+	if (!vblk) {
+		nvm_cli_perror("nvm_vblk_alloc");
+		return -1;
+	}
+
+	res = _perf_run(cli, vblk, wl);
+
+	nvm_vblk_free(vblk);
+
+	return res;
+}
+
+static int cmd_line_erase(struct nvm_cli *cli)
+{
+	return _perf_line(cli, PERF_WL_ERASE);
+}
+
+static int cmd_line_seq_write(struct nvm_cli *cli)
+{
+	return _perf_line(cli, PERF_WL_SEQ_WRITE);
+}
+
+static int cmd_line_seq_read(struct nvm_cli *cli)
+{
+	return _perf_line(cli, PERF_WL_SEQ_READ);
+}
+
+static int cmd_line_rand_write(struct nvm_cli *cli)
+{
+	return _perf_line(cli, PERF_WL_RAND_WRITE);
+}
+
+static int cmd_line_rand_read(struct nvm_cli *cli)
+{
+	return _perf_line(cli, PERF_WL_RAND_READ);
+}
+
+static int cmd_line_mixed(struct nvm_cli *cli)
+{
+	return _perf_line(cli, PERF_WL_MIXED);
+}
+
+static int cmd_set_erase(struct nvm_cli *cli)
+{
+	return _perf_set(cli, PERF_WL_ERASE);
+}
+
+static int cmd_set_seq_write(struct nvm_cli *cli)
+{
+	return _perf_set(cli, PERF_WL_SEQ_WRITE);
+}
+
+static int cmd_set_seq_read(struct nvm_cli *cli)
+{
+	return _perf_set(cli, PERF_WL_SEQ_READ);
+}
+
+static int cmd_set_rand_write(struct nvm_cli *cli)
+{
+	return _perf_set(cli, PERF_WL_RAND_WRITE);
+}
+
+static int cmd_set_rand_read(struct nvm_cli *cli)
+{
+	return _perf_set(cli, PERF_WL_RAND_READ);
+}
+
+static int cmd_set_mixed(struct nvm_cli *cli)
+{
+	return _perf_set(cli, PERF_WL_MIXED);
+}
+
+//
+// Remaining code is CLI boiler-plate
+//
+static struct nvm_cli_cmd cmds[] = {
+	{"line_erase",		cmd_line_erase,		NVM_CLI_ARG_VBLK_LINE,	NVM_CLI_OPT_DEFAULT},
+	{"line_seq_write",	cmd_line_seq_write,	NVM_CLI_ARG_VBLK_LINE,	NVM_CLI_OPT_DEFAULT},
+	{"line_seq_read",	cmd_line_seq_read,	NVM_CLI_ARG_VBLK_LINE,	NVM_CLI_OPT_DEFAULT},
+	{"line_rand_write",	cmd_line_rand_write,	NVM_CLI_ARG_VBLK_LINE,	NVM_CLI_OPT_DEFAULT},
+	{"line_rand_read",	cmd_line_rand_read,	NVM_CLI_ARG_VBLK_LINE,	NVM_CLI_OPT_DEFAULT},
+	{"line_mixed",		cmd_line_mixed,		NVM_CLI_ARG_VBLK_LINE,	NVM_CLI_OPT_DEFAULT},
+
+	{"set_erase",		cmd_set_erase,		NVM_CLI_ARG_ADDR_LIST,	NVM_CLI_OPT_DEFAULT},
+	{"set_seq_write",	cmd_set_seq_write,	NVM_CLI_ARG_ADDR_LIST,	NVM_CLI_OPT_DEFAULT},
+	{"set_seq_read",	cmd_set_seq_read,	NVM_CLI_ARG_ADDR_LIST,	NVM_CLI_OPT_DEFAULT},
+	{"set_rand_write",	cmd_set_rand_write,	NVM_CLI_ARG_ADDR_LIST,	NVM_CLI_OPT_DEFAULT},
+	{"set_rand_read",	cmd_set_rand_read,	NVM_CLI_ARG_ADDR_LIST,	NVM_CLI_OPT_DEFAULT},
+	{"set_mixed",		cmd_set_mixed,		NVM_CLI_ARG_ADDR_LIST,	NVM_CLI_OPT_DEFAULT},
+};
+
+/* Define the CLI */
+static struct nvm_cli cli = {
+	.title = "NVM Performance (nvm_perf)",
+	.descr_short = "Workload generator: IOPS, bandwidth and latency "
+		       "percentiles of the nvm_cmd_* I/O paths",
+	.descr_long = "Workloads run on a chunk-set given as a line or a list "
+		      "of chunk addresses. Options are given via the "
+		      "environment: NVM_CLI_PERF_ASYNC, NVM_CLI_PERF_QDEPTH, "
+		      "NVM_CLI_PERF_NTHREADS, NVM_CLI_PERF_STRIPE (chunks per "
+		      "command), NVM_CLI_PERF_NSECTR (sectors per chunk per "
+		      "command), NVM_CLI_PERF_NIOS, NVM_CLI_PERF_RWMIX (read "
+		      "percentage for mixed), NVM_CLI_PERF_SCALAR, "
+		      "NVM_CLI_PERF_SEED, and NVM_CLI_PERF_FMT (text, csv, "
+		      "json). The backend is selected with NVM_CLI_CMD_OPTS.",
+	.cmds = cmds,
+	.ncmds = sizeof(cmds) / sizeof(cmds[0]),
+};
+
+/* Initialize and run */
+int main(int argc, char **argv)
+{
+	int res = 0;
+
+	if (nvm_cli_init(&cli, argc, argv) < 0) {
+		nvm_cli_perror("FAILED");
+		return 1;
+	}
+
+	res = nvm_cli_run(&cli);
+
+	nvm_cli_destroy(&cli);
+
+	return res;
+}
@@ -1,9 +1,17 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <liblightnvm_cli.h>
 
+#define NVM_CLI_VBLK_STREAM_NBYTES (8 * 1024 * 1024)	///< Default window
+#define NVM_CLI_VBLK_STREAM_DEPTH 3			///< Default # windows
+#define NVM_CLI_VBLK_STREAM_DEPTH_MAX 8
+
 static inline void _vblk_cmd_mode(struct nvm_vblk *vblk)
 {
 	if (getenv("NVM_CLI_VBLK_ASYNC")) {
@@ -22,6 +30,259 @@ static inline void _vblk_cmd_mode(struct nvm_vblk *vblk)
 	}
 }
 
+/**
+ * Moves data between a file and a vblk through a ring of 'depth' windows, the
+ * file side runs on a thread of its own such that file and device I/O overlap
+ */
+struct vblk_stream {
+	struct nvm_vblk *vblk;
+	int fd;
+	int import;		///< File to vblk, else vblk to file
+	size_t nbytes;		///< # bytes to move
+	size_t win;		///< # bytes of a window, whole stripes
+	int depth;		///< # of windows
+
+	char *bufs[NVM_CLI_VBLK_STREAM_DEPTH_MAX];
+	int full[NVM_CLI_VBLK_STREAM_DEPTH_MAX];	///< Window holds data
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int err;		///< errno of the failing side, stops both sides
+};
+
+static inline int _stream_wait(struct vblk_stream *s, int slot, int full)
+{
+	int err;
+
+	pthread_mutex_lock(&s->lock);
+	while ((s->full[slot] != full) && (!s->err))
+		pthread_cond_wait(&s->cond, &s->lock);
+	err = s->err;
+	pthread_mutex_unlock(&s->lock);
+
+	return err ? -1 : 0;
+}
+
+static inline void _stream_post(struct vblk_stream *s, int slot, int full)
+{
+	pthread_mutex_lock(&s->lock);
+	s->full[slot] = full;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+
+static inline void _stream_fail(struct vblk_stream *s, int err)
+{
+	pthread_mutex_lock(&s->lock);
+	if (!s->err)
+		s->err = err ? err : EIO;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * Transfer a window between 'buf' and the file at 'offset', O_DIRECT is
+ * dropped when the file system rejects the alignment
+ */
+static int _stream_file_io(struct vblk_stream *s, char *buf, size_t len,
+			   size_t offset)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t res;
+
+		if (s->import)
+			res = pread(s->fd, buf + done, len - done,
+				    offset + done);
+		else
+			res = pwrite(s->fd, buf + done, len - done,
+				     offset + done);
+
+		if ((res < 0) && (errno == EINTR))
+			continue;
+#ifdef O_DIRECT
+		if ((res < 0) && (errno == EINVAL) &&
+		    (fcntl(s->fd, F_GETFL) & O_DIRECT)) {
+			if (fcntl(s->fd, F_SETFL,
+				  fcntl(s->fd, F_GETFL) & ~O_DIRECT))
+				return -1;
+			continue;
+		}
+#endif
+		if (res < 0)
+			return -1;
+		if (!res) {		// File is shorter than the vblk
+			errno = EINVAL;
+			return -1;
+		}
+
+		done += res;
+	}
+
+	return 0;
+}
+
+static void *_stream_file(void *arg)
+{
+	struct vblk_stream *s = arg;
+	size_t offset = 0;
+
+	for (int i = 0; offset < s->nbytes; ++i, offset += s->win) {
+		const size_t left = s->nbytes - offset;
+		const size_t len = left < s->win ? left : s->win;
+		const int slot = i % s->depth;
+
+		if (_stream_wait(s, slot, !s->import))
+			break;
+
+		if (_stream_file_io(s, s->bufs[slot], len, offset)) {
+			_stream_fail(s, errno);
+			break;
+		}
+
+		_stream_post(s, slot, s->import);
+	}
+
+	return NULL;
+}
+
+static int _stream_vblk(struct vblk_stream *s)
+{
+	size_t offset = 0;
+
+	for (int i = 0; offset < s->nbytes; ++i, offset += s->win) {
+		const size_t left = s->nbytes - offset;
+		const size_t len = left < s->win ? left : s->win;
+		const int slot = i % s->depth;
+		ssize_t res;
+
+		if (_stream_wait(s, slot, s->import))
+			return -1;
+
+		if (s->import)
+			res = nvm_vblk_pwrite(s->vblk, s->bufs[slot], len, offset);
+		else
+			res = nvm_vblk_pread(s->vblk, s->bufs[slot], len, offset);
+		if (res < 0) {
+			_stream_fail(s, errno);
+			return -1;
+		}
+
+		_stream_post(s, slot, !s->import);
+	}
+
+	return 0;
+}
+
+/**
+ * Window size, the stripe of the vblk; 'naddrs' times the optimal write size,
+ * times as many stripes as fit in NVM_CLI_VBLK_STREAM_NBYTES
+ */
+static size_t _stream_win(struct nvm_vblk *vblk)
+{
+	const struct nvm_dev *dev = nvm_vblk_get_dev(vblk);
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const size_t nbytes = nvm_vblk_get_nbytes(vblk);
+	size_t sector_nbytes, stripe, win = NVM_CLI_VBLK_STREAM_NBYTES;
+	char *str;
+
+	switch (nvm_dev_get_verid(dev)) {
+	case NVM_SPEC_VERID_12:
+		sector_nbytes = geo->g.sector_nbytes;
+		break;
+	default:
+		sector_nbytes = geo->l.nbytes;
+		break;
+	}
+	stripe = nvm_vblk_get_naddrs(vblk) * nvm_dev_get_ws_opt(dev) *
+		 sector_nbytes;
+
+	if (NULL != (str = getenv("NVM_CLI_VBLK_STREAM_NBYTES")))
+		sscanf(str, "%zu", &win);
+
+	win = win < stripe ? stripe : (win / stripe) * stripe;
+
+	return win < nbytes ? win : nbytes;
+}
+
+/**
+ * Write the content of file 'path' to the vblk, or read the vblk into 'path',
+ * using bounded memory
+ */
+static ssize_t _vblk_stream(struct vblk_stream *s, const char *path)
+{
+	const struct nvm_dev *dev = nvm_vblk_get_dev(s->vblk);
+	int flags = s->import ? O_RDONLY : (O_WRONLY | O_CREAT | O_TRUNC);
+	pthread_t file;
+	ssize_t res = 0;
+	char *str;
+
+	s->nbytes = nvm_vblk_get_nbytes(s->vblk);
+	s->win = _stream_win(s->vblk);
+	s->depth = NVM_CLI_VBLK_STREAM_DEPTH;
+	if (NULL != (str = getenv("NVM_CLI_VBLK_STREAM_DEPTH")))
+		sscanf(str, "%d", &s->depth);
+	s->depth = NVM_MIN(NVM_MAX(s->depth, 2), NVM_CLI_VBLK_STREAM_DEPTH_MAX);
+
+#ifdef O_DIRECT
+	s->fd = open(path, flags | O_DIRECT, 0644);
+	if ((s->fd < 0) && (errno == EINVAL))	// O_DIRECT not supported
+#endif
+		s->fd = open(path, flags, 0644);
+	if (s->fd < 0) {
+		nvm_cli_perror("open");
+		return -1;
+	}
+
+	for (int i = 0; i < s->depth; ++i) {
+		s->bufs[i] = nvm_buf_alloc(dev, s->win, NULL);
+		if (!s->bufs[i]) {
+			nvm_cli_perror("nvm_buf_alloc(stream window)");
+			res = -1;
+			goto out;
+		}
+	}
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+
+	printf("# stream: win: %zu, depth: %d\n", s->win, s->depth);
+
+	nvm_cli_timer_start();
+	if (pthread_create(&file, NULL, _stream_file, s)) {
+		nvm_cli_perror("pthread_create");
+		res = -1;
+	} else {
+		if (_stream_vblk(s))
+			res = -1;
+		pthread_join(file, NULL);
+		if (s->err) {
+			errno = s->err;
+			res = -1;
+		}
+	}
+	nvm_cli_timer_stop();
+	nvm_cli_timer_bw_pr(s->import ? "nvm_vblk_write(stream)" :
+			    "nvm_vblk_read(stream)", s->nbytes);
+
+	if (res < 0)
+		nvm_cli_perror(s->import ? "nvm_vblk_write(stream)" :
+			       "nvm_vblk_read(stream)");
+	else
+		res = s->nbytes;
+
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+
+out:
+	for (int i = 0; i < s->depth; ++i)
+		nvm_buf_free(dev, s->bufs[i]);
+	close(s->fd);
+
+	return res;
+}
+
 static ssize_t _vblk_erase(struct nvm_cli *NVM_UNUSED(cli), struct nvm_vblk *vblk)
 {
 	ssize_t res = 0;
@@ -51,6 +312,14 @@ static ssize_t _vblk_write(struct nvm_cli *cli, struct nvm_vblk *vblk)
 	_vblk_cmd_mode(vblk);
 	nvm_vblk_pr(vblk);
 
+	if (getenv("NVM_CLI_VBLK_STREAM") &&
+	    (cli->opts.mask & NVM_CLI_OPT_FILE_INPUT) &&
+	     cli->opts.file_input) {	// Stream content from file
+		struct vblk_stream stream = { .vblk = vblk, .import = 1 };
+
+		return _vblk_stream(&stream, cli->opts.file_input);
+	}
+
 	nvm_cli_timer_start();		// Allocate write buffer
 	buf = nvm_buf_alloc(dev, nbytes, NULL);
 	if (!buf) {
@@ -97,6 +366,14 @@ static ssize_t _vblk_read(struct nvm_cli *cli, struct nvm_vblk *vblk)
 	_vblk_cmd_mode(vblk);
 	nvm_vblk_pr(vblk);
 
+	if (getenv("NVM_CLI_VBLK_STREAM") &&
+	    (cli->opts.mask & NVM_CLI_OPT_FILE_OUTPUT) &&
+	     cli->opts.file_output) {	// Stream content to file
+		struct vblk_stream stream = { .vblk = vblk, .import = 0 };
+
+		return _vblk_stream(&stream, cli->opts.file_output);
+	}
+
 	nvm_cli_timer_start();		// Allocate read buffer
 	buf = nvm_buf_alloc(dev, nbytes, NULL);
 	if (!buf) {
@@ -35,8 +35,11 @@ def gen_capi(args):
         "nvm_async": "Async. Controls",
         "nvm_sgl": "Scather/Gather Lists",
         "nvm_vblk": "Virtual Block",
+        "nvm_ftl": "Flash Translation Layer",
         "nvm_bp": "Boilerplate",
-        "nvm_bbt": "Bad-Block-Table"
+        "nvm_bbt": "Bad-Block-Table",
+        "nvm_chunks": "Chunk Allocator",
+        "nvm_mvblk": "Multi-Device Virtual Block"
     }
     docs = {}
 
@@ -41,11 +41,14 @@ extern "C" {
 #include <stdlib.h>
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <liblightnvm_util.h>
 #include <liblightnvm_spec.h>
 
 #define NVM_NADDR_MAX 64
 
+#define NVM_VBLK_RA_NSTRIPES_MAX 64	///< See nvm_vblk_set_readahead
+
 #define NVM_DEV_NAME_LEN 32
 #define NVM_DEV_PATH_LEN (NVM_DEV_NAME_LEN + 5)
 
@@ -129,8 +132,8 @@ struct nvm_dev;
 struct nvm_sgl;
 
 /**
- * Opaque handle for a Scatter Gather List (SGL) pool. A seperate pool should
- * be used for each asynchronous context.
+ * Opaque handle for a Scatter Gather List (SGL) pool. SGLs may be allocated
+ * from and freed to a pool by any number of threads, the pool is lock-free.
  *
  * @struct nvm_sgl_pool
  */
@@ -147,7 +150,8 @@ struct nvm_sgl_pool;
 struct nvm_sgl_pool *nvm_sgl_pool_create(struct nvm_dev *dev);
 
 /**
- * Destroy an SGL pool (and all SGLs in the pool).
+ * Destroy an SGL pool and the free SGLs in it. SGLs allocated from the pool
+ * and not returned to it remain with the caller, see `nvm_sgl_destroy`.
  *
  * @param SGL Pool to destroy.
  */
@@ -182,7 +186,8 @@ struct nvm_sgl *nvm_sgl_create(struct nvm_dev *dev, int hint);
 struct nvm_sgl *nvm_sgl_alloc(struct nvm_sgl_pool *pool);
 
 /**
- * Destroy an SGL, freeing the memory used.
+ * Destroy an SGL, freeing the memory used. An SGL allocated from a pool is
+ * returned to it instead while the pool exists, and freed with the pool.
  *
  * @see nvm_sgl_free
  *
@@ -214,6 +219,16 @@ void nvm_sgl_reset(struct nvm_sgl *sgl);
 /**
  * Add an entry to the SGL
  *
+ * The SGL grows by chaining segments, with no limit on the number of entries.
+ * An entry physically contiguous with the one added before it extends it
+ * instead of taking a descriptor. Buffers are translated once per page they
+ * span, a hugepage for DMA memory of the SPDK backend, translations are cached
+ * until the SGL is reset or freed.
+ *
+ * @note
+ * With the SPDK backend, 'buf' must be DMA memory, e.g. from `nvm_buf_alloc`,
+ * which is backed by hugepages
+ *
  * @see nvm_sgl_alloc
  * @see nvm_buf_alloc
  *
@@ -221,6 +236,9 @@ void nvm_sgl_reset(struct nvm_sgl *sgl);
  * @param sgl Pointer to sgl as allocated by `nvm_sgl_alloc`
  * @param buf Pointer to buffer as allocated with `nvm_buf_alloc`
  * @param nbytes Size of the given buffer in bytes
+ *
+ * @return On success, 0 is returned and the SGL holds the entry. On error, -1
+ * is returned, `errno` set to indicate the error and the SGL is left as is.
  */
 int nvm_sgl_add(struct nvm_dev *dev, struct nvm_sgl *sgl, void *buf, size_t nbytes);
 
@@ -300,14 +318,59 @@ struct nvm_async_cmd_ctx {
 	void *cb_arg;			///< User provided callback arguments
 };
 
+/**
+ * Options for nvm_async_init
+ */
+enum nvm_async_opts {
+	/**
+	 * The context is shared by multiple submitting and reaping threads,
+	 * submissions go through a lock-free ring drained into the backend
+	 */
+	NVM_ASYNC_SHARED = 0x1,
+
+	/**
+	 * Completions are signaled on an eventfd, see nvm_async_get_fd
+	 */
+	NVM_ASYNC_EVENTFD = 0x1 << 1
+};
+
+/**
+ * Policies for nvm_async_wait
+ *
+ * @see nvm_async_set_wait
+ */
+enum nvm_async_wait_policy {
+	/**
+	 * Wait as the backend does, blocking in the kernel for NVM_BE_LBD and
+	 * busy-polling for NVM_BE_SPDK
+	 */
+	NVM_ASYNC_WAIT_DEFAULT = 0,
+
+	/**
+	 * Poll for an adaptive period, then sleep, on the eventfd of the
+	 * context when it has one
+	 */
+	NVM_ASYNC_WAIT_HYBRID = 1
+};
+
 /**
  * Allocate an asynchronous context for command submission of the given depth
  * for submission of commands to the given device
  *
+ * By default a context, and the commands submitted on it, must only be used by
+ * a single thread at a time. With NVM_ASYNC_SHARED any number of threads may
+ * submit commands and poke, wait or reap completions concurrently; callbacks
+ * are then invoked by the reaping thread without any internal lock held, and
+ * may submit new commands.
+ *
+ * With NVM_ASYNC_EVENTFD completions are signaled on a file descriptor, see
+ * nvm_async_get_fd. This requires a backend completing commands through the
+ * kernel, NVM_BE_LBD, other backends fail with ENOSYS.
+ *
  * @param dev Associated device
  * @param depth Maximum iodepth / qdepth, maximum number of outstanding commands
  * of the returned context
- * @param flags TBD
+ * @param flags 0x0 or a mask of `enum nvm_async_opts`
  *
  * @return On success, pointer to async. context is returned. On error, NULL is
  * returned and `errno` set to indicate the error
@@ -366,6 +429,50 @@ int nvm_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
  */
 int nvm_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx);
 
+/**
+ * Set the policy by which nvm_async_wait waits for completions
+ *
+ * @param ctx Asynchronous context
+ * @param policy One of `enum nvm_async_wait_policy`
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_async_set_wait(struct nvm_async_ctx *ctx, int policy);
+
+/**
+ * Get the eventfd on which completions of the given context are signaled
+ *
+ * The descriptor becomes readable when commands complete, e.g. for use with
+ * epoll, then reap the completions with nvm_async_poke or nvm_async_reap,
+ * these reset the descriptor. Do not read or close it.
+ *
+ * @param ctx Asynchronous context, initialized with NVM_ASYNC_EVENTFD
+ *
+ * @return On success, the file descriptor is returned. On error, -1 is
+ * returned and `errno` set to indicate the error
+ */
+int nvm_async_get_fd(struct nvm_async_ctx *ctx);
+
+/**
+ * Reap completions from the given ASYNC context without invoking callbacks
+ *
+ * Up to 'max' completed commands are stored in 'out', the status of each is
+ * in the returned `nvm_ret`. The `async.cb` of a command is not invoked, and
+ * may be NULL for commands which are only reaped; nvm_async_poke and
+ * nvm_async_wait skip the callback of such commands. Does not block.
+ *
+ * @param dev Associated device
+ * @param ctx Asynchronous context
+ * @param out Array of at least 'max' elements to store completed commands in
+ * @param max Maximum number of completions to reap, must be larger than 0
+ *
+ * @return On success, number of completions stored in 'out', may be 0. On
+ * error, -1 is returned and `errno` set to indicate the error
+ */
+int nvm_async_reap(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+		   struct nvm_ret *out[], uint32_t max);
+
 /**
  * Encapsulation and representation of lower-level error conditions
  *
@@ -554,6 +661,24 @@ int nvm_cmd_pass(struct nvm_dev *dev, struct nvm_nvme_cmd *cmd, void *data,
  */
 struct nvm_spec_idfy *nvm_cmd_idfy(struct nvm_dev *dev, struct nvm_ret *ret);
 
+/**
+ * Execute an OCSSD 1.2 identify / OCSSD 2.0 geometry command, storing the
+ * result in the given 'idfy' instead of allocating it
+ *
+ * The buffer need not be allocated with `nvm_buf_alloc`, when the backend
+ * requires DMA memory the command goes via a scratch buffer of the device.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param idfy Pointer to the structure to fill
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error and
+ * ret filled with lower-level result codes
+ */
+int nvm_cmd_idfy_into(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		      struct nvm_ret *ret);
+
 /**
  * Executes one or multiple OCSSD 2.0 get-log-page for chunk-information
  *
@@ -574,6 +699,43 @@ struct nvm_spec_idfy *nvm_cmd_idfy(struct nvm_dev *dev, struct nvm_ret *ret);
 struct nvm_spec_rprt *nvm_cmd_rprt(struct nvm_dev *dev, struct nvm_addr *addr,
 				   int opt, struct nvm_ret *ret);
 
+/**
+ * Returns the number of bytes of the report chunk structure produced by
+ * `nvm_cmd_rprt` for the given 'addr'
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param addr Address of a chunk as given to `nvm_cmd_rprt`, NULL for the
+ *             entire device
+ *
+ * @return The size in bytes of the report chunk structure
+ */
+size_t nvm_cmd_rprt_nbytes(const struct nvm_dev *dev,
+			   const struct nvm_addr *addr);
+
+/**
+ * Executes one or multiple OCSSD 2.0 get-log-page for chunk-information,
+ * storing the report in the given 'rprt' instead of allocating it
+ *
+ * Polling chunk state with a buffer allocated once performs no allocations.
+ * The buffer need not be allocated with `nvm_buf_alloc`, when the backend
+ * requires DMA memory the command goes via a scratch buffer of the device.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param addr Pointer to a `struct nvm_addr` containing the address of a chunk
+ *             to report about
+ * @param opt Reporting options, see `enum nvm_spec_chunk_state`
+ * @param rprt Pointer to the report to fill
+ * @param nbytes Size of 'rprt' in bytes, at least `nvm_cmd_rprt_nbytes`
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error and
+ * ret filled with lower-level result codes
+ */
+int nvm_cmd_rprt_into(struct nvm_dev *dev, struct nvm_addr *addr, int opt,
+		      struct nvm_spec_rprt *rprt, size_t nbytes,
+		      struct nvm_ret *ret);
+
 /**
  * Find an arbitrary set of 'naddrs' chunk-addresses on the given 'dev', in the
  * given chunk state 'cs' and store them in the provided 'addrs' array
@@ -621,6 +783,37 @@ int nvm_cmd_sfeat(struct nvm_dev *dev, enum nvm_nvme_feat_id id,
 struct nvm_spec_bbt *nvm_cmd_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
 				  struct nvm_ret *ret);
 
+/**
+ * Returns the number of bytes of the bad-block-table produced by
+ * `nvm_cmd_gbbt`
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ *
+ * @return The size in bytes of the bad-block-table
+ */
+size_t nvm_cmd_gbbt_nbytes(const struct nvm_dev *dev);
+
+/**
+ * Execute an OCSSD 1.2 get bad-block-table command, storing the table in the
+ * given 'bbt' instead of allocating it
+ *
+ * The buffer need not be allocated with `nvm_buf_alloc`, when the backend
+ * requires DMA memory the command goes via a scratch buffer of the device.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param addr Address of the LUN
+ * @param bbt Pointer to the bad-block-table to fill
+ * @param nbytes Size of 'bbt' in bytes, at least `nvm_cmd_gbbt_nbytes`
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error and
+ * ret filled with lower-level result codes
+ */
+int nvm_cmd_gbbt_into(struct nvm_dev *dev, struct nvm_addr addr,
+		      struct nvm_spec_bbt *bbt, size_t nbytes,
+		      struct nvm_ret *ret);
+
 /**
  * Find an arbitrary set of 'naddrs' block-addresses on the given 'dev', in the
  * given block state 'bs' and store them in the provided 'addrs' array
@@ -1101,6 +1294,122 @@ int nvm_dev_get_bbts_cached(const struct nvm_dev *dev);
  */
 int nvm_dev_set_bbts_cached(struct nvm_dev *dev, int bbts_cached);
 
+/**
+ * Returns the NUMA node on which buffers for the device are placed
+ *
+ * The node is determined at device open, from sysfs for a block device and
+ * from the PCI address for SPDK, the environment variable `NVM_DEV_NUMA_NODE`
+ * overrides it.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ *
+ * @return The NUMA node, or -1 when buffers are not placed
+ */
+int nvm_dev_get_numa_node(const struct nvm_dev *dev);
+
+/**
+ * Sets the NUMA node on which `nvm_buf_alloc` places buffers for the device
+ *
+ * Unless an affinity is given with `nvm_pool_conf`, the library worker threads
+ * are pinned to the CPUs of the node of the first device in use.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param node NUMA node, or -1 to disable placement
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error.
+ */
+int nvm_dev_set_numa_node(struct nvm_dev *dev, int node);
+
+/**
+ * Returns whether buffers for the device are backed by hugepages
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ */
+int nvm_dev_get_buf_hugepages(const struct nvm_dev *dev);
+
+/**
+ * Sets whether `nvm_buf_alloc` backs buffers for the device by transparent
+ * hugepages, applies to the IOCTL and LBD backends, SPDK buffers are always
+ * backed by hugepages. The environment variable `NVM_BUF_HUGEPAGES` sets it
+ * at device open.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param hugepages 1 = enabled, 0 = disabled
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error.
+ */
+int nvm_dev_set_buf_hugepages(struct nvm_dev *dev, int hugepages);
+
+/**
+ * Returns whether `nvm_buf_alloc` serves buffers for the device from its
+ * arena
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ */
+int nvm_dev_get_buf_arena(const struct nvm_dev *dev);
+
+/**
+ * Sets whether `nvm_buf_alloc` serves buffers for the device, of up to 2 MiB,
+ * from a per-device arena, see `nvm_buf_arena_create`, instead of allocating
+ * each of them. Larger buffers are allocated directly. Disabled by default,
+ * the environment variable `NVM_BUF_ARENA=1` enables it at device open.
+ *
+ * Disabling it does not release the arena, buffers from it remain valid until
+ * they are freed with `nvm_buf_free`. The memory of the arena is held until
+ * `nvm_dev_close`.
+ *
+ * @note
+ * With the arena enabled, buffers from `nvm_buf_alloc` must be released with
+ * `nvm_buf_free`, never with `free()`, and must not be used after
+ * `nvm_dev_close` of the device, which releases the arena.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param arena 1 = enabled, 0 = disabled
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error.
+ */
+int nvm_dev_set_buf_arena(struct nvm_dev *dev, int arena);
+
+/**
+ * Returns whether the device has a read cache of recently written sectors
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ */
+int nvm_dev_get_rcache(const struct nvm_dev *dev);
+
+/**
+ * Returns the # of sectors served by the read cache since it was enabled, 0
+ * when it is disabled
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ */
+uint64_t nvm_dev_get_rcache_nhits(const struct nvm_dev *dev);
+
+/**
+ * Sets whether the device keeps a read cache of recently written sectors
+ *
+ * A sector of an open chunk can be read back from the media only when
+ * 'mw_cunits' sectors have been written after it, see
+ * `nvm_dev_get_mw_cunits`. With the cache enabled, the data of the last
+ * 'mw_cunits' sectors written to each open chunk is kept in host memory, up to
+ * 'maxocpu' chunks per parallel unit, and synchronous reads by `nvm_cmd_read`,
+ * thus also `nvm_vblk_pread`, serve these sectors from memory and the rest from
+ * the device. Reads with metadata, asynchronous reads, and sectors written
+ * through an SGL, by copy, or by asynchronous commands are served by the
+ * device, as are the chunks of a failed write. The environment variable
+ * `NVM_DEV_RCACHE` enables it at device open.
+ *
+ * @note
+ * Applies only to OCSSD 2.0 devices reporting a non-zero 'mw_cunits', do not
+ * change it while commands are in flight
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param rcache 1 = enabled, 0 = disabled
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error.
+ */
+int nvm_dev_set_rcache(struct nvm_dev *dev, int rcache);
+
 /**
  * Returns the 'meta-mode' of the given device
  *
@@ -1211,7 +1520,8 @@ int nvm_dev_get_be_id(const struct nvm_dev *dev);
  * @note
  * nbytes must be greater than zero and a multiple of minimal granularity
  * @note
- * De-allocate the buffer using `nvm_buf_free`
+ * De-allocate the buffer using `nvm_buf_free`, before `nvm_dev_close` when
+ * the device serves buffers from its arena, see `nvm_dev_set_buf_arena`
  *
  * @see nvm_buf_free
  *
@@ -1294,6 +1604,78 @@ void *nvm_buf_virt_alloc(size_t alignment, size_t nbytes);
  */
 void nvm_buf_virt_free(void *buf);
 
+/**
+ * Opaque handle of an arena of IO buffers
+ *
+ * @see nvm_buf_arena_create
+ *
+ * @struct nvm_buf_arena
+ */
+struct nvm_buf_arena;
+
+/**
+ * Create an arena of IO buffers for the given device
+ *
+ * The arena maps memory in chunks of 2 MiB, by DMA memory for the SPDK
+ * backend, otherwise by normal pages. With hugepages enabled for the device,
+ * see `nvm_dev_set_buf_hugepages`, a chunk is backed by a reserved 2 MiB
+ * hugepage when the system has any, otherwise its pages are advised for
+ * transparent hugepages. A chunk is carved into buffers of a single
+ * power-of-two size class, aligned to their size, from 512 bytes, or the
+ * sector size, up to 2 MiB. Freed buffers are kept in caches which threads
+ * are spread over, and move between caches via the arena, chunks are released
+ * only when the arena is destroyed, for the arena of a device, by
+ * `nvm_dev_close`.
+ *
+ * @see nvm_buf_arena_destroy
+ *
+ * @param dev The device to allocate IO buffers for
+ *
+ * @return On success, the arena is returned. On error, NULL is returned and
+ * `errno` set to indicate the error.
+ */
+struct nvm_buf_arena *nvm_buf_arena_create(const struct nvm_dev *dev);
+
+/**
+ * Destroy the arena, releasing the memory of every buffer allocated from it
+ *
+ * @param arena The arena to destroy
+ */
+void nvm_buf_arena_destroy(struct nvm_buf_arena *arena);
+
+/**
+ * Allocate an IO buffer of at least 'nbytes' from the arena
+ *
+ * @param arena The arena to allocate from
+ * @param nbytes The size of the buffer in bytes, at most 2 MiB
+ * @param phys A pointer to the variable to hold the physical address of the
+ * allocated buffer. If NULL, the physical address is not returned.
+ *
+ * @return On success, a pointer to the buffer is returned. On error, NULL is
+ * returned and `errno` set to indicate the error.
+ */
+void *nvm_buf_arena_alloc(struct nvm_buf_arena *arena, size_t nbytes,
+			  uint64_t *phys);
+
+/**
+ * Return a buffer allocated with `nvm_buf_arena_alloc` to the arena
+ *
+ * @param arena The arena the buffer was allocated from
+ * @param buf The buffer to free
+ */
+void nvm_buf_arena_free(struct nvm_buf_arena *arena, void *buf);
+
+/**
+ * Free every buffer allocated from the arena at once, keeping its memory for
+ * the allocations to follow
+ *
+ * @note
+ * No buffer of the arena may be in use, or be freed, after the reset
+ *
+ * @param arena The arena to reset
+ */
+void nvm_buf_arena_reset(struct nvm_buf_arena *arena);
+
 /**
  * Fills `buf` with chars A-Z
  *
@@ -1549,6 +1931,42 @@ struct nvm_vblk *nvm_vblk_alloc_line(struct nvm_dev *dev, int ch_bgn,
 				     int ch_end, int lun_bgn, int lun_end,
 				     int blk);
 
+/**
+ * Options for nvm_vblk_alloc_line_healthy
+ */
+enum nvm_vblk_line_opts {
+	NVM_VBLK_LINE_NARROW = 0x0,	///< Leave out units lacking a healthy block
+	NVM_VBLK_LINE_SUBST = 0x1,	///< Substitute the nearest healthy block
+};
+
+/**
+ * Allocate a virtual block as nvm_vblk_alloc_line, skipping blocks which are
+ * bad, according to the bad-block-table on 1.2, or offline, according to a
+ * device-wide chunk report on 2.0
+ *
+ * With NVM_VBLK_LINE_SUBST, a parallel unit where block 'blk' is unhealthy
+ * contributes the healthy block with the nearest index instead, on 2.0 only
+ * free chunks are substituted. Otherwise, or when the unit has no healthy
+ * block, the unit is left out and the line is narrower. The resulting blocks
+ * are those of the virtual block, see nvm_vblk_get_addrs, and reads and writes
+ * stripe across them.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param ch_bgn Beginning of the channel span, as inclusive index
+ * @param ch_end End of the channel span, as inclusive index
+ * @param lun_bgn Beginning of the LUN span, as inclusive index
+ * @param lun_end End of the LUN span, as inclusive index
+ * @param blk Block index
+ * @param flags One of `enum nvm_vblk_line_opts`
+ *
+ * @return On success, an opaque pointer to the initialized virtual block is
+ * returned. On error, NULL and `errno` set to indicate the error, ENOSPC when
+ * no unit in the span has a healthy block.
+ */
+struct nvm_vblk *nvm_vblk_alloc_line_healthy(struct nvm_dev *dev, int ch_bgn,
+					     int ch_end, int lun_bgn,
+					     int lun_end, int blk, int flags);
+
 /**
  * Set the command mode for the virtual block to async.
  */
@@ -1559,9 +1977,91 @@ int nvm_vblk_set_async(struct nvm_vblk *vblk, uint32_t depth);
  */
 int nvm_vblk_set_scalar(struct nvm_vblk *vblk);
 
+/**
+ * Enable a write buffer for nvm_vblk_write on the virtual block
+ *
+ * With the buffer enabled, nvm_vblk_write accepts writes of any size. Data is
+ * absorbed by the buffer and written as soon as it fills a whole multiple of
+ * the optimal write size, striped across the blocks of the vblk. A write which
+ * starts on an aligned position is written directly from the given buffer,
+ * without copying, up to its last whole multiple of the optimal write size.
+ * Data short of the optimal write size is held until nvm_vblk_flush, pad, or
+ * free of the virtual block pads it.
+ *
+ * @param vblk The virtual block to buffer writes of
+ * @param nbytes Capacity of the buffer, rounded up to a multiple of the
+ * optimal write size, 0 to use one stripe across all blocks of the vblk
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, EBUSY when the current buffer holds data.
+ */
+int nvm_vblk_set_wbuf(struct nvm_vblk *vblk, size_t nbytes);
+
+/**
+ * Enable read-ahead for nvm_vblk_read on the virtual block
+ *
+ * With read-ahead enabled, sequential nvm_vblk_read is served from a ring of
+ * 'nstripes' windows, each a stripe across the blocks of the vblk. The ring
+ * starts once two reads in a row each start where the read before it ended,
+ * at the stripe holding the read position, and windows consumed by the reader
+ * are released. On a vblk in async mode of a spec. 2.0 device, see
+ * nvm_vblk_set_async, the windows ahead of the reader are read ahead by
+ * requests in flight on its async. context, see nvm_vblk_pread_async,
+ * otherwise, and when a read-ahead fails, a window is read when the reader
+ * reaches it. Reads need not be aligned.
+ *
+ * Windows are not read past the write position when the vblk is written by
+ * nvm_vblk_write. Reads which are not sequential, past the last whole window,
+ * or stripe-aligned and spanning the ring, are not buffered; unaligned, they
+ * read their aligned span only. nvm_vblk_set_pos_read, nvm_vblk_pwrite, and
+ * nvm_vblk_erase drop the ring.
+ *
+ * @param vblk The virtual block to read ahead on
+ * @param nstripes Number of windows of the ring, at most
+ * NVM_VBLK_RA_NSTRIPES_MAX, 0 to disable read-ahead
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_vblk_set_readahead(struct nvm_vblk *vblk, int nstripes);
+
+/**
+ * Set whether the virtual block keeps XOR parity across its blocks
+ *
+ * With parity, every stripe of optimal-write-size units across the blocks
+ * holds the parity of the others in one block, rotating from stripe to stripe,
+ * and the capacity of the vblk shrinks by that of one block. A read of a unit
+ * which fails is reconstructed from the other blocks of its stripe, and the
+ * failing block is then read by reconstruction, such that the vblk serves reads
+ * of a single failed block.
+ *
+ * Writes cover whole stripes, their offset and size a multiple of the optimal
+ * write size times the number of blocks less one, the write buffer of
+ * nvm_vblk_set_wbuf aggregates to that size. Reads cover units of the optimal
+ * write size. Commands run synchronously, on the library worker-pool, also when
+ * the vblk is set up with nvm_vblk_set_async.
+ *
+ * @note
+ * Only available for devices of spec. version 2.0, set it before writing the
+ * vblk. nvm_vblk_append, nvm_vblk_pcopy and the requests of
+ * nvm_vblk_pwrite_async and nvm_vblk_pread_async are not available with parity.
+ * Sector metadata is not written, writes fail with EINVAL unless the meta mode
+ * of the device is NVM_META_MODE_NONE, see nvm_dev_set_meta_mode.
+ *
+ * @param vblk The virtual block to change
+ * @param parity 1 = enabled, 0 = disabled
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, EBUSY when the vblk has been written.
+ */
+int nvm_vblk_set_parity(struct nvm_vblk *vblk, int parity);
+
 /**
  * Destroy a virtual block
  *
+ * @note
+ * Data held by the write buffer is flushed, see nvm_vblk_flush
+ *
  * @param vblk The virtual block to destroy
  */
 void nvm_vblk_free(struct nvm_vblk *vblk);
@@ -1588,6 +2088,12 @@ ssize_t nvm_vblk_erase(struct nvm_vblk *vblk);
  * do not mix use of nvm_vblk_pwrite with nvm_vblk_write on the same virtual
  * block
  *
+ * With a write buffer enabled, see nvm_vblk_set_wbuf, count can be any number
+ * of bytes, and buf any memory for the part which is copied to the buffer. When
+ * a device write fails after part of buf is written or buffered, the number of
+ * those bytes is returned and the write position is advanced by it, like a
+ * short write(2).
+ *
  * @param vblk The virtual block to write to
  * @param buf Write content starting at buf
  * @param count The number of bytes to write
@@ -1619,6 +2125,20 @@ ssize_t nvm_vblk_write(struct nvm_vblk *vblk, const void *buf, size_t count);
 ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
 			size_t offset);
 
+/**
+ * Write the data held by the write buffer of the virtual block, padded to the
+ * optimal write size
+ *
+ * @see nvm_vblk_set_wbuf
+ *
+ * @param vblk The virtual block to flush
+ *
+ * @return On success, the number of padding bytes written is returned, 0 when
+ * the buffer is empty or not enabled. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+ssize_t nvm_vblk_flush(struct nvm_vblk *vblk);
+
 /**
  * Pad the virtual block with synthetic data
  *
@@ -1634,8 +2154,43 @@ ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
  */
 ssize_t nvm_vblk_pad(struct nvm_vblk *vblk);
 
+/**
+ * Append to a virtual block, from any number of threads without locking
+ *
+ * Every call places its data in a single chunk of the virtual block, it
+ * reserves the next 'count' bytes of the chunk by an atomic update of a
+ * host-side write pointer, appends start at the chunks in turn. Writes to a
+ * chunk are submitted in the order of reservation, such that the device sees
+ * sequential writes, appends to distinct chunks proceed in parallel. An append
+ * waiting for its turn on a chunk sleeps rather than spins. Sector metadata is
+ * written as for nvm_vblk_write, see nvm_dev_set_meta_mode.
+ *
+ * The host-side write pointers start at the beginning of the chunks, the
+ * chunks must be reset, they are rewound by nvm_vblk_erase. Appends do not
+ * move the position of nvm_vblk_write, and must not be mixed with it.
+ *
+ * @note Only available for devices of spec. version 2.0
+ *
+ * @param vblk The virtual block to append to
+ * @param buf Buffer of 'count' bytes, allocated with nvm_buf_alloc
+ * @param count The number of bytes to append, a multiple of the minimum write
+ * size and at most the size of a chunk
+ * @param addr Set to the address of the chunk and first sector written, may be
+ * NULL
+ *
+ * @return On success, 'count' is returned. On error, -1 is returned and
+ * `errno` set to indicate the error, ENOSPC when no chunk has room for
+ * 'count' bytes.
+ */
+ssize_t nvm_vblk_append(struct nvm_vblk *vblk, const void *buf, size_t count,
+			struct nvm_addr *addr);
+
 /**
  * Read from a virtual block
+ *
+ * @note
+ * With read-ahead enabled, sequential reads are served from the read-ahead
+ * ring, see nvm_vblk_set_readahead
  */
 ssize_t nvm_vblk_read(struct nvm_vblk *vblk, void *buf, size_t count);
 
@@ -1646,18 +2201,183 @@ ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
 		       size_t offset);
 
 /**
- * Copy the virtual block 'src' to the virtual block 'dst'
+ * Write the segments of 'iov' to a virtual block at given offset
  *
- * @return On success, the number of bytes copied is returned. On error, -1 is
+ * The segments are written in place, without copying them into a contiguous
+ * buffer. When the device is opened with NVM_CMD_SGL the segments of a
+ * command are described by an SGL, otherwise commands are split at segment
+ * boundaries, in multiples of the minimum write size. Only the parts of a
+ * segment boundary not on the minimum write size are copied.
+ *
+ * @note
+ * The segments must satisfy the requirements on the buffer of nvm_vblk_pwrite
+ * e.g. be allocated with nvm_buf_alloc. The sum of the segment lengths and
+ * 'offset' must be multiples of the optimal write size. Virtual blocks of
+ * spec. version 1.2 devices, and with parity, copy the segments into a
+ * contiguous buffer. On the NVM_BE_LBD backend, which opens the device with
+ * O_DIRECT, the base and length of every segment must be multiples of the
+ * sector size, otherwise -1 is returned and `errno` set to EINVAL.
+ *
+ * Like nvm_vblk_pwrite, the write drops the read-ahead windows of the vblk.
+ *
+ * @param vblk The vblk to write to
+ * @param iov Array of segments to write, in order
+ * @param iovcnt The number of segments in 'iov'
+ * @param offset Start writing offset bytes within the vblk
+ *
+ * @return On success, the number of bytes written is returned. On error, -1 is
  * returned and `errno` set to indicate the error.
  */
-ssize_t nvm_vblk_copy(struct nvm_vblk *src, struct nvm_vblk *dst, int flags);
+ssize_t nvm_vblk_pwritev(struct nvm_vblk *vblk, const struct iovec *iov,
+			 int iovcnt, size_t offset);
 
 /**
- * Retrieve the device associated with the given virtual block
+ * Read from a virtual block at given offset into the segments of 'iov'
  *
- * @param vblk The entity to retrieve information from
- */
+ * @see nvm_vblk_pwritev
+ *
+ * Commands are split at segment boundaries in multiples of the sector size.
+ *
+ * @return On success, the number of bytes read is returned. On error, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+ssize_t nvm_vblk_preadv(struct nvm_vblk *vblk, const struct iovec *iov,
+			int iovcnt, size_t offset);
+
+/**
+ * Opaque handle of an asynchronous virtual block request
+ *
+ * @see nvm_vblk_pwrite_async
+ *
+ * @struct nvm_vblk_req
+ */
+struct nvm_vblk_req;
+
+/**
+ * Signature of the callback invoked when every command of a virtual block
+ * request has completed
+ */
+typedef void (*nvm_vblk_req_cb)(struct nvm_vblk_req *req, void *cb_arg);
+
+/**
+ * Write to a virtual block at given offset, without waiting for the write
+ *
+ * The commands of the write are submitted on the async. context of the vblk
+ * as it has room, writes to a chunk in order, one at a time. The request
+ * progresses as completions are processed with nvm_vblk_async_poke or
+ * nvm_vblk_async_wait; once every command has completed 'cb' is invoked, the
+ * request reports done and the number of failed commands. Any number of
+ * requests may be in flight on the vblk, their writes reach each chunk in the
+ * order the requests were created. Once a write to a chunk fails, the writes
+ * to that chunk which follow it, of this and of later requests, fail without
+ * being submitted until the vblk is erased.
+ *
+ * @note
+ * Only available for devices of spec. version 2.0, after nvm_vblk_set_async.
+ * 'count' and 'offset' must be multiples of the optimal write size. The vblk,
+ * its async. context and its requests must be used by one thread at a time.
+ *
+ * @param vblk The vblk to write to
+ * @param buf Write content starting at buf, must stay valid until done
+ * @param count The number of bytes to write
+ * @param offset Start writing offset bytes within the vblk
+ * @param cb Callback invoked when the request is done, may be NULL
+ * @param cb_arg Argument passed to 'cb'
+ *
+ * @return On success, the request, which must be freed with nvm_vblk_req_free
+ * once done. On error, NULL and `errno` set to indicate the error, EIO when
+ * no command could be submitted.
+ */
+struct nvm_vblk_req *nvm_vblk_pwrite_async(struct nvm_vblk *vblk,
+					   const void *buf, size_t count,
+					   size_t offset, nvm_vblk_req_cb cb,
+					   void *cb_arg);
+
+/**
+ * Read from a virtual block at given offset, without waiting for the read
+ *
+ * @see nvm_vblk_pwrite_async
+ *
+ * @return On success, the request, which must be freed with nvm_vblk_req_free
+ * once done. On error, NULL and `errno` set to indicate the error.
+ */
+struct nvm_vblk_req *nvm_vblk_pread_async(struct nvm_vblk *vblk, void *buf,
+					  size_t count, size_t offset,
+					  nvm_vblk_req_cb cb, void *cb_arg);
+
+/**
+ * Returns 1 when every command of the request has completed, 0 otherwise
+ */
+int nvm_vblk_req_is_done(struct nvm_vblk_req *req);
+
+/**
+ * Returns the number of commands of the request which failed
+ */
+size_t nvm_vblk_req_get_nerr(struct nvm_vblk_req *req);
+
+/**
+ * Free a request which is done, this may be done from its callback
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to EBUSY when the request is in flight.
+ */
+int nvm_vblk_req_free(struct nvm_vblk_req *req);
+
+/**
+ * Process up to 'max' completions of the async. context of the vblk, 0 means
+ * no max, progressing its requests
+ *
+ * @return On success, the number of completions processed, may be 0. On error,
+ * -1 is returned and `errno` set to indicate the error.
+ */
+int nvm_vblk_async_poke(struct nvm_vblk *vblk, uint32_t max);
+
+/**
+ * Wait for every request in flight on the vblk to be done
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_vblk_async_wait(struct nvm_vblk *vblk);
+
+/**
+ * Copy the virtual block 'src' to the virtual block 'dst'
+ *
+ * @see nvm_vblk_pcopy
+ *
+ * @return On success, the number of bytes copied is returned. On error, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+ssize_t nvm_vblk_copy(struct nvm_vblk *src, struct nvm_vblk *dst, int flags);
+
+/**
+ * Copy 'count' bytes at 'offset' of the virtual block 'src' to the same range
+ * of the virtual block 'dst'
+ *
+ * Within a device, and for virtual blocks with the same number of chunks, the
+ * copy is done with vector-copy commands, submitted on the async. context of
+ * 'src' when set via nvm_vblk_set_async. Otherwise, e.g. when 'dst' is on
+ * another device or the backend has no vector-copy, the data is read into host
+ * memory and written out, the reads overlapping the writes of the previous
+ * window. Only vector-copy carries the out-of-bound metadata along.
+ *
+ * @param src The virtual block to copy from
+ * @param dst The virtual block to copy to, possibly on another device
+ * @param count The number of bytes to copy, a multiple of the optimal write
+ * size of both devices
+ * @param offset Start offset in bytes, aligned as 'count'
+ *
+ * @return On success, the number of bytes copied is returned. On error, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+ssize_t nvm_vblk_pcopy(struct nvm_vblk *src, struct nvm_vblk *dst,
+		       size_t count, size_t offset);
+
+/**
+ * Retrieve the device associated with the given virtual block
+ *
+ * @param vblk The entity to retrieve information from
+ */
 struct nvm_dev *nvm_vblk_get_dev(struct nvm_vblk *vblk);
 
 /**
@@ -1691,6 +2411,9 @@ size_t nvm_vblk_get_pos_read(struct nvm_vblk *vblk);
 /**
  * Retrieve the write cursor position for the given virtual block
  *
+ * @note
+ * The position includes data held by the write buffer
+ *
  * @param vblk The entity to retrieve information from
  */
 size_t nvm_vblk_get_pos_write(struct nvm_vblk *vblk);
@@ -1709,6 +2432,10 @@ int nvm_vblk_set_pos_read(struct nvm_vblk *vblk, size_t pos);
 /**
  * Set the write cursor position for the given virtual block
  *
+ * @note
+ * Fails with `errno` set to EBUSY while the write buffer holds data, see
+ * nvm_vblk_flush
+ *
  * @param vblk The vblk to change
  * @param pos The new write cursor
  *
@@ -1724,6 +2451,447 @@ int nvm_vblk_set_pos_write(struct nvm_vblk *vblk, size_t pos);
  */
 void nvm_vblk_pr(struct nvm_vblk *vblk);
 
+/**
+ * Opaque virtual block striped across devices
+ *
+ * @see nvm_mvblk_alloc
+ *
+ * @struct nvm_mvblk
+ */
+struct nvm_mvblk;
+
+/**
+ * Allocate a virtual block striped across the given virtual blocks, typically
+ * one per device
+ *
+ * Units of the optimal write size interleave across the members, and within a
+ * member across its blocks as for nvm_vblk, such that a sequential stream
+ * spreads over all parallel units of all devices. Every member has its own
+ * asynchronous context and queue on the library worker-pool, the completions
+ * of the members are aggregated per request. A member on a backend without
+ * asynchronous support, e.g. NVM_BE_IOCTL, submits synchronously on its queue.
+ *
+ * @note
+ * Only available for devices of spec. version 2.0. The members must have the
+ * same optimal write size in bytes and the same size, without parity or write
+ * buffer. On success the mvblk owns the members, they are freed by
+ * nvm_mvblk_free.
+ *
+ * @param vblks Array of virtual blocks
+ * @param nvblks Number of elements in 'vblks'
+ *
+ * @return On success, an opaque pointer to the mvblk is returned. On error,
+ * NULL and `errno` set to indicate the error.
+ */
+struct nvm_mvblk *nvm_mvblk_alloc(struct nvm_vblk *vblks[], int nvblks);
+
+/**
+ * Destroy a multi-device virtual block and its members
+ *
+ * @param mvblk The mvblk to destroy
+ */
+void nvm_mvblk_free(struct nvm_mvblk *mvblk);
+
+/**
+ * Erase the members of a multi-device virtual block, in parallel
+ *
+ * @param mvblk The mvblk to erase
+ *
+ * @return On success, the number of bytes erased is returned. On error, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+ssize_t nvm_mvblk_erase(struct nvm_mvblk *mvblk);
+
+/**
+ * Write to a multi-device virtual block
+ *
+ * @see nvm_mvblk_pwrite
+ *
+ * @return On success, the number of bytes written is returned and the write
+ * position is updated. On error, -1 is returned and `errno` set to indicate
+ * the error.
+ */
+ssize_t nvm_mvblk_write(struct nvm_mvblk *mvblk, const void *buf,
+			size_t count);
+
+/**
+ * Write to a multi-device virtual block at a given offset
+ *
+ * @note
+ * count and offset must be multiples of the optimal write size, writes to a
+ * block must be sequential, as for nvm_vblk_pwrite
+ *
+ * @param mvblk The mvblk to write to
+ * @param buf Write content starting at buf, NULL to write padding
+ * @param count The number of bytes to write
+ * @param offset Start writing offset bytes within the mvblk
+ *
+ * @return On success, the number of bytes written is returned. On error, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+ssize_t nvm_mvblk_pwrite(struct nvm_mvblk *mvblk, const void *buf,
+			 size_t count, size_t offset);
+
+/**
+ * Pad the multi-device virtual block with synthetic data, from the write
+ * position to its end
+ *
+ * @return On success, the number of bytes padded is returned. On error, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+ssize_t nvm_mvblk_pad(struct nvm_mvblk *mvblk);
+
+/**
+ * Read from a multi-device virtual block
+ *
+ * @see nvm_mvblk_pread
+ *
+ * @return On success, the number of bytes read is returned and the read
+ * position is updated. On error, -1 is returned and `errno` set to indicate
+ * the error.
+ */
+ssize_t nvm_mvblk_read(struct nvm_mvblk *mvblk, void *buf, size_t count);
+
+/**
+ * Read from a multi-device virtual block at a given offset
+ *
+ * @note
+ * count and offset must be multiples of the optimal write size
+ *
+ * @param mvblk The mvblk to read from
+ * @param buf Buffer to store the result of the read into
+ * @param count The number of bytes to read
+ * @param offset Start reading offset bytes within the mvblk
+ *
+ * @return On success, the number of bytes read is returned. On error, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+ssize_t nvm_mvblk_pread(struct nvm_mvblk *mvblk, void *buf, size_t count,
+			size_t offset);
+
+/**
+ * Retrieve the size, in bytes, of the multi-device virtual block
+ */
+size_t nvm_mvblk_get_nbytes(struct nvm_mvblk *mvblk);
+
+/**
+ * Retrieve the number of members of the multi-device virtual block
+ */
+int nvm_mvblk_get_nvblks(struct nvm_mvblk *mvblk);
+
+/**
+ * Retrieve member 'idx' of the multi-device virtual block
+ *
+ * @return On success, the member. On error, NULL and `errno` set.
+ */
+struct nvm_vblk *nvm_mvblk_get_vblk(struct nvm_mvblk *mvblk, int idx);
+
+/**
+ * Print the multi-device virtual block in a humanly readable form
+ *
+ * @param mvblk The entity to print information about
+ */
+void nvm_mvblk_pr(struct nvm_mvblk *mvblk);
+
+/**
+ * Opaque chunk allocator
+ *
+ * @see nvm_chunks_alloc
+ *
+ * @struct nvm_chunks
+ */
+struct nvm_chunks;
+
+/**
+ * Allocate a chunk allocator for the given device
+ *
+ * The state of every chunk is read once, from a device-wide chunk report on
+ * 2.0 and from the bad-block-tables on 1.2. Free chunks are kept in host memory
+ * on per parallel unit free lists, ordered by the P/E cycles counted since
+ * alloc, see nvm_chunks_put, and among chunks of equal cycles by the wear-level
+ * index reported at alloc. Offline chunks and bad blocks are left out. Chunks
+ * are then handed out and taken back without issuing admin commands,
+ * concurrently from multiple threads.
+ *
+ * @note Chunks which are open or closed on alloc are considered in use, they
+ * may be reset and released with nvm_chunks_put
+ *
+ * @param dev Associated device
+ *
+ * @return On success, an allocator is returned. On error, NULL is returned and
+ * `errno` set to indicate the error
+ */
+struct nvm_chunks *nvm_chunks_alloc(struct nvm_dev *dev);
+
+/**
+ * Free the given chunk allocator, chunks handed out are not reset
+ *
+ * @param chunks The allocator to free
+ */
+void nvm_chunks_free(struct nvm_chunks *chunks);
+
+/**
+ * Get 'naddrs' free chunks, each on a distinct parallel unit, the least worn
+ * chunk of the unit is picked
+ *
+ * Stripes start at a rotating parallel unit and alternate between groups,
+ * spreading load and wear across the device.
+ *
+ * @param chunks The allocator to get chunks from
+ * @param naddrs Number of chunks, at most the number of parallel units
+ * @param addrs Array of at least 'naddrs' elements, filled with chunk addresses
+ *
+ * @return On success, 0 is returned. On error, -1 is returned, `errno` set to
+ * indicate the error, e.g. ENOSPC when fewer than 'naddrs' parallel units have
+ * a free chunk, and no chunks are taken
+ */
+int nvm_chunks_get(struct nvm_chunks *chunks, int naddrs,
+		   struct nvm_addr addrs[]);
+
+/**
+ * Get a free chunk on every parallel unit of the device
+ *
+ * @param chunks The allocator to get chunks from
+ * @param addrs Array with an element per parallel unit
+ *
+ * @return On success, the number of chunks in the line is returned. On error,
+ * -1 is returned and `errno` set to indicate the error
+ */
+int nvm_chunks_get_line(struct nvm_chunks *chunks, struct nvm_addr addrs[]);
+
+/**
+ * Return chunks to the allocator, the caller resets them before writing to them
+ * again, after getting them anew
+ *
+ * Every release counts as a program/erase cycle in the wear of the chunk.
+ *
+ * @param chunks The allocator the chunks were obtained from
+ * @param addrs Array of chunk addresses
+ * @param naddrs Number of elements in 'addrs'
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, e.g. EINVAL when a chunk is not in use
+ */
+int nvm_chunks_put(struct nvm_chunks *chunks, const struct nvm_addr addrs[],
+		   int naddrs);
+
+/**
+ * Retire chunks, e.g. after failing to reset them, they are never handed out
+ * again
+ *
+ * @param chunks The allocator the chunks were obtained from
+ * @param addrs Array of chunk addresses
+ * @param naddrs Number of elements in 'addrs'
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_chunks_retire(struct nvm_chunks *chunks, const struct nvm_addr addrs[],
+		      int naddrs);
+
+/**
+ * Returns the number of free chunks
+ *
+ * @param chunks The allocator to inspect
+ *
+ * @return The number of free chunks
+ */
+uint32_t nvm_chunks_get_nfree(struct nvm_chunks *chunks);
+
+/**
+ * Print the chunk allocator in a humanly readable form
+ *
+ * @param chunks The allocator to print
+ */
+void nvm_chunks_pr(struct nvm_chunks *chunks);
+
+/**
+ * Configure the worker-pool used by the synchronous virtual block I/O, erase,
+ * and copy
+ *
+ * The pool is started on first use, until configured by this function its
+ * settings are read from the environment variables `NVM_POOL_NTHREADS` and
+ * `NVM_POOL_CPUS`. Reconfiguring stops the workers, they are started again
+ * with the new settings on next use. Must not be called with I/O in flight.
+ *
+ * @param nthreads Number of threads, calling thread included, 0 for one per
+ * online CPU
+ * @param cpus CPU list to pin the workers to, in the format of `taskset -c`
+ * e.g. "0-7,16", or NULL for no pinning
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_pool_conf(int nthreads, const char *cpus);
+
+/**
+ * Opaque host-side, page-mapped, flash translation layer
+ *
+ * @see nvm_ftl_alloc
+ *
+ * @struct nvm_ftl
+ */
+struct nvm_ftl;
+
+/**
+ * Allocate a flash translation layer exposing a logical block address space
+ * over the chunks [chunk_bgn, chunk_end) of every parallel unit
+ *
+ * Chunks with the same index form a line, writes are placed out-of-place in
+ * the open line, striped in optimal write-size units across the parallel
+ * units. The logical-to-physical mapping is kept in host memory only, it is
+ * not persisted and lost on nvm_ftl_free. Lookups are lock-free, thus reads,
+ * writes and trims may be issued concurrently from multiple threads.
+ *
+ * Sectors of open lines which the device cannot serve yet, as fewer than
+ * 'mw_cunits' sectors are written after them, are read from a copy kept in
+ * host memory, see `nvm_dev_get_mw_cunits`.
+ *
+ * @note Only available for devices of spec. version 2.0
+ *
+ * @param dev Associated device
+ * @param chunk_bgn Index of the first chunk of the range
+ * @param chunk_end Index of the chunk after the range
+ * @param flags Reserved, must be 0
+ *
+ * @return On success, a pointer to the FTL is returned. On error, NULL is
+ * returned and `errno` set to indicate the error
+ */
+struct nvm_ftl *nvm_ftl_alloc(struct nvm_dev *dev, int chunk_bgn,
+			      int chunk_end, int flags);
+
+/**
+ * Destroy the given FTL, the mapping is lost
+ *
+ * @param ftl The FTL to destroy
+ */
+void nvm_ftl_free(struct nvm_ftl *ftl);
+
+/**
+ * Returns the number of logical blocks exposed by the given FTL, the size of a
+ * logical block is the sector size of the device
+ *
+ * @param ftl The FTL to inspect
+ *
+ * @return The number of logical blocks
+ */
+uint64_t nvm_ftl_get_nlbas(const struct nvm_ftl *ftl);
+
+/**
+ * Read 'nlbas' logical blocks starting at 'lba' into 'buf', blocks never
+ * written or trimmed read as zeroes
+ *
+ * With NVM_CMD_ASYNC in 'flags' the read is submitted on the asynchronous
+ * context in `ret->async.ctx`, and `ret->async.cb` is invoked with `ret` once
+ * every command of the read has completed, reap the completions with
+ * nvm_async_poke or nvm_async_wait
+ *
+ * @param ftl The FTL to read from
+ * @param lba First logical block to read
+ * @param nlbas Number of logical blocks to read
+ * @param buf Buffer, of at least 'nlbas' sectors, allocated with nvm_buf_alloc
+ * @param flags NVM_CMD_SYNC or NVM_CMD_ASYNC
+ * @param ret Pointer to structure in which to store the command status, may be
+ * NULL for synchronous reads
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_read(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas, void *buf,
+		 uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Write 'nlbas' logical blocks starting at 'lba' from 'buf'
+ *
+ * @see nvm_ftl_read for the asynchronous semantics
+ *
+ * @param ftl The FTL to write to
+ * @param lba First logical block to write
+ * @param nlbas Number of logical blocks to write
+ * @param buf Buffer, of at least 'nlbas' sectors, allocated with nvm_buf_alloc
+ * @param flags NVM_CMD_SYNC or NVM_CMD_ASYNC
+ * @param ret Pointer to structure in which to store the command status, may be
+ * NULL for synchronous writes
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_write(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+		  const void *buf, uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Discard the mapping of 'nlbas' logical blocks starting at 'lba'
+ *
+ * @param ftl The FTL to trim
+ * @param lba First logical block to trim
+ * @param nlbas Number of logical blocks to trim
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_trim(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas);
+
+/**
+ * Policies for picking the line to reclaim by garbage collection
+ *
+ * @see nvm_ftl_set_gc_policy
+ */
+enum nvm_ftl_gc_policy {
+	NVM_FTL_GC_GREEDY = 0x0,	///< Fewest valid sectors
+	NVM_FTL_GC_COST_BENEFIT = 0x1,	///< Free space gained weighed by age
+};
+
+/**
+ * Reclaim up to 'nlines' lines of the given FTL
+ *
+ * The valid sectors of the picked lines are relocated with vector-copy, when
+ * the backend supports it, and otherwise by pipelined reads and writes through
+ * the host. The chunks of reclaimed lines are reset asynchronously when the
+ * backend supports it. Relocation is throttled by the rate set with
+ * nvm_ftl_set_gc_rate.
+ *
+ * Writes reclaim lines on their own, ignoring the rate-limit, when the FTL
+ * runs out of free lines, calling this function when the device is idle avoids
+ * such stalls.
+ *
+ * @param ftl The FTL to collect
+ * @param nlines Maximum number of lines to reclaim
+ *
+ * @return On success, the number of lines reclaimed. On error, -1 is returned
+ * and `errno` set to indicate the error
+ */
+int nvm_ftl_gc(struct nvm_ftl *ftl, uint32_t nlines);
+
+/**
+ * Set the policy for picking lines to reclaim
+ *
+ * @param ftl The FTL to configure
+ * @param policy One of `enum nvm_ftl_gc_policy`
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_set_gc_policy(struct nvm_ftl *ftl, int policy);
+
+/**
+ * Limit the number of sectors relocated per second by nvm_ftl_gc, leaving
+ * bandwidth to foreground I/O
+ *
+ * @param ftl The FTL to configure
+ * @param nsectrs Sectors per second, 0 for no limit
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_set_gc_rate(struct nvm_ftl *ftl, uint64_t nsectrs);
+
+/**
+ * Prints a human readable representation of the given FTL
+ *
+ * @param ftl The FTL to print
+ */
+void nvm_ftl_pr(const struct nvm_ftl *ftl);
+
 /**
  * Boilerplate for working with the API
  *
@@ -28,6 +28,56 @@
 
 #ifndef __INTERNAL_NVM_ASYNC_H
 #define __INTERNAL_NVM_ASYNC_H
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+enum nvm_async_op {
+	NVM_ASYNC_OP_ERASE,
+	NVM_ASYNC_OP_WRITE,
+	NVM_ASYNC_OP_READ,
+	NVM_ASYNC_OP_COPY
+};
+
+/**
+ * A command submitted on a shared context, queued until drained into the
+ * backend
+ */
+struct nvm_async_cmd {
+	int op;
+	int opt;		///< NVM_CMD_SCALAR or NVM_CMD_VECTOR
+	int naddrs;
+	uint16_t flags;
+	void *data;
+	void *meta;
+	struct nvm_ret *ret;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_addr dst[NVM_NADDR_MAX];
+};
+
+struct nvm_async_slot {
+	atomic_size_t seq;	///< Position the slot is ready for
+	struct nvm_async_cmd cmd;
+};
+
+/**
+ * Bounded MPSC submission ring of a context initialized with NVM_ASYNC_SHARED
+ *
+ * Submitters reserve one of 'depth' commands on 'nreserved', enqueue at
+ * 'head' and then attempt to drain the ring. The backend, and everything below
+ * 'lock', is only touched by the thread holding 'lock'.
+ */
+struct nvm_async_ring {
+	atomic_uint nreserved;	///< Queued plus outstanding commands
+	atomic_size_t head;
+	size_t mask;
+
+	atomic_flag lock;
+	atomic_size_t tail;
+	struct nvm_ret **failed;	///< Submissions rejected by the backend
+	uint32_t nfailed;
+
+	struct nvm_async_slot slots[];
+};
 
 struct nvm_async_ctx {
 	uint32_t depth;		///< IO depth of the ASYNC CTX
@@ -35,6 +85,32 @@ struct nvm_async_ctx {
 
 	// Lower-layer context, e.g. for the implementation of nvm_be_*_async_*
 	void *be_ctx;
+
+	// Completions are stored here instead of invoking callbacks, while set
+	struct nvm_ret **reap;
+	uint32_t nreaped;
+
+	struct nvm_async_ring *ring;	///< Set with NVM_ASYNC_SHARED
+
+	uint16_t flags;		///< Options in effect, `enum nvm_async_opts`
+	int efd;		///< eventfd, armed by the backend for NVM_ASYNC_EVENTFD
+
+	int wait_policy;	///< One of `enum nvm_async_wait_policy`
+	_Atomic uint64_t spin_nsecs;	///< Adaptive polling period of hybrid wait
 };
 
+/**
+ * Queue a command on the shared context in `ret->async.ctx`
+ */
+int nvm_async_ring_submit(struct nvm_dev *dev, int op, int opt,
+			  struct nvm_addr addrs[], struct nvm_addr dst[],
+			  int naddrs, const void *data, const void *meta,
+			  uint16_t flags, struct nvm_ret *ret);
+
+static inline int nvm_async_is_shared(uint16_t flags, struct nvm_ret *ret)
+{
+	return (flags & NVM_CMD_ASYNC) && ret && ret->async.ctx &&
+	       ret->async.ctx->ring;
+}
+
 #endif /* __INTERNAL_NVM_ASYNC_H */
@@ -61,15 +61,18 @@ struct nvm_be {
 		    void*, size_t, int, struct nvm_ret *);
 
 	/**
-	 * Execute identify command
+	 * Execute identify command, filling the given buffer
+	 *
+	 * Buffers handed to the backend are DMA buffers, see nvm_buf_alloc
 	 */
-	struct nvm_spec_idfy *(*idfy)(struct nvm_dev *, struct nvm_ret *);
+	int (*idfy)(struct nvm_dev *, struct nvm_spec_idfy *, struct nvm_ret *);
 
 	/**
-	 * Execute report chunk command
+	 * Execute report chunk command, filling the given buffer of
+	 * nvm_cmd_rprt_nbytes
 	 */
-	struct nvm_spec_rprt *(*rprt)(struct nvm_dev *, struct nvm_addr *, int,
-				      struct nvm_ret *);
+	int (*rprt)(struct nvm_dev *, struct nvm_addr *, int,
+		    struct nvm_spec_rprt *, struct nvm_ret *);
 
 	/**
 	 * Execute get feature command
@@ -84,10 +87,11 @@ struct nvm_be {
 		     struct nvm_ret *);
 
 	/**
-	 * Execute get bad-block-table command
+	 * Execute get bad-block-table command, filling the given buffer of
+	 * nvm_cmd_gbbt_nbytes
 	 */
-	struct nvm_spec_bbt *(*gbbt)(struct nvm_dev *, struct nvm_addr,
-				     struct nvm_ret *);
+	int (*gbbt)(struct nvm_dev *, struct nvm_addr, struct nvm_spec_bbt *,
+		    struct nvm_ret *);
 
 	/**
 	 * Execute set bad-block-table command
@@ -159,6 +163,19 @@ struct nvm_be {
 	 * Wait for completion of all asynchronous events on a given context
 	 */
 	int (*async_wait)(struct nvm_dev *, struct nvm_async_ctx *);
+
+	/**
+	 * Store up to 'max' completed commands of a given context in an array,
+	 * without invoking their callbacks
+	 */
+	int (*async_reap)(struct nvm_dev *, struct nvm_async_ctx *,
+			  struct nvm_ret *[], uint32_t);
+
+	/**
+	 * Translate a buffer address to the address the device DMAs to, NULL
+	 * for the translation by backend identifier, see nvm_buf_vtophys
+	 */
+	int (*vtophys)(const struct nvm_dev *, void *, uint64_t *);
 };
 
 /**
@@ -174,12 +191,11 @@ int nvm_be_nosys_pass(struct nvm_dev *dev, struct nvm_nvme_cmd *cmd,
 		      void *meta, size_t meta_nbytes, int flags,
 		      struct nvm_ret *ret);
 
-struct nvm_spec_idfy *nvm_be_nosys_idfy(struct nvm_dev *dev,
-					struct nvm_ret *ret);
+int nvm_be_nosys_idfy(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		      struct nvm_ret *ret);
 
-struct nvm_spec_rprt *nvm_be_nosys_rprt(struct nvm_dev *dev,
-					struct nvm_addr *addr, int opt,
-					struct nvm_ret *ret);
+int nvm_be_nosys_rprt(struct nvm_dev *dev, struct nvm_addr *addr, int opt,
+		      struct nvm_spec_rprt *rprt, struct nvm_ret *ret);
 
 int nvm_be_nosys_gfeat(struct nvm_dev *, uint8_t, union nvm_nvme_feat *,
 		       struct nvm_ret *);
@@ -187,9 +203,8 @@ int nvm_be_nosys_gfeat(struct nvm_dev *, uint8_t, union nvm_nvme_feat *,
 int nvm_be_nosys_sfeat(struct nvm_dev *, uint8_t, const union nvm_nvme_feat *,
 		       struct nvm_ret *);
 
-struct nvm_spec_bbt *nvm_be_nosys_gbbt(struct nvm_dev *dev,
-				       struct nvm_addr addr,
-				       struct nvm_ret *ret);
+int nvm_be_nosys_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
+		      struct nvm_spec_bbt *bbt, struct nvm_ret *ret);
 
 int nvm_be_nosys_sbbt(struct nvm_dev *dev, struct nvm_addr *addrs, int naddrs,
 		      uint16_t flags, struct nvm_ret *ret);
@@ -231,6 +246,9 @@ int nvm_be_nosys_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
 
 int nvm_be_nosys_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx);
 
+int nvm_be_nosys_async_reap(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			    struct nvm_ret *out[], uint32_t max);
+
 /**
  * Auxilary helpers
  */
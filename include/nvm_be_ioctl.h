@@ -197,12 +197,11 @@ struct nvm_dev *nvm_be_ioctl_open(const char *dev_path, int flags);
 
 void nvm_be_ioctl_close(struct nvm_dev *dev);
 
-struct nvm_spec_idfy *nvm_be_ioctl_idfy(struct nvm_dev *dev,
-					struct nvm_ret *ret);
+int nvm_be_ioctl_idfy(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		      struct nvm_ret *ret);
 
-struct nvm_spec_rprt *nvm_be_ioctl_rprt(struct nvm_dev *dev,
-					struct nvm_addr *addr, int opt,
-					struct nvm_ret *ret);
+int nvm_be_ioctl_rprt(struct nvm_dev *dev, struct nvm_addr *addr, int opt,
+		      struct nvm_spec_rprt *rprt, struct nvm_ret *ret);
 
 int nvm_be_ioctl_gfeat(struct nvm_dev *dev, uint8_t id,
 		       union nvm_nvme_feat *feat,
@@ -212,9 +211,8 @@ int nvm_be_ioctl_sfeat(struct nvm_dev *dev, uint8_t id,
 		       const union nvm_nvme_feat *feat,
 		       struct nvm_ret *ret);
 
-struct nvm_spec_bbt *nvm_be_ioctl_gbbt(struct nvm_dev *dev,
-				       struct nvm_addr addr,
-				       struct nvm_ret *ret);
+int nvm_be_ioctl_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
+		      struct nvm_spec_bbt *bbt, struct nvm_ret *ret);
 
 int nvm_be_ioctl_sbbt(struct nvm_dev *dev, struct nvm_addr *addrs, int naddrs,
 		      uint16_t flags, struct nvm_ret *ret);
@@ -53,8 +53,8 @@ int nvm_be_nocd_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
 
 int nvm_be_nocd_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx);
 
-struct nvm_spec_idfy *nvm_be_nocd_idfy(struct nvm_dev *dev,
-				        struct nvm_ret *ret);
+int nvm_be_nocd_idfy(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		     struct nvm_ret *ret);
 
 int nvm_be_nocd_gfeat(struct nvm_dev *dev, uint8_t id,
 		       union nvm_nvme_feat *feat, struct nvm_ret *ret);
@@ -62,12 +62,11 @@ int nvm_be_nocd_gfeat(struct nvm_dev *dev, uint8_t id,
 int nvm_be_nocd_sfeat(struct nvm_dev *dev, uint8_t id,
 		       const union nvm_nvme_feat *feat, struct nvm_ret *ret);
 
-struct nvm_spec_rprt *nvm_be_nocd_rprt(struct nvm_dev *dev,
-					struct nvm_addr *addr, int opt,
-					struct nvm_ret *ret);
+int nvm_be_nocd_rprt(struct nvm_dev *dev, struct nvm_addr *addr, int opt,
+		     struct nvm_spec_rprt *rprt, struct nvm_ret *ret);
 
-struct nvm_spec_bbt *nvm_be_nocd_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
-				       struct nvm_ret *ret);
+int nvm_be_nocd_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
+		     struct nvm_spec_bbt *bbt, struct nvm_ret *ret);
 
 int nvm_be_nocd_sbbt(struct nvm_dev *dev, struct nvm_addr *addrs, int naddrs,
 		      uint16_t flags, struct nvm_ret *ret);
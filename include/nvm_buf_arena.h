@@ -0,0 +1,113 @@
+/*
+ * nvm_buf_arena - Size-class arena for DMA buffers (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_BUF_ARENA_H
+#define __INTERNAL_NVM_BUF_ARENA_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+#define NVM_BUF_ARENA_CHUNK_NBYTES (2 * 1024 * 1024)	///< A hugepage
+#define NVM_BUF_ARENA_NCHUNKS_MAX 1024		///< Chunks of an arena, 2 GiB
+#define NVM_BUF_ARENA_CLASS_MIN 512		///< Smallest size class
+#define NVM_BUF_ARENA_NCLASSES 13		///< 512 B to a chunk
+#define NVM_BUF_ARENA_NCACHES 16		///< Caches threads are spread over
+#define NVM_BUF_ARENA_CACHE_MAX 64		///< Blocks per class in a cache
+#define NVM_BUF_ARENA_BATCH 8			///< Blocks moved per refill
+
+/**
+ * How the memory of a chunk is obtained
+ */
+enum nvm_buf_arena_backing {
+	NVM_BUF_ARENA_HUGETLB = 0x0,	///< mmap of a hugepage
+	NVM_BUF_ARENA_VIRT = 0x1,	///< nvm_buf_virt_alloc, THP advised
+	NVM_BUF_ARENA_DMA = 0x2,	///< DMA allocation of the backend
+};
+
+/**
+ * A chunk is carved into blocks of a single size class, blocks are aligned to
+ * their size
+ */
+struct nvm_buf_arena_chunk {
+	char *base;
+	uint64_t phys;			///< Bus address of 'base', DMA backing
+	int backing;
+	int cls;			///< Size class, -1 when unassigned
+	size_t ncarved;			///< Blocks carved off the chunk
+	struct nvm_buf_arena_chunk *next;	///< Next unassigned chunk
+};
+
+/**
+ * Free blocks of the threads using the cache, blocks are linked through their
+ * first word
+ */
+struct nvm_buf_arena_cache {
+	pthread_mutex_t lock;
+	void *free[NVM_BUF_ARENA_NCLASSES];
+	size_t nfree[NVM_BUF_ARENA_NCLASSES];
+};
+
+struct nvm_buf_arena {
+	const struct nvm_dev *dev;
+	size_t align;			///< Alignment of nvm_buf_alloc
+
+	pthread_mutex_t lock;		///< Guards the members below
+	void *free[NVM_BUF_ARENA_NCLASSES];	///< Blocks flushed by caches
+	struct nvm_buf_arena_chunk *carve[NVM_BUF_ARENA_NCLASSES];
+	struct nvm_buf_arena_chunk *unassigned;
+	atomic_size_t nchunks;
+
+	struct nvm_buf_arena_chunk chunks[NVM_BUF_ARENA_NCHUNKS_MAX];
+
+	/// Chunk base to chunk index + 1, insert-only, read without the lock
+	_Atomic uintptr_t keys[2 * NVM_BUF_ARENA_NCHUNKS_MAX];
+	atomic_uint vals[2 * NVM_BUF_ARENA_NCHUNKS_MAX];
+
+	struct nvm_buf_arena_cache caches[NVM_BUF_ARENA_NCACHES];
+};
+
+/**
+ * Returns the chunk holding 'buf', NULL when 'buf' is not from the arena
+ */
+struct nvm_buf_arena_chunk *nvm_buf_arena_chunk(struct nvm_buf_arena *arena,
+						const void *buf);
+
+/**
+ * Returns the size of the block at 'buf' of 'chunk'
+ */
+size_t nvm_buf_arena_nbytes(const struct nvm_buf_arena_chunk *chunk);
+
+/**
+ * DMA allocation of the backend of 'dev', aligned to 'alignment', provided by
+ * nvm_buf.c for chunks
+ */
+void *nvm_buf_dma_alloc(const struct nvm_dev *dev, size_t nbytes,
+			size_t alignment, uint64_t *phys);
+
+void nvm_buf_dma_free(const struct nvm_dev *dev, void *buf);
+
+#endif /* __INTERNAL_NVM_BUF_ARENA_H */
@@ -0,0 +1,71 @@
+/*
+ * nvm_buf_scratch - Per-thread scratch buffers of a device (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_BUF_SCRATCH_H
+#define __INTERNAL_NVM_BUF_SCRATCH_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define NVM_BUF_SCRATCH_NSLOTS 16	///< Slots threads are spread over
+
+struct nvm_dev;
+
+/**
+ * A DMA buffer kept by the device between commands, it only grows
+ */
+struct nvm_buf_scratch_slot {
+	atomic_int busy;		///< 1 while a thread holds the slot
+	void *_Atomic buf;		///< Allocated by nvm_buf_alloc
+	size_t nbytes;			///< Size of 'buf'
+};
+
+struct nvm_buf_scratch {
+	struct nvm_buf_scratch_slot slots[NVM_BUF_SCRATCH_NSLOTS];
+};
+
+/**
+ * Hands out a DMA buffer of at least 'nbytes' for the duration of a command,
+ * return it with nvm_buf_scratch_put
+ *
+ * The calling thread tries its own slot first, then the others. When all are
+ * held, a buffer is allocated with nvm_buf_alloc and freed by put.
+ *
+ * @returns The buffer on success. On error: NULL and errno set accordingly.
+ */
+void *nvm_buf_scratch_get(struct nvm_dev *dev, size_t nbytes);
+
+/**
+ * Returns a buffer from nvm_buf_scratch_get, NULL is ignored
+ */
+void nvm_buf_scratch_put(struct nvm_dev *dev, void *buf);
+
+/**
+ * Frees the buffers of all slots, the slots must not be held
+ */
+void nvm_buf_scratch_term(struct nvm_dev *dev);
+
+#endif /* __INTERNAL_NVM_BUF_SCRATCH_H */
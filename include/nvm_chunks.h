@@ -0,0 +1,70 @@
+/*
+ * nvm_chunks - Wear- and state-aware chunk allocator (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_CHUNKS_H
+#define __INTERNAL_NVM_CHUNKS_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+#define NVM_CHUNKS_NBUCKETS 256		///< Wear buckets, by P/E cycles
+
+#define NVM_CHUNKS_NIL UINT32_MAX	///< End of a free list
+
+enum nvm_chunks_state {
+	NVM_CHUNKS_FREE = 0,		///< On a free list
+	NVM_CHUNKS_USED = 1,		///< Handed out, or in use on alloc
+	NVM_CHUNKS_BAD = 2,		///< Offline, bad, or retired
+};
+
+/**
+ * Free chunks of a parallel unit, one LIFO list per wear bucket and a bitmap of
+ * the non-empty buckets, such that the least worn chunk is found in O(1)
+ */
+struct nvm_chunks_pu {
+	atomic_flag lock;
+	uint32_t nfree;
+	uint64_t nonempty[NVM_CHUNKS_NBUCKETS / 64];
+	uint32_t heads[NVM_CHUNKS_NBUCKETS];
+};
+
+struct nvm_chunks {
+	struct nvm_dev *dev;
+	uint32_t ngrps;			///< # of groups/channels
+	uint32_t nunits;		///< # of parallel units/LUNs per group
+	uint32_t npus;			///< # of parallel units, 'ngrps * nunits'
+	uint32_t nchunk;		///< # of chunks/blocks per parallel unit
+	struct nvm_chunks_pu *pus;
+	uint32_t *next;			///< Free list links, by chunk id
+	uint16_t *ncycles;		///< P/E cycles since alloc, by chunk id
+	uint8_t *state;			///< enum nvm_chunks_state, by chunk id
+	_Atomic uint64_t *nonempty;	///< Parallel units with free chunks, a
+					///< bit per position in stripe order
+	atomic_uint cursor;		///< Parallel unit at which stripes start
+	atomic_uint nfree;
+};
+
+#endif /* __INTERNAL_NVM_CHUNKS_H */
@@ -30,6 +30,9 @@
 #define __INTERNAL_NVM_DEV_H
 
 #include <liblightnvm.h>
+#include <nvm_buf_scratch.h>
+
+struct nvm_rcache;
 
 struct nvm_dev {
 	int fd;				///< Device IOCTL handle
@@ -54,6 +57,14 @@ struct nvm_dev {
 		int write_naddrs_max;		///< Max # of addrs. vblk write
 		enum nvm_meta_mode meta_mode;	///< Pseudo-meta pattern
 	} vblk_opts;
+	struct {
+		int place;			///< Place buffers on 'node'
+		int node;			///< NUMA node local to the device
+		int hugepages;			///< Back buffers by hugepages
+		int arena;			///< Serve buffers from buf_arena
+	} buf_opts;
+	struct nvm_buf_arena *buf_arena;	///< See nvm_dev_set_buf_arena
+	struct nvm_buf_scratch buf_scratch;	///< Buffers of admin commands
 	int bbts_cached;		///< Whether to cache bbts
 	size_t nbbts;			///< Number of entries in cache
 	struct nvm_bbt **bbts;		///< Cache of bad-block-tables
@@ -61,6 +72,7 @@ struct nvm_dev {
 	struct nvm_be *be;		///< Backend interface
 	void *be_state;			///< Backend state
 	int cmd_opts;			///< Default options for CMD execution
+	struct nvm_rcache *rcache;	///< Read cache, see nvm_dev_set_rcache
 };
 
 #endif /* __INTERNAL_NVM_DEV_H */
@@ -0,0 +1,377 @@
+/*
+ * nvm_ftl - Host-side page-mapped FTL over OCSSD 2.0 lines (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_FTL_H
+#define __INTERNAL_NVM_FTL_H
+
+#include <stdatomic.h>
+#include <string.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+
+#define NVM_FTL_UNMAPPED UINT32_MAX	///< L2P/P2L entry without a mapping
+
+#define NVM_FTL_NLINES_OP_MIN 3		///< Minimum # of over-provisioned lines
+
+#define NVM_FTL_GC_NLINES_RSV 1		///< Free lines only the collector may open
+
+#define NVM_FTL_GC_SETTLE_YIELDS 10000	///< Yields awaiting racing invalidations
+
+#define NVM_FTL_READ_RETRIES 8		///< Re-reads of sectors moved under a read
+
+enum nvm_ftl_line_state {
+	NVM_FTL_LINE_FREE = 0,		///< Erased or to be erased on open
+	NVM_FTL_LINE_OPEN = 1,		///< Receiving writes
+	NVM_FTL_LINE_CLOSED = 2,	///< Every write-unit written
+	NVM_FTL_LINE_BAD = 3,		///< Failed to erase, not used
+	NVM_FTL_LINE_GC = 4,		///< Being reclaimed by the collector
+};
+
+/**
+ * Asynchronous write in flight on a chunk of a line, see _ftl_wunit_wait
+ */
+struct nvm_ftl_wowner {
+	atomic_uint rnd;		///< Round of the write + 1, 0 when none or
+					///< being recorded
+	struct nvm_async_ctx *_Atomic ctx;	///< Context of the write
+	pthread_t thread;		///< Thread which submitted it
+};
+
+/**
+ * A line is the chunk with index 'idx' on every parallel unit, written in
+ * 'ws_opt' sized write-units striped across the parallel units, sector 'v' of
+ * the line is sector 'v % ws_opt + (wunit / npus) * ws_opt' of the chunk on
+ * parallel unit 'wunit % npus', where 'wunit = v / ws_opt'
+ */
+struct nvm_ftl_line {
+	uint32_t idx;			///< Chunk index of the line
+	atomic_int state;		///< enum nvm_ftl_line_state
+	int erased;			///< Erased since last written
+	uint64_t seq;			///< Value of 'nclosed' when closed
+	atomic_uint wunit_next;		///< Next write-unit, of the collector line
+	atomic_uint nwunits_done;	///< # of write-units completed
+	atomic_uint nvalid;		///< # of valid sectors in the line
+	atomic_uint *wrnd;		///< Per-chunk # of write-units completed
+	struct nvm_ftl_wowner *wown;	///< Per-chunk async. write in flight
+	atomic_uint *cnk_nvalid;	///< Per-chunk # of valid sectors
+	_Atomic uint64_t *valid;	///< Per-chunk bitmap of valid sectors
+	_Atomic uint32_t *p2l;		///< LBA of every sector, in line order
+	char *_Atomic tail;		///< Write-units not yet readable, see
+					///< _ftl_tail_get
+};
+
+/**
+ * Host copy of the last 'tail_nwunits' write-units of every chunk of an open
+ * line, a sector can only be read from the device once 'mw_cunits' sectors
+ * are written after it
+ */
+struct nvm_ftl_tail {
+	char *buf;
+	struct nvm_ftl_line *owner;	///< Line it was last assigned to
+};
+
+struct ftl_gc_batch;
+
+/**
+ * State of the garbage collector, which relocates the valid sectors of closed
+ * lines and resets them for reuse
+ */
+struct nvm_ftl_gc {
+	pthread_mutex_t lock;		///< Serializes collection
+	int policy;			///< enum nvm_ftl_gc_policy
+	int copy;			///< Relocate by vector-copy, else read+write
+	int erase_async;		///< Reset lines on the async. context
+	uint64_t rate;			///< Max. sectors relocated per sec., 0 = any
+	double tokens;			///< Sectors which may be relocated now
+	uint64_t tokens_ts;		///< Time of the last refill, in nsec.
+	struct nvm_async_ctx *ctx;	///< NULL when the backend has no async.
+	struct nvm_ftl_line *line;	///< Line receiving relocated sectors
+	struct ftl_gc_batch *batches;	///< Double-buffered relocation batches
+	uint32_t nerasing;		///< # of lines with resets in flight
+	uint64_t nrelocated;		///< # of sectors relocated
+	uint64_t nreclaimed;		///< # of lines reclaimed
+};
+
+struct nvm_ftl {
+	struct nvm_dev *dev;
+	const struct nvm_geo *geo;
+	struct nvm_addr *pus;		///< Parallel units in line order
+	uint32_t npus;			///< # of parallel units, chunks in a line
+	uint32_t ws_opt;		///< # of sectors in a write-unit
+	uint32_t line_nsectr;		///< # of sectors in a line
+	uint32_t line_nwunits;		///< # of write-units in a line
+	uint32_t cnk_nwords;		///< # of words in a chunk bitmap
+	uint32_t cnk_nwunits;		///< # of write-units in a chunk
+	uint32_t mw_cunits;		///< # of sectors written before a read
+	uint32_t tail_nwunits;		///< # of write-units of a chunk in a tail
+	uint32_t wqueues;		///< # of pool queues for line writes
+	int scalar;			///< Device is addressed with scalar commands
+
+	uint32_t nlines;
+	struct nvm_ftl_line *lines;
+	struct nvm_ftl_tail *tails;	///< One per line at most, see free_lock
+
+	uint64_t nlbas;			///< # of LBAs exposed
+	_Atomic uint32_t *l2p;		///< Sector of every LBA, line * line_nsectr + v
+
+	pthread_mutex_t lock;		///< Serializes opening of write lines
+	pthread_mutex_t free_lock;	///< Protects the stack of free lines
+	uint32_t *free;			///< Stack of free lines
+	uint32_t nfree;
+	_Atomic uint64_t resv;		///< Open line << 32 | next write-unit
+	_Atomic uint64_t nclosed;	///< # of lines closed, the age of lines
+
+	struct nvm_ftl_gc gc;
+};
+
+static inline void _ftl_ppa2addr(const struct nvm_ftl *ftl, uint32_t ppa,
+				 struct nvm_addr *addr)
+{
+	const uint32_t line = ppa / ftl->line_nsectr;
+	const uint32_t v = ppa % ftl->line_nsectr;
+	const uint32_t wunit = v / ftl->ws_opt;
+
+	addr->val = ftl->pus[wunit % ftl->npus].val;
+	addr->l.chunk = ftl->lines[line].idx;
+	addr->l.sectr = (wunit / ftl->npus) * ftl->ws_opt + v % ftl->ws_opt;
+}
+
+static inline uint32_t _ftl_line_ppa(const struct nvm_ftl *ftl,
+				     const struct nvm_ftl_line *line,
+				     uint32_t v)
+{
+	return (line - ftl->lines) * ftl->line_nsectr + v;
+}
+
+static inline _Atomic uint64_t *_ftl_valid_word(const struct nvm_ftl *ftl,
+						 const struct nvm_ftl_line *line,
+						 uint32_t v, uint64_t *bit)
+{
+	const uint32_t wunit = v / ftl->ws_opt;
+	const uint32_t pu = wunit % ftl->npus;
+	const uint32_t sectr = (wunit / ftl->npus) * ftl->ws_opt + v % ftl->ws_opt;
+
+	*bit = 1ULL << (sectr % 64);
+
+	return &line->valid[pu * ftl->cnk_nwords + sectr / 64];
+}
+
+static inline int _ftl_is_valid(const struct nvm_ftl *ftl,
+				const struct nvm_ftl_line *line, uint32_t v)
+{
+	uint64_t bit;
+
+	return !!(atomic_load(_ftl_valid_word(ftl, line, v, &bit)) & bit);
+}
+
+/**
+ * Mark sector 'v' of 'line' as holding 'lba'
+ */
+static inline void _ftl_validate(struct nvm_ftl *ftl, struct nvm_ftl_line *line,
+				 uint32_t v, uint32_t lba)
+{
+	const uint32_t pu = (v / ftl->ws_opt) % ftl->npus;
+	_Atomic uint64_t *word;
+	uint64_t bit;
+
+	atomic_store_explicit(&line->p2l[v], lba, memory_order_relaxed);
+
+	word = _ftl_valid_word(ftl, line, v, &bit);
+	atomic_fetch_or(word, bit);
+	atomic_fetch_add(&line->cnk_nvalid[pu], 1);
+	atomic_fetch_add(&line->nvalid, 1);
+}
+
+/**
+ * Mark the sector 'ppa' as no longer holding 'lba', unless the line was
+ * reclaimed and the sector now holds another LBA
+ */
+static inline void _ftl_invalidate(struct nvm_ftl *ftl, uint32_t ppa,
+				   uint32_t lba)
+{
+	struct nvm_ftl_line *line = &ftl->lines[ppa / ftl->line_nsectr];
+	const uint32_t v = ppa % ftl->line_nsectr;
+	const uint32_t pu = (v / ftl->ws_opt) % ftl->npus;
+	_Atomic uint64_t *word;
+	uint64_t bit;
+
+	if (atomic_load_explicit(&line->p2l[v], memory_order_relaxed) != lba)
+		return;
+
+	word = _ftl_valid_word(ftl, line, v, &bit);
+	if (!(atomic_fetch_and(word, ~bit) & bit))
+		return;
+
+	atomic_fetch_sub(&line->cnk_nvalid[pu], 1);
+	atomic_fetch_sub(&line->nvalid, 1);
+}
+
+/**
+ * Whether sector 'i' of round 'rnd' of a chunk with 'wrnd' write-units
+ * written can be read from the device
+ */
+static inline int _ftl_readable(const struct nvm_ftl *ftl, uint32_t wrnd,
+				uint32_t rnd, uint32_t i)
+{
+	return (wrnd == ftl->cnk_nwunits) ||
+	       ((uint64_t)wrnd * ftl->ws_opt >=
+		(uint64_t)rnd * ftl->ws_opt + i + 1 + ftl->mw_cunits);
+}
+
+static inline char *_ftl_tail_slot(const struct nvm_ftl *ftl, char *tail,
+				   uint32_t wunit)
+{
+	const uint32_t pu = wunit % ftl->npus;
+	const uint32_t rnd = wunit / ftl->npus;
+
+	return tail + ((size_t)pu * ftl->tail_nwunits +
+		       rnd % ftl->tail_nwunits) * ftl->ws_opt *
+		      ftl->geo->l.nbytes;
+}
+
+/**
+ * Keep the data of 'wunit' of 'line' in its tail, called once the write-units
+ * before it on the chunk are written, as that is when the slot it reuses
+ * holds a readable write-unit
+ */
+static inline void _ftl_tail_put(const struct nvm_ftl *ftl,
+				 struct nvm_ftl_line *line, uint32_t wunit,
+				 const char *data)
+{
+	char *tail = atomic_load(&line->tail);
+
+	if (tail)
+		memcpy(_ftl_tail_slot(ftl, tail, wunit), data,
+		       ftl->ws_opt * ftl->geo->l.nbytes);
+}
+
+/**
+ * Copy sector 'ppa' to 'buf' when the device cannot serve it yet
+ *
+ * The slot is checked again after the copy, it is only reused, by the line or
+ * by another line, once the sector is readable from the device.
+ *
+ * @return 1 when 'buf' holds the sector, 0 when it must be read from the device
+ */
+static inline int _ftl_tail_get(const struct nvm_ftl *ftl, uint32_t ppa,
+				char *buf)
+{
+	const struct nvm_ftl_line *line = &ftl->lines[ppa / ftl->line_nsectr];
+	const uint32_t v = ppa % ftl->line_nsectr;
+	const uint32_t wunit = v / ftl->ws_opt;
+	const uint32_t pu = wunit % ftl->npus;
+	const uint32_t rnd = wunit / ftl->npus;
+	const uint32_t i = v % ftl->ws_opt;
+	const size_t nbytes = ftl->geo->l.nbytes;
+	char *tail = atomic_load(&line->tail);
+
+	if (!tail || _ftl_readable(ftl, atomic_load(&line->wrnd[pu]), rnd, i))
+		return 0;
+
+	memcpy(buf, _ftl_tail_slot(ftl, tail, wunit) + i * nbytes, nbytes);
+	atomic_thread_fence(memory_order_acquire);
+
+	return !_ftl_readable(ftl, atomic_load(&line->wrnd[pu]), rnd, i);
+}
+
+/**
+ * Let the next write-unit of the chunk of 'wunit' go, called once the write of
+ * 'wunit' has completed, or failed to submit
+ */
+static inline void _ftl_wunit_completed(const struct nvm_ftl *ftl,
+					struct nvm_ftl_line *line,
+					uint32_t wunit)
+{
+	atomic_fetch_add(&line->wrnd[wunit % ftl->npus], 1);
+}
+
+static inline void _ftl_wunit_done(struct nvm_ftl *ftl,
+				   struct nvm_ftl_line *line)
+{
+	if (atomic_fetch_add(&line->nwunits_done, 1) + 1 != ftl->line_nwunits)
+		return;
+
+	line->seq = atomic_fetch_add(&ftl->nclosed, 1);
+	atomic_store(&line->state, NVM_FTL_LINE_CLOSED);
+}
+
+static inline void _ftl_wunit_addrs(const struct nvm_ftl *ftl,
+				    const struct nvm_ftl_line *line,
+				    uint32_t wunit, struct nvm_addr addrs[])
+{
+	const uint32_t rnd = wunit / ftl->npus;
+
+	for (uint32_t i = 0; i < ftl->ws_opt; ++i) {
+		addrs[i].val = ftl->pus[wunit % ftl->npus].val;
+		addrs[i].l.chunk = line->idx;
+		addrs[i].l.sectr = rnd * ftl->ws_opt + i;
+	}
+}
+
+/**
+ * Pop a line of the free stack, leaving 'nrsv' lines on it
+ *
+ * @return The line, or NULL when no more than 'nrsv' lines are free
+ */
+struct nvm_ftl_line *nvm_ftl_line_pop(struct nvm_ftl *ftl, uint32_t nrsv);
+
+/**
+ * Push a reset line on the free stack
+ */
+void nvm_ftl_line_push(struct nvm_ftl *ftl, struct nvm_ftl_line *line);
+
+/**
+ * Reset the bookkeeping of 'line'
+ */
+void nvm_ftl_line_init(struct nvm_ftl *ftl, struct nvm_ftl_line *line);
+
+/**
+ * Erase the chunks of 'line', in parallel on the worker-pool
+ */
+int nvm_ftl_line_erase(struct nvm_ftl *ftl, struct nvm_ftl_line *line);
+
+/**
+ * Prepare a popped line for writing, erasing it unless already erased
+ *
+ * @return On success, 0 is returned. On error, the line is marked bad, -1 is
+ * returned and `errno` set to indicate the error.
+ */
+int nvm_ftl_line_open(struct nvm_ftl *ftl, struct nvm_ftl_line *line);
+
+int nvm_ftl_gc_init(struct nvm_ftl *ftl);
+
+void nvm_ftl_gc_term(struct nvm_ftl *ftl);
+
+/**
+ * Reclaim lines until more than NVM_FTL_GC_NLINES_RSV lines are free, ignoring
+ * the rate-limit, as writers are waiting for a line
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to ENOSPC when no line can be reclaimed.
+ */
+int nvm_ftl_gc_forced(struct nvm_ftl *ftl);
+
+#endif /* __INTERNAL_NVM_FTL_H */
@@ -0,0 +1,68 @@
+/*
+ * nvm_mvblk - Virtual block striped across devices (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_MVBLK_H
+#define __INTERNAL_NVM_MVBLK_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+#define NVM_MVBLK_NVBLKS_MAX 32		///< Max. # of members of a mvblk
+
+/**
+ * A member of a multi-device vblk, with its own async context
+ */
+struct nvm_mvblk_member {
+	struct nvm_vblk *vblk;
+	struct nvm_async_ctx *ctx;
+	struct nvm_ret *rets;		///< A ret per command of a batch
+	uint32_t batch;			///< # of commands between waits
+};
+
+struct nvm_mvblk {
+	struct nvm_mvblk_member members[NVM_MVBLK_NVBLKS_MAX];
+	int nmembers;
+	size_t unit_nbytes;		///< Bytes of the ws_opt interleave unit
+	size_t nbytes;
+	size_t pos_write;
+	size_t pos_read;
+};
+
+/**
+ * A read or write of a mvblk, one pool item per member, the completions of
+ * all members are aggregated in 'nerr'
+ */
+struct nvm_mvblk_job {
+	struct nvm_mvblk *mvblk;
+	char *buf;
+	int pad;			///< Whether 'buf' is a padding unit
+	size_t bgn;			///< First unit of the request
+	size_t end;			///< End unit, exclusive
+	int write;
+	atomic_size_t nerr;
+};
+
+#endif /* __INTERNAL_NVM_MVBLK_H */
@@ -0,0 +1,62 @@
+/*
+ * nvm_numa - NUMA placement of buffers and threads (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_NUMA_H
+#define __INTERNAL_NVM_NUMA_H
+
+#include <liblightnvm.h>
+
+#define NVM_NUMA_NODES_MAX 1024
+
+/**
+ * Determine the NUMA node local to the device, from sysfs via the block device
+ * for the IOCTL/LBD backends, and via the PCI address of the transport
+ * identifier for the SPDK/NOCD backends
+ *
+ * @return The node on success, -1 when it cannot be determined
+ */
+int nvm_numa_dev_node(const struct nvm_dev *dev, const char *dev_ident);
+
+/**
+ * Retrieve the list of CPUs local to the given NUMA node, in the format of
+ * `taskset -c` e.g. "0-7,16-23"
+ *
+ * @return On success, 0 is returned. On error, -1 and `errno` set to indicate
+ * the error.
+ */
+int nvm_numa_node_cpus(int node, char *cpus, size_t len);
+
+/**
+ * Prefer the given NUMA node for the pages backing the buffer, pages already
+ * faulted in are migrated, a negative node leaves placement as is. With
+ * 'hugepages' set, the range is advised for transparent hugepages.
+ *
+ * @return On success, 0 is returned. On error, -1 and `errno` set to indicate
+ * the error.
+ */
+int nvm_numa_buf_place(void *buf, size_t nbytes, int node, int hugepages);
+
+#endif /* __INTERNAL_NVM_NUMA_H */
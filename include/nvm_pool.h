@@ -0,0 +1,74 @@
+/*
+ * nvm_pool - Persistent worker-pool for parallel command submission (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_POOL_H
+#define __INTERNAL_NVM_POOL_H
+
+#include <liblightnvm.h>
+
+#define NVM_POOL_NQUEUES_MAX 128	///< Maximum number of queues of a job
+
+#define NVM_POOL_ORDERED 0x1		///< Items in a queue run in order
+
+/**
+ * Function executed for every item of a job
+ *
+ * @return 0 on success, non-zero on error
+ */
+typedef int (*nvm_pool_func)(void *arg, size_t item);
+
+/**
+ * Execute 'func' for every item in [0, nitems) on the worker-pool and wait for
+ * completion
+ *
+ * Items are spread over 'nqueues' queues, item 'i' going to queue
+ * 'i % nqueues', callers map a queue to a parallel unit e.g. a chunk of a
+ * virtual block. Every participant drains its home queue and then steals from
+ * the queues of others. With NVM_POOL_ORDERED a queue is claimed as a whole,
+ * such that the items in it execute in order on a single thread.
+ *
+ * The calling thread takes part in the job, at most 'nthreads' threads, caller
+ * included, work on it. Several jobs are posted to the workers at once, a job
+ * submitted while all job slots are taken waits for one. Jobs with a single
+ * thread or queue, and jobs submitted from within a job while the slots are
+ * taken, execute on the caller.
+ *
+ * Built without NVM_POOL_ENABLED the job runs as an OpenMP parallel-for.
+ *
+ * @return On success, the number of items for which 'func' failed. On error, -1
+ * and `errno` set to indicate the error.
+ */
+ssize_t nvm_pool_run(nvm_pool_func func, void *arg, size_t nitems,
+		     size_t nqueues, int nthreads, int flags);
+
+/**
+ * Hint the CPUs local to a device in use, the workers are pinned to them
+ * unless an affinity is configured via nvm_pool_conf() or NVM_POOL_CPUS. Only
+ * the first hint before the pool starts takes effect.
+ */
+void nvm_pool_hint_cpus(const char *cpus);
+
+#endif /* __INTERNAL_NVM_POOL_H */
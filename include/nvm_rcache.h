@@ -0,0 +1,98 @@
+/*
+ * nvm_rcache - Read cache of recently written sectors (internal)
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_RCACHE_H
+#define __INTERNAL_NVM_RCACHE_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+#define NVM_RCACHE_NSLOTS_DEF 4		///< Chunks per PU when maxocpu is 0
+#define NVM_RCACHE_NSLOTS_MAX 16	///< Upper bound on chunks per PU
+
+/**
+ * The last 'mw_cunits' sectors written to an open chunk, sector 'sectr' is
+ * held at 'sectr % mw_cunits' of 'data'
+ */
+struct nvm_rcache_cnk {
+	int used;
+	struct nvm_addr addr;		///< Chunk address, sector zero
+	uint32_t bgn;			///< First sector of the sequential run
+	uint32_t wp;			///< Sector following the last written
+	uint64_t stamp;			///< Time of the last write, for eviction
+	char *data;
+};
+
+struct nvm_rcache_pu {
+	atomic_flag lock;
+	uint64_t stamp;
+	struct nvm_rcache_cnk cnks[NVM_RCACHE_NSLOTS_MAX];
+};
+
+struct nvm_rcache {
+	uint32_t npus;			///< # of parallel units
+	uint32_t npunit;		///< # of parallel units per group
+	uint32_t nsectr;		///< # of sectors per chunk
+	uint32_t mw_cunits;		///< # of sectors held per chunk
+	uint32_t nslots;		///< # of chunks held per parallel unit
+	size_t sectr_nbytes;
+	_Atomic uint64_t nhits;		///< # of sectors served
+	struct nvm_rcache_pu *pus;
+};
+
+/**
+ * Allocate a read cache for 'dev', only 2.0 devices with a non-zero
+ * 'mw_cunits' are supported
+ *
+ * @return On success, the cache. On error, NULL and `errno` set.
+ */
+struct nvm_rcache *nvm_rcache_alloc(const struct nvm_dev *dev);
+
+void nvm_rcache_free(struct nvm_rcache *rcache);
+
+/**
+ * Record the data of a write command, 'data' is NULL when the data is not
+ * available to the host, e.g. an SGL or copy, the chunks are then dropped
+ */
+void nvm_rcache_write(struct nvm_rcache *rcache, struct nvm_addr addrs[],
+		      int naddrs, int scalar, const void *data);
+
+/**
+ * Drop the chunks of an erase command
+ */
+void nvm_rcache_erase(struct nvm_rcache *rcache, struct nvm_addr addrs[],
+		      int naddrs, int scalar);
+
+/**
+ * Read, serving the sectors held by the cache from memory and the rest from
+ * the device
+ *
+ * @return As nvm_cmd_read
+ */
+int nvm_rcache_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		    int scalar, void *data, uint16_t flags, struct nvm_ret *ret);
+
+#endif /* __INTERNAL_NVM_RCACHE_H */
@@ -29,22 +29,73 @@
 #ifndef __INTERNAL_NVM_SGL_H
 #define __INTERNAL_NVM_SGL_H
 
+#include <stdatomic.h>
 #include <nvm_dev.h>
 
-#include <bsd/sys/queue.h>
+#define NVM_SGL_SEG_NBYTES 4096		///< A segment is a page of descriptors
+#define NVM_SGL_SEG_NDESCR (NVM_SGL_SEG_NBYTES / \
+			    sizeof(struct nvm_nvme_sgl_descriptor))
+#define NVM_SGL_SEG_NDATA (NVM_SGL_SEG_NDESCR - 1)	///< Last one links
 
+#define NVM_SGL_VTOP_NBYTES (2 * 1024 * 1024)	///< Translations per hugepage
+#define NVM_SGL_PAGE_NBYTES 4096	///< Translations per page, other memory
+#define NVM_SGL_VTOP_NENTRIES 8		///< Translations cached per SGL
+
+#define NVM_SGL_POOL_NSLOTS 4096	///< SGLs kept by a pool at most
+
+/**
+ * A segment of an SGL, a physically contiguous list of descriptors
+ */
+struct nvm_sgl_seg {
+	struct nvm_nvme_sgl_descriptor *descr;	///< NVM_SGL_SEG_NDESCR entries
+	uint64_t phys;				///< Bus address of 'descr'
+};
+
+/**
+ * Cached translation of the page at 'page', a hugepage for DMA memory of the
+ * SPDK backend, see sgl_vtop_nbytes
+ */
+struct nvm_sgl_vtop {
+	uintptr_t page;
+	uint64_t phys;
+};
+
+/**
+ * Data descriptor 'i' is entry 'i % NVM_SGL_SEG_NDATA' of segment
+ * 'i / NVM_SGL_SEG_NDATA', the last entry of a full segment links to the next
+ * one, see nvm_sgl_dptr
+ */
 struct nvm_sgl {
-	struct nvm_nvme_sgl_descriptor *indirect, *descriptors;
-	int ndescr, nalloc;
+	struct nvm_nvme_sgl_descriptor *indirect;	///< For NVM_CMD_SGL_META
+	uint64_t indirect_phys;
+	struct nvm_sgl_seg *segs;
+	int nsegs;			///< Segments allocated, may exceed use
+	int ndescr;			///< Data descriptors
 	size_t len;
 
-	SLIST_ENTRY(nvm_sgl) free_list;
+	struct nvm_sgl_vtop vtop[NVM_SGL_VTOP_NENTRIES];
+
+	struct nvm_sgl_pool *pool;	///< Pool holding the SGL, if any
+	uint32_t pool_idx;		///< Slot of the SGL in the pool
+	_Atomic uint32_t pool_next;	///< Next free slot + 1, 0 = none
 };
 
+/**
+ * The free SGLs of a pool form a lock-free stack of slot indexes, the head
+ * carries a tag in its upper 32 bits which is bumped by every update, such
+ * that a pop racing with a pop and push of the same SGL fails its CAS
+ */
 struct nvm_sgl_pool {
 	struct nvm_dev *dev;
-
-	SLIST_HEAD(, nvm_sgl) free_list;
+	_Atomic uint64_t head;		///< Tag << 32 | free slot + 1
+	atomic_uint nslots;		///< Slots taken
+	struct nvm_sgl *_Atomic slots[NVM_SGL_POOL_NSLOTS];
 };
 
+/**
+ * Fill 'dptr' with the descriptor addressing the SGL from a command, writing
+ * the links between its segments
+ */
+void nvm_sgl_dptr(struct nvm_sgl *sgl, struct nvm_nvme_sgl_descriptor *dptr);
+
 #endif /* __INTERNAL_NVM_SGL_H */
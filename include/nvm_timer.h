@@ -30,21 +30,129 @@
 #ifndef __INTERNAL_NVM_TIMER_H
 #define __INTERNAL_NVM_TIMER_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define NVM_TIMER_TSC_ENABLED
+#endif
 
-inline uint64_t _clock_sample(void)
+/**
+ * State of the time-stamp-counter (TSC) clock source
+ */
+enum nvm_timer_tsc_state {
+	NVM_TIMER_TSC_UNCALIBRATED = 0,	///< Calibration has not run yet
+	NVM_TIMER_TSC_INVARIANT = 1,	///< Ticks are TSC cycles
+	NVM_TIMER_TSC_FALLBACK = -1,	///< Ticks are CLOCK_MONOTONIC nsecs
+};
+
+/**
+ * Calibration of the TSC, shared by all timers, 'state' is stored with
+ * release semantics once the other fields are set
+ */
+struct nvm_timer_tsc {
+	atomic_int state;	///< One of `enum nvm_timer_tsc_state`
+	double nsecs_per_tick;	///< Conversion factor from ticks to nsecs
+	uint64_t hz;		///< Ticks per second
+};
+
+extern struct nvm_timer_tsc nvm_timer_tsc;
+
+/**
+ * Calibrate the TSC against CLOCK_MONOTONIC, this is done once, lazily, by the
+ * first timer conversion. Falls back to CLOCK_MONOTONIC when the CPU lacks an
+ * invariant TSC or when the environment variable NVM_TIMER_NOTSC is set.
+ * Concurrent callers wait for the one calibrating.
+ *
+ * @return The resulting `enum nvm_timer_tsc_state`
+ */
+int nvm_timer_tsc_calibrate(void);
+
+/**
+ * The state of the TSC, calibrating it on first use
+ */
+static inline int _tsc_state(void)
+{
+	const int state = atomic_load_explicit(&nvm_timer_tsc.state,
+					       memory_order_acquire);
+
+	if (state == NVM_TIMER_TSC_UNCALIBRATED)
+		return nvm_timer_tsc_calibrate();
+
+	return state;
+}
+
+static inline uint64_t _clock_monotonic(void)
 {
 	struct timespec ts;
 
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	return ts.tv_nsec + ts.tv_sec * 1e9;
+	return ts.tv_nsec + ts.tv_sec * 1000000000ULL;
+}
+
+/**
+ * Sample the clock source, without serialization, at the start of a measurement
+ *
+ * @returns clock sample in ticks
+ */
+static inline uint64_t nvm_timer_ticks(void)
+{
+#ifdef NVM_TIMER_TSC_ENABLED
+	if (atomic_load_explicit(&nvm_timer_tsc.state, memory_order_relaxed) ==
+	    NVM_TIMER_TSC_INVARIANT)
+		return __rdtsc();
+#endif
+	return _clock_monotonic();
+}
+
+/**
+ * Sample the clock source at the end of a measurement, waits for preceding
+ * instructions to retire such that they are included in the measurement
+ *
+ * @returns clock sample in ticks
+ */
+static inline uint64_t nvm_timer_ticks_end(void)
+{
+#ifdef NVM_TIMER_TSC_ENABLED
+	if (atomic_load_explicit(&nvm_timer_tsc.state, memory_order_relaxed) ==
+	    NVM_TIMER_TSC_INVARIANT) {
+		unsigned int aux;
+
+		return __rdtscp(&aux);
+	}
+#endif
+	return _clock_monotonic();
+}
+
+/**
+ * Convert the given number of ticks to nanoseconds
+ *
+ * @returns nanoseconds as a floating point number
+ */
+static inline double nvm_timer_ticks2nsecs(uint64_t ticks)
+{
+	_tsc_state();
+
+	return ticks * nvm_timer_tsc.nsecs_per_tick;
+}
+
+/**
+ * Sample the clock source
+ *
+ * @returns clock sample in nano seconds.
+ */
+static inline uint64_t _clock_sample(void)
+{
+	_tsc_state();
+
+	return nvm_timer_ticks2nsecs(nvm_timer_ticks());
 }
 
 /*
- * A simple timer.
+ * A simple timer, 'start' and 'stop' are in ticks of the clock source
  */
 struct nvm_timer {
 	uint64_t start;
@@ -54,33 +162,45 @@ struct nvm_timer {
 /**
  * Start a timer.
  *
- * @returns clock sample in nano seconds.
+ * @returns clock sample in ticks.
  */
-inline uint64_t nvm_timer_start(struct nvm_timer *t)
+static inline uint64_t nvm_timer_start(struct nvm_timer *t)
 {
-	t->start = _clock_sample();
+	_tsc_state();
+
+	t->start = nvm_timer_ticks();
 	return t->start;
 }
 
 /**
  * Stop a timer.
  *
- * @returns clock sample in nano seconds.
+ * @returns clock sample in ticks.
  */
-inline uint64_t nvm_timer_stop(struct nvm_timer *t)
+static inline uint64_t nvm_timer_stop(struct nvm_timer *t)
 {
-	t->stop = _clock_sample();
+	t->stop = nvm_timer_ticks_end();
 	return t->stop;
 }
 
+/**
+ * Get the elapsed time in nanoseconds.
+ *
+ * @returns elapsed time in nanoseconds.
+ */
+static inline uint64_t nvm_timer_elapsed_nsecs(struct nvm_timer *t)
+{
+	return nvm_timer_ticks2nsecs(t->stop - t->start);
+}
+
 /**
  * Get the elapsed time in seconds.
  *
  * @returns elapsed time in seconds as a floating point number.
  */
-inline double nvm_timer_elapsed_secs(struct nvm_timer *t)
+static inline double nvm_timer_elapsed_secs(struct nvm_timer *t)
 {
-	return (t->stop - t->start) / (double)1e9;
+	return nvm_timer_ticks2nsecs(t->stop - t->start) / (double)1e9;
 }
 
 /**
@@ -88,7 +208,7 @@ inline double nvm_timer_elapsed_secs(struct nvm_timer *t)
  *
  * @returns elapsed time in seconds as a floating point number.
  */
-inline double nvm_timer_elapsed(struct nvm_timer *t)
+static inline double nvm_timer_elapsed(struct nvm_timer *t)
 {
 	return nvm_timer_elapsed_secs(t);
 }
@@ -98,9 +218,9 @@ inline double nvm_timer_elapsed(struct nvm_timer *t)
  *
  * @returns elapsed time in milliseconds as a floating point number.
  */
-inline double nvm_timer_elapsed_msecs(struct nvm_timer *t)
+static inline double nvm_timer_elapsed_msecs(struct nvm_timer *t)
 {
-	return (t->stop - t->start) / (double)1e6;
+	return nvm_timer_ticks2nsecs(t->stop - t->start) / (double)1e6;
 }
 
 /**
@@ -108,25 +228,15 @@ inline double nvm_timer_elapsed_msecs(struct nvm_timer *t)
  *
  * @returns elapsed time in microseconds as a floating point number.
  */
-inline double nvm_timer_elapsed_usecs(struct nvm_timer *t)
-{
-	return (t->stop - t->start) / (double)1e3;
-}
-
-/**
- * Get the elapsed time in nanoseconds.
- *
- * @returns elapsed time in nanoseconds.
- */
-inline uint64_t nvm_timer_elapsed_nsecs(struct nvm_timer *t)
+static inline double nvm_timer_elapsed_usecs(struct nvm_timer *t)
 {
-	return t->stop - t->start;
+	return nvm_timer_ticks2nsecs(t->stop - t->start) / (double)1e3;
 }
 
 /**
  * Print the elapsed time in seconds as a floating point number.
  */
-inline void nvm_timer_pr(struct nvm_timer *t, const char *prefix)
+static inline void nvm_timer_pr(struct nvm_timer *t, const char *prefix)
 {
 	printf("%s: {elapsed: %lf}\n", prefix, nvm_timer_elapsed(t));
 }
@@ -134,7 +244,8 @@ inline void nvm_timer_pr(struct nvm_timer *t, const char *prefix)
 /**
  * Print the elapsed time in seconds and the associated data rate in MB/s.
  */
-inline void nvm_timer_bw_pr(struct nvm_timer *t, const char *prefix, size_t nbytes)
+static inline void nvm_timer_bw_pr(struct nvm_timer *t, const char *prefix,
+				   size_t nbytes)
 {
 	double secs = nvm_timer_elapsed_secs(t);
 	double mb = nbytes / (double)1048576;
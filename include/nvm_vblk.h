@@ -29,8 +29,30 @@
 #ifndef __INTERNAL_NVM_VBLK_H
 #define __INTERNAL_NVM_VBLK_H
 
+#include <stdatomic.h>
+#include <pthread.h>
 #include <liblightnvm.h>
 
+/**
+ * Host-side state of appends to a chunk of a virtual block
+ */
+struct nvm_vblk_append {
+	atomic_uint wp;			///< Next sector to reserve
+	atomic_uint wp_submitted;	///< Sectors written, in order
+	atomic_int failed;		///< A write failed, the chunk takes no more
+	pthread_mutex_t lock;		///< Guards updates of wp_submitted
+	pthread_cond_t turn;		///< Signalled when wp_submitted moves
+};
+
+/**
+ * State of a window of the read-ahead ring, see nvm_vblk_set_readahead
+ */
+enum nvm_vblk_ra_state {
+	NVM_VBLK_RA_EMPTY = 0,		///< Not read
+	NVM_VBLK_RA_BUSY = 1,		///< Read request in flight
+	NVM_VBLK_RA_FULL = 2,		///< Holds the data of its stripe
+};
+
 struct nvm_vblk {
 	struct nvm_dev *dev;
 	struct nvm_addr blks[128];
@@ -43,6 +65,54 @@ struct nvm_vblk {
 	struct nvm_async_ctx *async_ctx;
 	struct nvm_ret **rets;
 	uint32_t retsp;
+	char *wbuf;			///< Write buffer, see nvm_vblk_set_wbuf
+	size_t wbuf_nbytes;		///< Capacity of the write buffer
+	size_t wbuf_len;		///< Bytes held, not yet written
+	int parity;			///< Whether a chunk per stripe is parity
+	atomic_int parity_degraded;	///< Failed chunk + 1, 0 when none
+	atomic_uint append_cursor;	///< Chunk at which appends start
+	struct nvm_vblk_append append[128];
+	struct nvm_vblk_req *reqs_stalled;	///< Requests awaiting room
+	struct nvm_vblk_req *reqs_write;	///< Write requests, oldest first
+	size_t nreqs;			///< Requests in flight
+	uint8_t chunk_busy[128];	///< A request write is in flight
+	uint8_t chunk_failed[128];	///< A request write failed, until erased
+	char *ra_buf;			///< Read-ahead ring, see nvm_vblk_set_readahead
+	size_t ra_win;			///< Bytes per window of the ring, a stripe
+	int ra_nwins;			///< Windows of the ring, 0 when disabled
+	int ra_head;			///< Window holding the lowest offset
+	size_t ra_off;			///< Offset of the head, SIZE_MAX when dropped
+	size_t ra_next;			///< Position at which a read is sequential
+	int ra_nseq;			///< Sequential reads in a row
+	uint8_t ra_state[NVM_VBLK_RA_NSTRIPES_MAX];
+	struct nvm_vblk_req *ra_reqs[NVM_VBLK_RA_NSTRIPES_MAX];
+};
+
+/**
+ * Request-level asynchronous I/O, see nvm_vblk_pwrite_async
+ *
+ * Stripe 's' of the request is stripe 'stripe_bgn + s' of the vblk. Writes to
+ * a chunk are chained, one in flight at a time and the oldest request first,
+ * the next is submitted by the completion of the one before it. Reads are
+ * submitted in order as the queue has room.
+ */
+struct nvm_vblk_req {
+	struct nvm_vblk *vblk;
+	int write;
+	char *buf;
+	size_t stripe_bgn;
+	size_t nstripes;
+	size_t nsubmitted;		///< Reads: next stripe to submit
+	size_t ncompleted;
+	size_t nerr;
+	int done;
+	int stalled;			///< On vblk->reqs_stalled
+	struct nvm_vblk_req *next;
+	struct nvm_vblk_req *wnext;	///< Next on vblk->reqs_write
+	nvm_vblk_req_cb cb;
+	void *cb_arg;
+	size_t *chunk_next;		///< Writes: next stripe per chunk
+	struct nvm_ret *rets;		///< Per stripe
 };
 
 struct nvm_vblk_async_cb_state {
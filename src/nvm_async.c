@@ -27,37 +27,511 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
 #include <liblightnvm.h>
 #include <nvm_be.h>
 #include <nvm_dev.h>
+#include <nvm_timer.h>
 #include <nvm_async.h>
 
+// Status of a command which the backend refused: Internal Error, DNR
+#define NVM_ASYNC_STATUS_SUBMIT (0x06 | (0x1 << 14))
+
+// Bounds of the polling period and of the sleeps of the hybrid wait
+#define NVM_ASYNC_SPIN_NSECS_MIN 1000ULL
+#define NVM_ASYNC_SPIN_NSECS_DEF 20000ULL
+#define NVM_ASYNC_SPIN_NSECS_MAX 200000ULL
+#define NVM_ASYNC_SLEEP_NSECS_MIN 10000ULL
+#define NVM_ASYNC_SLEEP_NSECS_MAX 1000000ULL
+// Sleeping on the eventfd, guards against a wakeup consumed by another reaper
+#define NVM_ASYNC_SLEEP_MSECS_EFD 100
+
+static int async_ring_dispatch(struct nvm_dev *dev, struct nvm_async_cmd *cmd)
+{
+	switch (cmd->op) {
+	case NVM_ASYNC_OP_ERASE:
+		return cmd->opt == NVM_CMD_SCALAR ?
+			dev->be->scalar_erase(dev, cmd->addrs, cmd->naddrs,
+					      cmd->flags, cmd->ret) :
+			dev->be->vector_erase(dev, cmd->addrs, cmd->naddrs,
+					      cmd->meta, cmd->flags, cmd->ret);
+	case NVM_ASYNC_OP_WRITE:
+		return cmd->opt == NVM_CMD_SCALAR ?
+			dev->be->scalar_write(dev, cmd->addrs[0], cmd->naddrs,
+					      cmd->data, cmd->meta, cmd->flags,
+					      cmd->ret) :
+			dev->be->vector_write(dev, cmd->addrs, cmd->naddrs,
+					      cmd->data, cmd->meta, cmd->flags,
+					      cmd->ret);
+	case NVM_ASYNC_OP_READ:
+		return cmd->opt == NVM_CMD_SCALAR ?
+			dev->be->scalar_read(dev, cmd->addrs[0], cmd->naddrs,
+					     cmd->data, cmd->meta, cmd->flags,
+					     cmd->ret) :
+			dev->be->vector_read(dev, cmd->addrs, cmd->naddrs,
+					     cmd->data, cmd->meta, cmd->flags,
+					     cmd->ret);
+	case NVM_ASYNC_OP_COPY:
+		return dev->be->vector_copy(dev, cmd->addrs, cmd->dst,
+					    cmd->naddrs, cmd->flags, cmd->ret);
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+static inline int async_ring_pending(struct nvm_async_ring *ring)
+{
+	const size_t tail = atomic_load(&ring->tail);
+
+	return atomic_load(&ring->slots[tail & ring->mask].seq) == tail + 1;
+}
+
+/**
+ * Submit the queued commands to the backend, the caller holds 'ring->lock'
+ *
+ * The reservation on 'nreserved' bounds the commands in the backend by the
+ * depth of the context, thus the backend does not return EAGAIN. Commands it
+ * refuses otherwise are completed with NVM_ASYNC_STATUS_SUBMIT.
+ */
+static void async_ring_drain(struct nvm_dev *dev, struct nvm_async_ring *ring)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	while (1) {
+		struct nvm_async_slot *slot = &ring->slots[tail & ring->mask];
+
+		if (atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+		    tail + 1)
+			break;
+
+		if (async_ring_dispatch(dev, &slot->cmd)) {
+			NVM_DEBUG("FAILED: async_ring_dispatch, errno: %d",
+				  errno);
+			slot->cmd.ret->status = NVM_ASYNC_STATUS_SUBMIT;
+			ring->failed[ring->nfailed++] = slot->cmd.ret;
+		}
+
+		atomic_store_explicit(&slot->seq, tail + ring->mask + 1,
+				      memory_order_release);
+		atomic_store(&ring->tail, ++tail);
+	}
+}
+
+/**
+ * Release 'ring->lock', draining commands queued by submitters which found
+ * the lock taken
+ */
+static void async_ring_unlock(struct nvm_dev *dev, struct nvm_async_ring *ring)
+{
+	while (1) {
+		atomic_flag_clear(&ring->lock);
+
+		if (!async_ring_pending(ring))
+			break;
+		if (atomic_flag_test_and_set(&ring->lock))
+			break;	// The new holder drains
+
+		async_ring_drain(dev, ring);
+	}
+}
+
+int nvm_async_ring_submit(struct nvm_dev *dev, int op, int opt,
+			  struct nvm_addr addrs[], struct nvm_addr dst[],
+			  int naddrs, const void *data, const void *meta,
+			  uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_async_ctx *ctx = ret->async.ctx;
+	struct nvm_async_ring *ring = ctx->ring;
+	const int scalar_io = (opt == NVM_CMD_SCALAR) &&
+			      ((op == NVM_ASYNC_OP_WRITE) ||
+			       (op == NVM_ASYNC_OP_READ));
+	const int ncopy = scalar_io ? 1 : naddrs;
+	unsigned int nreserved = atomic_load(&ring->nreserved);
+	struct nvm_async_slot *slot;
+	size_t pos;
+
+	if ((opt != NVM_CMD_SCALAR && opt != NVM_CMD_VECTOR) ||
+	    (op == NVM_ASYNC_OP_ERASE && opt == NVM_CMD_SCALAR && meta) ||
+	    naddrs < 1 || ncopy > NVM_NADDR_MAX) {
+		NVM_DEBUG("FAILED: op: %d, opt: 0x%x, naddrs: %d",
+			  op, opt, naddrs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	do {
+		if (nreserved >= ctx->depth) {
+			errno = EAGAIN;
+			return -1;
+		}
+	} while (!atomic_compare_exchange_weak(&ring->nreserved, &nreserved,
+					       nreserved + 1));
+
+	pos = atomic_fetch_add(&ring->head, 1);
+	slot = &ring->slots[pos & ring->mask];
+
+	// Free by the reservation, the drainer may not have published it yet
+	while (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos)
+		sched_yield();
+
+	slot->cmd.op = op;
+	slot->cmd.opt = opt;
+	slot->cmd.naddrs = naddrs;
+	slot->cmd.flags = flags;
+	slot->cmd.data = (void *)data;
+	slot->cmd.meta = (void *)meta;
+	slot->cmd.ret = ret;
+	memcpy(slot->cmd.addrs, addrs, ncopy * sizeof(*addrs));
+	if (dst)
+		memcpy(slot->cmd.dst, dst, ncopy * sizeof(*dst));
+
+	atomic_store(&slot->seq, pos + 1);
+
+	if (!atomic_flag_test_and_set(&ring->lock)) {
+		async_ring_drain(dev, ring);
+		async_ring_unlock(dev, ring);
+	}
+
+	return 0;
+}
+
+/**
+ * Reap up to 'max' completions of a shared context into 'out', without
+ * blocking; returns 0 when another thread holds the backend
+ */
+static int async_ring_reap(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			   struct nvm_ret *out[], uint32_t max)
+{
+	struct nvm_async_ring *ring = ctx->ring;
+	uint32_t nreaped = 0;
+	int res;
+
+	if (atomic_flag_test_and_set(&ring->lock))
+		return 0;
+
+	async_ring_drain(dev, ring);
+
+	if (max > ring->nfailed) {
+		res = dev->be->async_reap(dev, ctx, out, max - ring->nfailed);
+		if (res < 0) {
+			NVM_DEBUG("FAILED: async_reap");
+			async_ring_unlock(dev, ring);
+			return -1;
+		}
+		nreaped = res;
+	}
+
+	while (ring->nfailed && nreaped < max)
+		out[nreaped++] = ring->failed[--ring->nfailed];
+
+	atomic_fetch_sub(&ring->nreserved, nreaped);
+	async_ring_unlock(dev, ring);
+
+	return nreaped;
+}
+
+static int async_ring_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			   uint32_t max)
+{
+	int nreaped;
+
+	max = (!max || max > ctx->depth) ? ctx->depth : max;
+
+	{
+		struct nvm_ret *out[max];
+
+		nreaped = async_ring_reap(dev, ctx, out, max);
+
+		// Without the lock held, callbacks may submit and reap
+		for (int i = 0; i < nreaped; ++i) {
+			if (out[i]->async.cb)
+				out[i]->async.cb(out[i], out[i]->async.cb_arg);
+		}
+	}
+
+	return nreaped;
+}
+
+static int async_ring_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
+{
+	int acc = 0;
+
+	while (atomic_load(&ctx->ring->nreserved)) {
+		int res = async_ring_poke(dev, ctx, 0);
+
+		if (res < 0) {
+			NVM_DEBUG("FAILED: async_ring_poke");
+			return -1;
+		}
+		if (!res)
+			sched_yield();
+
+		acc += res;
+	}
+
+	return acc;
+}
+
+static struct nvm_async_ring *async_ring_alloc(uint32_t depth)
+{
+	struct nvm_async_ring *ring;
+	size_t nslots = 1;
+
+	while (nslots < depth)
+		nslots <<= 1;
+
+	ring = calloc(1, sizeof(*ring) + nslots * sizeof(ring->slots[0]));
+	if (!ring) {
+		NVM_DEBUG("FAILED: calloc, errno: %d", errno);
+		return NULL;
+	}
+
+	ring->failed = calloc(depth, sizeof(*ring->failed));
+	if (!ring->failed) {
+		NVM_DEBUG("FAILED: calloc, errno: %d", errno);
+		free(ring);
+		return NULL;
+	}
+
+	ring->mask = nslots - 1;
+	for (size_t i = 0; i < nslots; ++i)
+		atomic_init(&ring->slots[i].seq, i);
+	atomic_init(&ring->nreserved, 0);
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_flag_clear(&ring->lock);
+
+	return ring;
+}
+
+static void async_ring_free(struct nvm_async_ring *ring)
+{
+	if (!ring)
+		return;
+
+	free(ring->failed);
+	free(ring);
+}
+
+/**
+ * Reset the eventfd before reaping, completions after this signal it again
+ */
+static inline void async_efd_reset(struct nvm_async_ctx *ctx)
+{
+	uint64_t nevents;
+
+	if (!(ctx->flags & NVM_ASYNC_EVENTFD))
+		return;
+
+	if ((read(ctx->efd, &nevents, sizeof(nevents)) < 0) &&
+	    (errno != EAGAIN)) {
+		NVM_DEBUG("FAILED: read, efd: %d, errno: %d", ctx->efd, errno);
+	}
+}
+
+static void async_sleep(struct nvm_async_ctx *ctx, uint64_t nsecs)
+{
+	struct timespec ts;
+
+	if (ctx->flags & NVM_ASYNC_EVENTFD) {
+		struct pollfd pfd = { .fd = ctx->efd, .events = POLLIN };
+
+		poll(&pfd, 1, NVM_ASYNC_SLEEP_MSECS_EFD);
+		return;
+	}
+
+	ts.tv_sec = nsecs / 1000000000ULL;
+	ts.tv_nsec = nsecs % 1000000000ULL;
+
+	nanosleep(&ts, NULL);
+}
+
+/**
+ * Poll for completions during the adaptive period 'ctx->spin_nsecs', then
+ * sleep, with exponential backoff or on the eventfd, until some arrive
+ *
+ * The period grows when completions arrive in the second half of it, such
+ * that a longer period would likely have caught more, and is halved when none
+ * arrive, converging on the latency of the commands in flight.
+ */
+static int async_wait_hybrid(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
+{
+	uint64_t spin_nsecs = atomic_load_explicit(&ctx->spin_nsecs,
+						   memory_order_relaxed);
+	uint64_t sleep_nsecs = NVM_ASYNC_SLEEP_NSECS_MIN;
+	int acc = 0;
+
+	while (nvm_async_get_outstanding(ctx)) {
+		const uint64_t bgn = _clock_monotonic();
+		uint64_t spent = 0;
+		int res;
+
+		while (1) {
+			res = nvm_async_poke(dev, ctx, 0);
+			if (res < 0) {
+				NVM_DEBUG("FAILED: nvm_async_poke");
+				return -1;
+			}
+			spent = _clock_monotonic() - bgn;
+			if (res || !nvm_async_get_outstanding(ctx))
+				break;
+			if (spent > spin_nsecs)
+				break;
+		}
+
+		if (res) {
+			if (spent > spin_nsecs / 2) {
+				spin_nsecs += spin_nsecs / 4;
+				if (spin_nsecs > NVM_ASYNC_SPIN_NSECS_MAX)
+					spin_nsecs = NVM_ASYNC_SPIN_NSECS_MAX;
+			}
+			sleep_nsecs = NVM_ASYNC_SLEEP_NSECS_MIN;
+			acc += res;
+			continue;
+		}
+
+		if (!nvm_async_get_outstanding(ctx))
+			break;
+
+		spin_nsecs /= 2;
+		if (spin_nsecs < NVM_ASYNC_SPIN_NSECS_MIN)
+			spin_nsecs = NVM_ASYNC_SPIN_NSECS_MIN;
+
+		async_sleep(ctx, sleep_nsecs);
+
+		sleep_nsecs *= 2;
+		if (sleep_nsecs > NVM_ASYNC_SLEEP_NSECS_MAX)
+			sleep_nsecs = NVM_ASYNC_SLEEP_NSECS_MAX;
+	}
+
+	atomic_store_explicit(&ctx->spin_nsecs, spin_nsecs,
+			      memory_order_relaxed);
+
+	return acc;
+}
+
 struct nvm_async_ctx *nvm_async_init(struct nvm_dev *dev, uint32_t depth,
 				     uint16_t flags)
 {
-	return dev->be->async_init(dev, depth, flags);
+	struct nvm_async_ctx *ctx = dev->be->async_init(dev, depth, flags);
+
+	if (!ctx)
+		return NULL;
+
+	atomic_init(&ctx->spin_nsecs, NVM_ASYNC_SPIN_NSECS_DEF);
+
+	if ((flags & NVM_ASYNC_EVENTFD) &&
+	    !(ctx->flags & NVM_ASYNC_EVENTFD)) {
+		NVM_DEBUG("FAILED: backend does not signal an eventfd");
+		dev->be->async_term(dev, ctx);
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	if (!(flags & NVM_ASYNC_SHARED))
+		return ctx;
+
+	ctx->flags |= NVM_ASYNC_SHARED;
+	ctx->ring = async_ring_alloc(ctx->depth);
+	if (!ctx->ring) {
+		NVM_DEBUG("FAILED: async_ring_alloc");
+		dev->be->async_term(dev, ctx);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return ctx;
 }
 
 int nvm_async_term(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
 {
-	return dev->be->async_term(dev, ctx);
+	struct nvm_async_ring *ring = ctx->ring;
+	int err;
+
+	err = dev->be->async_term(dev, ctx);
+	if (!err)
+		async_ring_free(ring);
+
+	return err;
 }
 
 int nvm_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
 {
+	if (ctx->wait_policy == NVM_ASYNC_WAIT_HYBRID)
+		return async_wait_hybrid(dev, ctx);
+
+	if (ctx->ring)
+		return async_ring_wait(dev, ctx);
+
 	return dev->be->async_wait(dev, ctx);
 }
 
 int nvm_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx, uint32_t max)
 {
+	async_efd_reset(ctx);
+
+	if (ctx->ring)
+		return async_ring_poke(dev, ctx, max);
+
 	return dev->be->async_poke(dev, ctx, max);
 }
 
+int nvm_async_reap(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+		   struct nvm_ret *out[], uint32_t max)
+{
+	if (!out || !max) {
+		NVM_DEBUG("FAILED: out: %p, max: %u", (void *)out, max);
+		errno = EINVAL;
+		return -1;
+	}
+
+	async_efd_reset(ctx);
+
+	if (ctx->ring)
+		return async_ring_reap(dev, ctx, out, max);
+
+	return dev->be->async_reap(dev, ctx, out, max);
+}
+
+int nvm_async_set_wait(struct nvm_async_ctx *ctx, int policy)
+{
+	switch (policy) {
+	case NVM_ASYNC_WAIT_DEFAULT:
+	case NVM_ASYNC_WAIT_HYBRID:
+		ctx->wait_policy = policy;
+		return 0;
+
+	default:
+		NVM_DEBUG("FAILED: invalid policy: %d", policy);
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+int nvm_async_get_fd(struct nvm_async_ctx *ctx)
+{
+	if (!(ctx->flags & NVM_ASYNC_EVENTFD)) {
+		NVM_DEBUG("FAILED: ctx without NVM_ASYNC_EVENTFD");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return ctx->efd;
+}
+
 uint32_t nvm_async_get_depth(struct nvm_async_ctx *ctx) {
 	return ctx->depth;
 }
 
 uint32_t nvm_async_get_outstanding(struct nvm_async_ctx *ctx) {
+	if (ctx->ring)
+		return atomic_load(&ctx->ring->nreserved);
+
 	return ctx->outstanding;
 }
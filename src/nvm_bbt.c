@@ -92,6 +92,30 @@ static inline int _refresh_counters(struct nvm_dev *dev, struct nvm_bbt *bbt)
 	return 0;
 }
 
+/**
+ * Fetches the bbt of 'addr' from the device into a scratch buffer of 'dev',
+ * return it with nvm_buf_scratch_put
+ */
+static struct nvm_spec_bbt *bbt_spec_get(struct nvm_dev *dev,
+					 struct nvm_addr addr,
+					 struct nvm_ret *ret)
+{
+	struct nvm_spec_bbt *spec;
+
+	spec = nvm_buf_scratch_get(dev, nvm_cmd_gbbt_nbytes(dev));
+	if (!spec) {
+		NVM_DEBUG("FAILED: nvm_buf_scratch_get");
+		return NULL;
+	}
+
+	if (dev->be->gbbt(dev, addr, spec, ret)) {
+		nvm_buf_scratch_put(dev, spec);
+		return NULL;			// Propagate `errno`
+	}
+
+	return spec;
+}
+
 int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
 		  struct nvm_ret *ret)
 {
@@ -111,9 +135,9 @@ int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
 	if (!cached)
 		return 0;			// Nothing to flush
 
-	spec = nvm_cmd_gbbt(dev, addr, ret);
+	spec = bbt_spec_get(dev, addr, ret);
 	if (!spec) {
-		NVM_DEBUG("FAILED: nvm_cmd_gbbt failed spec");
+		NVM_DEBUG("FAILED: bbt_spec_get");
 		return -1;			// Propagate `errno`
 	}
 
@@ -121,7 +145,7 @@ int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
 		NVM_DEBUG("FAILED: cached->nblks(%lu) != spec->tblks(%u)",
 			  cached->nblks, spec->tblks);
 		errno = EINVAL;
-		free(spec);
+		nvm_buf_scratch_put(dev, spec);
 		return -1;
 	}
 	
@@ -139,12 +163,12 @@ int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
 		if (nvm_cmd_sbbt(dev, &blk_addr, 1, cached->blks[i],
 					ret)) {
 			NVM_DEBUG("FAILED: nvm_cmd_sbbt");
-			free(spec);
+			nvm_buf_scratch_put(dev, spec);
 			return -1;		// Propagate `errno`
 		}
 	}
 
-	free(spec);
+	nvm_buf_scratch_put(dev, spec);
 
 	/* Deallocate the bbt entry */
 	nvm_bbt_free(dev->bbts[bbt_idx]);
@@ -212,7 +236,7 @@ const struct nvm_bbt *nvm_bbt_get(struct nvm_dev *dev, struct nvm_addr addr,
 	}
 
 	/* Update bbt entry in managed memory area with bbt from device */
-	spec = nvm_cmd_gbbt(dev, addr, ret);
+	spec = bbt_spec_get(dev, addr, ret);
 	if (!spec) {
 		free(dev->bbts[bbt_idx]);
 		dev->bbts[bbt_idx] = NULL;
@@ -222,7 +246,7 @@ const struct nvm_bbt *nvm_bbt_get(struct nvm_dev *dev, struct nvm_addr addr,
 
 	if (dev->bbts[bbt_idx]->nblks != spec->tblks) {
 		free(dev->bbts[bbt_idx]);
-		free(spec);
+		nvm_buf_scratch_put(dev, spec);
 		dev->bbts[bbt_idx] = NULL;
 
 		return NULL;
@@ -236,7 +260,7 @@ const struct nvm_bbt *nvm_bbt_get(struct nvm_dev *dev, struct nvm_addr addr,
 	dev->bbts[bbt_idx]->ndmrk = spec->tdresv;
 	dev->bbts[bbt_idx]->nhmrk = spec->thresv;
 
-	free(spec);
+	nvm_buf_scratch_put(dev, spec);
 
 	return dev->bbts[bbt_idx];
 }
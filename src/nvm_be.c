@@ -124,22 +124,23 @@ int nvm_be_nosys_pass(struct nvm_dev *NVM_UNUSED(dev),
 	return -1;
 }
 
-struct nvm_spec_idfy *nvm_be_nosys_idfy(struct nvm_dev *NVM_UNUSED(dev),
-					struct nvm_ret *NVM_UNUSED(ret))
+int nvm_be_nosys_idfy(struct nvm_dev *NVM_UNUSED(dev),
+		      struct nvm_spec_idfy *NVM_UNUSED(idfy),
+		      struct nvm_ret *NVM_UNUSED(ret))
 {
 	NVM_DEBUG("FAILED: not implemented(possibly intentionally)");
 	errno = ENOSYS;
-	return NULL;
+	return -1;
 }
 
-struct nvm_spec_rprt *nvm_be_nosys_rprt(struct nvm_dev *NVM_UNUSED(dev),
-					struct nvm_addr *NVM_UNUSED(addr),
-					int NVM_UNUSED(opt),
-				        struct nvm_ret *NVM_UNUSED(ret))
+int nvm_be_nosys_rprt(struct nvm_dev *NVM_UNUSED(dev),
+		      struct nvm_addr *NVM_UNUSED(addr), int NVM_UNUSED(opt),
+		      struct nvm_spec_rprt *NVM_UNUSED(rprt),
+		      struct nvm_ret *NVM_UNUSED(ret))
 {
 	NVM_DEBUG("FAILED: not implemented(possibly intentionally)");
 	errno = ENOSYS;
-	return NULL;
+	return -1;
 }
 
 int nvm_be_nosys_gfeat(struct nvm_dev *NVM_UNUSED(dev), uint8_t NVM_UNUSED(id),
@@ -160,13 +161,14 @@ int nvm_be_nosys_sfeat(struct nvm_dev *NVM_UNUSED(dev), uint8_t NVM_UNUSED(id),
 	return -1;
 }
 
-struct nvm_spec_bbt *nvm_be_nosys_gbbt(struct nvm_dev *NVM_UNUSED(dev),
-				       struct nvm_addr NVM_UNUSED(addr),
-				       struct nvm_ret *NVM_UNUSED(ret))
+int nvm_be_nosys_gbbt(struct nvm_dev *NVM_UNUSED(dev),
+		      struct nvm_addr NVM_UNUSED(addr),
+		      struct nvm_spec_bbt *NVM_UNUSED(bbt),
+		      struct nvm_ret *NVM_UNUSED(ret))
 {
 	NVM_DEBUG("FAILED: not implemented(possibly intentionally)");
 	errno = ENOSYS;
-	return NULL;
+	return -1;
 }
 
 int nvm_be_nosys_sbbt(struct nvm_dev *NVM_UNUSED(dev),
@@ -298,6 +300,16 @@ int nvm_be_nosys_async_wait(struct nvm_dev *NVM_UNUSED(dev),
 	return -1;
 }
 
+int nvm_be_nosys_async_reap(struct nvm_dev *NVM_UNUSED(dev),
+			    struct nvm_async_ctx *NVM_UNUSED(ctx),
+			    struct nvm_ret *NVM_UNUSED(out[]),
+			    uint32_t NVM_UNUSED(max))
+{
+	NVM_DEBUG("FAILED: not implemented(possibly intentionally)");
+	errno = ENOSYS;
+	return -1;
+}
+
 int nvm_be_split_dpath(const char *dev_path, char *nvme_name, int *nsid)
 {
 	const char prefix[] = "/dev/nvme";
@@ -421,9 +433,17 @@ int nvm_be_populate(struct nvm_dev *dev, struct nvm_be *be)
 
 	dev->be = be;			// TODO: Clean the init. process
 
-	idfy = be->idfy(dev, NULL);
+	idfy = nvm_buf_alloc(dev, sizeof(*idfy), NULL);
 	if (!idfy) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(idfy, 0, sizeof(*idfy));
+
+	if (be->idfy(dev, idfy, NULL)) {
 		NVM_DEBUG("FAILED: be->idfy(...)");
+		nvm_buf_free(dev, idfy);
 		return -1;
 	}
 	
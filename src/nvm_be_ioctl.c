@@ -58,6 +58,7 @@ struct nvm_be nvm_be_ioctl = {
 	.async_term = nvm_be_nosys_async_term,
 	.async_poke = nvm_be_nosys_async_poke,
 	.async_wait = nvm_be_nosys_async_wait,
+	.async_reap = nvm_be_nosys_async_reap,
 };
 #else
 #define _GNU_SOURCE
@@ -199,20 +200,12 @@ void nvm_cmd_pr(struct nvm_cmd *cmd)
 		       NVM_I32_TO_STR(cmd->cdw[i]));
 }
 
-struct nvm_spec_idfy *nvm_be_ioctl_idfy(struct nvm_dev *dev,
-					struct nvm_ret *ret)
+int nvm_be_ioctl_idfy(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		      struct nvm_ret *ret)
 {
 	struct nvm_cmd cmd = {.cdw={0}};
-	struct nvm_spec_idfy *idfy = NULL;
 	int err;
 
-	idfy = nvm_buf_alloc(dev, sizeof(*idfy), NULL);
-	if (!idfy) {
-		errno = ENOMEM;
-		return NULL;
-	}
-	memset(idfy, 0, sizeof(*idfy));
-
 	cmd.vadmin.opcode = NVM_AOPC_IDFY;
 	cmd.vadmin.addr = (uint64_t)idfy;
 	cmd.vadmin.data_len = sizeof(*idfy);
@@ -220,11 +213,10 @@ struct nvm_spec_idfy *nvm_be_ioctl_idfy(struct nvm_dev *dev,
 	err = ioctl_vam(dev, &cmd, ret);
 	if (err) {
 		NVM_DEBUG("FAILED: ioctl_vam err: %d", err);
-		nvm_buf_free(dev, idfy);
-		return NULL; // NOTE: Propagate errno
+		return -1; // NOTE: Propagate errno
 	}
 
-	return idfy;
+	return 0;
 }
 
 int nvm_be_ioctl_gfeat(struct nvm_dev *dev, uint8_t id,
@@ -268,18 +260,15 @@ int nvm_be_ioctl_sfeat(struct nvm_dev *dev, uint8_t id,
 	return 0;
 }
 
-struct nvm_spec_rprt *nvm_be_ioctl_rprt(struct nvm_dev *dev,
-					struct nvm_addr *addr,
-					int NVM_UNUSED(opt),
-					struct nvm_ret *ret)
+int nvm_be_ioctl_rprt(struct nvm_dev *dev, struct nvm_addr *addr,
+		      int NVM_UNUSED(opt), struct nvm_spec_rprt *rprt,
+		      struct nvm_ret *ret)
 {
 	if (NVM_SPEC_VERID_20 != dev->verid) {
 		errno = EINVAL;
-		return NULL;
+		return -1;
 	}
 
-	struct nvm_spec_rprt *rprt;
-
 	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
 	const size_t lpo_off = addr ? nvm_addr_gen2lpo(dev, *addr) : 0;
 
@@ -291,14 +280,6 @@ struct nvm_spec_rprt *nvm_be_ioctl_rprt(struct nvm_dev *dev,
 	}
 
 	const size_t descr_len = sizeof(struct nvm_spec_rprt_descr);
-	const size_t rprt_len = ndescr * descr_len + sizeof(rprt->ndescr);
-
-	rprt = nvm_buf_alloc(dev, rprt_len, NULL);
-	if (!rprt) {
-		errno = ENOMEM;
-		return NULL;
-	}
-	memset(rprt, 0, rprt_len);
 
 	rprt->ndescr = ndescr;
 
@@ -326,32 +307,22 @@ struct nvm_spec_rprt *nvm_be_ioctl_rprt(struct nvm_dev *dev,
 		cmd.admin.cdw12 = lpo;
 		cmd.admin.cdw13 = (lpo >> 32);
 
-		if (ioctl_wrap(dev, NVME_IOCTL_ADMIN_CMD, &cmd, ret)) {
-			nvm_buf_free(dev, rprt);
-			return NULL;
-		}
+		if (ioctl_wrap(dev, NVME_IOCTL_ADMIN_CMD, &cmd, ret))
+			return -1;
 	}
 
-	return rprt;
+	return 0;
 }
 
-struct nvm_spec_bbt *nvm_be_ioctl_gbbt(struct nvm_dev *dev,
-				       struct nvm_addr addr,
-				       struct nvm_ret *ret)
+int nvm_be_ioctl_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
+		      struct nvm_spec_bbt *spec_bbt, struct nvm_ret *ret)
 {
 	struct nvm_cmd cmd = {.cdw={0}};
-	struct nvm_spec_bbt *spec_bbt;
 	size_t spec_bbt_sz;
 	int err;
 
 	uint32_t nblks = dev->geo.nblocks * dev->geo.nplanes;
 	spec_bbt_sz = sizeof(*spec_bbt) + sizeof(*(spec_bbt->blk)) * nblks;
-	spec_bbt = nvm_buf_alloc(dev, spec_bbt_sz, NULL);
-	if (!spec_bbt) {
-		NVM_DEBUG("FAILED: malloc k_bbt failed");
-		errno = ENOMEM;
-		return NULL;
-	}
 
 	cmd.vadmin.opcode = NVM_AOPC_GBBT;
 	cmd.vadmin.addr = (uint64_t)spec_bbt;
@@ -363,18 +334,16 @@ struct nvm_spec_bbt *nvm_be_ioctl_gbbt(struct nvm_dev *dev,
 	if (err || (spec_bbt->tblks != nblks)) {
 		NVM_DEBUG("FAILED: be execution failed err: %d", err);
 		errno = EIO;
-		nvm_buf_free(dev, spec_bbt);
-		return NULL;
+		return -1;
 	}
 	if (!(spec_bbt->tblid[0] == 'B' && spec_bbt->tblid[1] == 'B' &&
 	      spec_bbt->tblid[2] == 'L' && spec_bbt->tblid[3] == 'T')) {
 		NVM_DEBUG("FAILED: invalid format of returned bbt");
 		errno = EIO;
-		nvm_buf_free(dev, spec_bbt);
-		return NULL;
+		return -1;
 	}
 
-	return spec_bbt;
+	return 0;
 }
 
 int nvm_be_ioctl_sbbt(struct nvm_dev *dev, struct nvm_addr *addrs, int naddrs,
@@ -448,9 +417,9 @@ int nvm_be_ioctl_scalar_erase(struct nvm_dev *dev, struct nvm_addr *addrs,
 		return -1;
 	}
 
-	dsmr = nvm_buf_alloc(dev, dsmr_len, NULL);
+	dsmr = nvm_buf_scratch_get(dev, dsmr_len);
 	if (!dsmr) {
-		NVM_DEBUG("FAILED: nvm_buf_alloc of DSM range");
+		NVM_DEBUG("FAILED: nvm_buf_scratch_get of DSM range");
 		return -1;
 	}
 
@@ -469,11 +438,11 @@ int nvm_be_ioctl_scalar_erase(struct nvm_dev *dev, struct nvm_addr *addrs,
 
 	int err = ioctl_wrap(dev, NVME_IOCTL_IO_CMD, &cmd, ret);
 	if (err) {
-		nvm_buf_free(dev, dsmr);
+		nvm_buf_scratch_put(dev, dsmr);
 		return -1;
 	}
 
-	nvm_buf_free(dev, dsmr);
+	nvm_buf_scratch_put(dev, dsmr);
 
 	return 0;
 }
@@ -789,5 +758,6 @@ struct nvm_be nvm_be_ioctl = {
 	.async_term = nvm_be_nosys_async_term,
 	.async_poke = nvm_be_nosys_async_poke,
 	.async_wait = nvm_be_nosys_async_wait,
+	.async_reap = nvm_be_nosys_async_reap,
 };
 #endif
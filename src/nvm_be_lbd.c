@@ -60,6 +60,7 @@ struct nvm_be nvm_be_lbd = {
 	.async_term = nvm_be_nosys_async_term,
 	.async_poke = nvm_be_nosys_async_poke,
 	.async_wait = nvm_be_nosys_async_wait,
+	.async_reap = nvm_be_nosys_async_reap,
 };
 #else
 #include <stdlib.h>
@@ -71,6 +72,7 @@ struct nvm_be nvm_be_lbd = {
 #include <linux/fs.h>
 #include <time.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <nvm_be_ioctl.h>
 #include <nvm_dev.h>
 #include <nvm_async.h>
@@ -85,9 +87,10 @@ struct nvm_be_lbd_async_state {
 	struct iocb **iocbs;
 };
 
+int nvm_be_lbd_async_term(struct nvm_dev *dev, struct nvm_async_ctx *ctx);
+
 struct nvm_async_ctx *nvm_be_lbd_async_init(struct nvm_dev *NVM_UNUSED(dev),
-					    uint32_t depth,
-					    uint16_t NVM_UNUSED(flags))
+					    uint32_t depth, uint16_t flags)
 {
 	struct nvm_be_lbd_async_state *state = calloc(1, sizeof(*state));
 	struct nvm_async_ctx *ctx = calloc(1, sizeof(*ctx));
@@ -113,6 +116,19 @@ struct nvm_async_ctx *nvm_be_lbd_async_init(struct nvm_dev *NVM_UNUSED(dev),
 		return NULL;
 	}
 
+	// Completions of the iocbs are signaled by the kernel
+	if (flags & NVM_ASYNC_EVENTFD) {
+		ctx->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (ctx->efd < 0) {
+			err = errno;
+			NVM_DEBUG("FAILED: eventfd, errno: %d", err);
+			nvm_be_lbd_async_term(NULL, ctx);
+			errno = err;
+			return NULL;
+		}
+		ctx->flags |= NVM_ASYNC_EVENTFD;
+	}
+
 	return ctx;
 }
 
@@ -134,6 +150,9 @@ int nvm_be_lbd_async_term(struct nvm_dev *NVM_UNUSED(dev),
 		return -1;
 	}
 
+	if (ctx->flags & NVM_ASYNC_EVENTFD)
+		close(ctx->efd);
+
 	free(state);
 	free(ctx);
 
@@ -141,29 +160,42 @@ int nvm_be_lbd_async_term(struct nvm_dev *NVM_UNUSED(dev),
 }
 
 int cmd_async_getevents(struct nvm_async_ctx *ctx, unsigned int min,
-			unsigned int max, struct timespec *timeout)
+			unsigned int max, struct timespec *timeout,
+			struct nvm_ret *out[])
 {
 	struct nvm_be_lbd_async_state *state = ctx->be_ctx;
 
 	int r, nevents = 0;
 	while (ctx->outstanding) {
-		if (0 == (r = io_getevents(state->aio_ctx, min, max, state->aio_events, timeout))) {
+		if (out && (unsigned int)nevents == max)
+			break;
+
+		// Callbacks may submit, never wait for more than is in flight
+		if (min > ctx->outstanding)
+			min = ctx->outstanding;
+
+		if (0 == (r = io_getevents(state->aio_ctx, min,
+					   out ? max - nevents : max,
+					   state->aio_events, timeout))) {
 			break;
 		}
 
 		if (r < 0) return -r;
 
-		nevents += r;
-
 		for (int i = 0; i < r; i++) {
 			struct io_event *event = &state->aio_events[i];
 			struct nvm_ret *ret = event->data;
 
 			ret->status = event->res2;
-			ret->async.cb(ret, ret->async.cb_arg);
+			if (out)
+				out[nevents + i] = ret;
+			else if (ret->async.cb)
+				ret->async.cb(ret, ret->async.cb_arg);
 
 			state->iocbs[--(ctx->outstanding)] = event->obj;
 		}
+
+		nevents += r;
 	}
 
 	return nevents;
@@ -177,13 +209,27 @@ int nvm_be_lbd_async_poke(struct nvm_dev *NVM_UNUSED(dev),
 		max = ctx->depth;
 	}
 
-	return cmd_async_getevents(ctx, 0, max, &timeout);
+	return cmd_async_getevents(ctx, 0, max, &timeout, NULL);
 }
 
 int nvm_be_lbd_async_wait(struct nvm_dev *NVM_UNUSED(dev),
 			  struct nvm_async_ctx *ctx)
 {
-	return cmd_async_getevents(ctx, ctx->outstanding, ctx->depth, NULL);
+	return cmd_async_getevents(ctx, ctx->outstanding, ctx->depth, NULL,
+				   NULL);
+}
+
+int nvm_be_lbd_async_reap(struct nvm_dev *NVM_UNUSED(dev),
+			  struct nvm_async_ctx *ctx, struct nvm_ret *out[],
+			  uint32_t max)
+{
+	struct timespec timeout = { 0, 0 };
+
+	if (max > ctx->depth) {
+		max = ctx->depth;
+	}
+
+	return cmd_async_getevents(ctx, 0, max, &timeout, out);
 }
 
 int cmd_async_scalar_wr(struct nvm_dev *dev, int naddrs, void *data,
@@ -217,6 +263,8 @@ int cmd_async_scalar_wr(struct nvm_dev *dev, int naddrs, void *data,
 	}
 
 	iocb->data = ret;
+	if (ctx->flags & NVM_ASYNC_EVENTFD)
+		io_set_eventfd(iocb, ctx->efd);
 
 	int r = io_submit(state->aio_ctx, 1, &iocb);
 	if (r < 0) {
@@ -366,11 +414,13 @@ struct nvm_be nvm_be_lbd = {
 	.async_term = nvm_be_lbd_async_term,
 	.async_poke = nvm_be_lbd_async_poke,
 	.async_wait = nvm_be_lbd_async_wait,
+	.async_reap = nvm_be_lbd_async_reap,
 #else
 	.async_init = nvm_be_nosys_async_init,
 	.async_term = nvm_be_nosys_async_term,
 	.async_poke = nvm_be_nosys_async_poke,
 	.async_wait = nvm_be_nosys_async_wait,
+	.async_reap = nvm_be_nosys_async_reap,
 #endif
 };
 #endif
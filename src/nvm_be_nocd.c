@@ -39,6 +39,7 @@ struct nvm_be nvm_be_nocd = {
 	.async_term = nvm_be_nosys_async_term,
 	.async_poke = nvm_be_nosys_async_poke,
 	.async_wait = nvm_be_nosys_async_wait,
+	.async_reap = nvm_be_nosys_async_reap,
 
 	.idfy = nvm_be_nosys_idfy,
 	.rprt = nvm_be_nosys_rprt,
@@ -160,21 +161,12 @@ failed:
 	return NULL;
 }
 
-struct nvm_spec_idfy *nvm_be_nocd_idfy(struct nvm_dev *dev,
-					struct nvm_ret *NVM_UNUSED(ret))
+int nvm_be_nocd_idfy(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		     struct nvm_ret *NVM_UNUSED(ret))
 {
-	struct nvm_spec_idfy *idfy = NULL;
-	const size_t idfy_len = sizeof(*idfy);
-
 	const size_t lba_byts = 1 << dev->ns.lbaf[dev->ns.flbas & 0xf].ds;
 	const size_t ncap_byts = dev->ns.ncap * lba_byts;
 
-	idfy = nvm_buf_alloc(dev, idfy_len, NULL);
-	if (!idfy) {
-		NVM_DEBUG("nvm_buf_alloc: FAILED");
-		errno = ENOMEM;
-		return NULL;
-	}
 	memset(idfy, 0, sizeof(*idfy));
 
 	idfy->s.verid = NVM_SPEC_VERID_20;
@@ -205,7 +197,7 @@ struct nvm_spec_idfy *nvm_be_nocd_idfy(struct nvm_dev *dev,
 	idfy->s20.perf.tcet = 1;
 	idfy->s20.perf.tcem = 1;
 
-	return idfy;
+	return 0;
 }
 
 int nvm_be_nocd_gfeat(struct nvm_dev *dev, uint8_t id,
@@ -222,38 +214,28 @@ int nvm_be_nocd_sfeat(struct nvm_dev *dev, uint8_t id,
 	return nvm_be_spdk_sfeat(dev, id, feat, ret);
 }
 
-struct nvm_spec_rprt *nvm_be_nocd_rprt(struct nvm_dev *dev,
-					struct nvm_addr *addr,
-					int NVM_UNUSED(opt),
-					struct nvm_ret *NVM_UNUSED(ret))
+int nvm_be_nocd_rprt(struct nvm_dev *dev, struct nvm_addr *addr,
+		     int NVM_UNUSED(opt), struct nvm_spec_rprt *rprt,
+		     struct nvm_ret *NVM_UNUSED(ret))
 {
 	const size_t DESCR_NBYTES = sizeof(struct nvm_spec_rprt_descr);
 	struct nvm_be_nocd_state *state = dev->be_state;
 	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
 	size_t lpo = addr ? nvm_addr_gen2lpo(dev, *addr) : 0;
 	size_t idx = addr ? lpo / sizeof(struct nvm_spec_rprt_descr) : 0;
-	struct nvm_spec_rprt *rprt = NULL;
-	size_t rprt_len, ndescr;
+	size_t ndescr;
 
 	if (NVM_SPEC_VERID_20 != dev->verid) {
 		errno = EINVAL;
-		return NULL;
+		return -1;
 	}
 
 	ndescr = addr ? geo->l.nchunk : geo->l.nchunk * geo->l.npunit * geo->l.npugrp;
-	rprt_len = ndescr * DESCR_NBYTES + sizeof(rprt->ndescr);
-
-	rprt = nvm_buf_alloc(dev, rprt_len, NULL);
-	if (!rprt) {
-		errno = ENOMEM;
-		return NULL;
-	}
-	memset(rprt, 0, rprt_len);
 	rprt->ndescr = ndescr;
 
 	memcpy(rprt->descr, state->descr + idx, ndescr * DESCR_NBYTES);
 
-	return rprt;
+	return 0;
 }
 
 int nvm_be_nocd_vector_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
@@ -385,6 +367,7 @@ struct nvm_be nvm_be_nocd = {
 	.async_term = nvm_be_spdk_async_term,
 	.async_poke = nvm_be_spdk_async_poke,
 	.async_wait = nvm_be_spdk_async_wait,
+	.async_reap = nvm_be_spdk_async_reap,
 
 	.idfy = nvm_be_nocd_idfy,
 	.rprt = nvm_be_nocd_rprt,
@@ -56,6 +56,7 @@ struct nvm_be nvm_be_spdk = {
 	.async_term = nvm_be_nosys_async_term,
 	.async_poke = nvm_be_nosys_async_poke,
 	.async_wait = nvm_be_nosys_async_wait,
+	.async_reap = nvm_be_nosys_async_reap,
 };
 #else
 #include <assert.h>
@@ -368,6 +369,7 @@ failed:
  *
  * The context is not thread-safe and the intent is that the user must
  * initialize the opaque `struct nvm_async_ctx` via nvm_async_init() pr. thread,
+ * or with NVM_ASYNC_SHARED, serializing access to the qpair in nvm_async,
  * which is then delegated to the backend, in this case NVM_BE_SPDK, which then
  * initialized a struct containing what it needs for a submission / completion
  * path, in the case of NVM_BE_SPDK, then a qpair is needed and thus allocated
@@ -481,6 +483,29 @@ int nvm_be_spdk_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
 	return acc;
 }
 
+int nvm_be_spdk_async_reap(struct nvm_dev *NVM_UNUSED(dev),
+			   struct nvm_async_ctx *ctx, struct nvm_ret *out[],
+			   uint32_t max)
+{
+	struct spdk_nvme_qpair *qpair = ctx->be_ctx;
+	int32_t res;
+
+	// cmd_async_cb stores into 'out', at most 'max' completions
+	ctx->reap = out;
+	ctx->nreaped = 0;
+
+	res = spdk_nvme_qpair_process_completions(qpair, max);
+
+	ctx->reap = NULL;
+
+	if (res < 0) {
+		NVM_DEBUG("FAILED: processing completions: res: %d", res);
+		return -1;
+	}
+
+	return ctx->nreaped;
+}
+
 struct cpl_ctx {
 	struct spdk_nvme_cpl cpl;
 	bool completed;
@@ -555,10 +580,10 @@ static int cmd_sync_admin_glp(struct nvm_dev *dev, void *buf, uint32_t ndw,
 	return 0;
 }
 
-struct nvm_spec_idfy *nvm_be_spdk_idfy(struct nvm_dev *dev, struct nvm_ret *ret)
+int nvm_be_spdk_idfy(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		     struct nvm_ret *ret)
 {
 	struct nvm_be_spdk_state *state = dev->be_state;
-	struct nvm_spec_idfy *idfy = NULL;
 	const size_t idfy_len = sizeof(*idfy);
 
 	struct nvm_nvme_cmd cmd = { 0 };
@@ -566,20 +591,12 @@ struct nvm_spec_idfy *nvm_be_spdk_idfy(struct nvm_dev *dev, struct nvm_ret *ret)
 	cmd.opcode = NVM_AOPC_IDFY;
 	cmd.nsid = state->nsid;
 
-	idfy = nvm_buf_alloc(dev, idfy_len, NULL);
-	if (!idfy) {
-		errno = ENOMEM;
-		return NULL;
-	}
-	memset(idfy, 0, sizeof(*idfy));
-
 	if (cmd_sync_admin(dev, &cmd, idfy, idfy_len, NULL, 0, 0x0, ret)) {
 		NVM_DEBUG("FAILED: cmd_sync_admin");
-		nvm_buf_free(dev, idfy);
-		return NULL;
+		return -1;
 	}
 
-	return idfy;
+	return 0;
 }
 
 int nvm_be_spdk_gfeat(struct nvm_dev *dev, uint8_t id,
@@ -628,31 +645,21 @@ int nvm_be_spdk_sfeat(struct nvm_dev *dev, uint8_t id,
 	return 0;
 }
 
-struct nvm_spec_rprt *nvm_be_spdk_rprt(struct nvm_dev *dev,
-					      struct nvm_addr *addr,
-					      int NVM_UNUSED(opt),
-					      struct nvm_ret *ret)
+int nvm_be_spdk_rprt(struct nvm_dev *dev, struct nvm_addr *addr,
+		     int NVM_UNUSED(opt), struct nvm_spec_rprt *rprt,
+		     struct nvm_ret *ret)
 {
 	const size_t DESCR_NBYTES = sizeof(struct nvm_spec_rprt_descr);
 	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
 	size_t lpo_off = addr ? nvm_addr_gen2lpo(dev, *addr) : 0;
-	struct nvm_spec_rprt *rprt = NULL;
-	size_t rprt_len, ndescr;
+	size_t ndescr;
 
 	if (NVM_SPEC_VERID_20 != dev->verid) {
 		errno = EINVAL;
-		return NULL;
+		return -1;
 	}
 
 	ndescr = addr ? geo->l.nchunk : geo->l.nchunk * geo->l.npunit * geo->l.npugrp;
-	rprt_len = ndescr * DESCR_NBYTES + sizeof(rprt->ndescr);
-
-	rprt = nvm_buf_alloc(dev, rprt_len, NULL);
-	if (!rprt) {
-		errno = ENOMEM;
-		return NULL;
-	}
-	memset(rprt, 0, rprt_len);
 	rprt->ndescr = ndescr;
 
 	for (size_t i = 0; i < ndescr; i += 0x1000) {
@@ -661,43 +668,33 @@ struct nvm_spec_rprt *nvm_be_spdk_rprt(struct nvm_dev *dev,
 		if (cmd_sync_admin_glp(dev, &rprt->descr[i],
 				      (count * DESCR_NBYTES) / 4 - 1,
 				      lpo_off + i * DESCR_NBYTES, 0x0, ret)) {
-			nvm_buf_free(dev, rprt);
-			return NULL;
+			return -1;
 		}
 	}
 
-	return rprt;
+	return 0;
 }
 
-struct nvm_spec_bbt *nvm_be_spdk_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
-				      struct nvm_ret *ret)
+int nvm_be_spdk_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
+		     struct nvm_spec_bbt *bbt, struct nvm_ret *ret)
 {
 	struct nvm_be_spdk_state *state = dev->be_state;
 
 	const uint32_t nblks = dev->geo.g.nblocks * dev->geo.g.nplanes;
-	struct nvm_spec_bbt *bbt = NULL;
 	const size_t bbt_len = sizeof(*bbt) + sizeof(*(bbt->blk)) * nblks;
 
 	struct nvm_nvme_cmd cmd = { 0 };
 
-	bbt = nvm_buf_alloc(dev, bbt_len, NULL);
-	if (!bbt) {
-		errno = ENOMEM;
-		return NULL;
-	}
-	memset(bbt, 0, sizeof(*bbt));
-
 	cmd.opcode = NVM_AOPC_GBBT;
 	cmd.nsid = state->nsid;
 	cmd.addrs = nvm_addr_gen2dev(dev, addr);
 
 	if (cmd_sync_admin(dev, &cmd, bbt, bbt_len, NULL, 0, 0x0, ret)) {
 		NVM_DEBUG("FAILED: cmd_sync_admin");
-		nvm_buf_free(dev, bbt);
-		return NULL;
+		return -1;
 	}
 
-	return bbt;
+	return 0;
 }
 
 int nvm_be_spdk_sbbt(struct nvm_dev *dev, struct nvm_addr *addrs,
@@ -749,10 +746,15 @@ static void cmd_async_cb(void *cb_arg, const struct spdk_nvme_cpl *cpl)
 {
 	struct nvm_cmd_wrap *wrap = cb_arg;
 
-	wrap->ret->async.ctx->outstanding -= 1;
+	struct nvm_async_ctx *ctx = wrap->ret->async.ctx;
+
+	ctx->outstanding -= 1;
 
 	nvm_cmd_wrap_cpl(wrap, (const struct nvm_nvme_cpl*)cpl);
-	wrap->ret->async.cb(wrap->ret, wrap->ret->async.cb_arg);
+	if (ctx->reap)
+		ctx->reap[ctx->nreaped++] = wrap->ret;
+	else if (wrap->ret->async.cb)
+		wrap->ret->async.cb(wrap->ret, wrap->ret->async.cb_arg);
 	nvm_cmd_wrap_term(wrap);
 }
 
@@ -1161,6 +1163,7 @@ struct nvm_be nvm_be_spdk = {
 	.async_term = nvm_be_spdk_async_term,
 	.async_poke = nvm_be_spdk_async_poke,
 	.async_wait = nvm_be_spdk_async_wait,
+	.async_reap = nvm_be_spdk_async_reap,
 
 	.idfy = nvm_be_spdk_idfy,
 	.rprt = nvm_be_spdk_rprt,
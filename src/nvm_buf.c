@@ -31,6 +31,10 @@
 #include <liblightnvm.h>
 #include <nvm_dev.h>
 #include <nvm_be.h>
+#include <nvm_numa.h>
+#include <nvm_buf_arena.h>
+
+#define NVM_BUF_HUGEPAGE_NBYTES (2 * 1024 * 1024)
 
 #ifdef NVM_BE_SPDK_ENABLED
 #include <spdk/stdinc.h>
@@ -44,6 +48,14 @@ static inline void* spdk_dma_malloc(size_t NVM_UNUSED(size),
 	errno = ENOSYS;
 	return NULL;
 }
+static inline void* spdk_dma_malloc_socket(size_t NVM_UNUSED(size),
+					   size_t NVM_UNUSED(align),
+					   uint64_t *NVM_UNUSED(phys_addr),
+					   int NVM_UNUSED(socket_id))
+{
+	errno = ENOSYS;
+	return NULL;
+}
 static inline void spdk_dma_free(void *NVM_UNUSED(buf)) { }
 #define SPDK_VTOPHYS_ERROR	(0xFFFFFFFFFFFFFFFFULL)
 uint64_t spdk_vtophys(void *NVM_UNUSED(buf)) { return SPDK_VTOPHYS_ERROR; }
@@ -85,6 +97,50 @@ void nvm_buf_virt_free(void *buf)
 #endif
 }
 
+/**
+ * Allocate a virtual buffer placed according to the buffer options of 'dev'
+ */
+static inline void *_buf_virt_alloc_placed(const struct nvm_dev *dev,
+					   size_t alignment, size_t nbytes)
+{
+	const int node = dev->buf_opts.place ? dev->buf_opts.node : -1;
+	const int hugepages = dev->buf_opts.hugepages &&
+			      (nbytes >= NVM_BUF_HUGEPAGE_NBYTES);
+	void *buf;
+
+	if ((node < 0) && (!hugepages))
+		return nvm_buf_virt_alloc(alignment, nbytes);
+
+	// Whole pages, or hugepages, such that placement affects only 'buf'
+	alignment = NVM_MAX(alignment, hugepages ? NVM_BUF_HUGEPAGE_NBYTES : 4096);
+	nbytes = ((nbytes + alignment - 1) / alignment) * alignment;
+
+	buf = nvm_buf_virt_alloc(alignment, nbytes);
+	if (!buf)
+		return NULL;		// Propagate errno
+
+	if (nvm_numa_buf_place(buf, nbytes, node, hugepages)) {
+		NVM_DEBUG("FAILED: nvm_numa_buf_place, using as is");
+	}
+
+	return buf;
+}
+
+void *nvm_buf_dma_alloc(const struct nvm_dev *dev, size_t nbytes,
+			size_t alignment, uint64_t *phys)
+{
+	if (dev->buf_opts.place)
+		return spdk_dma_malloc_socket(nbytes, alignment, phys,
+					      dev->buf_opts.node);
+
+	return spdk_dma_malloc(nbytes, alignment, phys);
+}
+
+void nvm_buf_dma_free(const struct nvm_dev *NVM_UNUSED(dev), void *buf)
+{
+	spdk_dma_free(buf);
+}
+
 void *nvm_buf_alloc(const struct nvm_dev *dev, size_t nbytes, uint64_t *phys)
 {
 	size_t alignment = 4096;
@@ -104,14 +160,23 @@ void *nvm_buf_alloc(const struct nvm_dev *dev, size_t nbytes, uint64_t *phys)
 		return NULL;
 	}
 
+	if (dev->buf_opts.arena && (nbytes <= NVM_BUF_ARENA_CHUNK_NBYTES)) {
+		void *buf = nvm_buf_arena_alloc(dev->buf_arena, nbytes, phys);
+
+		if (buf)
+			return buf;
+
+		NVM_DEBUG("FAILED: nvm_buf_arena_alloc, allocating directly");
+	}
+
 	switch(dev->be->id) {
 	case NVM_BE_IOCTL:
 	case NVM_BE_LBD:
-		return nvm_buf_virt_alloc(alignment, nbytes);
+		return _buf_virt_alloc_placed(dev, alignment, nbytes);
 
 	case NVM_BE_SPDK:
 	case NVM_BE_NOCD:
-		return spdk_dma_malloc(nbytes, alignment, phys);
+		return nvm_buf_dma_alloc(dev, nbytes, alignment, phys);
 
 	case NVM_BE_ANY:
 		errno = EINVAL;
@@ -125,6 +190,7 @@ void *nvm_buf_alloc(const struct nvm_dev *dev, size_t nbytes, uint64_t *phys)
 void *nvm_buf_realloc(const struct nvm_dev *dev, void *buf, size_t nbytes,
 		      uint64_t *phys)
 {
+	struct nvm_buf_arena_chunk *chunk;
 	size_t alignment = 4096;
 
 	switch (dev->geo.verid) {
@@ -142,6 +208,19 @@ void *nvm_buf_realloc(const struct nvm_dev *dev, void *buf, size_t nbytes,
 		return NULL;
 	}
 
+	chunk = nvm_buf_arena_chunk(dev->buf_arena, buf);
+	if (chunk) {		// Move it, the arena has no in-place growth
+		void *moved = nvm_buf_alloc(dev, nbytes, phys);
+
+		if (!moved)
+			return NULL;	// Propagate errno
+
+		memcpy(moved, buf, NVM_MIN(nbytes, nvm_buf_arena_nbytes(chunk)));
+		nvm_buf_arena_free(dev->buf_arena, buf);
+
+		return moved;
+	}
+
 	switch (dev->be->id) {
 	case NVM_BE_IOCTL:
 	case NVM_BE_LBD:
@@ -162,6 +241,11 @@ void *nvm_buf_realloc(const struct nvm_dev *dev, void *buf, size_t nbytes,
 
 void nvm_buf_free(const struct nvm_dev *dev, void *buf)
 {
+	if (nvm_buf_arena_chunk(dev->buf_arena, buf)) {
+		nvm_buf_arena_free(dev->buf_arena, buf);
+		return;
+	}
+
 	switch(dev->be->id) {
 		case NVM_BE_IOCTL:
 		case NVM_BE_LBD:
@@ -187,6 +271,9 @@ int nvm_buf_vtophys(const struct nvm_dev *dev, void *buf, uint64_t *phys)
 		return -1;
 	}
 
+	if (dev->be->vtophys)
+		return dev->be->vtophys(dev, buf, phys);
+
 	switch(dev->be->id) {
 		case NVM_BE_ANY:
 			NVM_DEBUG("FAILED: invalid be-id: %d", dev->be->id);
@@ -0,0 +1,444 @@
+/*
+ * nvm_buf_arena - Size-class arena for DMA buffers
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_numa.h>
+#include <nvm_buf_arena.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#if defined(__linux__) && defined(MAP_HUGETLB) && !defined(MAP_HUGE_2MB)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)	///< log2 of 2 MiB
+#endif
+
+static atomic_uint arena_nthreads;
+static _Thread_local unsigned arena_tid;	///< Thread number + 1, 0 unset
+
+/**
+ * Returns the cache of the calling thread, threads are spread round-robin
+ */
+static inline struct nvm_buf_arena_cache *arena_cache(
+						struct nvm_buf_arena *arena)
+{
+	if (!arena_tid)
+		arena_tid = atomic_fetch_add(&arena_nthreads, 1) + 1;
+
+	return &arena->caches[(arena_tid - 1) % NVM_BUF_ARENA_NCACHES];
+}
+
+/**
+ * Returns the size class of 'nbytes', -1 when too large for the arena
+ */
+static inline int arena_class(const struct nvm_buf_arena *arena, size_t nbytes)
+{
+	size_t cls_nbytes = NVM_BUF_ARENA_CLASS_MIN;
+	int cls = 0;
+
+	nbytes = NVM_MAX(nbytes, arena->align);
+	while (cls_nbytes < nbytes) {
+		cls_nbytes <<= 1;
+		++cls;
+	}
+
+	return cls < NVM_BUF_ARENA_NCLASSES ? cls : -1;
+}
+
+size_t nvm_buf_arena_nbytes(const struct nvm_buf_arena_chunk *chunk)
+{
+	return (size_t)NVM_BUF_ARENA_CLASS_MIN << chunk->cls;
+}
+
+static inline size_t arena_hash(uintptr_t key)
+{
+	const size_t nslots = 2 * NVM_BUF_ARENA_NCHUNKS_MAX;
+
+	return ((key / NVM_BUF_ARENA_CHUNK_NBYTES) * 0x9E3779B97F4A7C15ULL) %
+	       nslots;
+}
+
+struct nvm_buf_arena_chunk *nvm_buf_arena_chunk(struct nvm_buf_arena *arena,
+						const void *buf)
+{
+	const size_t nslots = 2 * NVM_BUF_ARENA_NCHUNKS_MAX;
+	const uintptr_t key = (uintptr_t)buf &
+			      ~((uintptr_t)NVM_BUF_ARENA_CHUNK_NBYTES - 1);
+
+	if (!arena || !buf)
+		return NULL;
+
+	for (size_t i = arena_hash(key), n = 0; n < nslots;
+	     i = (i + 1) % nslots, ++n) {
+		const uintptr_t slot = atomic_load_explicit(&arena->keys[i],
+							memory_order_acquire);
+
+		if (!slot)
+			return NULL;
+		if (slot == key)
+			return &arena->chunks[atomic_load(&arena->vals[i]) - 1];
+	}
+
+	return NULL;
+}
+
+/**
+ * Map a chunk, with hugepages enabled for the device by a reserved 2 MiB
+ * hugepage when there are any, otherwise by normal pages advised for
+ * transparent hugepages
+ */
+static int arena_chunk_map(struct nvm_buf_arena *arena,
+			   struct nvm_buf_arena_chunk *chunk)
+{
+	const struct nvm_dev *dev = arena->dev;
+	const size_t nbytes = NVM_BUF_ARENA_CHUNK_NBYTES;
+	const int node = nvm_dev_get_numa_node(dev);
+	const int hugepages = nvm_dev_get_buf_hugepages(dev);
+
+	switch (dev->be->id) {
+	case NVM_BE_SPDK:
+	case NVM_BE_NOCD:
+		chunk->base = nvm_buf_dma_alloc(dev, nbytes, nbytes,
+						&chunk->phys);
+		chunk->backing = NVM_BUF_ARENA_DMA;
+		return chunk->base ? 0 : -1;
+
+	default:
+		break;
+	}
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+	// Sized explicitly, the default hugepage may be larger than a chunk
+	chunk->base = hugepages ? mmap(NULL, nbytes, PROT_READ | PROT_WRITE,
+				       MAP_PRIVATE | MAP_ANONYMOUS |
+				       MAP_HUGETLB | MAP_HUGE_2MB, -1, 0) :
+				  MAP_FAILED;
+	if (chunk->base != MAP_FAILED) {
+		chunk->backing = NVM_BUF_ARENA_HUGETLB;
+		if ((node >= 0) && nvm_numa_buf_place(chunk->base, nbytes,
+						      node, 0)) {
+			NVM_DEBUG("FAILED: nvm_numa_buf_place, using as is");
+		}
+		return 0;
+	}
+#endif
+
+	chunk->base = nvm_buf_virt_alloc(nbytes, nbytes);
+	if (!chunk->base)
+		return -1;		// Propagate errno
+
+	chunk->backing = NVM_BUF_ARENA_VIRT;
+	if (((node >= 0) || hugepages) &&
+	    nvm_numa_buf_place(chunk->base, nbytes, node, hugepages)) {
+		NVM_DEBUG("FAILED: nvm_numa_buf_place, using as is");
+	}
+
+	return 0;
+}
+
+static void arena_chunk_unmap(struct nvm_buf_arena *arena,
+			      struct nvm_buf_arena_chunk *chunk)
+{
+	switch (chunk->backing) {
+	case NVM_BUF_ARENA_DMA:
+		nvm_buf_dma_free(arena->dev, chunk->base);
+		break;
+#if defined(__linux__) && defined(MAP_HUGETLB)
+	case NVM_BUF_ARENA_HUGETLB:
+		munmap(chunk->base, NVM_BUF_ARENA_CHUNK_NBYTES);
+		break;
+#endif
+	default:
+		nvm_buf_virt_free(chunk->base);
+		break;
+	}
+}
+
+/**
+ * Returns a chunk for size class 'cls', the lock is held
+ */
+static struct nvm_buf_arena_chunk *arena_chunk_get(struct nvm_buf_arena *arena,
+						   int cls)
+{
+	const size_t nslots = 2 * NVM_BUF_ARENA_NCHUNKS_MAX;
+	struct nvm_buf_arena_chunk *chunk = arena->unassigned;
+	const size_t nchunks = atomic_load(&arena->nchunks);
+	uintptr_t key;
+	size_t i;
+
+	if (chunk) {
+		arena->unassigned = chunk->next;
+		goto out;
+	}
+
+	if (nchunks == NVM_BUF_ARENA_NCHUNKS_MAX) {
+		NVM_DEBUG("FAILED: arena is full");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	chunk = &arena->chunks[nchunks];
+	if (arena_chunk_map(arena, chunk)) {
+		NVM_DEBUG("FAILED: arena_chunk_map");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	key = (uintptr_t)chunk->base;
+	for (i = arena_hash(key); atomic_load(&arena->keys[i]);
+	     i = (i + 1) % nslots)
+		;
+	atomic_store(&arena->vals[i], nchunks + 1);
+	atomic_store_explicit(&arena->keys[i], key, memory_order_release);
+	atomic_store(&arena->nchunks, nchunks + 1);
+
+out:
+	chunk->cls = cls;
+	chunk->ncarved = 0;
+	chunk->next = NULL;
+
+	return chunk;
+}
+
+/**
+ * Take up to 'max' free blocks of size class 'cls' off the arena, flushed by
+ * caches or carved off chunks, into the list at 'list'
+ *
+ * @return The number of blocks taken, 0 on error with errno set
+ */
+static size_t arena_refill(struct nvm_buf_arena *arena, int cls, void **list,
+			   size_t max)
+{
+	const size_t cls_nbytes = (size_t)NVM_BUF_ARENA_CLASS_MIN << cls;
+	const size_t nblocks = NVM_BUF_ARENA_CHUNK_NBYTES / cls_nbytes;
+	size_t n = 0;
+
+	pthread_mutex_lock(&arena->lock);
+	while (n < max && arena->free[cls]) {
+		void *block = arena->free[cls];
+
+		arena->free[cls] = *(void **)block;
+		*(void **)block = *list;
+		*list = block;
+		++n;
+	}
+
+	while (n < max) {
+		struct nvm_buf_arena_chunk *chunk = arena->carve[cls];
+		void *block;
+
+		if (!chunk || chunk->ncarved == nblocks) {
+			if (n)
+				break;	// Map chunks only when out of blocks
+
+			chunk = arena_chunk_get(arena, cls);
+			if (!chunk)
+				break;	// Propagate errno
+			arena->carve[cls] = chunk;
+		}
+
+		block = chunk->base + chunk->ncarved++ * cls_nbytes;
+		*(void **)block = *list;
+		*list = block;
+		++n;
+	}
+	pthread_mutex_unlock(&arena->lock);
+
+	return n;
+}
+
+/**
+ * Move 'n' blocks of size class 'cls' of the cache to the arena, the cache
+ * lock is held
+ */
+static void arena_flush(struct nvm_buf_arena *arena,
+			struct nvm_buf_arena_cache *cache, int cls, size_t n)
+{
+	pthread_mutex_lock(&arena->lock);
+	for (size_t i = 0; i < n && cache->free[cls]; ++i) {
+		void *block = cache->free[cls];
+
+		cache->free[cls] = *(void **)block;
+		--cache->nfree[cls];
+
+		*(void **)block = arena->free[cls];
+		arena->free[cls] = block;
+	}
+	pthread_mutex_unlock(&arena->lock);
+}
+
+struct nvm_buf_arena *nvm_buf_arena_create(const struct nvm_dev *dev)
+{
+	struct nvm_buf_arena *arena;
+
+	if (!dev) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	arena = calloc(1, sizeof(*arena));
+	if (!arena) {
+		NVM_DEBUG("FAILED: calloc");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	arena->dev = dev;
+	switch (dev->geo.verid) {
+	case NVM_SPEC_VERID_12:
+		arena->align = dev->geo.sector_nbytes;
+		break;
+	case NVM_SPEC_VERID_20:
+		arena->align = dev->geo.l.nbytes;
+		break;
+	default:
+		arena->align = 4096;
+		break;
+	}
+
+	pthread_mutex_init(&arena->lock, NULL);
+	for (int i = 0; i < NVM_BUF_ARENA_NCACHES; ++i)
+		pthread_mutex_init(&arena->caches[i].lock, NULL);
+
+	return arena;
+}
+
+void nvm_buf_arena_destroy(struct nvm_buf_arena *arena)
+{
+	if (!arena)
+		return;
+
+	for (size_t i = 0; i < atomic_load(&arena->nchunks); ++i)
+		arena_chunk_unmap(arena, &arena->chunks[i]);
+
+	for (int i = 0; i < NVM_BUF_ARENA_NCACHES; ++i)
+		pthread_mutex_destroy(&arena->caches[i].lock);
+	pthread_mutex_destroy(&arena->lock);
+
+	free(arena);
+}
+
+void *nvm_buf_arena_alloc(struct nvm_buf_arena *arena, size_t nbytes,
+			  uint64_t *phys)
+{
+	struct nvm_buf_arena_cache *cache;
+	struct nvm_buf_arena_chunk *chunk;
+	void *block;
+	int cls;
+
+	if (!arena || !nbytes) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cls = arena_class(arena, nbytes);
+	if (cls < 0) {
+		NVM_DEBUG("FAILED: nbytes: %zu exceeds a chunk", nbytes);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cache = arena_cache(arena);
+	pthread_mutex_lock(&cache->lock);
+	if (!cache->free[cls]) {
+		cache->nfree[cls] = arena_refill(arena, cls, &cache->free[cls],
+						 NVM_BUF_ARENA_BATCH);
+		if (!cache->nfree[cls]) {
+			pthread_mutex_unlock(&cache->lock);
+			return NULL;	// Propagate errno
+		}
+	}
+	block = cache->free[cls];
+	cache->free[cls] = *(void **)block;
+	--cache->nfree[cls];
+	pthread_mutex_unlock(&cache->lock);
+
+	if (phys) {
+		chunk = nvm_buf_arena_chunk(arena, block);
+		*phys = chunk->phys + ((char *)block - chunk->base);
+	}
+
+	return block;
+}
+
+void nvm_buf_arena_free(struct nvm_buf_arena *arena, void *buf)
+{
+	struct nvm_buf_arena_chunk *chunk = nvm_buf_arena_chunk(arena, buf);
+	struct nvm_buf_arena_cache *cache;
+	int cls;
+
+	if (!chunk || (chunk->cls < 0)) {
+		NVM_DEBUG("FAILED: buf: %p is not from the arena", buf);
+		return;
+	}
+	cls = chunk->cls;
+
+	cache = arena_cache(arena);
+	pthread_mutex_lock(&cache->lock);
+	*(void **)buf = cache->free[cls];
+	cache->free[cls] = buf;
+	if (++cache->nfree[cls] > NVM_BUF_ARENA_CACHE_MAX)
+		arena_flush(arena, cache, cls, NVM_BUF_ARENA_CACHE_MAX / 2);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void nvm_buf_arena_reset(struct nvm_buf_arena *arena)
+{
+	if (!arena)
+		return;
+
+	for (int i = 0; i < NVM_BUF_ARENA_NCACHES; ++i)
+		pthread_mutex_lock(&arena->caches[i].lock);
+	pthread_mutex_lock(&arena->lock);
+
+	for (int i = 0; i < NVM_BUF_ARENA_NCACHES; ++i) {
+		memset(arena->caches[i].free, 0, sizeof(arena->caches[i].free));
+		memset(arena->caches[i].nfree, 0,
+		       sizeof(arena->caches[i].nfree));
+	}
+	memset(arena->free, 0, sizeof(arena->free));
+	memset(arena->carve, 0, sizeof(arena->carve));
+
+	// Chunks stay mapped, and in the lookup, for any size class to take
+	arena->unassigned = NULL;
+	for (size_t i = atomic_load(&arena->nchunks); i-- > 0;) {
+		arena->chunks[i].cls = -1;
+		arena->chunks[i].next = arena->unassigned;
+		arena->unassigned = &arena->chunks[i];
+	}
+
+	pthread_mutex_unlock(&arena->lock);
+	for (int i = NVM_BUF_ARENA_NCACHES; i-- > 0;)
+		pthread_mutex_unlock(&arena->caches[i].lock);
+}
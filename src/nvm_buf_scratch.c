@@ -0,0 +1,112 @@
+/*
+ * nvm_buf_scratch - Per-thread scratch buffers of a device
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_buf_scratch.h>
+
+static atomic_uint scratch_nthreads;
+static _Thread_local unsigned scratch_tid;	///< Thread number + 1, 0 unset
+
+void *nvm_buf_scratch_get(struct nvm_dev *dev, size_t nbytes)
+{
+	struct nvm_buf_scratch *scratch = &dev->buf_scratch;
+
+	if (!nbytes) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (!scratch_tid)
+		scratch_tid = atomic_fetch_add(&scratch_nthreads, 1) + 1;
+
+	for (int i = 0; i < NVM_BUF_SCRATCH_NSLOTS; ++i) {
+		const int idx = (scratch_tid - 1 + i) % NVM_BUF_SCRATCH_NSLOTS;
+		struct nvm_buf_scratch_slot *slot = &scratch->slots[idx];
+
+		if (atomic_load_explicit(&slot->busy, memory_order_relaxed) ||
+		    atomic_exchange_explicit(&slot->busy, 1,
+					     memory_order_acquire))
+			continue;
+
+		if (slot->nbytes < nbytes) {
+			void *buf;
+
+			nvm_buf_free(dev, atomic_exchange(&slot->buf, NULL));
+			slot->nbytes = 0;
+
+			buf = nvm_buf_alloc(dev, nbytes, NULL);
+			if (!buf) {
+				NVM_DEBUG("FAILED: nvm_buf_alloc");
+				atomic_store_explicit(&slot->busy, 0,
+						      memory_order_release);
+				errno = ENOMEM;
+				return NULL;
+			}
+			atomic_store(&slot->buf, buf);
+			slot->nbytes = nbytes;
+		}
+
+		return atomic_load_explicit(&slot->buf, memory_order_relaxed);
+	}
+
+	return nvm_buf_alloc(dev, nbytes, NULL);	// All slots are held
+}
+
+void nvm_buf_scratch_put(struct nvm_dev *dev, void *buf)
+{
+	struct nvm_buf_scratch *scratch = &dev->buf_scratch;
+
+	if (!buf)
+		return;
+
+	for (int i = 0; i < NVM_BUF_SCRATCH_NSLOTS; ++i) {
+		struct nvm_buf_scratch_slot *slot = &scratch->slots[i];
+
+		// Held buffers are distinct, a match is the slot of 'buf'
+		if (atomic_load_explicit(&slot->buf, memory_order_relaxed) != buf)
+			continue;
+
+		atomic_store_explicit(&slot->busy, 0, memory_order_release);
+		return;
+	}
+
+	nvm_buf_free(dev, buf);
+}
+
+void nvm_buf_scratch_term(struct nvm_dev *dev)
+{
+	struct nvm_buf_scratch *scratch = &dev->buf_scratch;
+
+	for (int i = 0; i < NVM_BUF_SCRATCH_NSLOTS; ++i) {
+		struct nvm_buf_scratch_slot *slot = &scratch->slots[i];
+
+		nvm_buf_free(dev, atomic_exchange(&slot->buf, NULL));
+		slot->nbytes = 0;
+	}
+}
@@ -0,0 +1,546 @@
+/*
+ * nvm_chunks - Wear- and state-aware chunk allocator
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_chunks.h>
+
+static inline void _pu_lock(struct nvm_chunks_pu *pu)
+{
+	while (atomic_flag_test_and_set_explicit(&pu->lock,
+						 memory_order_acquire))
+		;
+}
+
+static inline void _pu_unlock(struct nvm_chunks_pu *pu)
+{
+	atomic_flag_clear_explicit(&pu->lock, memory_order_release);
+}
+
+static inline uint32_t _bucket(uint16_t ncycles)
+{
+	return NVM_MIN(ncycles, NVM_CHUNKS_NBUCKETS - 1);
+}
+
+/**
+ * Index of the parallel unit holding 'addr', parallel units are numbered as
+ * the descriptors of a device-wide chunk report, group-major
+ */
+static inline int _pu_idx(const struct nvm_chunks *chunks,
+			  struct nvm_addr addr)
+{
+	if (chunks->dev->verid == NVM_SPEC_VERID_20)
+		return addr.l.pugrp * chunks->nunits + addr.l.punit;
+
+	return addr.g.ch * chunks->nunits + addr.g.lun;
+}
+
+static inline int _chunk_idx(const struct nvm_chunks *chunks,
+			     struct nvm_addr addr)
+{
+	if (chunks->dev->verid == NVM_SPEC_VERID_20)
+		return addr.l.chunk;
+
+	return addr.g.blk;
+}
+
+static inline struct nvm_addr _addr(const struct nvm_chunks *chunks,
+				    uint32_t pu, uint32_t chunk)
+{
+	struct nvm_addr addr = { .val = 0 };
+
+	if (chunks->dev->verid == NVM_SPEC_VERID_20) {
+		addr.l.pugrp = pu / chunks->nunits;
+		addr.l.punit = pu % chunks->nunits;
+		addr.l.chunk = chunk;
+	} else {
+		addr.g.ch = pu / chunks->nunits;
+		addr.g.lun = pu % chunks->nunits;
+		addr.g.blk = chunk;
+	}
+
+	return addr;
+}
+
+/**
+ * Position of parallel unit 'pu' in the order stripes visit them, consecutive
+ * positions alternate between groups
+ */
+static inline uint32_t _pu_pos(const struct nvm_chunks *chunks, uint32_t pu)
+{
+	return (pu % chunks->nunits) * chunks->ngrps + pu / chunks->nunits;
+}
+
+/**
+ * Parallel unit at position 'pos' in the order stripes visit them
+ */
+static inline uint32_t _pos_pu(const struct nvm_chunks *chunks, uint32_t pos)
+{
+	return (pos % chunks->ngrps) * chunks->nunits + pos / chunks->ngrps;
+}
+
+/**
+ * First position at or after 'pos' of a parallel unit with free chunks
+ *
+ * @return The position, NVM_CHUNKS_NIL when there is none
+ */
+static inline uint32_t _next_nonempty(const struct nvm_chunks *chunks,
+				      uint32_t pos)
+{
+	for (uint32_t w = pos / 64; w < (chunks->npus + 63) / 64; ++w) {
+		uint64_t bits = atomic_load(&chunks->nonempty[w]);
+
+		if (w == pos / 64)
+			bits &= ~0ULL << (pos % 64);
+		if (bits)
+			return w * 64 + __builtin_ctzll(bits);
+	}
+
+	return NVM_CHUNKS_NIL;
+}
+
+/**
+ * Push chunk 'id' on the free list of its parallel unit, caller holds the lock
+ */
+static inline void _push(struct nvm_chunks *chunks, struct nvm_chunks_pu *pu,
+			 uint32_t id)
+{
+	const uint32_t b = _bucket(chunks->ncycles[id]);
+
+	chunks->next[id] = pu->heads[b];
+	pu->heads[b] = id;
+	pu->nonempty[b / 64] |= 1ULL << (b % 64);
+
+	chunks->state[id] = NVM_CHUNKS_FREE;
+	if (!pu->nfree++) {
+		const uint32_t pos = _pu_pos(chunks, pu - chunks->pus);
+
+		atomic_fetch_or(&chunks->nonempty[pos / 64],
+				1ULL << (pos % 64));
+	}
+	atomic_fetch_add(&chunks->nfree, 1);
+}
+
+/**
+ * Pop the least worn chunk of 'pu', caller holds the lock
+ *
+ * @return Chunk id, NVM_CHUNKS_NIL when 'pu' has no free chunks
+ */
+static inline uint32_t _pop(struct nvm_chunks *chunks,
+			    struct nvm_chunks_pu *pu)
+{
+	for (uint32_t w = 0; w < NVM_CHUNKS_NBUCKETS / 64; ++w) {
+		uint32_t b, id;
+
+		if (!pu->nonempty[w])
+			continue;
+
+		b = w * 64 + __builtin_ctzll(pu->nonempty[w]);
+		id = pu->heads[b];
+
+		pu->heads[b] = chunks->next[id];
+		if (pu->heads[b] == NVM_CHUNKS_NIL)
+			pu->nonempty[w] &= ~(1ULL << (b % 64));
+
+		chunks->state[id] = NVM_CHUNKS_USED;
+		if (!--pu->nfree) {
+			const uint32_t pos = _pu_pos(chunks, pu - chunks->pus);
+
+			atomic_fetch_and(&chunks->nonempty[pos / 64],
+					 ~(1ULL << (pos % 64)));
+		}
+		atomic_fetch_sub(&chunks->nfree, 1);
+
+		return id;
+	}
+
+	return NVM_CHUNKS_NIL;
+}
+
+static int _cmp_u64(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Classify the chunks from one device-wide chunk report
+ *
+ * The wear-level index is not a count of P/E cycles, it only orders the free
+ * chunks, which are pushed most worn first, such that among chunks of equal
+ * cycles the least worn is popped first.
+ */
+static int _scan_s20(struct nvm_chunks *chunks)
+{
+	struct nvm_spec_rprt *rprt;
+	uint64_t *order;
+	uint32_t nfree = 0;
+
+	rprt = nvm_cmd_rprt(chunks->dev, NULL, 0x0, NULL);
+	if (!rprt) {
+		NVM_DEBUG("FAILED: nvm_cmd_rprt");
+		return -1;		// Propagate errno
+	}
+	if (rprt->ndescr != chunks->npus * chunks->nchunk) {
+		NVM_DEBUG("FAILED: unexpected ndescr: %"PRIu32, rprt->ndescr);
+		nvm_buf_free(chunks->dev, rprt);
+		errno = EIO;
+		return -1;
+	}
+
+	order = malloc(rprt->ndescr * sizeof(*order));
+	if (!order) {
+		NVM_DEBUG("FAILED: malloc(order)");
+		nvm_buf_free(chunks->dev, rprt);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (uint32_t id = 0; id < rprt->ndescr; ++id) {
+		const struct nvm_spec_rprt_descr *descr = &rprt->descr[id];
+
+		switch (descr->cs) {
+		case NVM_CHUNK_STATE_FREE:
+			order[nfree++] = ((uint64_t)(UINT8_MAX - descr->wli)
+					  << 32) | id;
+			break;
+
+		case NVM_CHUNK_STATE_OFFLINE:
+			chunks->state[id] = NVM_CHUNKS_BAD;
+			break;
+
+		default:
+			chunks->state[id] = NVM_CHUNKS_USED;
+			break;
+		}
+	}
+
+	qsort(order, nfree, sizeof(*order), _cmp_u64);
+	for (uint32_t i = 0; i < nfree; ++i) {
+		const uint32_t id = order[i] & UINT32_MAX;
+
+		_push(chunks, &chunks->pus[id / chunks->nchunk], id);
+	}
+
+	free(order);
+	nvm_buf_free(chunks->dev, rprt);
+
+	return 0;
+}
+
+/**
+ * Classify the blocks from the bad-block-table of every LUN, a block is free
+ * when it is good on every plane, 1.2 devices report no wear
+ */
+static int _scan_s12(struct nvm_chunks *chunks)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(chunks->dev);
+
+	for (uint32_t pu = 0; pu < chunks->npus; ++pu) {
+		const struct nvm_addr addr = _addr(chunks, pu, 0);
+		const struct nvm_bbt *bbt;
+
+		bbt = nvm_bbt_get(chunks->dev, addr, NULL);
+		if (!bbt) {
+			NVM_DEBUG("FAILED: nvm_bbt_get");
+			return -1;	// Propagate errno
+		}
+
+		for (uint32_t blk = 0; blk < chunks->nchunk; ++blk) {
+			const uint32_t id = pu * chunks->nchunk + blk;
+			int good = 1;
+
+			for (size_t pl = 0; pl < geo->g.nplanes; ++pl)
+				good &= bbt->blks[blk * geo->g.nplanes + pl] ==
+					NVM_BBT_FREE;
+
+			if (good)
+				_push(chunks, &chunks->pus[pu], id);
+			else
+				chunks->state[id] = NVM_CHUNKS_BAD;
+		}
+	}
+
+	return 0;
+}
+
+struct nvm_chunks *nvm_chunks_alloc(struct nvm_dev *dev)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_chunks *chunks;
+	size_t nchunks;
+	int err;
+
+	chunks = calloc(1, sizeof(*chunks));
+	if (!chunks) {
+		NVM_DEBUG("FAILED: calloc(chunks)");
+		errno = ENOMEM;
+		return NULL;
+	}
+	chunks->dev = dev;
+
+	switch (nvm_dev_get_verid(dev)) {
+	case NVM_SPEC_VERID_12:
+		chunks->ngrps = geo->g.nchannels;
+		chunks->nunits = geo->g.nluns;
+		chunks->nchunk = geo->g.nblocks;
+		break;
+
+	case NVM_SPEC_VERID_20:
+		chunks->ngrps = geo->l.npugrp;
+		chunks->nunits = geo->l.npunit;
+		chunks->nchunk = geo->l.nchunk;
+		break;
+
+	default:
+		NVM_DEBUG("FAILED: unsupported verid");
+		free(chunks);
+		errno = ENOSYS;
+		return NULL;
+	}
+	chunks->npus = chunks->ngrps * chunks->nunits;
+	nchunks = (size_t)chunks->npus * chunks->nchunk;
+
+	chunks->pus = calloc(chunks->npus, sizeof(*chunks->pus));
+	chunks->next = calloc(nchunks, sizeof(*chunks->next));
+	chunks->ncycles = calloc(nchunks, sizeof(*chunks->ncycles));
+	chunks->state = calloc(nchunks, sizeof(*chunks->state));
+	chunks->nonempty = calloc((chunks->npus + 63) / 64,
+				  sizeof(*chunks->nonempty));
+	if (!(chunks->pus && chunks->next && chunks->ncycles &&
+	      chunks->state && chunks->nonempty)) {
+		NVM_DEBUG("FAILED: calloc");
+		nvm_chunks_free(chunks);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (uint32_t pu = 0; pu < chunks->npus; ++pu) {
+		atomic_flag_clear(&chunks->pus[pu].lock);
+		for (uint32_t b = 0; b < NVM_CHUNKS_NBUCKETS; ++b)
+			chunks->pus[pu].heads[b] = NVM_CHUNKS_NIL;
+	}
+
+	if (nvm_dev_get_verid(dev) == NVM_SPEC_VERID_20)
+		err = _scan_s20(chunks);
+	else
+		err = _scan_s12(chunks);
+
+	if (err) {
+		nvm_chunks_free(chunks);
+		return NULL;	// Propagate errno
+	}
+
+	return chunks;
+}
+
+void nvm_chunks_free(struct nvm_chunks *chunks)
+{
+	if (!chunks)
+		return;
+
+	free(chunks->pus);
+	free(chunks->next);
+	free(chunks->ncycles);
+	free(chunks->state);
+	free(chunks->nonempty);
+	free(chunks);
+}
+
+int nvm_chunks_get(struct nvm_chunks *chunks, int naddrs,
+		   struct nvm_addr addrs[])
+{
+	const uint32_t bgn = atomic_fetch_add(&chunks->cursor, 1) %
+			     chunks->npus;
+	uint32_t pos = bgn;
+	int wrapped = 0;
+	int nalloc = 0;
+
+	if ((naddrs < 0) || ((uint32_t)naddrs > chunks->npus)) {
+		NVM_DEBUG("FAILED: invalid naddrs: %d", naddrs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Visit the parallel units with free chunks once, from 'bgn' around
+	while (nalloc < naddrs) {
+		uint32_t pu, id;
+
+		pos = _next_nonempty(chunks, pos);
+		if (wrapped && (pos >= bgn))	// Includes NVM_CHUNKS_NIL
+			break;
+		if (pos == NVM_CHUNKS_NIL) {
+			wrapped = 1;
+			pos = 0;
+			continue;
+		}
+		pu = _pos_pu(chunks, pos++);
+
+		_pu_lock(&chunks->pus[pu]);
+		id = _pop(chunks, &chunks->pus[pu]);
+		_pu_unlock(&chunks->pus[pu]);
+
+		if (id == NVM_CHUNKS_NIL)	// Emptied since the bit was read
+			continue;
+
+		addrs[nalloc++] = _addr(chunks, pu, id % chunks->nchunk);
+	}
+
+	if (nalloc < naddrs) {
+		NVM_DEBUG("FAILED: nalloc(%d) < naddrs(%d)", nalloc, naddrs);
+		for (int i = 0; i < nalloc; ++i) {
+			const uint32_t pu = _pu_idx(chunks, addrs[i]);
+			const uint32_t id = pu * chunks->nchunk +
+					    _chunk_idx(chunks, addrs[i]);
+
+			_pu_lock(&chunks->pus[pu]);
+			_push(chunks, &chunks->pus[pu], id);
+			_pu_unlock(&chunks->pus[pu]);
+		}
+		errno = ENOSPC;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nvm_chunks_get_line(struct nvm_chunks *chunks, struct nvm_addr addrs[])
+{
+	if (nvm_chunks_get(chunks, chunks->npus, addrs))
+		return -1;	// Propagate errno
+
+	return chunks->npus;
+}
+
+/**
+ * Move chunks handed out by nvm_chunks_get to the free lists, or retire them
+ */
+static int _release(struct nvm_chunks *chunks, const struct nvm_addr addrs[],
+		    int naddrs, int retire)
+{
+	int nerr = 0;
+
+	for (int i = 0; i < naddrs; ++i) {
+		const int pu = _pu_idx(chunks, addrs[i]);
+		const int chunk = _chunk_idx(chunks, addrs[i]);
+		uint32_t id;
+
+		if ((pu < 0) || ((uint32_t)pu >= chunks->npus) ||
+		    (chunk < 0) || ((uint32_t)chunk >= chunks->nchunk)) {
+			NVM_DEBUG("FAILED: invalid address");
+			++nerr;
+			continue;
+		}
+		id = pu * chunks->nchunk + chunk;
+
+		_pu_lock(&chunks->pus[pu]);
+		if (chunks->state[id] != NVM_CHUNKS_USED) {
+			_pu_unlock(&chunks->pus[pu]);
+			NVM_DEBUG("FAILED: chunk is not in use");
+			++nerr;
+			continue;
+		}
+
+		if (retire) {
+			chunks->state[id] = NVM_CHUNKS_BAD;
+		} else {
+			// A chunk is reset once per use, count the cycle
+			if (chunks->ncycles[id] < UINT16_MAX)
+				++chunks->ncycles[id];
+			_push(chunks, &chunks->pus[pu], id);
+		}
+		_pu_unlock(&chunks->pus[pu]);
+	}
+
+	if (nerr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nvm_chunks_put(struct nvm_chunks *chunks, const struct nvm_addr addrs[],
+		   int naddrs)
+{
+	return _release(chunks, addrs, naddrs, 0);
+}
+
+int nvm_chunks_retire(struct nvm_chunks *chunks, const struct nvm_addr addrs[],
+		      int naddrs)
+{
+	return _release(chunks, addrs, naddrs, 1);
+}
+
+uint32_t nvm_chunks_get_nfree(struct nvm_chunks *chunks)
+{
+	return atomic_load(&chunks->nfree);
+}
+
+void nvm_chunks_pr(struct nvm_chunks *chunks)
+{
+	size_t nused = 0, nbad = 0;
+
+	if (!chunks) {
+		printf("chunks: ~\n");
+		return;
+	}
+
+	for (size_t id = 0; id < (size_t)chunks->npus * chunks->nchunk; ++id) {
+		nused += chunks->state[id] == NVM_CHUNKS_USED;
+		nbad += chunks->state[id] == NVM_CHUNKS_BAD;
+	}
+
+	printf("chunks:\n");
+	printf("  npus: %"PRIu32"\n", chunks->npus);
+	printf("  nchunk: %"PRIu32"\n", chunks->nchunk);
+	printf("  nfree: %"PRIu32"\n", nvm_chunks_get_nfree(chunks));
+	printf("  nused: %zu\n", nused);
+	printf("  nbad: %zu\n", nbad);
+	printf("  pus:\n");
+	for (uint32_t pu = 0; pu < chunks->npus; ++pu) {
+		struct nvm_chunks_pu *p = &chunks->pus[pu];
+		uint32_t ncycles_min = 0;
+
+		_pu_lock(p);
+		for (uint32_t w = 0; w < NVM_CHUNKS_NBUCKETS / 64; ++w) {
+			if (p->nonempty[w]) {
+				ncycles_min = w * 64 +
+					      __builtin_ctzll(p->nonempty[w]);
+				break;
+			}
+		}
+		printf("  - {pu: %"PRIu32", nfree: %"PRIu32", "
+		       "ncycles_min: %"PRIu32"}\n", pu, p->nfree, ncycles_min);
+		_pu_unlock(p);
+	}
+}
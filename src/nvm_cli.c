@@ -35,16 +35,13 @@
 #include <getopt.h>
 #include <time.h>
 #include <liblightnvm_cli.h>
+#include <nvm_timer.h>
 
 static size_t start, stop;
 
 static inline size_t clock_sample(void)
 {
-	struct timespec ts;
-
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-
-	return ts.tv_nsec + ts.tv_sec * 1e9;
+	return _clock_sample();
 }
 
 size_t nvm_cli_timer_start(void)
@@ -30,6 +30,8 @@
 #include <nvm_dev.h>
 #include <nvm_cmd.h>
 #include <nvm_sgl.h>
+#include <nvm_rcache.h>
+#include <nvm_async.h>
 
 int nvm_cmd_is_scalar(uint16_t opcode)
 {
@@ -69,7 +71,6 @@ static inline void cmd_wrap_setup_sgl(struct nvm_cmd_wrap *wrap, void *data,
 				      void *meta, int flags)
 {
 	struct nvm_sgl *sgl = data;
-	uint64_t phys;
 
 	if (!(flags & NVM_CMD_SGL)) {
 		return;
@@ -77,15 +78,7 @@ static inline void cmd_wrap_setup_sgl(struct nvm_cmd_wrap *wrap, void *data,
 
 	wrap->cmd.psdt = NVM_NVME_PSDT_SGL_MPTR_CONTIGUOUS;
 
-	if (sgl->ndescr == 1) {
-		wrap->cmd.dptr.sgl = sgl->descriptors[0];
-	} else {
-		nvm_buf_vtophys(wrap->dev, sgl->descriptors, &phys);
-
-		wrap->cmd.dptr.sgl.unkeyed.type = NVM_NVME_SGL_DESCR_TYPE_LAST_SEGMENT;
-		wrap->cmd.dptr.sgl.unkeyed.len = sgl->ndescr * sizeof(struct nvm_nvme_sgl_descriptor);
-		wrap->cmd.dptr.sgl.addr = phys;
-	}
+	nvm_sgl_dptr(sgl, &wrap->cmd.dptr.sgl);
 
 	wrap->data = NULL;
 	wrap->data_len = 0;
@@ -95,16 +88,11 @@ static inline void cmd_wrap_setup_sgl(struct nvm_cmd_wrap *wrap, void *data,
 
 		sgl = meta;
 
-		nvm_buf_vtophys(wrap->dev, sgl->descriptors, &phys);
 		if (sgl->ndescr == 1) {
-			wrap->cmd.mptr = phys;
+			wrap->cmd.mptr = sgl->segs[0].phys;
 		} else {
-			sgl->indirect->unkeyed.type = NVM_NVME_SGL_DESCR_TYPE_LAST_SEGMENT;
-			sgl->indirect->unkeyed.len = sgl->ndescr * sizeof(struct nvm_nvme_sgl_descriptor);
-			sgl->indirect->addr = phys;
-
-			nvm_buf_vtophys(wrap->dev, sgl->indirect, &phys);
-			wrap->cmd.mptr = phys;
+			nvm_sgl_dptr(sgl, sgl->indirect);
+			wrap->cmd.mptr = sgl->indirect_phys;
 		}
 
 		wrap->meta = NULL;
@@ -307,15 +295,136 @@ int nvm_cmd_pass(struct nvm_dev *dev, struct nvm_nvme_cmd *cmd,
 			     flags, ret);
 }
 
+/**
+ * Whether the backend needs DMA buffers, caller buffers given to the *_into
+ * commands are then bounced through a scratch buffer of the device
+ */
+static inline int cmd_into_bounce(const struct nvm_dev *dev)
+{
+	return dev->be->id == NVM_BE_SPDK;
+}
+
 struct nvm_spec_idfy *nvm_cmd_idfy(struct nvm_dev *dev, struct nvm_ret *ret)
 {
-	return dev->be->idfy(dev, ret);
+	struct nvm_spec_idfy *idfy = NULL;
+
+	idfy = nvm_buf_alloc(dev, sizeof(*idfy), NULL);
+	if (!idfy) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(idfy, 0, sizeof(*idfy));
+
+	if (dev->be->idfy(dev, idfy, ret)) {
+		nvm_buf_free(dev, idfy);
+		return NULL;		// Propagate errno
+	}
+
+	return idfy;
+}
+
+int nvm_cmd_idfy_into(struct nvm_dev *dev, struct nvm_spec_idfy *idfy,
+		      struct nvm_ret *ret)
+{
+	struct nvm_spec_idfy *buf = idfy;
+
+	if (!idfy) {
+		NVM_DEBUG("FAILED: !idfy");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (cmd_into_bounce(dev)) {
+		buf = nvm_buf_scratch_get(dev, sizeof(*buf));
+		if (!buf) {
+			NVM_DEBUG("FAILED: nvm_buf_scratch_get");
+			return -1;
+		}
+	}
+
+	if (dev->be->idfy(dev, buf, ret)) {
+		if (buf != idfy)
+			nvm_buf_scratch_put(dev, buf);
+		return -1;		// Propagate errno
+	}
+
+	if (buf != idfy) {
+		memcpy(idfy, buf, sizeof(*idfy));
+		nvm_buf_scratch_put(dev, buf);
+	}
+
+	return 0;
+}
+
+size_t nvm_cmd_rprt_nbytes(const struct nvm_dev *dev,
+			   const struct nvm_addr *addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	size_t ndescr;
+
+	ndescr = addr ? geo->l.nchunk : geo->l.nchunk * geo->l.npunit * geo->l.npugrp;
+
+	return sizeof(struct nvm_spec_rprt) +
+	       ndescr * sizeof(struct nvm_spec_rprt_descr);
 }
 
 struct nvm_spec_rprt *nvm_cmd_rprt(struct nvm_dev *dev, struct nvm_addr *addr,
 				   int opt, struct nvm_ret *ret)
 {
-	return dev->be->rprt(dev, addr, opt, ret);
+	const size_t rprt_len = nvm_cmd_rprt_nbytes(dev, addr);
+	struct nvm_spec_rprt *rprt = NULL;
+
+	rprt = nvm_buf_alloc(dev, rprt_len, NULL);
+	if (!rprt) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(rprt, 0, rprt_len);
+
+	if (dev->be->rprt(dev, addr, opt, rprt, ret)) {
+		nvm_buf_free(dev, rprt);
+		return NULL;		// Propagate errno
+	}
+
+	return rprt;
+}
+
+int nvm_cmd_rprt_into(struct nvm_dev *dev, struct nvm_addr *addr, int opt,
+		      struct nvm_spec_rprt *rprt, size_t nbytes,
+		      struct nvm_ret *ret)
+{
+	const size_t rprt_len = nvm_cmd_rprt_nbytes(dev, addr);
+	struct nvm_spec_rprt *buf = rprt;
+
+	if (!rprt || (nbytes < rprt_len)) {
+		NVM_DEBUG("FAILED: !rprt or nbytes: %zu < %zu", nbytes,
+			  rprt_len);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (cmd_into_bounce(dev)) {
+		buf = nvm_buf_scratch_get(dev, rprt_len);
+		if (!buf) {
+			NVM_DEBUG("FAILED: nvm_buf_scratch_get");
+			return -1;
+		}
+	}
+
+	if (dev->be->rprt(dev, addr, opt, buf, ret)) {
+		if (buf != rprt)
+			nvm_buf_scratch_put(dev, buf);
+		return -1;		// Propagate errno
+	}
+
+	if (buf != rprt) {
+		memcpy(rprt, buf, rprt_len);
+		nvm_buf_scratch_put(dev, buf);
+	}
+
+	return 0;
 }
 
 int nvm_cmd_rprt_arbs(struct nvm_dev *dev, int cs, int naddrs,
@@ -330,8 +439,16 @@ int nvm_cmd_rprt_arbs(struct nvm_dev *dev, int cs, int naddrs,
 		return -1;
 	}
 
+	struct nvm_addr punit = { .val = 0 };
+	struct nvm_spec_rprt *rprt = NULL;
+
+	rprt = nvm_buf_scratch_get(dev, nvm_cmd_rprt_nbytes(dev, &punit));
+	if (!rprt) {
+		NVM_DEBUG("FAILED: nvm_buf_scratch_get");
+		return -1;
+	}
+
 	for (int idx = 0; idx < naddrs; ++idx) {
-		struct nvm_spec_rprt *rprt = NULL;
 		struct nvm_addr addr = { .val = 0 };
 		size_t cur = (idx + arb) % naddrs;
 		size_t des_idx;
@@ -339,9 +456,10 @@ int nvm_cmd_rprt_arbs(struct nvm_dev *dev, int cs, int naddrs,
 		addr.l.pugrp = cur % geo->l.npugrp;
 		addr.l.punit = (cur / geo->l.npugrp) % geo->l.npunit;
 
-		rprt = nvm_cmd_rprt(dev, &addr, 0x0, NULL);	// Grab RPRT
-		if (!(rprt && (rprt->ndescr == geo->l.nchunk))) {
-			nvm_buf_free(dev, rprt);
+		// Grab RPRT
+		if (dev->be->rprt(dev, &addr, 0x0, rprt, NULL) ||
+		    (rprt->ndescr != geo->l.nchunk)) {
+			nvm_buf_scratch_put(dev, rprt);
 			errno = EINVAL;
 			return -1;
 		}
@@ -358,21 +476,80 @@ int nvm_cmd_rprt_arbs(struct nvm_dev *dev, int cs, int naddrs,
 		}
 
 		if (des_idx == rprt->ndescr) {			// No chunk !
-			nvm_buf_free(dev, rprt);
+			nvm_buf_scratch_put(dev, rprt);
 			errno = EINVAL;
 			return -1;
 		}
-
-		nvm_buf_free(dev, rprt);
 	}
 
+	nvm_buf_scratch_put(dev, rprt);
+
 	return 0;
 }
 
+size_t nvm_cmd_gbbt_nbytes(const struct nvm_dev *dev)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+
+	return sizeof(struct nvm_spec_bbt) +
+	       sizeof(uint8_t) * geo->g.nblocks * geo->g.nplanes;
+}
+
 struct nvm_spec_bbt *nvm_cmd_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
 				  struct nvm_ret *ret)
 {
-	return dev->be->gbbt(dev, addr, ret);
+	const size_t bbt_len = nvm_cmd_gbbt_nbytes(dev);
+	struct nvm_spec_bbt *bbt = NULL;
+
+	bbt = nvm_buf_alloc(dev, bbt_len, NULL);
+	if (!bbt) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(bbt, 0, sizeof(*bbt));
+
+	if (dev->be->gbbt(dev, addr, bbt, ret)) {
+		nvm_buf_free(dev, bbt);
+		return NULL;		// Propagate errno
+	}
+
+	return bbt;
+}
+
+int nvm_cmd_gbbt_into(struct nvm_dev *dev, struct nvm_addr addr,
+		      struct nvm_spec_bbt *bbt, size_t nbytes,
+		      struct nvm_ret *ret)
+{
+	const size_t bbt_len = nvm_cmd_gbbt_nbytes(dev);
+	struct nvm_spec_bbt *buf = bbt;
+
+	if (!bbt || (nbytes < bbt_len)) {
+		NVM_DEBUG("FAILED: !bbt or nbytes: %zu < %zu", nbytes, bbt_len);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (cmd_into_bounce(dev)) {
+		buf = nvm_buf_scratch_get(dev, bbt_len);
+		if (!buf) {
+			NVM_DEBUG("FAILED: nvm_buf_scratch_get");
+			return -1;
+		}
+	}
+
+	if (dev->be->gbbt(dev, addr, buf, ret)) {
+		if (buf != bbt)
+			nvm_buf_scratch_put(dev, buf);
+		return -1;		// Propagate errno
+	}
+
+	if (buf != bbt) {
+		memcpy(bbt, buf, bbt_len);
+		nvm_buf_scratch_put(dev, buf);
+	}
+
+	return 0;
 }
 
 int nvm_cmd_gbbt_arbs(struct nvm_dev *dev, int bs, int naddrs,
@@ -387,8 +564,15 @@ int nvm_cmd_gbbt_arbs(struct nvm_dev *dev, int bs, int naddrs,
 		return -1;
 	}
 
+	struct nvm_spec_bbt *bbt = NULL;
+
+	bbt = nvm_buf_scratch_get(dev, nvm_cmd_gbbt_nbytes(dev));
+	if (!bbt) {
+		NVM_DEBUG("FAILED: nvm_buf_scratch_get");
+		return -1;
+	}
+
 	for (size_t idx = 0; idx < (size_t)naddrs; ++idx) {
-		struct nvm_spec_bbt *bbt = NULL;
 		struct nvm_addr addr = { .val = 0 };
 		size_t cur = (idx + arb) % naddrs;
 		size_t blk_idx;
@@ -396,9 +580,10 @@ int nvm_cmd_gbbt_arbs(struct nvm_dev *dev, int bs, int naddrs,
 		addr.g.ch = cur % geo->g.nchannels;
 		addr.g.lun = (cur / geo->g.nchannels) % geo->g.nluns;
 
-		bbt = nvm_cmd_gbbt(dev, addr, NULL);		// Grab BBT
-		if (!bbt)
+		if (dev->be->gbbt(dev, addr, bbt, NULL)) {	// Grab BBT
+			nvm_buf_scratch_put(dev, bbt);
 			return -1;
+		}
 
 		for (blk_idx = 0; idx < geo->g.nblocks; ++idx) {
 			size_t blk_cur = (blk_idx + arb) % geo->g.nblocks;
@@ -418,10 +603,14 @@ int nvm_cmd_gbbt_arbs(struct nvm_dev *dev, int bs, int naddrs,
 			addrs[idx].g.blk = blk_cur;
 			break;
 		}
-		if (blk_idx == geo->g.nblocks)
+		if (blk_idx == geo->g.nblocks) {
+			nvm_buf_scratch_put(dev, bbt);
 			return -1;				// No block!
+		}
 	}
 
+	nvm_buf_scratch_put(dev, bbt);
+
 	return 0;
 }
 
@@ -447,24 +636,37 @@ int nvm_cmd_erase(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		  void *meta, uint16_t flags, struct nvm_ret *ret)
 {
 	int opt = flags & NVM_CMD_MASK_ADDR;
+	int err;
 
 	opt = opt ? opt : (dev->cmd_opts & NVM_CMD_MASK_ADDR);
 
-	switch(opt) {
+	if (nvm_async_is_shared(flags, ret))
+		err = nvm_async_ring_submit(dev, NVM_ASYNC_OP_ERASE, opt, addrs,
+					    NULL, naddrs, NULL, meta, flags,
+					    ret);
+	else switch(opt) {
 	case NVM_CMD_SCALAR:
 		if (meta) {
 			errno = EINVAL;
 			return -1;
 		}
 
-		return dev->be->scalar_erase(dev, addrs, naddrs, flags, ret);
+		err = dev->be->scalar_erase(dev, addrs, naddrs, flags, ret);
+		break;
 	case NVM_CMD_VECTOR:
-		return dev->be->vector_erase(dev, addrs, naddrs, meta, flags,
-					     ret);
+		err = dev->be->vector_erase(dev, addrs, naddrs, meta, flags,
+					    ret);
+		break;
 	default:
 		errno = EINVAL;
 		return -1;
 	}
+
+	if (dev->rcache)	// Also on error, the chunks may be reset
+		nvm_rcache_erase(dev->rcache, addrs, naddrs,
+				 opt == NVM_CMD_SCALAR);
+
+	return err;
 }
 
 int nvm_cmd_write(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
@@ -472,20 +674,37 @@ int nvm_cmd_write(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		  struct nvm_ret *ret)
 {
 	int opt = flags & NVM_CMD_MASK_ADDR;
+	int err;
 
 	opt = opt ? opt : (dev->cmd_opts & NVM_CMD_MASK_ADDR);
 
-	switch(opt) {
+	if (nvm_async_is_shared(flags, ret))
+		err = nvm_async_ring_submit(dev, NVM_ASYNC_OP_WRITE, opt, addrs,
+					    NULL, naddrs, data, meta, flags,
+					    ret);
+	else switch(opt) {
 	case NVM_CMD_SCALAR:
-		return dev->be->scalar_write(dev, *addrs, naddrs, data, meta,
-					     flags, ret);
+		err = dev->be->scalar_write(dev, *addrs, naddrs, data, meta,
+					    flags, ret);
+		break;
 	case NVM_CMD_VECTOR:
-		return dev->be->vector_write(dev, addrs, naddrs, data, meta,
-					     flags, ret);
+		err = dev->be->vector_write(dev, addrs, naddrs, data, meta,
+					    flags, ret);
+		break;
 	default:
 		errno = EINVAL;
 		return -1;
 	}
+
+	// Data behind an SGL is not at hand, nor is the outcome of a command
+	// still in flight, the chunks are dropped then and on error
+	if (dev->rcache)
+		nvm_rcache_write(dev->rcache, addrs, naddrs,
+				 opt == NVM_CMD_SCALAR,
+				 (err || (flags & (NVM_CMD_SGL | NVM_CMD_ASYNC))) ?
+				 NULL : data);
+
+	return err;
 }
 
 int nvm_cmd_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
@@ -496,6 +715,18 @@ int nvm_cmd_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 
 	opt = opt ? opt : (dev->cmd_opts & NVM_CMD_MASK_ADDR);
 
+	// Synchronous reads of data to a plain buffer are served by the cache
+	if (dev->rcache && (!meta) && (!(flags & NVM_CMD_ASYNC)) &&
+	    (!(flags & NVM_CMD_SGL)) &&
+	    ((opt == NVM_CMD_SCALAR) || (opt == NVM_CMD_VECTOR)))
+		return nvm_rcache_read(dev, addrs, naddrs,
+				       opt == NVM_CMD_SCALAR, data, flags, ret);
+
+	if (nvm_async_is_shared(flags, ret))
+		return nvm_async_ring_submit(dev, NVM_ASYNC_OP_READ, opt, addrs,
+					     NULL, naddrs, data, meta, flags,
+					     ret);
+
 	switch(opt) {
 	case NVM_CMD_SCALAR:
 		return dev->be->scalar_read(dev, *addrs, naddrs, data, meta,
@@ -513,5 +744,14 @@ int nvm_cmd_copy(struct nvm_dev *dev, struct nvm_addr src[],
 		 struct nvm_addr dst[], int naddrs, uint16_t flags,
 		 struct nvm_ret *ret)
 {
-	return dev->be->vector_copy(dev, src, dst, naddrs, flags, ret);
+	int err = nvm_async_is_shared(flags, ret) ?
+		nvm_async_ring_submit(dev, NVM_ASYNC_OP_COPY, NVM_CMD_VECTOR,
+				      src, dst, naddrs, NULL, NULL, flags,
+				      ret) :
+		dev->be->vector_copy(dev, src, dst, naddrs, flags, ret);
+
+	if (dev->rcache)		// Data of the copy is not at hand
+		nvm_rcache_write(dev->rcache, dst, naddrs, 0, NULL);
+
+	return err;
 }
@@ -33,6 +33,10 @@
 #include <liblightnvm.h>
 #include <nvm_be.h>
 #include <nvm_dev.h>
+#include <nvm_numa.h>
+#include <nvm_pool.h>
+#include <nvm_rcache.h>
+#include <nvm_buf_arena.h>
 
 const char *nvm_pmode_str(int pmode) {
 	switch (pmode) {
@@ -97,6 +101,10 @@ void nvm_dev_attr_pr(const struct nvm_dev *dev)
 	printf("  mccap: '"NVM_I32_FMT"'\n",
 	       NVM_I32_TO_STR(nvm_dev_get_mccap(dev)));
 	printf("  bbts_cached: %d\n", nvm_dev_get_bbts_cached(dev));
+	printf("  numa_node: %d\n", nvm_dev_get_numa_node(dev));
+	printf("  buf_hugepages: %d\n", nvm_dev_get_buf_hugepages(dev));
+	printf("  buf_arena: %d\n", nvm_dev_get_buf_arena(dev));
+	printf("  rcache: %d\n", nvm_dev_get_rcache(dev));
 	printf("  quirks: '"NVM_I8_FMT"'\n",
 	       NVM_I8_TO_STR(nvm_dev_get_quirks(dev)));
 }
@@ -395,6 +403,150 @@ int nvm_dev_set_bbts_cached(struct nvm_dev *dev, int bbts_cached)
 	return 0;
 }
 
+int nvm_dev_get_numa_node(const struct nvm_dev *dev)
+{
+	return dev->buf_opts.place ? dev->buf_opts.node : -1;
+}
+
+int nvm_dev_set_numa_node(struct nvm_dev *dev, int node)
+{
+	char cpus[1024];
+
+	if ((node < -1) || (node >= NVM_NUMA_NODES_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (node == -1) {
+		dev->buf_opts.place = 0;
+		return 0;
+	}
+
+	if (nvm_numa_node_cpus(node, cpus, sizeof(cpus))) {
+		NVM_DEBUG("FAILED: no cpus for node: %d", node);
+		errno = EINVAL;
+		return -1;
+	}
+
+	dev->buf_opts.place = 1;
+	dev->buf_opts.node = node;
+
+	nvm_pool_hint_cpus(cpus);
+
+	return 0;
+}
+
+int nvm_dev_get_buf_hugepages(const struct nvm_dev *dev)
+{
+	return dev->buf_opts.hugepages;
+}
+
+int nvm_dev_set_buf_hugepages(struct nvm_dev *dev, int hugepages)
+{
+	switch(hugepages) {
+	case 0:
+	case 1:
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	dev->buf_opts.hugepages = hugepages;
+
+	return 0;
+}
+
+int nvm_dev_get_buf_arena(const struct nvm_dev *dev)
+{
+	return dev->buf_opts.arena;
+}
+
+int nvm_dev_set_buf_arena(struct nvm_dev *dev, int arena)
+{
+	switch(arena) {
+	case 0:
+		break;
+	case 1:
+		if (dev->buf_arena)
+			break;
+
+		dev->buf_arena = nvm_buf_arena_create(dev);
+		if (!dev->buf_arena) {
+			NVM_DEBUG("FAILED: nvm_buf_arena_create");
+			return -1;	// Propagate errno
+		}
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	// The arena stays until close, buffers from it may be in use
+	dev->buf_opts.arena = arena;
+
+	return 0;
+}
+
+int nvm_dev_get_rcache(const struct nvm_dev *dev)
+{
+	return dev->rcache ? 1 : 0;
+}
+
+uint64_t nvm_dev_get_rcache_nhits(const struct nvm_dev *dev)
+{
+	return dev->rcache ? atomic_load(&dev->rcache->nhits) : 0;
+}
+
+int nvm_dev_set_rcache(struct nvm_dev *dev, int rcache)
+{
+	switch(rcache) {
+	case 0:
+		nvm_rcache_free(dev->rcache);
+		dev->rcache = NULL;
+		return 0;
+
+	case 1:
+		if (dev->rcache)
+			return 0;
+
+		dev->rcache = nvm_rcache_alloc(dev);
+		if (!dev->rcache) {
+			NVM_DEBUG("FAILED: nvm_rcache_alloc");
+			return -1;	// Propagate errno
+		}
+		return 0;
+
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+static inline void _dev_numa_setup(struct nvm_dev *dev, const char *dev_path)
+{
+	const char *node_env = getenv("NVM_DEV_NUMA_NODE");
+	const char *hugepages_env = getenv("NVM_BUF_HUGEPAGES");
+	const char *arena_env = getenv("NVM_BUF_ARENA");
+	int node;
+
+	node = node_env ? atoi(node_env) : nvm_numa_dev_node(dev, dev_path);
+	if ((node >= 0) && nvm_dev_set_numa_node(dev, node)) {
+		NVM_DEBUG("FAILED: nvm_dev_set_numa_node, node: %d", node);
+	}
+
+	if (hugepages_env)
+		nvm_dev_set_buf_hugepages(dev, atoi(hugepages_env) ? 1 : 0);
+
+	if (arena_env && nvm_dev_set_buf_arena(dev, atoi(arena_env) ? 1 : 0)) {
+		NVM_DEBUG("FAILED: nvm_dev_set_buf_arena");
+	}
+
+	NVM_DEBUG("numa_node: %d, hugepages: %d, arena: %d",
+		  nvm_dev_get_numa_node(dev), dev->buf_opts.hugepages,
+		  dev->buf_opts.arena);
+}
+
 struct nvm_dev * nvm_dev_openf(const char *dev_path, int flags) {
 	struct nvm_dev *dev = NULL;
 
@@ -406,6 +558,8 @@ struct nvm_dev * nvm_dev_openf(const char *dev_path, int flags) {
 		return NULL;
 	}
 
+	_dev_numa_setup(dev, dev_path);
+
 	dev->bbts_cached = 0;
 	dev->nbbts = dev->geo.nchannels * dev->geo.nluns;
 	dev->bbts = malloc(sizeof(*dev->bbts) * dev->nbbts);
@@ -446,6 +600,12 @@ struct nvm_dev * nvm_dev_openf(const char *dev_path, int flags) {
 
 	NVM_DEBUG("cmd_opts: 0x%x", dev->cmd_opts);
 
+	dev->rcache = NULL;
+	if (getenv("NVM_DEV_RCACHE") && atoi(getenv("NVM_DEV_RCACHE")) &&
+	    nvm_dev_set_rcache(dev, 1)) {
+		NVM_DEBUG("FAILED: nvm_dev_set_rcache");
+	}
+
 	return dev;
 }
 
@@ -461,8 +621,12 @@ void nvm_dev_close(struct nvm_dev *dev)
 
 	nvm_bbt_flush_all(dev, NULL);
 
+	nvm_buf_scratch_term(dev);
+
 	dev->be->close(dev);
 
+	nvm_rcache_free(dev->rcache);
+	nvm_buf_arena_destroy(dev->buf_arena);
 	free(dev->bbts);
 	free(dev);
 }
@@ -0,0 +1,1279 @@
+/*
+ * nvm_ftl - Host-side page-mapped FTL over OCSSD 2.0 lines
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+
+#ifdef NVM_FTL_ENABLED
+#include <sched.h>
+#include <nvm_ftl.h>
+#include <nvm_pool.h>
+
+#define NVM_FTL_STATUS_ERR 0x6		///< NVMe generic status: internal error
+
+/**
+ * Install the mapping of 'lba' to sector 'v' of 'line', the validity of the
+ * new sector is set before the mapping is published such that a concurrent
+ * overwrite always finds a sector to invalidate
+ */
+static inline void _ftl_map(struct nvm_ftl *ftl, struct nvm_ftl_line *line,
+			    uint32_t v, uint64_t lba)
+{
+	const uint32_t ppa = _ftl_line_ppa(ftl, line, v);
+	uint32_t old;
+
+	_ftl_validate(ftl, line, v, lba);
+
+	old = atomic_exchange(&ftl->l2p[lba], ppa);
+	if (old != NVM_FTL_UNMAPPED)
+		_ftl_invalidate(ftl, old, lba);
+}
+
+/**
+ * Wait until the write-units before 'wunit' on the same chunk have completed,
+ * such that a chunk has a single write in flight and the device sees in-order
+ * writes per chunk
+ *
+ * The unit before may be in flight on an async. context which only 'caller'
+ * reaps, 'ctx' of an asynchronous write, or any context of the thread calling
+ * a synchronous write, blocked on the pool while its units are written. Its
+ * completions are then reaped while waiting, else the caller would wait on
+ * itself.
+ */
+static inline void _ftl_wunit_wait(const struct nvm_ftl *ftl,
+				   struct nvm_ftl_line *line, uint32_t wunit,
+				   struct nvm_async_ctx *ctx, pthread_t caller)
+{
+	struct nvm_ftl_wowner *own = &line->wown[wunit % ftl->npus];
+	const uint32_t pu = wunit % ftl->npus;
+	const uint32_t rnd = wunit / ftl->npus;
+	uint32_t wrnd;
+
+	while ((wrnd = atomic_load(&line->wrnd[pu])) != rnd) {
+		// The owner of round 'wrnd', unless re-recorded while read
+		if (atomic_load(&own->rnd) == wrnd + 1) {
+			struct nvm_async_ctx *own_ctx = atomic_load(&own->ctx);
+			const int mine = (own_ctx == ctx) ||
+					 pthread_equal(own->thread, caller);
+
+			if (mine && (atomic_load(&own->rnd) == wrnd + 1) &&
+			    (nvm_async_poke(ftl->dev, own_ctx, 0) < 0)) {
+				NVM_DEBUG("FAILED: nvm_async_poke");
+			}
+		}
+
+		sched_yield();
+	}
+}
+
+/**
+ * Record the asynchronous write of 'wunit' as in flight on 'ctx', called after
+ * _ftl_wunit_wait, thus with no other write in flight on the chunk
+ */
+static inline void _ftl_wunit_own(const struct nvm_ftl *ftl,
+				  struct nvm_ftl_line *line, uint32_t wunit,
+				  struct nvm_async_ctx *ctx)
+{
+	struct nvm_ftl_wowner *own = &line->wown[wunit % ftl->npus];
+
+	atomic_store(&own->rnd, 0);
+	atomic_store(&own->ctx, ctx);
+	own->thread = pthread_self();
+	atomic_store(&own->rnd, wunit / ftl->npus + 1);
+}
+
+static int _ftl_erase_cmd(void *arg, size_t pu)
+{
+	struct nvm_ftl *ftl = ((void **)arg)[0];
+	struct nvm_ftl_line *line = ((void **)arg)[1];
+	struct nvm_ret ret = { 0 };
+	struct nvm_addr addr;
+
+	addr.val = ftl->pus[pu].val;
+	addr.l.chunk = line->idx;
+
+	return nvm_cmd_erase(ftl->dev, &addr, 1, NULL, NVM_CMD_SYNC, &ret) ? 1 : 0;
+}
+
+int nvm_ftl_line_erase(struct nvm_ftl *ftl, struct nvm_ftl_line *line)
+{
+	void *arg[2] = { ftl, line };
+	ssize_t nerr;
+
+	nerr = nvm_pool_run(_ftl_erase_cmd, arg, ftl->npus,
+			    NVM_MIN(ftl->npus, NVM_POOL_NQUEUES_MAX), ftl->npus,
+			    0);
+	if (nerr) {
+		NVM_DEBUG("FAILED: erase of line: %"PRIu32, line->idx);
+		errno = nerr < 0 ? errno : EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
+void nvm_ftl_line_init(struct nvm_ftl *ftl, struct nvm_ftl_line *line)
+{
+	for (uint32_t pu = 0; pu < ftl->npus; ++pu) {
+		atomic_init(&line->wrnd[pu], 0);
+		atomic_init(&line->wown[pu].rnd, 0);
+		atomic_init(&line->cnk_nvalid[pu], 0);
+	}
+	// Stale invalidations may race with the reset, see _ftl_invalidate
+	for (uint32_t i = 0; i < ftl->npus * ftl->cnk_nwords; ++i)
+		atomic_store_explicit(&line->valid[i], 0, memory_order_relaxed);
+	for (uint32_t v = 0; v < ftl->line_nsectr; ++v)
+		atomic_store_explicit(&line->p2l[v], NVM_FTL_UNMAPPED,
+				      memory_order_relaxed);
+
+	atomic_init(&line->nvalid, 0);
+	atomic_init(&line->nwunits_done, 0);
+	atomic_init(&line->wunit_next, 0);
+}
+
+/**
+ * Mark 'line' open, assigning it the tail of a line which is not open, every
+ * chunk of a line which was open is fully written, thus readable from the
+ * device
+ */
+static int _ftl_tail_assign(struct nvm_ftl *ftl, struct nvm_ftl_line *line)
+{
+	const size_t nbytes = (size_t)ftl->npus * ftl->tail_nwunits *
+			      ftl->ws_opt * ftl->geo->l.nbytes;
+	struct nvm_ftl_tail *tail = NULL;
+
+	if (!ftl->tail_nwunits) {
+		atomic_store(&line->state, NVM_FTL_LINE_OPEN);
+		return 0;
+	}
+
+	// Opening under the lock, such that no two lines take the same tail
+	pthread_mutex_lock(&ftl->free_lock);
+
+	for (uint32_t i = 0; i < ftl->nlines; ++i) {
+		tail = &ftl->tails[i];
+
+		if ((!tail->owner) ||
+		    (atomic_load(&tail->owner->state) != NVM_FTL_LINE_OPEN))
+			break;
+	}
+
+	if (!tail->buf)
+		tail->buf = malloc(nbytes);
+	if (!tail->buf) {
+		pthread_mutex_unlock(&ftl->free_lock);
+		NVM_DEBUG("FAILED: malloc(tail)");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	tail->owner = line;
+	atomic_store(&line->tail, tail->buf);
+	atomic_store(&line->state, NVM_FTL_LINE_OPEN);
+
+	pthread_mutex_unlock(&ftl->free_lock);
+
+	return 0;
+}
+
+int nvm_ftl_line_open(struct nvm_ftl *ftl, struct nvm_ftl_line *line)
+{
+	if (!line->erased && nvm_ftl_line_erase(ftl, line)) {
+		atomic_store(&line->state, NVM_FTL_LINE_BAD);
+		return -1;	// Propagate errno
+	}
+
+	nvm_ftl_line_init(ftl, line);
+	line->erased = 0;
+
+	if (_ftl_tail_assign(ftl, line)) {
+		line->erased = 1;
+		nvm_ftl_line_push(ftl, line);
+		return -1;	// Propagate errno
+	}
+
+	return 0;
+}
+
+struct nvm_ftl_line *nvm_ftl_line_pop(struct nvm_ftl *ftl, uint32_t nrsv)
+{
+	struct nvm_ftl_line *line = NULL;
+
+	pthread_mutex_lock(&ftl->free_lock);
+	if (ftl->nfree > nrsv)
+		line = &ftl->lines[ftl->free[--ftl->nfree]];
+	pthread_mutex_unlock(&ftl->free_lock);
+
+	return line;
+}
+
+void nvm_ftl_line_push(struct nvm_ftl *ftl, struct nvm_ftl_line *line)
+{
+	atomic_store(&line->state, NVM_FTL_LINE_FREE);
+
+	pthread_mutex_lock(&ftl->free_lock);
+	ftl->free[ftl->nfree++] = line - ftl->lines;
+	pthread_mutex_unlock(&ftl->free_lock);
+}
+
+static inline uint64_t _ftl_resv(uint32_t line, uint32_t wunit)
+{
+	return ((uint64_t)line << 32) | wunit;
+}
+
+/**
+ * Replace the open line by a free line, unless another writer did so already,
+ * reclaiming lines when only the reserve is left
+ */
+static int _ftl_line_next(struct nvm_ftl *ftl)
+{
+	for (;;) {
+		struct nvm_ftl_line *line;
+
+		pthread_mutex_lock(&ftl->lock);
+
+		if ((uint32_t)atomic_load(&ftl->resv) < ftl->line_nwunits) {
+			pthread_mutex_unlock(&ftl->lock);
+			return 0;
+		}
+
+		line = nvm_ftl_line_pop(ftl, NVM_FTL_GC_NLINES_RSV);
+		if (line) {
+			int err = nvm_ftl_line_open(ftl, line);
+
+			if (!err)
+				atomic_store(&ftl->resv,
+					     _ftl_resv(line - ftl->lines, 0));
+
+			pthread_mutex_unlock(&ftl->lock);
+
+			// The line is fine, it is back on the free stack
+			if (err && (errno == ENOMEM))
+				return -1;
+
+			continue;
+		}
+
+		pthread_mutex_unlock(&ftl->lock);
+
+		if (nvm_ftl_gc_forced(ftl))
+			return -1;	// Propagate errno
+	}
+}
+
+/**
+ * Reserve up to 'nwunits' consecutive write-units of the open line
+ *
+ * The reservation is a single fetch-add on the line and write-unit pair, so
+ * the units of one writer are contiguous, and a writer can never reserve in a
+ * line which was reclaimed and reopened since it looked at it. A writer only
+ * ever waits on units reserved before its own, which keeps concurrent writers
+ * free of deadlock.
+ *
+ * @return The line, with the first unit in 'wunit' and the # of reserved
+ * units in 'nreserved'. On error, NULL and `errno` set.
+ */
+static struct nvm_ftl_line *_ftl_reserve(struct nvm_ftl *ftl, uint32_t nwunits,
+					 uint32_t *wunit, uint32_t *nreserved)
+{
+	for (;;) {
+		const uint64_t resv = atomic_fetch_add(&ftl->resv, nwunits);
+		const uint32_t bgn = resv;
+
+		if (bgn < ftl->line_nwunits) {
+			*wunit = bgn;
+			*nreserved = NVM_MIN(nwunits, ftl->line_nwunits - bgn);
+			return &ftl->lines[resv >> 32];
+		}
+
+		if (_ftl_line_next(ftl))
+			return NULL;
+	}
+}
+
+/**
+ * Write-units of one call to nvm_ftl_write within a single line
+ */
+struct ftl_wjob {
+	struct nvm_ftl *ftl;
+	struct nvm_ftl_line *line;
+	uint32_t wunit;			///< First write-unit
+	uint64_t lba;			///< LBA of the first sector
+	uint64_t nlbas;			///< # of LBAs
+	const char *buf;
+	char *pad;			///< Buffer for the last, partial, unit
+	pthread_t caller;		///< Thread calling nvm_ftl_write
+	atomic_uint status;		///< Status of the first failed command
+};
+
+static int _ftl_write_cmd(void *arg, size_t item)
+{
+	struct ftl_wjob *job = arg;
+	struct nvm_ftl *ftl = job->ftl;
+	struct nvm_ftl_line *line = job->line;
+	struct nvm_ret ret = { 0 };
+
+	const uint32_t wunit = job->wunit + item;
+	const uint64_t lba_ofz = item * ftl->ws_opt;
+	const uint32_t nlbas = NVM_MIN(ftl->ws_opt, job->nlbas - lba_ofz);
+	const size_t nbytes = ftl->geo->l.nbytes;
+
+	struct nvm_addr addrs[ftl->ws_opt];
+	const char *data = job->buf + lba_ofz * nbytes;
+	int err;
+
+	if (nlbas < ftl->ws_opt) {
+		memcpy(job->pad, data, nlbas * nbytes);
+		data = job->pad;
+	}
+
+	_ftl_wunit_addrs(ftl, line, wunit, addrs);
+
+	_ftl_wunit_wait(ftl, line, wunit, NULL, job->caller);
+	_ftl_tail_put(ftl, line, wunit, data);
+	err = nvm_cmd_write(ftl->dev, addrs, ftl->ws_opt, data, NULL,
+			    NVM_CMD_SYNC, &ret);
+	_ftl_wunit_completed(ftl, line, wunit);
+
+	if (err) {
+		unsigned int none = 0;
+
+		atomic_compare_exchange_strong(&job->status, &none,
+				ret.status ? ret.status : NVM_FTL_STATUS_ERR);
+	} else {
+		for (uint32_t i = 0; i < nlbas; ++i)
+			_ftl_map(ftl, line, wunit * ftl->ws_opt + i,
+				 job->lba + lba_ofz + i);
+	}
+
+	_ftl_wunit_done(ftl, line);
+
+	return err ? 1 : 0;
+}
+
+static int _ftl_write_sync(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+			   const char *buf, struct nvm_ret *ret)
+{
+	const size_t nbytes = ftl->geo->l.nbytes;
+	char *pad = NULL;
+	size_t nerr = 0;
+
+	if (nlbas % ftl->ws_opt) {
+		pad = nvm_buf_alloc(ftl->dev, ftl->ws_opt * nbytes, NULL);
+		if (!pad) {
+			NVM_DEBUG("FAILED: nvm_buf_alloc(pad)");
+			errno = ENOMEM;
+			return -1;
+		}
+		memset(pad, 0, ftl->ws_opt * nbytes);
+	}
+
+	for (size_t done = 0; done < nlbas;) {
+		const uint32_t nwunits = (nlbas - done + ftl->ws_opt - 1) / ftl->ws_opt;
+		struct ftl_wjob job = { 0 };
+		uint32_t nreserved;
+		ssize_t err;
+
+		job.line = _ftl_reserve(ftl, nwunits, &job.wunit, &nreserved);
+		if (!job.line) {
+			nvm_buf_free(ftl->dev, pad);
+			return -1;	// Propagate errno
+		}
+
+		job.ftl = ftl;
+		job.lba = lba + done;
+		job.nlbas = NVM_MIN(nreserved * ftl->ws_opt, nlbas - done);
+		job.buf = buf + done * nbytes;
+		job.pad = pad;
+		job.caller = pthread_self();
+		atomic_init(&job.status, 0);
+
+		// Units 'npus' apart share a chunk, thus an ordered queue
+		err = nvm_pool_run(_ftl_write_cmd, &job, nreserved,
+				   ftl->wqueues, ftl->npus, NVM_POOL_ORDERED);
+		if (err) {
+			nerr += err < 0 ? nreserved : err;
+			if (ret)
+				ret->status = atomic_load(&job.status);
+		}
+
+		done += job.nlbas;
+	}
+
+	nvm_buf_free(ftl->dev, pad);
+
+	if (nerr) {
+		NVM_DEBUG("FAILED: nvm_cmd_write, nerr(%zu)", nerr);
+		errno = EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Reads of one call to nvm_ftl_read, batched into commands of sectors which
+ * were mapped when the call started
+ */
+struct ftl_rjob {
+	struct nvm_ftl *ftl;
+	uint64_t lba;
+	char *buf;
+	uint32_t *ppas;			///< Sector of every LBA at lookup
+	uint32_t *batches;		///< First and end LBA index of every batch
+	uint32_t nbatches;
+	atomic_uint status;
+};
+
+static int _ftl_read_cmd(void *arg, size_t item)
+{
+	struct ftl_rjob *job = arg;
+	struct nvm_ftl *ftl = job->ftl;
+	struct nvm_ret ret = { 0 };
+
+	const uint32_t bgn = job->batches[item * 2];
+	const uint32_t naddrs = job->batches[item * 2 + 1] - bgn;
+
+	struct nvm_addr addrs[naddrs];
+
+	for (uint32_t i = 0; i < naddrs; ++i)
+		_ftl_ppa2addr(ftl, job->ppas[bgn + i], &addrs[i]);
+
+	if (nvm_cmd_read(ftl->dev, addrs, naddrs,
+			 job->buf + bgn * ftl->geo->l.nbytes, NULL,
+			 NVM_CMD_SYNC, &ret)) {
+		unsigned int none = 0;
+
+		atomic_compare_exchange_strong(&job->status, &none,
+				ret.status ? ret.status : NVM_FTL_STATUS_ERR);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Whether sector 'ppa' can be read with the same command as 'prev'
+ */
+static inline int _ftl_batchable(const struct nvm_ftl *ftl, uint32_t prev,
+				 uint32_t ppa)
+{
+	struct nvm_addr a, b;
+
+	if (!ftl->scalar)
+		return 1;
+
+	_ftl_ppa2addr(ftl, prev, &a);
+	_ftl_ppa2addr(ftl, ppa, &b);
+	a.l.sectr += 1;
+
+	return a.val == b.val;
+}
+
+/**
+ * Look up 'nlbas' LBAs starting at 'lba' and form the read batches, unmapped
+ * LBAs read as zeroes
+ *
+ * @return The # of batches
+ */
+static uint32_t _ftl_lookup(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+			    char *buf, uint32_t ppas[], uint32_t batches[])
+{
+	const size_t nbytes = ftl->geo->l.nbytes;
+	uint32_t nbatches = 0;
+	uint32_t batch_len = 0;
+
+	for (size_t i = 0; i < nlbas; ++i) {
+		ppas[i] = atomic_load(&ftl->l2p[lba + i]);
+
+		if (ppas[i] == NVM_FTL_UNMAPPED) {
+			memset(buf + i * nbytes, 0, nbytes);
+			batch_len = 0;
+			continue;
+		}
+		if (_ftl_tail_get(ftl, ppas[i], buf + i * nbytes)) {
+			batch_len = 0;
+			continue;
+		}
+
+		if (batch_len && (batch_len < NVM_NADDR_MAX) &&
+		    _ftl_batchable(ftl, ppas[i - 1], ppas[i])) {
+			++batch_len;
+			batches[nbatches * 2 - 1] = i + 1;
+			continue;
+		}
+
+		batches[nbatches * 2] = i;
+		batches[nbatches * 2 + 1] = i + 1;
+		++nbatches;
+		batch_len = 1;
+	}
+
+	return nbatches;
+}
+
+static int _ftl_read_sync(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+			  char *buf, struct nvm_ret *ret)
+{
+	struct ftl_rjob job = { 0 };
+	uint32_t *batches;
+	size_t nerr = 0;
+
+	job.ppas = malloc(nlbas * sizeof(*job.ppas));
+	job.batches = malloc(nlbas * 2 * sizeof(*job.batches));
+	if (!job.ppas || !job.batches) {
+		NVM_DEBUG("FAILED: malloc");
+		free(job.ppas);
+		free(job.batches);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	job.ftl = ftl;
+	job.lba = lba;
+	job.buf = buf;
+	atomic_init(&job.status, 0);
+	batches = job.batches;
+
+	job.nbatches = _ftl_lookup(ftl, lba, nlbas, buf, job.ppas, job.batches);
+	if (job.nbatches) {
+		ssize_t err;
+
+		err = nvm_pool_run(_ftl_read_cmd, &job, job.nbatches,
+				   NVM_MIN(job.nbatches, NVM_POOL_NQUEUES_MAX),
+				   ftl->npus, 0);
+		if (err)
+			nerr += err < 0 ? job.nbatches : err;
+	}
+
+	// Sectors moved or overwritten while being read, are read again
+	for (size_t i = 0; (!nerr) && (i < nlbas); ++i) {
+		for (int retry = 0; retry < NVM_FTL_READ_RETRIES; ++retry) {
+			uint32_t ppa = atomic_load(&ftl->l2p[lba + i]);
+			uint32_t batch[2] = { i, i + 1 };
+
+			if (ppa == job.ppas[i])
+				break;
+
+			job.ppas[i] = ppa;
+			if (ppa == NVM_FTL_UNMAPPED) {
+				memset(buf + i * ftl->geo->l.nbytes, 0,
+				       ftl->geo->l.nbytes);
+				continue;
+			}
+
+			if (_ftl_tail_get(ftl, ppa,
+					  buf + i * ftl->geo->l.nbytes))
+				continue;
+
+			job.batches = batch;
+			if (_ftl_read_cmd(&job, 0)) {
+				++nerr;
+				break;
+			}
+		}
+	}
+
+	free(job.ppas);
+	free(batches);
+
+	if (nerr) {
+		if (ret)
+			ret->status = atomic_load(&job.status);
+		NVM_DEBUG("FAILED: nvm_cmd_read, nerr(%zu)", nerr);
+		errno = EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Command of an asynchronous FTL request
+ */
+struct ftl_acmd {
+	struct ftl_areq *req;
+	struct nvm_ftl_line *line;	///< Line written, NULL for reads
+	uint32_t wunit;			///< Write-unit written
+	uint32_t bgn;			///< Index of the first LBA of the request
+	uint32_t nlbas;			///< # of LBAs of the command
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_ret ret;
+};
+
+/**
+ * Asynchronous FTL request, completed when the last command completes
+ */
+struct ftl_areq {
+	struct nvm_ftl *ftl;
+	struct nvm_ret *ret;		///< Provided by the caller of the request
+	uint64_t lba;
+	size_t nlbas;
+	char *buf;
+	char *pad;			///< Buffer for the last, partial, write-unit
+	uint32_t *ppas;			///< Sector of every LBA at lookup
+	atomic_uint nleft;		///< # of commands, plus one during submit
+	atomic_uint status;		///< Status of the first failed command
+	uint32_t ncmds;
+	struct ftl_acmd cmds[];
+};
+
+static void _ftl_areq_fail(struct ftl_areq *req, uint16_t status)
+{
+	unsigned int none = 0;
+
+	atomic_compare_exchange_strong(&req->status, &none,
+				       status ? status : NVM_FTL_STATUS_ERR);
+}
+
+/**
+ * Re-read the sectors of a read request which were moved while being read
+ */
+static void _ftl_areq_reread(struct ftl_areq *req)
+{
+	struct nvm_ftl *ftl = req->ftl;
+	struct ftl_rjob job = { 0 };
+
+	job.ftl = ftl;
+	job.lba = req->lba;
+	job.buf = req->buf;
+	job.ppas = req->ppas;
+	atomic_init(&job.status, 0);
+
+	for (size_t i = 0; i < req->nlbas; ++i) {
+		for (int retry = 0; retry < NVM_FTL_READ_RETRIES; ++retry) {
+			uint32_t ppa = atomic_load(&ftl->l2p[req->lba + i]);
+			uint32_t batch[2] = { i, i + 1 };
+
+			if (ppa == req->ppas[i])
+				break;
+
+			req->ppas[i] = ppa;
+			if (ppa == NVM_FTL_UNMAPPED) {
+				memset(req->buf + i * ftl->geo->l.nbytes, 0,
+				       ftl->geo->l.nbytes);
+				continue;
+			}
+
+			if (_ftl_tail_get(ftl, ppa,
+					  req->buf + i * ftl->geo->l.nbytes))
+				continue;
+
+			job.batches = batch;
+			if (_ftl_read_cmd(&job, 0)) {
+				_ftl_areq_fail(req, atomic_load(&job.status));
+				return;
+			}
+		}
+	}
+}
+
+static void _ftl_areq_put(struct ftl_areq *req)
+{
+	struct nvm_ret *ret = req->ret;
+
+	if (atomic_fetch_sub(&req->nleft, 1) != 1)
+		return;
+
+	if (req->ppas && !atomic_load(&req->status))
+		_ftl_areq_reread(req);
+
+	ret->status = atomic_load(&req->status);
+
+	nvm_buf_free(req->ftl->dev, req->pad);
+	free(req->ppas);
+	free(req);
+
+	if (ret->async.cb)
+		ret->async.cb(ret, ret->async.cb_arg);
+}
+
+static void _ftl_acmd_cb(struct nvm_ret *ret, void *opaque)
+{
+	struct ftl_acmd *cmd = opaque;
+	struct ftl_areq *req = cmd->req;
+	struct nvm_ftl *ftl = req->ftl;
+
+	if (ret->status)
+		_ftl_areq_fail(req, ret->status);
+
+	if (cmd->line) {
+		if (!ret->status) {
+			for (uint32_t i = 0; i < cmd->nlbas; ++i)
+				_ftl_map(ftl, cmd->line,
+					 cmd->wunit * ftl->ws_opt + i,
+					 req->lba + cmd->bgn + i);
+		}
+		_ftl_wunit_completed(ftl, cmd->line, cmd->wunit);
+		_ftl_wunit_done(ftl, cmd->line);
+	}
+
+	_ftl_areq_put(req);
+}
+
+static struct ftl_areq *_ftl_areq_alloc(struct nvm_ftl *ftl, uint32_t ncmds,
+					uint64_t lba, size_t nlbas, char *buf,
+					struct nvm_ret *ret)
+{
+	struct ftl_areq *req;
+
+	req = calloc(1, sizeof(*req) + ncmds * sizeof(*req->cmds));
+	if (!req) {
+		NVM_DEBUG("FAILED: calloc");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	req->ftl = ftl;
+	req->ret = ret;
+	req->lba = lba;
+	req->nlbas = nlbas;
+	req->buf = buf;
+	atomic_init(&req->nleft, 1);
+	atomic_init(&req->status, 0);
+
+	return req;
+}
+
+/**
+ * Submit a command of an asynchronous request, waiting for room in the
+ * asynchronous context when it is full
+ */
+static int _ftl_acmd_submit(struct ftl_areq *req, struct ftl_acmd *cmd,
+			    uint32_t naddrs, char *data, int write)
+{
+	struct nvm_ftl *ftl = req->ftl;
+	int err;
+
+	cmd->req = req;
+	cmd->ret.async.ctx = req->ret->async.ctx;
+	cmd->ret.async.cb = _ftl_acmd_cb;
+	cmd->ret.async.cb_arg = cmd;
+
+	atomic_fetch_add(&req->nleft, 1);
+
+	do {
+		if (write)
+			err = nvm_cmd_write(ftl->dev, cmd->addrs, naddrs, data,
+					    NULL, NVM_CMD_ASYNC, &cmd->ret);
+		else
+			err = nvm_cmd_read(ftl->dev, cmd->addrs, naddrs, data,
+					   NULL, NVM_CMD_ASYNC, &cmd->ret);
+	} while (err && (errno == EAGAIN) &&
+		 (nvm_async_poke(ftl->dev, cmd->ret.async.ctx, 0) >= 0));
+
+	if (err) {
+		NVM_DEBUG("FAILED: async submit");
+		_ftl_areq_fail(req, 0);
+		atomic_fetch_sub(&req->nleft, 1);
+	}
+
+	return err;
+}
+
+static int _ftl_write_async(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+			    const char *buf, struct nvm_ret *ret)
+{
+	const size_t nbytes = ftl->geo->l.nbytes;
+	const uint32_t nwunits = (nlbas + ftl->ws_opt - 1) / ftl->ws_opt;
+	struct ftl_areq *req;
+	size_t done = 0;
+
+	req = _ftl_areq_alloc(ftl, nwunits, lba, nlbas, (char *)buf, ret);
+	if (!req)
+		return -1;
+
+	if (nlbas % ftl->ws_opt) {
+		size_t tail = nlbas % ftl->ws_opt;
+
+		req->pad = nvm_buf_alloc(ftl->dev, ftl->ws_opt * nbytes, NULL);
+		if (!req->pad) {
+			NVM_DEBUG("FAILED: nvm_buf_alloc(pad)");
+			free(req);
+			errno = ENOMEM;
+			return -1;
+		}
+		memset(req->pad, 0, ftl->ws_opt * nbytes);
+		memcpy(req->pad, buf + (nlbas - tail) * nbytes, tail * nbytes);
+	}
+
+	while (done < nlbas) {
+		struct nvm_ftl_line *line;
+		uint32_t wunit, nreserved;
+
+		line = _ftl_reserve(ftl, (nlbas - done + ftl->ws_opt - 1) /
+				    ftl->ws_opt, &wunit, &nreserved);
+		if (!line) {
+			_ftl_areq_fail(req, 0);
+			break;
+		}
+
+		for (uint32_t i = 0; i < nreserved; ++i) {
+			struct ftl_acmd *cmd = &req->cmds[req->ncmds++];
+			const char *data = buf + done * nbytes;
+			int err;
+
+			cmd->line = line;
+			cmd->wunit = wunit + i;
+			cmd->bgn = done;
+			cmd->nlbas = NVM_MIN(ftl->ws_opt, nlbas - done);
+			if (cmd->nlbas < ftl->ws_opt)
+				data = req->pad;
+
+			_ftl_wunit_addrs(ftl, line, cmd->wunit, cmd->addrs);
+
+			// The next unit of the chunk goes on completion
+			_ftl_wunit_wait(ftl, line, cmd->wunit,
+					ret->async.ctx, pthread_self());
+			_ftl_wunit_own(ftl, line, cmd->wunit, ret->async.ctx);
+			_ftl_tail_put(ftl, line, cmd->wunit, data);
+			err = _ftl_acmd_submit(req, cmd, ftl->ws_opt,
+					       (char *)data, 1);
+			if (err) {
+				_ftl_wunit_completed(ftl, line, cmd->wunit);
+				_ftl_wunit_done(ftl, line);
+			}
+
+			done += cmd->nlbas;
+		}
+	}
+
+	_ftl_areq_put(req);
+
+	return 0;
+}
+
+static int _ftl_read_async(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+			   char *buf, struct nvm_ret *ret)
+{
+	uint32_t *batches, nbatches;
+	struct ftl_areq *req;
+	uint32_t *ppas;
+
+	ppas = malloc(nlbas * sizeof(*ppas));
+	batches = malloc(nlbas * 2 * sizeof(*batches));
+	if (!ppas || !batches) {
+		NVM_DEBUG("FAILED: malloc");
+		free(ppas);
+		free(batches);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	nbatches = _ftl_lookup(ftl, lba, nlbas, buf, ppas, batches);
+
+	req = _ftl_areq_alloc(ftl, nbatches, lba, nlbas, buf, ret);
+	if (!req) {
+		free(ppas);
+		free(batches);
+		return -1;
+	}
+	req->ppas = ppas;
+
+	for (uint32_t b = 0; b < nbatches; ++b) {
+		struct ftl_acmd *cmd = &req->cmds[req->ncmds++];
+
+		cmd->bgn = batches[b * 2];
+		cmd->nlbas = batches[b * 2 + 1] - cmd->bgn;
+		for (uint32_t i = 0; i < cmd->nlbas; ++i)
+			_ftl_ppa2addr(ftl, ppas[cmd->bgn + i], &cmd->addrs[i]);
+
+		if (_ftl_acmd_submit(req, cmd, cmd->nlbas,
+				     buf + cmd->bgn * ftl->geo->l.nbytes, 0))
+			break;
+	}
+
+	free(batches);
+	_ftl_areq_put(req);
+
+	return 0;
+}
+
+/**
+ * Order the parallel units such that consecutive write-units land on
+ * different groups
+ */
+static int _ftl_pus_setup(struct nvm_ftl *ftl)
+{
+	const struct nvm_geo *geo = ftl->geo;
+
+	ftl->npus = geo->l.npugrp * geo->l.npunit;
+	ftl->pus = calloc(ftl->npus, sizeof(*ftl->pus));
+	if (!ftl->pus) {
+		NVM_DEBUG("FAILED: calloc(pus)");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < ftl->npus; ++i) {
+		ftl->pus[i].l.pugrp = i % geo->l.npugrp;
+		ftl->pus[i].l.punit = i / geo->l.npugrp;
+	}
+
+	// Largest # of ordered queues keeping each chunk on a single queue
+	for (ftl->wqueues = NVM_MIN(ftl->npus, NVM_POOL_NQUEUES_MAX);
+	     ftl->npus % ftl->wqueues; --ftl->wqueues)
+		;
+
+	return 0;
+}
+
+static int _ftl_lines_setup(struct nvm_ftl *ftl, int chunk_bgn, int chunk_end)
+{
+	const uint32_t nmaps = ftl->npus * ftl->cnk_nwords;
+
+	ftl->nlines = chunk_end - chunk_bgn;
+	ftl->lines = calloc(ftl->nlines, sizeof(*ftl->lines));
+	ftl->free = calloc(ftl->nlines, sizeof(*ftl->free));
+	ftl->tails = calloc(ftl->nlines, sizeof(*ftl->tails));
+	if (!ftl->lines || !ftl->free || !ftl->tails) {
+		NVM_DEBUG("FAILED: calloc(lines)");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < ftl->nlines; ++i) {
+		struct nvm_ftl_line *line = &ftl->lines[i];
+
+		line->idx = chunk_bgn + i;
+		atomic_init(&line->state, NVM_FTL_LINE_FREE);
+		atomic_init(&line->nvalid, 0);
+		line->wrnd = calloc(ftl->npus, sizeof(*line->wrnd));
+		line->wown = calloc(ftl->npus, sizeof(*line->wown));
+		line->cnk_nvalid = calloc(ftl->npus, sizeof(*line->cnk_nvalid));
+		line->valid = calloc(nmaps, sizeof(*line->valid));
+		line->p2l = calloc(ftl->line_nsectr, sizeof(*line->p2l));
+		if (!line->wrnd || !line->wown || !line->cnk_nvalid ||
+		    !line->valid || !line->p2l) {
+			NVM_DEBUG("FAILED: calloc(line)");
+			errno = ENOMEM;
+			return -1;
+		}
+
+		// Pushed in reverse, such that lines are opened in order
+		ftl->free[ftl->nlines - 1 - i] = i;
+	}
+	ftl->nfree = ftl->nlines;
+
+	return 0;
+}
+
+void nvm_ftl_free(struct nvm_ftl *ftl)
+{
+	if (!ftl)
+		return;
+
+	nvm_ftl_gc_term(ftl);
+
+	for (uint32_t i = 0; ftl->lines && (i < ftl->nlines); ++i) {
+		free(ftl->lines[i].wrnd);
+		free(ftl->lines[i].wown);
+		free(ftl->lines[i].cnk_nvalid);
+		free(ftl->lines[i].valid);
+		free(ftl->lines[i].p2l);
+	}
+	for (uint32_t i = 0; ftl->tails && (i < ftl->nlines); ++i)
+		free(ftl->tails[i].buf);
+	free(ftl->tails);
+	free(ftl->lines);
+	free(ftl->free);
+	free(ftl->l2p);
+	free(ftl->pus);
+
+	pthread_mutex_destroy(&ftl->gc.lock);
+	pthread_mutex_destroy(&ftl->free_lock);
+	pthread_mutex_destroy(&ftl->lock);
+
+	free(ftl);
+}
+
+struct nvm_ftl *nvm_ftl_alloc(struct nvm_dev *dev, int chunk_bgn,
+			      int chunk_end, int NVM_UNUSED(flags))
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_ftl *ftl;
+	uint32_t nlines_op;
+
+	if (geo->verid != NVM_SPEC_VERID_20) {
+		NVM_DEBUG("FAILED: unsupported verid: %d", geo->verid);
+		errno = ENOSYS;
+		return NULL;
+	}
+	if ((chunk_bgn < 0) || (chunk_end <= chunk_bgn) ||
+	    ((size_t)chunk_end > geo->l.nchunk)) {
+		NVM_DEBUG("FAILED: invalid chunk range [%d,%d)", chunk_bgn,
+			  chunk_end);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ftl = calloc(1, sizeof(*ftl));
+	if (!ftl) {
+		NVM_DEBUG("FAILED: calloc(ftl)");
+		errno = ENOMEM;
+		return NULL;
+	}
+	pthread_mutex_init(&ftl->lock, NULL);
+	pthread_mutex_init(&ftl->free_lock, NULL);
+	pthread_mutex_init(&ftl->gc.lock, NULL);
+
+	ftl->dev = dev;
+	ftl->geo = geo;
+	ftl->ws_opt = nvm_dev_get_ws_opt(dev);
+	ftl->scalar = (dev->cmd_opts & NVM_CMD_MASK_ADDR) == NVM_CMD_SCALAR;
+	ftl->cnk_nwords = (geo->l.nsectr + 63) / 64;
+
+	if (_ftl_pus_setup(ftl)) {
+		nvm_ftl_free(ftl);
+		return NULL;
+	}
+
+	ftl->line_nsectr = ftl->npus * geo->l.nsectr;
+	ftl->line_nwunits = ftl->line_nsectr / ftl->ws_opt;
+	ftl->cnk_nwunits = geo->l.nsectr / ftl->ws_opt;
+
+	// Enough write-units that 'mw_cunits' sectors are written after the
+	// last sector of the one a slot held, before the slot is reused
+	ftl->mw_cunits = nvm_dev_get_mw_cunits(dev);
+	ftl->tail_nwunits = ftl->mw_cunits ?
+			    (ftl->mw_cunits + 2 * ftl->ws_opt - 1) /
+			    ftl->ws_opt : 0;
+
+	if ((uint64_t)(chunk_end - chunk_bgn) * ftl->line_nsectr >=
+	    NVM_FTL_UNMAPPED) {
+		NVM_DEBUG("FAILED: range exceeds 32bit sector addressing");
+		nvm_ftl_free(ftl);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (_ftl_lines_setup(ftl, chunk_bgn, chunk_end)) {
+		nvm_ftl_free(ftl);
+		return NULL;
+	}
+
+	nlines_op = NVM_MAX(NVM_FTL_NLINES_OP_MIN, ftl->nlines / 10);
+	if (ftl->nlines <= nlines_op) {
+		NVM_DEBUG("FAILED: nlines(%u) <= nlines_op(%u)", ftl->nlines,
+			  nlines_op);
+		nvm_ftl_free(ftl);
+		errno = EINVAL;
+		return NULL;
+	}
+	ftl->nlbas = (uint64_t)(ftl->nlines - nlines_op) * ftl->line_nsectr;
+
+	ftl->l2p = malloc(ftl->nlbas * sizeof(*ftl->l2p));
+	if (!ftl->l2p) {
+		NVM_DEBUG("FAILED: malloc(l2p)");
+		nvm_ftl_free(ftl);
+		errno = ENOMEM;
+		return NULL;
+	}
+	for (uint64_t lba = 0; lba < ftl->nlbas; ++lba)
+		atomic_init(&ftl->l2p[lba], NVM_FTL_UNMAPPED);
+
+	atomic_init(&ftl->resv, _ftl_resv(0, ftl->line_nwunits));
+	atomic_init(&ftl->nclosed, 0);
+
+	if (nvm_ftl_gc_init(ftl)) {
+		nvm_ftl_free(ftl);
+		return NULL;
+	}
+
+	return ftl;
+}
+
+uint64_t nvm_ftl_get_nlbas(const struct nvm_ftl *ftl)
+{
+	return ftl->nlbas;
+}
+
+static int _ftl_range_check(const struct nvm_ftl *ftl, uint64_t lba,
+			    size_t nlbas)
+{
+	if (!nlbas || (lba >= ftl->nlbas) || (nlbas > ftl->nlbas - lba)) {
+		NVM_DEBUG("FAILED: invalid range lba(%"PRIu64"), nlbas(%zu)",
+			  lba, nlbas);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _ftl_async_check(const struct nvm_ret *ret)
+{
+	if (!ret || !ret->async.ctx) {
+		NVM_DEBUG("FAILED: NVM_CMD_ASYNC without async context");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nvm_ftl_write(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+		  const void *buf, uint16_t flags, struct nvm_ret *ret)
+{
+	if (_ftl_range_check(ftl, lba, nlbas))
+		return -1;
+
+	if (flags & NVM_CMD_ASYNC) {
+		if (_ftl_async_check(ret))
+			return -1;
+
+		return _ftl_write_async(ftl, lba, nlbas, buf, ret);
+	}
+
+	return _ftl_write_sync(ftl, lba, nlbas, buf, ret);
+}
+
+int nvm_ftl_read(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas, void *buf,
+		 uint16_t flags, struct nvm_ret *ret)
+{
+	if (_ftl_range_check(ftl, lba, nlbas))
+		return -1;
+
+	if (flags & NVM_CMD_ASYNC) {
+		if (_ftl_async_check(ret))
+			return -1;
+
+		return _ftl_read_async(ftl, lba, nlbas, buf, ret);
+	}
+
+	return _ftl_read_sync(ftl, lba, nlbas, buf, ret);
+}
+
+int nvm_ftl_trim(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas)
+{
+	if (_ftl_range_check(ftl, lba, nlbas))
+		return -1;
+
+	for (size_t i = 0; i < nlbas; ++i) {
+		uint32_t old;
+
+		old = atomic_exchange(&ftl->l2p[lba + i], NVM_FTL_UNMAPPED);
+		if (old != NVM_FTL_UNMAPPED)
+			_ftl_invalidate(ftl, old, lba + i);
+	}
+
+	return 0;
+}
+
+void nvm_ftl_pr(const struct nvm_ftl *ftl)
+{
+	const char *states[] = { "FREE", "OPEN", "CLOSED", "BAD", "GC" };
+	const char *policies[] = { "GREEDY", "COST_BENEFIT" };
+	uint64_t resv;
+
+	if (!ftl) {
+		printf("ftl: ~\n");
+		return;
+	}
+
+	resv = atomic_load(&((struct nvm_ftl *)ftl)->resv);
+
+	printf("ftl:\n");
+	printf("  nlbas: %"PRIu64"\n", ftl->nlbas);
+	printf("  npus: %"PRIu32"\n", ftl->npus);
+	printf("  ws_opt: %"PRIu32"\n", ftl->ws_opt);
+	printf("  line_nsectr: %"PRIu32"\n", ftl->line_nsectr);
+	printf("  nlines: %"PRIu32"\n", ftl->nlines);
+	printf("  nfree: %"PRIu32"\n", ftl->nfree);
+	printf("  open: %"PRIi64"\n", (uint32_t)resv < ftl->line_nwunits ?
+	       (int64_t)ftl->lines[resv >> 32].idx : -1);
+	printf("  gc:\n");
+	printf("    policy: %s\n", policies[ftl->gc.policy]);
+	printf("    rate: %"PRIu64"\n", ftl->gc.rate);
+	printf("    copy: %d\n", ftl->gc.copy);
+	printf("    erase_async: %d\n", ftl->gc.erase_async);
+	printf("    nrelocated: %"PRIu64"\n", ftl->gc.nrelocated);
+	printf("    nreclaimed: %"PRIu64"\n", ftl->gc.nreclaimed);
+	printf("  lines:\n");
+	for (uint32_t i = 0; i < ftl->nlines; ++i) {
+		const struct nvm_ftl_line *line = &ftl->lines[i];
+
+		printf("  - {idx: %"PRIu32", state: %s, nvalid: %u}\n",
+		       line->idx, states[atomic_load(&line->state)],
+		       atomic_load(&line->nvalid));
+	}
+}
+
+#else
+
+struct nvm_ftl *nvm_ftl_alloc(struct nvm_dev *NVM_UNUSED(dev),
+			      int NVM_UNUSED(chunk_bgn),
+			      int NVM_UNUSED(chunk_end),
+			      int NVM_UNUSED(flags))
+{
+	NVM_DEBUG("FAILED: built without NVM_FTL_ENABLED");
+	errno = ENOSYS;
+	return NULL;
+}
+
+void nvm_ftl_free(struct nvm_ftl *NVM_UNUSED(ftl))
+{
+	return;
+}
+
+uint64_t nvm_ftl_get_nlbas(const struct nvm_ftl *NVM_UNUSED(ftl))
+{
+	return 0;
+}
+
+int nvm_ftl_read(struct nvm_ftl *NVM_UNUSED(ftl), uint64_t NVM_UNUSED(lba),
+		 size_t NVM_UNUSED(nlbas), void *NVM_UNUSED(buf),
+		 uint16_t NVM_UNUSED(flags), struct nvm_ret *NVM_UNUSED(ret))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int nvm_ftl_write(struct nvm_ftl *NVM_UNUSED(ftl), uint64_t NVM_UNUSED(lba),
+		  size_t NVM_UNUSED(nlbas), const void *NVM_UNUSED(buf),
+		  uint16_t NVM_UNUSED(flags), struct nvm_ret *NVM_UNUSED(ret))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int nvm_ftl_trim(struct nvm_ftl *NVM_UNUSED(ftl), uint64_t NVM_UNUSED(lba),
+		 size_t NVM_UNUSED(nlbas))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+void nvm_ftl_pr(const struct nvm_ftl *NVM_UNUSED(ftl))
+{
+	printf("ftl: ~\n");
+}
+
+#endif
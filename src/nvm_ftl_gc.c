@@ -0,0 +1,794 @@
+/*
+ * nvm_ftl_gc - Garbage collection of the host-side FTL
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+
+#ifdef NVM_FTL_ENABLED
+#include <sched.h>
+#include <nvm_ftl.h>
+#include <nvm_timer.h>
+
+/**
+ * Sectors relocated by a single copy, or a single read and write, all to
+ * consecutive write-units of the same line
+ */
+struct ftl_gc_batch {
+	struct nvm_ftl_line *line;	///< Destination line
+	uint32_t wunit;			///< First destination write-unit
+	uint32_t nwunits;		///< # of destination write-units
+	uint32_t nsectrs;		///< # of sectors, including padding
+	uint32_t nvalid;		///< # of sectors relocated, excluding padding
+	uint32_t lbas[NVM_NADDR_MAX];	///< LBA of the relocated sectors
+	uint32_t ppas[NVM_NADDR_MAX];	///< Source of the relocated sectors
+	struct nvm_addr src[NVM_NADDR_MAX];
+	struct nvm_addr dst[NVM_NADDR_MAX];
+	struct nvm_ret rets[2 * NVM_NADDR_MAX + 1];	///< Reads, writes, copy
+	uint32_t ncmds;			///< # of commands submitted, in 'rets'
+	uint32_t nleft;			///< # of commands in flight
+	uint32_t nerr;			///< # of commands failed
+	int started;			///< Whether the relocation is submitted
+	char *buf;			///< Data for relocation by read+write
+};
+
+/**
+ * Chunk resets of a reclaimed line, in flight on the async. context
+ */
+struct ftl_gc_reset {
+	struct nvm_ftl *ftl;
+	struct nvm_ftl_line *line;
+	uint32_t nleft;
+	uint32_t nerr;
+	struct nvm_ret rets[];
+};
+
+static void _gc_reset_done(struct nvm_ftl *ftl, struct nvm_ftl_line *line,
+			   int err)
+{
+	if (err) {
+		NVM_DEBUG("FAILED: reset of line: %"PRIu32, line->idx);
+		atomic_store(&line->state, NVM_FTL_LINE_BAD);
+		return;
+	}
+
+	nvm_ftl_line_init(ftl, line);
+	line->erased = 1;
+	nvm_ftl_line_push(ftl, line);
+}
+
+static void _gc_reset_cb(struct nvm_ret *ret, void *opaque)
+{
+	struct ftl_gc_reset *reset = opaque;
+
+	if (ret->status)
+		++reset->nerr;
+
+	if (--reset->nleft)
+		return;
+
+	_gc_reset_done(reset->ftl, reset->line, reset->nerr);
+	--reset->ftl->gc.nerasing;
+	free(reset);
+}
+
+/**
+ * Reset the chunks of a reclaimed line, on the async. context when the backend
+ * supports asynchronous erase, otherwise on the worker-pool
+ */
+static void _gc_reset(struct nvm_ftl *ftl, struct nvm_ftl_line *line)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+	struct ftl_gc_reset *reset = NULL;
+	struct nvm_ret guard = { 0 };
+
+	if (gc->erase_async)
+		reset = calloc(1, sizeof(*reset) +
+			       ftl->npus * sizeof(*reset->rets));
+
+	if (!reset) {
+		_gc_reset_done(ftl, line, nvm_ftl_line_erase(ftl, line));
+		return;
+	}
+
+	reset->ftl = ftl;
+	reset->line = line;
+	reset->nleft = 1;	// Guards against completion during submission
+	++gc->nerasing;
+
+	for (uint32_t pu = 0; pu < ftl->npus; ++pu) {
+		struct nvm_ret *ret = &reset->rets[pu];
+		struct nvm_addr addr;
+		int err;
+
+		addr.val = ftl->pus[pu].val;
+		addr.l.chunk = line->idx;
+
+		ret->async.ctx = gc->ctx;
+		ret->async.cb = _gc_reset_cb;
+		ret->async.cb_arg = reset;
+
+		++reset->nleft;
+		do {
+			err = nvm_cmd_erase(ftl->dev, &addr, 1, NULL,
+					    NVM_CMD_ASYNC, ret);
+		} while (err && (errno == EAGAIN) &&
+			 (nvm_async_poke(ftl->dev, gc->ctx, 0) >= 0));
+		if (!err)
+			continue;
+
+		--reset->nleft;
+
+		// The backend has no async. erase, reset the rest synchronously
+		if (!pu && ((errno == EINVAL) || (errno == ENOSYS))) {
+			gc->erase_async = 0;
+			--gc->nerasing;
+			free(reset);
+			_gc_reset_done(ftl, line, nvm_ftl_line_erase(ftl, line));
+			return;
+		}
+
+		++reset->nerr;
+	}
+
+	_gc_reset_cb(&guard, reset);
+}
+
+/**
+ * Pick the closed line to reclaim
+ *
+ * Greedy picks the line with the fewest valid sectors. Cost-benefit weighs the
+ * free space gained against the cost of relocating, favoring lines which have
+ * been closed for long, as their remaining data is likely to stay valid,
+ * score = (1 - u) * age / (1 + u), with 'u' the fraction of valid sectors.
+ *
+ * @return The line, or NULL when no closed line has invalid sectors
+ */
+static struct nvm_ftl_line *_gc_victim(struct nvm_ftl *ftl)
+{
+	const uint64_t now = atomic_load(&ftl->nclosed);
+	struct nvm_ftl_line *victim = NULL;
+	double best = -1;
+
+	for (uint32_t i = 0; i < ftl->nlines; ++i) {
+		struct nvm_ftl_line *line = &ftl->lines[i];
+		const uint32_t nvalid = atomic_load(&line->nvalid);
+		double score;
+
+		if (atomic_load(&line->state) != NVM_FTL_LINE_CLOSED)
+			continue;
+		if (nvalid >= ftl->line_nsectr)
+			continue;
+
+		switch (ftl->gc.policy) {
+		case NVM_FTL_GC_COST_BENEFIT:
+		{
+			const double u = nvalid / (double)ftl->line_nsectr;
+
+			score = (1 - u) * (now - line->seq + 1) / (1 + u);
+			break;
+		}
+
+		case NVM_FTL_GC_GREEDY:
+		default:
+			score = ftl->line_nsectr - nvalid;
+			break;
+		}
+
+		if (score > best) {
+			best = score;
+			victim = line;
+		}
+	}
+
+	return victim;
+}
+
+/**
+ * Wait until 'nsectrs' sectors may be relocated within the rate-limit
+ */
+static void _gc_throttle(struct nvm_ftl_gc *gc, uint32_t nsectrs)
+{
+	const double burst = NVM_MAX(gc->rate, NVM_NADDR_MAX);
+	uint64_t now;
+
+	if (!gc->rate)
+		return;
+
+	now = _clock_monotonic();
+	if (gc->tokens_ts) {
+		gc->tokens += (now - gc->tokens_ts) * gc->rate / 1000000000.0;
+		if (gc->tokens > burst)
+			gc->tokens = burst;
+	}
+	gc->tokens_ts = now;
+
+	if (gc->tokens < nsectrs) {
+		const double wait = (nsectrs - gc->tokens) / gc->rate;
+		struct timespec ts;
+
+		ts.tv_sec = wait;
+		ts.tv_nsec = (wait - ts.tv_sec) * 1000000000.0;
+		nanosleep(&ts, NULL);
+
+		gc->tokens = nsectrs;
+		gc->tokens_ts = _clock_monotonic();
+	}
+
+	gc->tokens -= nsectrs;
+}
+
+/**
+ * Fill 'batch' with valid sectors of 'victim' from sector '*cur' and onwards,
+ * padded to whole write-units, and reserve its destination in the GC line
+ *
+ * @return The # of sectors to relocate, 0 when the victim has no more valid
+ * sectors. On error, -1 and `errno` set.
+ */
+static int _gc_batch_fill(struct nvm_ftl *ftl, struct ftl_gc_batch *batch,
+			  struct nvm_ftl_line *victim, uint32_t *cur)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+	uint32_t room, nvalid = 0;
+
+	if (!gc->line) {
+		struct nvm_ftl_line *line;
+
+		do {
+			// Lines reclaimed earlier may still be resetting
+			while (!(line = nvm_ftl_line_pop(ftl, 0)) && gc->nerasing)
+				nvm_async_poke(ftl->dev, gc->ctx, 0);
+
+			if (!line) {
+				NVM_DEBUG("FAILED: no free line for relocation");
+				errno = ENOSPC;
+				return -1;
+			}
+		} while (nvm_ftl_line_open(ftl, line) && (errno != ENOMEM));
+
+		if (atomic_load(&line->state) != NVM_FTL_LINE_OPEN)
+			return -1;	// Propagate errno
+
+		gc->line = line;
+	}
+
+	room = NVM_MIN(NVM_NADDR_MAX / ftl->ws_opt, ftl->line_nwunits -
+		       atomic_load(&gc->line->wunit_next)) * ftl->ws_opt;
+
+	for (; (*cur < ftl->line_nsectr) && (nvalid < room); ++(*cur)) {
+		uint32_t lba;
+
+		if (!_ftl_is_valid(ftl, victim, *cur))
+			continue;
+
+		lba = atomic_load_explicit(&victim->p2l[*cur],
+					   memory_order_relaxed);
+
+		batch->lbas[nvalid] = lba;
+		batch->ppas[nvalid] = _ftl_line_ppa(ftl, victim, *cur);
+		_ftl_ppa2addr(ftl, batch->ppas[nvalid], &batch->src[nvalid]);
+		++nvalid;
+	}
+	if (!nvalid)
+		return 0;
+
+	batch->line = gc->line;
+	batch->nvalid = nvalid;
+	batch->nwunits = (nvalid + ftl->ws_opt - 1) / ftl->ws_opt;
+	batch->nsectrs = batch->nwunits * ftl->ws_opt;
+	batch->wunit = atomic_fetch_add(&gc->line->wunit_next, batch->nwunits);
+
+	// Forget a full line, it may be reclaimed once the batch completes
+	if (batch->wunit + batch->nwunits >= ftl->line_nwunits)
+		gc->line = NULL;
+
+	for (uint32_t i = 0; i < batch->nwunits; ++i)
+		_ftl_wunit_addrs(ftl, batch->line, batch->wunit + i,
+				 &batch->dst[i * ftl->ws_opt]);
+
+	// Padding is copied from the last valid sector, it is never mapped
+	for (uint32_t i = nvalid; i < batch->nsectrs; ++i)
+		batch->src[i] = batch->src[nvalid - 1];
+
+	memset(batch->buf + nvalid * ftl->geo->l.nbytes, 0,
+	       (batch->nsectrs - nvalid) * ftl->geo->l.nbytes);
+
+	batch->ncmds = 0;
+	batch->nleft = 0;
+	batch->nerr = 0;
+	batch->started = 0;
+
+	return nvalid;
+}
+
+static void _gc_cmd_cb(struct nvm_ret *ret, void *opaque)
+{
+	struct ftl_gc_batch *batch = opaque;
+
+	if (ret->status)
+		++batch->nerr;
+
+	--batch->nleft;
+}
+
+enum ftl_gc_op {
+	FTL_GC_READ,
+	FTL_GC_WRITE,
+	FTL_GC_COPY,
+};
+
+/**
+ * Submit a read, write or copy of 'batch', on the async. context when
+ * available, a copy reads from the sources of 'batch'
+ *
+ * @return 0 on submission, -1 with `errno` set otherwise. A copy the backend
+ * does not support is not counted as failed.
+ */
+static int _gc_submit(struct nvm_ftl *ftl, struct ftl_gc_batch *batch,
+		      enum ftl_gc_op op, struct nvm_addr addrs[], int naddrs,
+		      char *data)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+	struct nvm_ret *ret = &batch->rets[batch->ncmds++];
+	const uint16_t flags = gc->ctx ? NVM_CMD_ASYNC : NVM_CMD_SYNC;
+	int err;
+
+	memset(ret, 0, sizeof(*ret));
+	if (gc->ctx) {
+		ret->async.ctx = gc->ctx;
+		ret->async.cb = _gc_cmd_cb;
+		ret->async.cb_arg = batch;
+		++batch->nleft;
+	}
+
+	do {
+		switch (op) {
+		case FTL_GC_WRITE:
+			err = nvm_cmd_write(ftl->dev, addrs, naddrs, data, NULL,
+					    flags, ret);
+			break;
+		case FTL_GC_COPY:
+			err = nvm_cmd_copy(ftl->dev, batch->src, addrs, naddrs,
+					   flags, ret);
+			break;
+		case FTL_GC_READ:
+		default:
+			err = nvm_cmd_read(ftl->dev, addrs, naddrs, data, NULL,
+					   flags, ret);
+			break;
+		}
+	} while (err && gc->ctx && (errno == EAGAIN) &&
+		 (nvm_async_poke(ftl->dev, gc->ctx, 0) >= 0));
+
+	if (err) {
+		const int errno_cmd = errno;
+
+		if (gc->ctx)
+			--batch->nleft;
+		if ((op == FTL_GC_COPY) && (errno_cmd == ENOSYS)) {
+			--batch->ncmds;
+			return -1;
+		}
+
+		NVM_DEBUG("FAILED: relocation op: %d", op);
+		++batch->nerr;
+		errno = errno_cmd;
+	}
+
+	return err ? -1 : 0;
+}
+
+/**
+ * Read the sectors of 'batch', as runs of consecutive sectors when the device
+ * is addressed with scalar commands
+ */
+static void _gc_batch_read(struct nvm_ftl *ftl, struct ftl_gc_batch *batch)
+{
+	const size_t nbytes = ftl->geo->l.nbytes;
+
+	if (!ftl->scalar) {
+		_gc_submit(ftl, batch, FTL_GC_READ, batch->src, batch->nvalid,
+			   batch->buf);
+		return;
+	}
+
+	for (uint32_t bgn = 0, i = 1; i <= batch->nvalid; ++i) {
+		if (i < batch->nvalid) {
+			struct nvm_addr succ = batch->src[i - 1];
+
+			succ.l.sectr += 1;
+			if (succ.val == batch->src[i].val)
+				continue;
+		}
+
+		_gc_submit(ftl, batch, FTL_GC_READ, &batch->src[bgn], i - bgn,
+			   batch->buf + bgn * nbytes);
+		bgn = i;
+	}
+}
+
+static void _gc_batch_wait(struct nvm_ftl *ftl, struct ftl_gc_batch *batch)
+{
+	while (batch->nleft)
+		nvm_async_poke(ftl->dev, ftl->gc.ctx, 0);
+}
+
+/**
+ * Write the sectors of 'batch', also when reading them failed, as the
+ * destination write-units are reserved and must be written in order
+ */
+static void _gc_batch_write(struct nvm_ftl *ftl, struct ftl_gc_batch *batch)
+{
+	const size_t nbytes = ftl->geo->l.nbytes;
+
+	if (!ftl->scalar) {
+		_gc_submit(ftl, batch, FTL_GC_WRITE, batch->dst,
+			   batch->nsectrs, batch->buf);
+		return;
+	}
+
+	for (uint32_t i = 0; i < batch->nwunits; ++i)
+		_gc_submit(ftl, batch, FTL_GC_WRITE, &batch->dst[i * ftl->ws_opt],
+			   ftl->ws_opt, batch->buf + i * ftl->ws_opt * nbytes);
+}
+
+/**
+ * Submit the relocation of 'batch', by vector-copy without host data transfer,
+ * else by writing the sectors read by _gc_batch_read. Falls back to read+write
+ * for good when the backend lacks vector-copy.
+ */
+static void _gc_batch_start(struct nvm_ftl *ftl, struct ftl_gc_batch *batch)
+{
+	batch->started = 1;
+
+	if (!ftl->gc.copy) {
+		_gc_batch_wait(ftl, batch);	// Reads of the batch
+		_gc_batch_write(ftl, batch);
+		return;
+	}
+
+	if (!_gc_submit(ftl, batch, FTL_GC_COPY, batch->dst, batch->nsectrs,
+			NULL)) {
+		// The tail of the line serves the copy until readable
+		if (atomic_load(&batch->line->tail))
+			_gc_batch_read(ftl, batch);
+		return;
+	}
+	if (errno != ENOSYS)
+		return;
+
+	ftl->gc.copy = 0;
+
+	_gc_batch_read(ftl, batch);
+	_gc_batch_wait(ftl, batch);
+	_gc_batch_write(ftl, batch);
+}
+
+/**
+ * Whether the relocation of 'next' may be in flight with that of 'cur', as
+ * their destination write-units are on distinct chunks
+ */
+static inline int _gc_batch_disjoint(struct nvm_ftl *ftl,
+				     struct ftl_gc_batch *cur,
+				     struct ftl_gc_batch *next)
+{
+	if (next->line != cur->line)
+		return 1;
+
+	return next->wunit + next->nwunits - cur->wunit <= ftl->npus;
+}
+
+/**
+ * Map the relocated sectors, unless overwritten or trimmed meanwhile
+ */
+static void _gc_batch_complete(struct nvm_ftl *ftl, struct ftl_gc_batch *batch)
+{
+	const size_t wunit_nbytes = ftl->ws_opt * ftl->geo->l.nbytes;
+
+	for (uint32_t i = 0; i < batch->nwunits; ++i) {
+		_ftl_tail_put(ftl, batch->line, batch->wunit + i,
+			      batch->buf + i * wunit_nbytes);
+		_ftl_wunit_completed(ftl, batch->line, batch->wunit + i);
+	}
+
+	for (uint32_t i = 0; (!batch->nerr) && (i < batch->nvalid); ++i) {
+		const uint32_t v = batch->wunit * ftl->ws_opt + i;
+		uint32_t ppa = _ftl_line_ppa(ftl, batch->line, v);
+		uint32_t old = batch->ppas[i];
+
+		_ftl_validate(ftl, batch->line, v, batch->lbas[i]);
+
+		if (atomic_compare_exchange_strong(&ftl->l2p[batch->lbas[i]],
+						   &old, ppa))
+			_ftl_invalidate(ftl, batch->ppas[i], batch->lbas[i]);
+		else
+			_ftl_invalidate(ftl, ppa, batch->lbas[i]);
+	}
+
+	for (uint32_t i = 0; i < batch->nwunits; ++i)
+		_ftl_wunit_done(ftl, batch->line);
+
+	if (!batch->nerr)
+		ftl->gc.nrelocated += batch->nvalid;
+}
+
+/**
+ * Relocate the valid sectors of 'victim' and reset it
+ *
+ * Relocation is pipelined over two batches. The next batch is filled while the
+ * current one is in flight, by read+write its reads are in flight with the
+ * writes of the current, by copy it is submitted as well when the two batches
+ * write to distinct chunks.
+ */
+static int _gc_collect(struct nvm_ftl *ftl, struct nvm_ftl_line *victim,
+		       int forced)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+	struct ftl_gc_batch *cur = &gc->batches[0];
+	struct ftl_gc_batch *next = &gc->batches[1];
+	uint32_t pos = 0;
+	int nerr = 0;
+	int err;
+
+	atomic_store(&victim->state, NVM_FTL_LINE_GC);
+
+	err = _gc_batch_fill(ftl, cur, victim, &pos);
+	if (err > 0 && !gc->copy)
+		_gc_batch_read(ftl, cur);
+
+	while (err > 0) {
+		struct ftl_gc_batch *tmp;
+
+		if (!cur->started) {
+			if (!forced)
+				_gc_throttle(gc, cur->nvalid);
+			_gc_batch_start(ftl, cur);
+		}
+
+		err = _gc_batch_fill(ftl, next, victim, &pos);
+		if ((err > 0) && !gc->copy) {
+			_gc_batch_read(ftl, next);
+		} else if ((err > 0) && _gc_batch_disjoint(ftl, cur, next)) {
+			if (!forced)
+				_gc_throttle(gc, next->nvalid);
+			_gc_batch_start(ftl, next);
+		}
+
+		_gc_batch_wait(ftl, cur);
+		_gc_batch_complete(ftl, cur);
+		nerr += cur->nerr;
+
+		tmp = cur;
+		cur = next;
+		next = tmp;
+	}
+
+	// Overwrites of relocated sectors may still be invalidating the source
+	for (int i = 0; (!err) && atomic_load(&victim->nvalid) &&
+	     (i < NVM_FTL_GC_SETTLE_YIELDS); ++i)
+		sched_yield();
+
+	if (err || nerr || atomic_load(&victim->nvalid)) {
+		NVM_DEBUG("FAILED: relocation from line: %"PRIu32, victim->idx);
+		atomic_store(&victim->state, NVM_FTL_LINE_CLOSED);
+		if (!err)
+			errno = EIO;
+		return -1;
+	}
+
+	_gc_reset(ftl, victim);
+	++gc->nreclaimed;
+
+	return 0;
+}
+
+static uint32_t _gc_nfree(struct nvm_ftl *ftl)
+{
+	uint32_t nfree;
+
+	pthread_mutex_lock(&ftl->free_lock);
+	nfree = ftl->nfree;
+	pthread_mutex_unlock(&ftl->free_lock);
+
+	return nfree;
+}
+
+int nvm_ftl_gc_forced(struct nvm_ftl *ftl)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+	int err = 0;
+
+	pthread_mutex_lock(&gc->lock);
+
+	// Bounded, as relocation could consume as many lines as it frees
+	for (uint32_t i = 0; _gc_nfree(ftl) <= NVM_FTL_GC_NLINES_RSV;) {
+		struct nvm_ftl_line *victim;
+
+		if (gc->nerasing) {
+			nvm_async_poke(ftl->dev, gc->ctx, 0);
+			sched_yield();
+			continue;
+		}
+
+		victim = i++ < ftl->nlines ? _gc_victim(ftl) : NULL;
+		if (!victim) {
+			NVM_DEBUG("FAILED: no line to reclaim");
+			errno = ENOSPC;
+			err = -1;
+			break;
+		}
+
+		err = _gc_collect(ftl, victim, 1);
+		if (err)
+			break;
+	}
+
+	pthread_mutex_unlock(&gc->lock);
+
+	return err;
+}
+
+int nvm_ftl_gc(struct nvm_ftl *ftl, uint32_t nlines)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+	int nreclaimed = 0;
+
+	pthread_mutex_lock(&gc->lock);
+
+	if (gc->nerasing)
+		nvm_async_poke(ftl->dev, gc->ctx, 0);
+
+	for (uint32_t i = 0; i < nlines; ++i) {
+		struct nvm_ftl_line *victim = _gc_victim(ftl);
+
+		if (!victim)
+			break;
+
+		if (_gc_collect(ftl, victim, 0)) {
+			pthread_mutex_unlock(&gc->lock);
+			return -1;	// Propagate errno
+		}
+
+		++nreclaimed;
+	}
+
+	pthread_mutex_unlock(&gc->lock);
+
+	return nreclaimed;
+}
+
+int nvm_ftl_set_gc_policy(struct nvm_ftl *ftl, int policy)
+{
+	switch (policy) {
+	case NVM_FTL_GC_GREEDY:
+	case NVM_FTL_GC_COST_BENEFIT:
+		break;
+
+	default:
+		NVM_DEBUG("FAILED: invalid policy: %d", policy);
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&ftl->gc.lock);
+	ftl->gc.policy = policy;
+	pthread_mutex_unlock(&ftl->gc.lock);
+
+	return 0;
+}
+
+int nvm_ftl_set_gc_rate(struct nvm_ftl *ftl, uint64_t nsectrs)
+{
+	pthread_mutex_lock(&ftl->gc.lock);
+	ftl->gc.rate = nsectrs;
+	ftl->gc.tokens = 0;
+	ftl->gc.tokens_ts = 0;
+	pthread_mutex_unlock(&ftl->gc.lock);
+
+	return 0;
+}
+
+int nvm_ftl_gc_init(struct nvm_ftl *ftl)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+	const size_t nbytes = NVM_NADDR_MAX * ftl->geo->l.nbytes;
+
+	if (ftl->ws_opt > NVM_NADDR_MAX) {
+		NVM_DEBUG("FAILED: ws_opt(%u) > NVM_NADDR_MAX", ftl->ws_opt);
+		errno = EINVAL;
+		return -1;
+	}
+
+	gc->policy = NVM_FTL_GC_GREEDY;
+	gc->copy = 1;
+
+	gc->batches = calloc(2, sizeof(*gc->batches));
+	if (!gc->batches) {
+		NVM_DEBUG("FAILED: calloc(batches)");
+		errno = ENOMEM;
+		return -1;
+	}
+	for (int i = 0; i < 2; ++i) {
+		gc->batches[i].buf = nvm_buf_alloc(ftl->dev, nbytes, NULL);
+		if (!gc->batches[i].buf) {
+			NVM_DEBUG("FAILED: nvm_buf_alloc");
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	// Without async. support, relocation and reset are synchronous
+	gc->ctx = nvm_async_init(ftl->dev, 0, 0);
+	gc->erase_async = !!gc->ctx;
+
+	return 0;
+}
+
+void nvm_ftl_gc_term(struct nvm_ftl *ftl)
+{
+	struct nvm_ftl_gc *gc = &ftl->gc;
+
+	if (gc->ctx) {
+		while (gc->nerasing)
+			nvm_async_poke(ftl->dev, gc->ctx, 0);
+
+		nvm_async_term(ftl->dev, gc->ctx);
+		gc->ctx = NULL;
+	}
+
+	for (int i = 0; gc->batches && (i < 2); ++i)
+		nvm_buf_free(ftl->dev, gc->batches[i].buf);
+
+	free(gc->batches);
+	gc->batches = NULL;
+}
+
+#else
+
+int nvm_ftl_gc(struct nvm_ftl *NVM_UNUSED(ftl), uint32_t NVM_UNUSED(nlines))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int nvm_ftl_set_gc_policy(struct nvm_ftl *NVM_UNUSED(ftl),
+			  int NVM_UNUSED(policy))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int nvm_ftl_set_gc_rate(struct nvm_ftl *NVM_UNUSED(ftl),
+			uint64_t NVM_UNUSED(nsectrs))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
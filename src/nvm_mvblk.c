@@ -0,0 +1,381 @@
+/*
+ * nvm_mvblk - Virtual block striped across devices
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_vblk.h>
+#include <nvm_pool.h>
+#include <nvm_mvblk.h>
+
+static void mvblk_members_term(struct nvm_mvblk *mvblk)
+{
+	for (int i = 0; i < mvblk->nmembers; ++i) {
+		struct nvm_mvblk_member *mbr = &mvblk->members[i];
+
+		if (mbr->ctx)
+			nvm_async_term(mbr->vblk->dev, mbr->ctx);
+		free(mbr->rets);
+	}
+}
+
+struct nvm_mvblk *nvm_mvblk_alloc(struct nvm_vblk *vblks[], int nvblks)
+{
+	struct nvm_mvblk *mvblk;
+
+	if ((nvblks < 1) || (nvblks > NVM_MVBLK_NVBLKS_MAX)) {
+		NVM_DEBUG("FAILED: invalid nvblks: %d", nvblks);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	for (int i = 0; i < nvblks; ++i) {
+		struct nvm_dev *dev = vblks[i]->dev;
+
+		if (nvm_dev_get_verid(dev) != NVM_SPEC_VERID_20) {
+			NVM_DEBUG("FAILED: only supported for 2.0");
+			errno = ENOSYS;
+			return NULL;
+		}
+		if ((nvm_dev_get_ws_opt(dev) * nvm_dev_get_geo(dev)->l.nbytes !=
+		     nvm_dev_get_ws_opt(vblks[0]->dev) *
+		     nvm_dev_get_geo(vblks[0]->dev)->l.nbytes) ||
+		    (vblks[i]->nbytes != vblks[0]->nbytes)) {
+			NVM_DEBUG("FAILED: vblks differ in ws_opt or size");
+			errno = EINVAL;
+			return NULL;
+		}
+		if (vblks[i]->parity || vblks[i]->wbuf) {
+			NVM_DEBUG("FAILED: vblk has parity or a write buffer");
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	mvblk = calloc(1, sizeof(*mvblk));
+	if (!mvblk) {
+		NVM_DEBUG("FAILED: calloc mvblk");
+		errno = ENOMEM;
+		return NULL;
+	}
+	mvblk->unit_nbytes = nvm_dev_get_ws_opt(vblks[0]->dev) *
+			     nvm_dev_get_geo(vblks[0]->dev)->l.nbytes;
+
+	for (int i = 0; i < nvblks; ++i) {
+		struct nvm_mvblk_member *mbr = &mvblk->members[i];
+
+		mbr->vblk = vblks[i];
+		++mvblk->nmembers;
+
+		// Without async support, the member submits synchronously
+		mbr->ctx = nvm_async_init(mbr->vblk->dev, 0, 0);
+		if (!mbr->ctx && (errno != ENOSYS)) {
+			NVM_DEBUG("FAILED: nvm_async_init");
+			goto failed;
+		}
+
+		// Commands of a batch go to distinct chunks
+		mbr->batch = mbr->ctx ?
+			NVM_MIN(nvm_async_get_depth(mbr->ctx),
+				mbr->vblk->nblks) : 1;
+		mbr->rets = calloc(mbr->batch, sizeof(*mbr->rets));
+		if (!mbr->rets) {
+			NVM_DEBUG("FAILED: calloc rets");
+			errno = ENOMEM;
+			goto failed;
+		}
+
+		mvblk->nbytes += mbr->vblk->nbytes;
+	}
+
+	return mvblk;
+
+failed:
+	mvblk_members_term(mvblk);
+	free(mvblk);
+
+	return NULL;			// Propagate errno
+}
+
+void nvm_mvblk_free(struct nvm_mvblk *mvblk)
+{
+	if (!mvblk)
+		return;
+
+	mvblk_members_term(mvblk);
+	for (int i = 0; i < mvblk->nmembers; ++i)
+		nvm_vblk_free(mvblk->members[i].vblk);
+
+	free(mvblk);
+}
+
+static int mvblk_erase_member(void *arg, size_t item)
+{
+	struct nvm_mvblk *mvblk = arg;
+
+	return nvm_vblk_erase(mvblk->members[item].vblk) < 0 ? 1 : 0;
+}
+
+ssize_t nvm_mvblk_erase(struct nvm_mvblk *mvblk)
+{
+	ssize_t nerr;
+
+	nerr = nvm_pool_run(mvblk_erase_member, mvblk, mvblk->nmembers,
+			    NVM_MIN(mvblk->nmembers, NVM_POOL_NQUEUES_MAX),
+			    mvblk->nmembers, NVM_POOL_ORDERED);
+	if (nerr < 0)
+		return -1;		// Propagate errno
+	if (nerr) {
+		NVM_DEBUG("FAILED: nvm_vblk_erase, nerr: %zd", nerr);
+		errno = EIO;
+		return -1;
+	}
+
+	return mvblk->nbytes;
+}
+
+static void mvblk_async_callback(struct nvm_ret *ret, void *opaque)
+{
+	struct nvm_mvblk_job *job = opaque;
+
+	if (ret->status)
+		atomic_fetch_add(&job->nerr, 1);
+}
+
+/**
+ * Submit the units of the request which belong to member 'item' on the async
+ * context of the member, unit 'u' of the mvblk is unit 'u / nmembers' of
+ * member 'u % nmembers', which stripes it across its chunks as a vblk does
+ */
+static int mvblk_io_member(void *arg, size_t item)
+{
+	struct nvm_mvblk_job *job = arg;
+	struct nvm_mvblk *mvblk = job->mvblk;
+	struct nvm_mvblk_member *mbr = &mvblk->members[item];
+	struct nvm_vblk *vblk = mbr->vblk;
+
+	const size_t nmembers = mvblk->nmembers;
+	const size_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const uint16_t flags = (vblk->flags & NVM_CMD_MASK_ADDR) |
+			       (mbr->ctx ? NVM_CMD_ASYNC : NVM_CMD_SYNC);
+
+	size_t nsubmitted = 0;
+	int err = 0;
+
+	for (size_t unit = job->bgn + (item + nmembers - job->bgn % nmembers) %
+			   nmembers; unit < job->end; unit += nmembers) {
+		const size_t wunit = unit / nmembers;
+		const size_t chunk = wunit % vblk->nblks;
+		struct nvm_ret *ret = &mbr->rets[nsubmitted % mbr->batch];
+		struct nvm_addr addrs[WS_OPT];
+		char *buf = job->pad ? job->buf : job->buf +
+			    (unit - job->bgn) * mvblk->unit_nbytes;
+
+		for (size_t idx = 0; idx < WS_OPT; ++idx) {
+			addrs[idx].val = vblk->blks[chunk].val;
+			addrs[idx].l.sectr = (wunit / vblk->nblks) * WS_OPT +
+					     idx;
+		}
+
+		memset(ret, 0, sizeof(*ret));
+		ret->async.ctx = mbr->ctx;
+		ret->async.cb = mvblk_async_callback;
+		ret->async.cb_arg = job;
+
+		err = job->write ?
+			nvm_cmd_write(vblk->dev, addrs, WS_OPT, buf, NULL,
+				      flags, ret) :
+			nvm_cmd_read(vblk->dev, addrs, WS_OPT, buf, NULL,
+				     flags, ret);
+		if (err) {
+			NVM_DEBUG("FAILED: nvm_cmd_write/read, member: %zu",
+				  item);
+			break;
+		}
+
+		++nsubmitted;
+		if (!mbr->ctx)
+			continue;
+
+		if ((nsubmitted % mbr->batch) == 0) {
+			err = nvm_async_wait(vblk->dev, mbr->ctx) < 0;
+			if (err)
+				break;
+		}
+	}
+
+	if (mbr->ctx && (nvm_async_wait(vblk->dev, mbr->ctx) < 0))
+		err = 1;
+
+	return err ? 1 : 0;
+}
+
+static ssize_t mvblk_io(struct nvm_mvblk *mvblk, const void *buf, size_t count,
+			size_t offset, int write)
+{
+	struct nvm_mvblk_job job = {
+		.mvblk = mvblk,
+		.buf = (char *)buf,
+		.bgn = offset / mvblk->unit_nbytes,
+		.end = (offset + count) / mvblk->unit_nbytes,
+		.write = write,
+	};
+	ssize_t nerr;
+
+	if ((count % mvblk->unit_nbytes) || (offset % mvblk->unit_nbytes)) {
+		NVM_DEBUG("FAILED: unaligned count: %zu or offset: %zu",
+			  count, offset);
+		errno = EINVAL;
+		return -1;
+	}
+	if (offset + count > mvblk->nbytes) {
+		NVM_DEBUG("FAILED: out of bounds");
+		errno = EINVAL;
+		return -1;
+	}
+	atomic_init(&job.nerr, 0);
+
+	if (!buf) {	// Allocate and use a padding unit
+		job.buf = nvm_buf_alloc(mvblk->members[0].vblk->dev,
+					mvblk->unit_nbytes, NULL);
+		if (!job.buf) {
+			NVM_DEBUG("FAILED: nvm_buf_alloc(pad)");
+			errno = ENOMEM;
+			return -1;
+		}
+		nvm_buf_fill(job.buf, mvblk->unit_nbytes);
+		job.pad = 1;
+	}
+
+	// A queue per member, executing its share of the request
+	nerr = nvm_pool_run(mvblk_io_member, &job, mvblk->nmembers,
+			    NVM_MIN(mvblk->nmembers, NVM_POOL_NQUEUES_MAX),
+			    mvblk->nmembers, NVM_POOL_ORDERED);
+
+	if (job.pad)
+		nvm_buf_free(mvblk->members[0].vblk->dev, job.buf);
+
+	if (nerr < 0)
+		return -1;		// Propagate errno
+	if (nerr || atomic_load(&job.nerr)) {
+		NVM_DEBUG("FAILED: nerr: %zd, ncmd_err: %zu", nerr,
+			  atomic_load(&job.nerr));
+		errno = EIO;
+		return -1;
+	}
+
+	return count;
+}
+
+ssize_t nvm_mvblk_pwrite(struct nvm_mvblk *mvblk, const void *buf,
+			 size_t count, size_t offset)
+{
+	return mvblk_io(mvblk, buf, count, offset, 1);
+}
+
+ssize_t nvm_mvblk_write(struct nvm_mvblk *mvblk, const void *buf,
+			size_t count)
+{
+	ssize_t nbytes = nvm_mvblk_pwrite(mvblk, buf, count, mvblk->pos_write);
+
+	if (nbytes < 0)
+		return nbytes;		// Propagate errno
+
+	mvblk->pos_write += nbytes;
+
+	return nbytes;
+}
+
+ssize_t nvm_mvblk_pad(struct nvm_mvblk *mvblk)
+{
+	return nvm_mvblk_write(mvblk, NULL, mvblk->nbytes - mvblk->pos_write);
+}
+
+ssize_t nvm_mvblk_pread(struct nvm_mvblk *mvblk, void *buf, size_t count,
+			size_t offset)
+{
+	if (!buf) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return mvblk_io(mvblk, buf, count, offset, 0);
+}
+
+ssize_t nvm_mvblk_read(struct nvm_mvblk *mvblk, void *buf, size_t count)
+{
+	ssize_t nbytes = nvm_mvblk_pread(mvblk, buf, count, mvblk->pos_read);
+
+	if (nbytes < 0)
+		return nbytes;		// Propagate errno
+
+	mvblk->pos_read += nbytes;
+
+	return nbytes;
+}
+
+size_t nvm_mvblk_get_nbytes(struct nvm_mvblk *mvblk)
+{
+	return mvblk->nbytes;
+}
+
+int nvm_mvblk_get_nvblks(struct nvm_mvblk *mvblk)
+{
+	return mvblk->nmembers;
+}
+
+struct nvm_vblk *nvm_mvblk_get_vblk(struct nvm_mvblk *mvblk, int idx)
+{
+	if ((idx < 0) || (idx >= mvblk->nmembers)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return mvblk->members[idx].vblk;
+}
+
+void nvm_mvblk_pr(struct nvm_mvblk *mvblk)
+{
+	if (!mvblk) {
+		printf("mvblk: ~\n");
+		return;
+	}
+
+	printf("mvblk:\n");
+	printf("  nvblks: %d\n", mvblk->nmembers);
+	printf("  unit_nbytes: %zu\n", mvblk->unit_nbytes);
+	printf("  nmbytes: %zu\n", mvblk->nbytes >> 20);
+	printf("  pos_write: %zu\n", mvblk->pos_write);
+	printf("  pos_read: %zu\n", mvblk->pos_read);
+	for (int i = 0; i < mvblk->nmembers; ++i) {
+		printf("  - dev: '%s'\n",
+		       nvm_dev_get_name(mvblk->members[i].vblk->dev));
+		printf("    batch: %"PRIu32"\n", mvblk->members[i].batch);
+	}
+}
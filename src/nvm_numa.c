@@ -0,0 +1,180 @@
+/*
+ * nvm_numa - NUMA placement of buffers and threads
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_be.h>
+#include <nvm_numa.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+#define NVM_NUMA_PATH_LEN 256
+
+static int _sysfs_read(const char *path, char *buf, size_t len)
+{
+	FILE *fp;
+	size_t nread;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;		// Propagate errno
+
+	nread = fread(buf, 1, len - 1, fp);
+	fclose(fp);
+
+	buf[nread] = '\0';
+	while (nread && (buf[nread - 1] == '\n'))
+		buf[--nread] = '\0';
+
+	if (!nread) {
+		errno = ENODATA;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _sysfs_node(const char *path)
+{
+	char buf[32];
+	int node;
+
+	if (_sysfs_read(path, buf, sizeof(buf)))
+		return -1;
+
+	node = atoi(buf);	// Kernel reports -1 when unknown
+
+	return node < NVM_NUMA_NODES_MAX ? node : -1;
+}
+
+int nvm_numa_dev_node(const struct nvm_dev *dev, const char *dev_ident)
+{
+	char path[NVM_NUMA_PATH_LEN];
+	const char *traddr;
+	int node;
+
+	switch (dev->be->id) {
+	case NVM_BE_IOCTL:
+	case NVM_BE_LBD:
+		// The namespace 'device' is the controller, or the PCI device
+		snprintf(path, sizeof(path), "/sys/class/block/%s/device/numa_node",
+			 dev->name);
+		node = _sysfs_node(path);
+		if (node >= 0)
+			return node;
+
+		snprintf(path, sizeof(path),
+			 "/sys/class/block/%s/device/device/numa_node",
+			 dev->name);
+		return _sysfs_node(path);
+
+	case NVM_BE_SPDK:
+	case NVM_BE_NOCD:
+		traddr = strstr(dev_ident, "traddr:");
+		if (!traddr)
+			return -1;
+		traddr += strlen("traddr:");
+
+		snprintf(path, sizeof(path), "/sys/bus/pci/devices/%.*s/numa_node",
+			 (int)strcspn(traddr, " /"), traddr);
+		return _sysfs_node(path);
+
+	case NVM_BE_ANY:
+		break;
+	}
+
+	return -1;
+}
+
+int nvm_numa_node_cpus(int node, char *cpus, size_t len)
+{
+	char path[NVM_NUMA_PATH_LEN];
+
+	if ((node < 0) || (node >= NVM_NUMA_NODES_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+		 node);
+
+	return _sysfs_read(path, cpus, len);
+}
+
+int nvm_numa_buf_place(void *buf, size_t nbytes, int node, int hugepages)
+{
+#ifdef SYS_mbind
+	unsigned long mask[NVM_NUMA_NODES_MAX / (8 * sizeof(unsigned long))] = { 0 };
+	const long page_nbytes = sysconf(_SC_PAGESIZE);
+	const uintptr_t bgn = (uintptr_t)buf & ~(page_nbytes - 1);
+	const uintptr_t end = (uintptr_t)buf + nbytes;
+	const size_t len = ((end - bgn) + page_nbytes - 1) & ~(page_nbytes - 1);
+	const size_t bits = 8 * sizeof(unsigned long);
+
+	if (node >= NVM_NUMA_NODES_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (node >= 0) {
+		mask[node / bits] = 1UL << (node % bits);
+
+		if (syscall(SYS_mbind, bgn, len, MPOL_PREFERRED, mask,
+			    NVM_NUMA_NODES_MAX + 1, MPOL_MF_MOVE)) {
+			NVM_DEBUG("FAILED: mbind, node: %d", node);
+			return -1;	// Propagate errno
+		}
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (hugepages && madvise((void *)bgn, len, MADV_HUGEPAGE)) {
+		NVM_DEBUG("FAILED: madvise(MADV_HUGEPAGE)");
+		return -1;		// Propagate errno
+	}
+#endif
+
+	return 0;
+#else
+	NVM_DEBUG("FAILED: mbind is not supported");
+	errno = ENOSYS;
+	return -1;
+#endif
+}
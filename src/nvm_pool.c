@@ -0,0 +1,520 @@
+/*
+ * nvm_pool - Persistent worker-pool for parallel command submission
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_pool.h>
+#include <nvm_omp.h>
+#ifdef NVM_POOL_ENABLED
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#endif
+
+#ifdef NVM_POOL_ENABLED
+
+#define NVM_POOL_NTHREADS_MAX 256
+#define NVM_POOL_NJOBS_MAX 8		///< Jobs posted to the workers at once
+
+struct nvm_pool_queue {
+	_Alignas(64) atomic_size_t next;	///< Next round to run, or claim
+};
+
+struct nvm_pool_job {
+	nvm_pool_func func;
+	void *arg;
+	size_t nitems;
+	size_t nqueues;
+	int flags;
+	int nworkers;			///< Max. # of pool workers to join the job
+	int njoined;			///< # of pool workers which joined the job
+	int nactive;			///< # of pool workers still on the job
+	atomic_size_t nerr;
+	struct nvm_pool_queue *queues;
+};
+
+struct nvm_pool_worker {
+	pthread_t thread;
+	int cpu;			///< CPU the worker is pinned to, -1: none
+	int idx;			///< Index of the worker, spreads the joins
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;		///< Signalled on new job and on stop
+	pthread_cond_t done;		///< Signalled when a job loses its workers
+					///< and when a job slot is released
+	int conf;			///< Whether the configuration is set
+	int nthreads;			///< Configured # threads, 0: # CPUs
+	int cpus_conf;			///< Whether the affinity is configured
+	int ncpus;			///< # of CPUs in the affinity list
+	int cpus[NVM_POOL_NTHREADS_MAX];///< Affinity list
+	int started;
+	int stop;
+	int nworkers;
+	struct nvm_pool_worker *workers;
+	struct nvm_pool_job *jobs[NVM_POOL_NJOBS_MAX];	///< Posted jobs
+	int njobs;			///< # of posted jobs
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+static _Thread_local int in_job;	///< Whether the thread works on a job
+
+/**
+ * Parse a CPU list in the format of `taskset -c` e.g. "0-3,8,10-11"
+ */
+static int _cpulist_parse(const char *str, int cpus[], int cpus_max)
+{
+	const char *cur = str;
+	int ncpus = 0;
+
+	while (*cur) {
+		char *end;
+		long bgn, last;
+
+		bgn = strtol(cur, &end, 10);
+		if ((end == cur) || (bgn < 0)) {
+			errno = EINVAL;
+			return -1;
+		}
+		last = bgn;
+
+		if (*end == '-') {
+			cur = end + 1;
+			last = strtol(cur, &end, 10);
+			if ((end == cur) || (last < bgn)) {
+				errno = EINVAL;
+				return -1;
+			}
+		}
+
+		for (long cpu = bgn; (cpu <= last) && (ncpus < cpus_max); ++cpu)
+			cpus[ncpus++] = cpu;
+
+		if (*end == ',')
+			++end;
+		else if (*end) {
+			errno = EINVAL;
+			return -1;
+		}
+		cur = end;
+	}
+
+	return ncpus;
+}
+
+static void _job_work(struct nvm_pool_job *job, int wid)
+{
+	const size_t home = (wid * job->nqueues) / (job->nworkers + 1);
+	size_t nerr = 0;
+
+	for (size_t i = 0; i < job->nqueues; ++i) {
+		const size_t qid = (home + i) % job->nqueues;
+		struct nvm_pool_queue *queue = &job->queues[qid];
+
+		if (job->flags & NVM_POOL_ORDERED) {
+			if (atomic_fetch_add(&queue->next, 1))
+				continue;	// Claimed by another thread
+
+			for (size_t item = qid; item < job->nitems;
+			     item += job->nqueues) {
+				if (job->func(job->arg, item))
+					++nerr;
+			}
+			continue;
+		}
+
+		for (;;) {
+			const size_t rnd = atomic_fetch_add(&queue->next, 1);
+			const size_t item = qid + rnd * job->nqueues;
+
+			if (item >= job->nitems)
+				break;
+
+			if (job->func(job->arg, item))
+				++nerr;
+		}
+	}
+
+	if (nerr)
+		atomic_fetch_add(&job->nerr, nerr);
+}
+
+/**
+ * A posted job with room for another worker, scanning from slot 'bgn', must be
+ * called with 'pool.lock' held
+ */
+static struct nvm_pool_job *_job_joinable(int bgn)
+{
+	for (int i = 0; i < NVM_POOL_NJOBS_MAX; ++i) {
+		struct nvm_pool_job *job = pool.jobs[(bgn + i) %
+						     NVM_POOL_NJOBS_MAX];
+
+		if (job && (job->njoined < job->nworkers))
+			return job;
+	}
+
+	return NULL;
+}
+
+static void *_worker(void *arg)
+{
+	struct nvm_pool_worker *worker = arg;
+
+	in_job = 1;
+
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		struct nvm_pool_job *job;
+		int wid;
+
+		while (!pool.stop && !(job = _job_joinable(worker->idx)))
+			pthread_cond_wait(&pool.work, &pool.lock);
+
+		if (pool.stop)
+			break;
+
+		wid = ++job->njoined;
+		++job->nactive;
+		pthread_mutex_unlock(&pool.lock);
+
+		_job_work(job, wid);
+
+		pthread_mutex_lock(&pool.lock);
+		if (!--job->nactive)
+			pthread_cond_broadcast(&pool.done);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return NULL;
+}
+
+static void _conf_env(void)
+{
+	const char *nthreads = getenv("NVM_POOL_NTHREADS");
+	const char *cpus = getenv("NVM_POOL_CPUS");
+
+	if (nthreads)
+		pool.nthreads = NVM_MAX(0, atoi(nthreads));
+
+	if (cpus) {
+		pool.ncpus = _cpulist_parse(cpus, pool.cpus,
+					    NVM_POOL_NTHREADS_MAX);
+		if (pool.ncpus < 0) {
+			NVM_DEBUG("FAILED: invalid NVM_POOL_CPUS: %s", cpus);
+			pool.ncpus = 0;
+		}
+		pool.cpus_conf = 1;
+	}
+
+	pool.conf = 1;
+}
+
+/**
+ * Start the pool workers, must be called with 'pool.lock' held
+ */
+static int _pool_start(void)
+{
+	int nthreads;
+
+	if (!pool.conf)
+		_conf_env();
+
+	if (pool.nthreads)
+		nthreads = pool.nthreads;
+	else if (pool.ncpus)
+		nthreads = pool.ncpus;
+	else
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = NVM_MAX(1, NVM_MIN(nthreads, NVM_POOL_NTHREADS_MAX));
+
+	pool.nworkers = 0;
+	pool.started = 1;
+
+	if (nthreads == 1)
+		return 0;
+
+	pool.workers = calloc(nthreads - 1, sizeof(*pool.workers));
+	if (!pool.workers) {
+		NVM_DEBUG("FAILED: calloc pool.workers");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	// The calling thread is thread 0, the workers are 1 .. nthreads-1
+	for (int i = 0; i < nthreads - 1; ++i) {
+		struct nvm_pool_worker *worker = &pool.workers[i];
+
+		worker->cpu = pool.ncpus ? pool.cpus[(i + 1) % pool.ncpus] : -1;
+		worker->idx = i;
+
+		if (pthread_create(&worker->thread, NULL, _worker, worker)) {
+			NVM_DEBUG("FAILED: pthread_create, nworkers: %d", i);
+			break;
+		}
+
+		if (worker->cpu >= 0) {
+			cpu_set_t cpuset;
+
+			CPU_ZERO(&cpuset);
+			CPU_SET(worker->cpu, &cpuset);
+			if (pthread_setaffinity_np(worker->thread,
+						   sizeof(cpuset), &cpuset)) {
+				NVM_DEBUG("FAILED: pin to cpu: %d", worker->cpu);
+			}
+		}
+
+		++pool.nworkers;
+	}
+
+	return 0;
+}
+
+/**
+ * Stop and join the pool workers, must be called with 'pool.lock' held
+ */
+static void _pool_stop(void)
+{
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < pool.nworkers; ++i)
+		pthread_join(pool.workers[i].thread, NULL);
+
+	pthread_mutex_lock(&pool.lock);
+	free(pool.workers);
+	pool.workers = NULL;
+	pool.nworkers = 0;
+	pool.started = 0;
+	pool.stop = 0;
+}
+
+int nvm_pool_conf(int nthreads, const char *cpus)
+{
+	int cpus_list[NVM_POOL_NTHREADS_MAX];
+	int ncpus = 0;
+
+	if ((nthreads < 0) || (nthreads > NVM_POOL_NTHREADS_MAX)) {
+		NVM_DEBUG("FAILED: invalid nthreads: %d", nthreads);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (cpus) {
+		ncpus = _cpulist_parse(cpus, cpus_list, NVM_POOL_NTHREADS_MAX);
+		if (ncpus < 0) {
+			NVM_DEBUG("FAILED: invalid cpus: %s", cpus);
+			return -1;
+		}
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	if (pool.njobs) {
+		pthread_mutex_unlock(&pool.lock);
+		NVM_DEBUG("FAILED: pool is busy");
+		errno = EBUSY;
+		return -1;
+	}
+
+	if (pool.started)
+		_pool_stop();
+
+	pool.nthreads = nthreads;
+	pool.ncpus = ncpus;
+	memcpy(pool.cpus, cpus_list, ncpus * sizeof(*cpus_list));
+	pool.cpus_conf = 1;
+	pool.conf = 1;
+	pthread_mutex_unlock(&pool.lock);
+
+	return 0;
+}
+
+void nvm_pool_hint_cpus(const char *cpus)
+{
+	int ncpus;
+
+	pthread_mutex_lock(&pool.lock);
+	if (!pool.conf)
+		_conf_env();
+
+	if (pool.started || pool.cpus_conf || pool.ncpus) {
+		pthread_mutex_unlock(&pool.lock);
+		return;
+	}
+
+	ncpus = _cpulist_parse(cpus, pool.cpus, NVM_POOL_NTHREADS_MAX);
+	pool.ncpus = ncpus < 0 ? 0 : ncpus;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static inline size_t _run_inline(nvm_pool_func func, void *arg,
+				 size_t nitems)
+{
+	size_t nerr = 0;
+
+	for (size_t item = 0; item < nitems; ++item) {
+		if (func(arg, item))
+			++nerr;
+	}
+
+	return nerr;
+}
+
+ssize_t nvm_pool_run(nvm_pool_func func, void *arg, size_t nitems,
+		     size_t nqueues, int nthreads, int flags)
+{
+	struct nvm_pool_job job = { 0 };
+	int slot, nested;
+
+	if ((!func) || (!nqueues) || (nqueues > NVM_POOL_NQUEUES_MAX)) {
+		NVM_DEBUG("FAILED: invalid args, nqueues: %zu", nqueues);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!nitems)
+		return 0;
+
+	if (nqueues > nitems)
+		nqueues = nitems;
+	if ((flags & NVM_POOL_ORDERED) && ((size_t)nthreads > nqueues))
+		nthreads = nqueues;
+	if ((size_t)nthreads > nitems)
+		nthreads = nitems;
+	if (nthreads <= 1)
+		return _run_inline(func, arg, nitems);
+
+	pthread_mutex_lock(&pool.lock);
+	if ((!pool.started) && _pool_start()) {
+		pthread_mutex_unlock(&pool.lock);
+		return _run_inline(func, arg, nitems);
+	}
+	if (!pool.nworkers) {			// Single-threaded
+		pthread_mutex_unlock(&pool.lock);
+		return _run_inline(func, arg, nitems);
+	}
+
+	// Wait for a job slot, unless called from a job, which then may wait
+	// on the very jobs holding the slots
+	while (pool.njobs == NVM_POOL_NJOBS_MAX) {
+		if (in_job) {
+			pthread_mutex_unlock(&pool.lock);
+			return _run_inline(func, arg, nitems);
+		}
+		pthread_cond_wait(&pool.done, &pool.lock);
+	}
+
+	struct nvm_pool_queue queues[nqueues];
+
+	for (size_t qid = 0; qid < nqueues; ++qid)
+		atomic_init(&queues[qid].next, 0);
+
+	job.func = func;
+	job.arg = arg;
+	job.nitems = nitems;
+	job.nqueues = nqueues;
+	job.flags = flags;
+	job.nworkers = NVM_MIN(nthreads - 1, pool.nworkers);
+	job.queues = queues;
+	atomic_init(&job.nerr, 0);
+
+	for (slot = 0; pool.jobs[slot]; ++slot)
+		;
+	pool.jobs[slot] = &job;
+	++pool.njobs;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	nested = in_job;
+	in_job = 1;
+	_job_work(&job, 0);
+	in_job = nested;
+
+	pthread_mutex_lock(&pool.lock);
+	pool.jobs[slot] = NULL;
+	--pool.njobs;
+	pthread_cond_broadcast(&pool.done);
+	while (job.nactive)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+
+	return atomic_load(&job.nerr);
+}
+
+#else
+
+#ifdef _OPENMP
+#define NVM_POOL_OMP_ARG(x) x
+#else
+#define NVM_POOL_OMP_ARG(x) NVM_UNUSED(x)
+#endif
+
+int nvm_pool_conf(int NVM_UNUSED(nthreads), const char *NVM_UNUSED(cpus))
+{
+	NVM_DEBUG("FAILED: built without NVM_POOL_ENABLED");
+	errno = ENOSYS;
+	return -1;
+}
+
+void nvm_pool_hint_cpus(const char *NVM_UNUSED(cpus))
+{
+	return;
+}
+
+ssize_t nvm_pool_run(nvm_pool_func func, void *arg, size_t nitems,
+		     size_t nqueues, int NVM_POOL_OMP_ARG(nthreads), int flags)
+{
+	size_t nerr = 0;
+
+	if ((!func) || (!nqueues) || (nqueues > NVM_POOL_NQUEUES_MAX)) {
+		NVM_DEBUG("FAILED: invalid args, nqueues: %zu", nqueues);
+		errno = EINVAL;
+		return -1;
+	}
+
+	#pragma omp parallel for num_threads(nthreads) schedule(static,1) reduction(+:nerr) ordered if(nthreads>1)
+	for (size_t item = 0; item < nitems; ++item) {
+		if (func(arg, item))
+			++nerr;
+
+		if (flags & NVM_POOL_ORDERED) {
+			#pragma omp ordered
+			{}
+		}
+	}
+
+	return nerr;
+}
+
+#endif
@@ -0,0 +1,452 @@
+/*
+ * nvm_rcache - Read cache of recently written sectors
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_rcache.h>
+
+static inline void _pu_lock(struct nvm_rcache_pu *pu)
+{
+	while (atomic_flag_test_and_set_explicit(&pu->lock,
+						 memory_order_acquire))
+		;
+}
+
+static inline void _pu_unlock(struct nvm_rcache_pu *pu)
+{
+	atomic_flag_clear_explicit(&pu->lock, memory_order_release);
+}
+
+/**
+ * Address of the i'th sector of a command, a scalar command addresses
+ * consecutive sectors from its first address
+ */
+static inline struct nvm_addr _sectr_addr(struct nvm_addr addrs[], int scalar,
+					  int i)
+{
+	struct nvm_addr addr = scalar ? addrs[0] : addrs[i];
+
+	if (scalar)
+		addr.l.sectr += i;
+
+	return addr;
+}
+
+static inline struct nvm_rcache_pu *_pu(struct nvm_rcache *rcache,
+					struct nvm_addr addr)
+{
+	return &rcache->pus[addr.l.pugrp * rcache->npunit + addr.l.punit];
+}
+
+static inline struct nvm_addr _cnk_key(struct nvm_addr addr)
+{
+	addr.l.sectr = 0;
+
+	return addr;
+}
+
+/**
+ * Find the entry of the chunk 'key' in 'pu', caller holds the lock
+ */
+static inline struct nvm_rcache_cnk *_cnk_find(struct nvm_rcache *rcache,
+					       struct nvm_rcache_pu *pu,
+					       struct nvm_addr key)
+{
+	for (uint32_t i = 0; i < rcache->nslots; ++i) {
+		if (pu->cnks[i].used && pu->cnks[i].addr.val == key.val)
+			return &pu->cnks[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Find or claim the entry of the chunk 'key' in 'pu', claiming an unused
+ * entry, else that of a fully written chunk, else the least recently written,
+ * caller holds the lock
+ *
+ * An entry claimed for the first time takes its memory from 'spare', when
+ * 'spare' is NULL, NULL is returned for the caller to allocate it unlocked
+ */
+static struct nvm_rcache_cnk *_cnk_claim(struct nvm_rcache *rcache,
+					 struct nvm_rcache_pu *pu,
+					 struct nvm_addr key, char **spare)
+{
+	struct nvm_rcache_cnk *cnk = _cnk_find(rcache, pu, key);
+
+	if (cnk)
+		return cnk;
+
+	for (uint32_t i = 0; i < rcache->nslots; ++i) {
+		struct nvm_rcache_cnk *cand = &pu->cnks[i];
+
+		if (!cand->used) {
+			cnk = cand;
+			break;
+		}
+		if (cand->wp == rcache->nsectr) {
+			cnk = cand;
+			continue;
+		}
+		if ((!cnk) || ((cnk->wp != rcache->nsectr) &&
+			       (cand->stamp < cnk->stamp)))
+			cnk = cand;
+	}
+
+	if (!cnk->data) {
+		if (!*spare)
+			return NULL;
+
+		cnk->data = *spare;
+		*spare = NULL;
+	}
+
+	cnk->used = 1;
+	cnk->addr = key;
+	cnk->bgn = 0;
+	cnk->wp = 0;
+
+	return cnk;
+}
+
+struct nvm_rcache *nvm_rcache_alloc(const struct nvm_dev *dev)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const uint32_t maxocpu = dev->idfy.s20.wrt.maxocpu;
+	struct nvm_rcache *rcache;
+
+	if (dev->verid != NVM_SPEC_VERID_20) {
+		NVM_DEBUG("FAILED: only supported for 2.0");
+		errno = ENOSYS;
+		return NULL;
+	}
+	if (!nvm_dev_get_mw_cunits(dev)) {
+		NVM_DEBUG("FAILED: device has no mw_cunits");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	rcache = calloc(1, sizeof(*rcache));
+	if (!rcache) {
+		NVM_DEBUG("FAILED: calloc rcache");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	rcache->npus = geo->l.npugrp * geo->l.npunit;
+	rcache->npunit = geo->l.npunit;
+	rcache->nsectr = geo->l.nsectr;
+	rcache->mw_cunits = nvm_dev_get_mw_cunits(dev);
+	rcache->nslots = maxocpu ? NVM_MIN(maxocpu, NVM_RCACHE_NSLOTS_MAX) :
+				   NVM_RCACHE_NSLOTS_DEF;
+	rcache->sectr_nbytes = geo->l.nbytes;
+
+	rcache->pus = calloc(rcache->npus, sizeof(*rcache->pus));
+	if (!rcache->pus) {
+		NVM_DEBUG("FAILED: calloc rcache->pus");
+		free(rcache);
+		errno = ENOMEM;
+		return NULL;
+	}
+	for (uint32_t i = 0; i < rcache->npus; ++i)
+		atomic_flag_clear(&rcache->pus[i].lock);
+
+	return rcache;
+}
+
+void nvm_rcache_free(struct nvm_rcache *rcache)
+{
+	if (!rcache)
+		return;
+
+	for (uint32_t i = 0; i < rcache->npus; ++i) {
+		for (uint32_t j = 0; j < rcache->nslots; ++j)
+			free(rcache->pus[i].cnks[j].data);
+	}
+
+	free(rcache->pus);
+	free(rcache);
+}
+
+/**
+ * Record the 'nsectrs' sectors of chunk 'key' of a write command, only the
+ * last 'mw_cunits' can be served, the device reads those before them
+ */
+static void _cnk_write(struct nvm_rcache *rcache, struct nvm_addr addrs[],
+		       int naddrs, int scalar, const char *data,
+		       struct nvm_addr key, int nsectrs)
+{
+	struct nvm_rcache_pu *pu = _pu(rcache, key);
+	const int nskip = nsectrs > (int)rcache->mw_cunits ?
+			  nsectrs - (int)rcache->mw_cunits : 0;
+	struct nvm_rcache_cnk *cnk;
+	char *spare = NULL;
+
+	_pu_lock(pu);
+
+	cnk = data ? _cnk_claim(rcache, pu, key, &spare) :
+		     _cnk_find(rcache, pu, key);
+	if (!data) {
+		if (cnk)
+			cnk->used = 0;
+
+		_pu_unlock(pu);
+		return;
+	}
+	if (!cnk) {		// Entry without memory, allocate it unlocked
+		_pu_unlock(pu);
+
+		spare = malloc(rcache->mw_cunits * rcache->sectr_nbytes);
+		if (!spare)	// No memory, the device serves the chunk
+			return;
+
+		_pu_lock(pu);
+		cnk = _cnk_claim(rcache, pu, key, &spare);
+	}
+
+	for (int i = 0, j = 0; (i < naddrs) && (j < nsectrs); ++i) {
+		const struct nvm_addr addr = _sectr_addr(addrs, scalar, i);
+
+		if (_cnk_key(addr).val != key.val)
+			continue;
+
+		if ((!j) && (addr.l.sectr != cnk->wp))	// Chunk reset, or a gap
+			cnk->bgn = addr.l.sectr;
+
+		if (j++ >= nskip) {
+			memcpy(cnk->data + (addr.l.sectr % rcache->mw_cunits) *
+			       rcache->sectr_nbytes,
+			       data + i * rcache->sectr_nbytes,
+			       rcache->sectr_nbytes);
+		}
+		cnk->wp = addr.l.sectr + 1;
+	}
+	cnk->stamp = ++pu->stamp;
+
+	_pu_unlock(pu);
+
+	free(spare);		// Another writer provided the memory meanwhile
+}
+
+void nvm_rcache_write(struct nvm_rcache *rcache, struct nvm_addr addrs[],
+		      int naddrs, int scalar, const void *data)
+{
+	struct nvm_addr keys[NVM_NADDR_MAX];
+	int nsectrs[NVM_NADDR_MAX];
+	int nkeys = 0;
+
+	// Group the sectors by chunk, the sectors of a chunk are consecutive
+	// and in order, as chunks are written sequentially
+	for (int i = 0; i < naddrs; ++i) {
+		const struct nvm_addr addr = _sectr_addr(addrs, scalar, i);
+		const struct nvm_addr key = _cnk_key(addr);
+		int k;
+
+		for (k = 0; (k < nkeys) && (keys[k].val != key.val); ++k)
+			;
+
+		if (k == nkeys) {
+			if (nkeys == NVM_NADDR_MAX) {	// Out of keys, drop
+				_cnk_write(rcache, addrs, 0, scalar, NULL, key,
+					   0);
+				continue;
+			}
+			keys[nkeys] = key;
+			nsectrs[nkeys++] = 0;
+		}
+
+		// Out of bounds, the chunk is dropped
+		nsectrs[k] = ((nsectrs[k] < 0) ||
+			      (addr.l.sectr >= rcache->nsectr)) ? -1 :
+			     nsectrs[k] + 1;
+	}
+
+	for (int k = 0; k < nkeys; ++k)
+		_cnk_write(rcache, addrs, naddrs, scalar,
+			   nsectrs[k] < 0 ? NULL : data, keys[k], nsectrs[k]);
+}
+
+void nvm_rcache_erase(struct nvm_rcache *rcache, struct nvm_addr addrs[],
+		      int naddrs, int scalar)
+{
+	for (int i = 0; i < naddrs; ++i) {
+		const struct nvm_addr addr = scalar ? addrs[0] : addrs[i];
+		struct nvm_rcache_pu *pu = _pu(rcache, addr);
+		struct nvm_rcache_cnk *cnk;
+
+		_pu_lock(pu);
+		cnk = _cnk_find(rcache, pu, _cnk_key(addr));
+		if (cnk)
+			cnk->used = 0;
+		_pu_unlock(pu);
+	}
+}
+
+/**
+ * Copy sector 'addr' to 'buf' when held by the cache
+ *
+ * @return 1 when the sector was copied, 0 otherwise
+ */
+static int _sectr_get(struct nvm_rcache *rcache, struct nvm_addr addr,
+		      char *buf)
+{
+	struct nvm_rcache_pu *pu = _pu(rcache, addr);
+	struct nvm_rcache_cnk *cnk;
+	int hit = 0;
+
+	_pu_lock(pu);
+
+	cnk = _cnk_find(rcache, pu, _cnk_key(addr));
+	if (cnk) {
+		uint32_t lo = cnk->wp > rcache->mw_cunits ?
+			      cnk->wp - rcache->mw_cunits : 0;
+
+		lo = lo > cnk->bgn ? lo : cnk->bgn;
+		hit = (addr.l.sectr >= lo) &&
+		      (addr.l.sectr < cnk->wp);
+	}
+	if (hit) {
+		memcpy(buf, cnk->data + (addr.l.sectr % rcache->mw_cunits) *
+		       rcache->sectr_nbytes, rcache->sectr_nbytes);
+	}
+
+	_pu_unlock(pu);
+
+	return hit;
+}
+
+int nvm_rcache_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		    int scalar, void *data, uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_rcache *rcache = dev->rcache;
+	const size_t sectr_nbytes = rcache->sectr_nbytes;
+	const uint16_t vflags = (flags & ~NVM_CMD_MASK_ADDR) | NVM_CMD_VECTOR;
+	struct nvm_addr *miss = NULL;
+	int *miss_idx = NULL;
+	char *miss_buf = NULL;
+	int nmiss = 0;
+	int err = 0;
+
+	for (int i = 0; i < naddrs; ++i) {
+		const struct nvm_addr addr = _sectr_addr(addrs, scalar, i);
+
+		if (!_sectr_get(rcache, addr, (char *)data + i * sectr_nbytes)) {
+			if (miss) {
+				miss[nmiss] = addr;
+				miss_idx[nmiss] = i;
+			}
+			++nmiss;
+			continue;
+		}
+
+		if (miss)
+			continue;
+
+		// First sector held, track the missing sectors from here on
+		miss = malloc(naddrs * sizeof(*miss));
+		miss_idx = malloc(naddrs * sizeof(*miss_idx));
+		if (!miss || !miss_idx) {
+			NVM_DEBUG("FAILED: malloc miss");
+			errno = ENOMEM;
+			err = -1;
+			goto out;
+		}
+		for (int j = 0; j < i; ++j) {
+			miss[j] = _sectr_addr(addrs, scalar, j);
+			miss_idx[j] = j;
+		}
+	}
+
+	if (nmiss == naddrs) {		// Nothing held, read as given
+		err = scalar ?
+			dev->be->scalar_read(dev, *addrs, naddrs, data, NULL,
+					     flags, ret) :
+			dev->be->vector_read(dev, addrs, naddrs, data, NULL,
+					     flags, ret);
+		goto out;
+	}
+
+	if (!nmiss) {			// All held, complete without the device
+		if (ret) {
+			ret->result.cdw0 = 0;
+			ret->status = 0;
+		}
+		goto out;
+	}
+
+	if (scalar) {			// Read the runs of missing sectors
+		for (int bgn = 0, end; bgn < nmiss; bgn = end) {
+			for (end = bgn + 1; (end < nmiss) &&
+			     (miss_idx[end] == miss_idx[end - 1] + 1); ++end)
+				;
+
+			err = dev->be->scalar_read(dev, miss[bgn], end - bgn,
+						   (char *)data + miss_idx[bgn] *
+						   sectr_nbytes, NULL, flags,
+						   ret);
+			if (err)
+				goto out;
+		}
+		goto out;
+	}
+
+	// Read the missing sectors to a bounce buffer and scatter them
+	miss_buf = nvm_buf_alloc(dev, nmiss * sectr_nbytes, NULL);
+	if (!miss_buf) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		err = -1;
+		goto out;
+	}
+	for (int bgn = 0; bgn < nmiss; bgn += NVM_NADDR_MAX) {
+		const int cmd_naddrs = NVM_MIN(NVM_NADDR_MAX, nmiss - bgn);
+
+		err = dev->be->vector_read(dev, miss + bgn, cmd_naddrs,
+					   miss_buf + bgn * sectr_nbytes, NULL,
+					   vflags, ret);
+		if (err)
+			goto out;
+	}
+	for (int i = 0; i < nmiss; ++i) {
+		memcpy((char *)data + miss_idx[i] * sectr_nbytes,
+		       miss_buf + i * sectr_nbytes, sectr_nbytes);
+	}
+
+out:
+	if ((!err) && (nmiss < naddrs))
+		atomic_fetch_add(&rcache->nhits, naddrs - nmiss);
+
+	nvm_buf_free(dev, miss_buf);
+	free(miss);
+	free(miss_idx);
+
+	return err;
+}
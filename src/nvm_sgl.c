@@ -27,9 +27,12 @@
  */
 
 #include <stdlib.h>
-#include <bsd/sys/queue.h>
+#include <string.h>
+#include <errno.h>
 
+#include <liblightnvm.h>
 #include <liblightnvm_spec.h>
+#include <nvm_be.h>
 #include <nvm_dev.h>
 #include <nvm_sgl.h>
 #include <nvm_cmd.h>
@@ -49,16 +52,57 @@ struct nvm_sgl_pool *nvm_sgl_pool_create(struct nvm_dev *dev)
 void nvm_sgl_pool_destroy(struct nvm_sgl_pool *pool)
 {
 	struct nvm_dev *dev = pool->dev;
-	struct nvm_sgl *sgl;
+	const uint32_t nslots = NVM_MIN(atomic_load(&pool->nslots),
+					NVM_SGL_POOL_NSLOTS);
+
+	// Every SGL is detached, those handed out remain with the caller
+	for (uint32_t i = 0; i < nslots; ++i) {
+		struct nvm_sgl *sgl = atomic_load(&pool->slots[i]);
+
+		if (sgl)
+			sgl->pool = NULL;
+	}
 
-	while (!SLIST_EMPTY(&pool->free_list)) {
-		sgl = SLIST_FIRST(&pool->free_list);
-		SLIST_REMOVE_HEAD(&pool->free_list, free_list);
+	// The SGLs on the free-list are destroyed
+	for (uint32_t slot = atomic_load(&pool->head) & 0xFFFFFFFF; slot;) {
+		struct nvm_sgl *sgl = atomic_load(&pool->slots[slot - 1]);
+
+		slot = atomic_load(&sgl->pool_next);
 		nvm_sgl_destroy(dev, sgl);
 	}
 
 	free(pool);
+}
+
+/**
+ * Make room for data descriptor 'ndescr' of the SGL
+ */
+static int sgl_seg_reserve(struct nvm_dev *dev, struct nvm_sgl *sgl,
+			   int ndescr)
+{
+	struct nvm_sgl_seg *segs;
+	struct nvm_sgl_seg seg = { 0 };
+
+	if (ndescr / (int)NVM_SGL_SEG_NDATA < sgl->nsegs)
+		return 0;
+
+	seg.descr = nvm_buf_alloc(dev, NVM_SGL_SEG_NBYTES, &seg.phys);
+	if (!seg.descr) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		return -1;
+	}
+
+	segs = realloc(sgl->segs, (sgl->nsegs + 1) * sizeof(*segs));
+	if (!segs) {
+		nvm_buf_free(dev, seg.descr);
+		errno = ENOMEM;
+		return -1;
+	}
 
+	segs[sgl->nsegs++] = seg;
+	sgl->segs = segs;
+
+	return 0;
 }
 
 struct nvm_sgl *nvm_sgl_create(struct nvm_dev *dev, int hint)
@@ -70,35 +114,100 @@ struct nvm_sgl *nvm_sgl_create(struct nvm_dev *dev, int hint)
 		return NULL;
 	}
 
-	if (hint) {
-		sgl->descriptors = nvm_buf_alloc(dev, hint * dsize, NULL);
-		if (!sgl->descriptors) {
-			free(sgl);
+	sgl->indirect = nvm_buf_alloc(dev, dsize, &sgl->indirect_phys);
+	if (!sgl->indirect) {
+		free(sgl);
+		return NULL;
+	}
+
+	for (int i = 0; i < hint; i += NVM_SGL_SEG_NDATA) {
+		if (sgl_seg_reserve(dev, sgl, i)) {
+			nvm_sgl_destroy(dev, sgl);
 			return NULL;
 		}
 	}
 
-	sgl->nalloc = hint;
-	sgl->indirect = nvm_buf_alloc(dev, dsize, NULL);
+	return sgl;
+}
+
+/**
+ * Pop a free SGL of the pool, NULL when there is none
+ */
+static struct nvm_sgl *sgl_pool_pop(struct nvm_sgl_pool *pool)
+{
+	uint64_t head = atomic_load(&pool->head);
+	uint64_t next;
+	struct nvm_sgl *sgl;
+
+	do {
+		const uint32_t slot = head & 0xFFFFFFFF;
+
+		if (!slot)
+			return NULL;
+
+		// SGLs of the pool are only freed with it, also when destroyed,
+		// a stale read of 'pool_next' is caught by the tag
+		sgl = atomic_load(&pool->slots[slot - 1]);
+		next = (((head >> 32) + 1) << 32) | atomic_load(&sgl->pool_next);
+	} while (!atomic_compare_exchange_weak(&pool->head, &head, next));
 
 	return sgl;
 }
 
+static void sgl_pool_push(struct nvm_sgl_pool *pool, struct nvm_sgl *sgl)
+{
+	uint64_t head = atomic_load(&pool->head);
+	uint64_t next;
+
+	do {
+		atomic_store(&sgl->pool_next, head & 0xFFFFFFFF);
+		next = (((head >> 32) + 1) << 32) | (sgl->pool_idx + 1);
+	} while (!atomic_compare_exchange_weak(&pool->head, &head, next));
+}
+
+/**
+ * Give the SGL a slot in the pool, returns -1 when the pool is full
+ */
+static int sgl_pool_adopt(struct nvm_sgl_pool *pool, struct nvm_sgl *sgl)
+{
+	const uint32_t slot = atomic_fetch_add(&pool->nslots, 1);
+
+	if (slot >= NVM_SGL_POOL_NSLOTS)
+		return -1;
+
+	sgl->pool = pool;
+	sgl->pool_idx = slot;
+	atomic_store(&pool->slots[slot], sgl);
+
+	return 0;
+}
+
 struct nvm_sgl *nvm_sgl_alloc(struct nvm_sgl_pool *pool)
 {
 	struct nvm_sgl *sgl;
 
-	if (NULL != (sgl = SLIST_FIRST(&pool->free_list))) {
-		SLIST_REMOVE_HEAD(&pool->free_list, free_list);
+	if (NULL != (sgl = sgl_pool_pop(pool))) {
 		return sgl;
 	}
 
-	return nvm_sgl_create(pool->dev, 1);
+	sgl = nvm_sgl_create(pool->dev, 1);
+	if (sgl)
+		sgl_pool_adopt(pool, sgl);	// Not pooled when full
+
+	return sgl;
 }
 
 void nvm_sgl_destroy(struct nvm_dev *dev, struct nvm_sgl *sgl)
 {
-	nvm_buf_free(dev, sgl->descriptors);
+	if (sgl->pool) {	// Freed with the pool, poppers may still read it
+		nvm_sgl_reset(sgl);
+		sgl_pool_push(sgl->pool, sgl);
+		return;
+	}
+
+	for (int i = 0; i < sgl->nsegs; ++i)
+		nvm_buf_free(dev, sgl->segs[i].descr);
+	free(sgl->segs);
 	nvm_buf_free(dev, sgl->indirect);
 	free(sgl);
 }
@@ -107,55 +216,182 @@ void nvm_sgl_reset(struct nvm_sgl *sgl)
 {
 	sgl->ndescr = 0;
 	sgl->len = 0;
+	memset(sgl->vtop, 0, sizeof(sgl->vtop));
 }
 
 void nvm_sgl_free(struct nvm_sgl_pool *pool, struct nvm_sgl *sgl)
 {
-	sgl->ndescr = 0;
-	sgl->len = 0;
-	SLIST_INSERT_HEAD(&pool->free_list, sgl, free_list);
-}
+	nvm_sgl_reset(sgl);
 
+	if (!sgl->pool && sgl_pool_adopt(pool, sgl)) {
+		nvm_sgl_destroy(pool->dev, sgl);	// Pool is full
+		return;
+	}
 
-int nvm_sgl_add(struct nvm_dev *dev, struct nvm_sgl *sgl, void *addr,
-	size_t len)
+	sgl_pool_push(sgl->pool, sgl);
+}
+
+/**
+ * Bytes covered by a translation, DMA memory of the SPDK backend is backed by
+ * hugepages, other memory is translated per page
+ */
+static inline size_t sgl_vtop_nbytes(const struct nvm_dev *dev)
 {
-	struct nvm_nvme_sgl_descriptor *d;
+	if (dev->be->vtophys)
+		return NVM_SGL_PAGE_NBYTES;
 
-	/**
-	 * FIXME(klaus.jensen): currently we only support one Last Segment
-	 *  descriptor (one 4K page).
-	 */
-	if (sgl->ndescr == 256) {
-		NVM_DEBUG("max 256 SGL descriptors supported");
-		errno = EINVAL;
-		return -1;
+	switch (dev->be->id) {
+	case NVM_BE_SPDK:
+	case NVM_BE_NOCD:
+		return NVM_SGL_VTOP_NBYTES;
+
+	default:
+		break;
 	}
 
-	if (sgl->ndescr == sgl->nalloc) {
-		size_t nbytes;
-		sgl->nalloc = sgl->nalloc ? 2 * sgl->nalloc : 1;
-		nbytes = sgl->nalloc * sizeof(struct nvm_nvme_sgl_descriptor);
-		sgl->descriptors = nvm_buf_realloc(dev, sgl->descriptors, nbytes, NULL);
-		if (!sgl->descriptors) {
+	return NVM_SGL_PAGE_NBYTES;
+}
+
+/**
+ * Translate 'addr', a translation holds for the 'vtop_nbytes' page
+ * containing 'addr'
+ */
+static int sgl_vtophys(struct nvm_dev *dev, struct nvm_sgl *sgl, void *addr,
+		       size_t vtop_nbytes, uint64_t *phys)
+{
+	const uintptr_t va = (uintptr_t)addr;
+	const uintptr_t page = va & ~((uintptr_t)vtop_nbytes - 1);
+	struct nvm_sgl_vtop *vtop;
+
+	vtop = &sgl->vtop[(page / vtop_nbytes) % NVM_SGL_VTOP_NENTRIES];
+	if (vtop->page != page || !page) {
+		if (nvm_buf_vtophys(dev, addr, phys))
 			return -1;
+
+		vtop->page = page;
+		vtop->phys = *phys - (va - page);
+		return 0;
+	}
+
+	*phys = vtop->phys + (va - page);
+
+	return 0;
+}
+
+/**
+ * Append a data descriptor of 'len' bytes at 'phys', merging it with the
+ * descriptor before it when they are physically contiguous
+ */
+static int sgl_push(struct nvm_dev *dev, struct nvm_sgl *sgl, uint64_t phys,
+		    size_t len)
+{
+	struct nvm_nvme_sgl_descriptor *d;
+
+	if (sgl->ndescr) {
+		const int i = sgl->ndescr - 1;
+
+		d = &sgl->segs[i / NVM_SGL_SEG_NDATA].descr[i % NVM_SGL_SEG_NDATA];
+		if ((d->addr + d->unkeyed.len == phys) &&
+		    (d->unkeyed.len + len <= UINT32_MAX)) {
+			d->unkeyed.len += len;
+			return 0;
 		}
 	}
 
-	d = &sgl->descriptors[sgl->ndescr];
+	if (sgl_seg_reserve(dev, sgl, sgl->ndescr))
+		return -1;
+
+	d = &sgl->segs[sgl->ndescr / NVM_SGL_SEG_NDATA]
+		.descr[sgl->ndescr % NVM_SGL_SEG_NDATA];
+	memset(d, 0, sizeof(*d));
 	d->unkeyed.type = NVM_NVME_SGL_DESCR_TYPE_DATA_BLOCK;
 	d->unkeyed.len = len;
+	d->addr = phys;
 
-	uint64_t phys;
+	++sgl->ndescr;
 
-	if (nvm_buf_vtophys(dev, addr, &phys)) {
-		return -1;
+	return 0;
+}
+
+int nvm_sgl_add(struct nvm_dev *dev, struct nvm_sgl *sgl, void *addr,
+	size_t len)
+{
+	const size_t vtop_nbytes = sgl_vtop_nbytes(dev);
+	const int ndescr = sgl->ndescr;
+	uint32_t last_len = 0;
+	char *va = addr;
+
+	if (ndescr) {		// Restored on error, it may take a merge
+		const int i = ndescr - 1;
+
+		last_len = sgl->segs[i / NVM_SGL_SEG_NDATA]
+			.descr[i % NVM_SGL_SEG_NDATA].unkeyed.len;
 	}
 
-	d->addr = phys;
+	// Translate per page, contiguous pages merge into one descriptor
+	while (len) {
+		const size_t ofz = (uintptr_t)va & (vtop_nbytes - 1);
+		const size_t nbytes = len < vtop_nbytes - ofz ?
+				      len : vtop_nbytes - ofz;
+		uint64_t phys;
 
-	sgl->len += len;
-	++sgl->ndescr;
+		if (sgl_vtophys(dev, sgl, va, vtop_nbytes, &phys) ||
+		    sgl_push(dev, sgl, phys, nbytes)) {
+			if (ndescr) {
+				const int i = ndescr - 1;
+
+				sgl->segs[i / NVM_SGL_SEG_NDATA]
+					.descr[i % NVM_SGL_SEG_NDATA]
+					.unkeyed.len = last_len;
+			}
+			sgl->len -= va - (char *)addr;
+			sgl->ndescr = ndescr;
+			return -1;
+		}
+
+		sgl->len += nbytes;
+		va += nbytes;
+		len -= nbytes;
+	}
 
 	return 0;
 }
+
+/**
+ * Returns the number of entries of segment 'i' of 'nused'
+ */
+static inline int sgl_seg_nentries(struct nvm_sgl *sgl, int i, int nused)
+{
+	const int ndata = NVM_MIN((int)NVM_SGL_SEG_NDATA,
+				  sgl->ndescr - i * (int)NVM_SGL_SEG_NDATA);
+
+	return ndata + (i + 1 < nused ? 1 : 0);
+}
+
+void nvm_sgl_dptr(struct nvm_sgl *sgl, struct nvm_nvme_sgl_descriptor *dptr)
+{
+	const int nused = (sgl->ndescr + NVM_SGL_SEG_NDATA - 1) /
+			  NVM_SGL_SEG_NDATA;
+	const size_t dsize = sizeof(struct nvm_nvme_sgl_descriptor);
+
+	memset(dptr, 0, sizeof(*dptr));
+
+	if (sgl->ndescr == 1) {
+		*dptr = sgl->segs[0].descr[0];
+		return;
+	}
+
+	// Segment 'i' is addressed by the command, or the link of segment
+	// 'i - 1', the segment addressed by a Last Segment holds no link
+	for (int i = 0; i < nused; ++i) {
+		struct nvm_nvme_sgl_descriptor *d = i ? \
+			&sgl->segs[i - 1].descr[NVM_SGL_SEG_NDATA] : dptr;
+
+		memset(d, 0, sizeof(*d));
+		d->unkeyed.type = (i + 1 == nused) ?
+			NVM_NVME_SGL_DESCR_TYPE_LAST_SEGMENT :
+			NVM_NVME_SGL_DESCR_TYPE_SEGMENT;
+		d->unkeyed.len = sgl_seg_nentries(sgl, i, nused) * dsize;
+		d->addr = sgl->segs[i].phys;
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ * nvm_timer - Calibration of the time-stamp-counter clock source
+ *
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm_timer.h>
+#ifdef NVM_TIMER_TSC_ENABLED
+#include <cpuid.h>
+#endif
+
+#define NVM_TIMER_TSC_CALIBRATE_NSECS 10000000ULL
+
+struct nvm_timer_tsc nvm_timer_tsc = {
+	.state = NVM_TIMER_TSC_UNCALIBRATED,
+	.nsecs_per_tick = 1.0,
+	.hz = 1000000000ULL,
+};
+
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+#ifdef NVM_TIMER_TSC_ENABLED
+/**
+ * CPUID.80000007H:EDX[8] -- TSC ticks at a constant rate across P-, C- and
+ * T-states, without it TSC deltas are not a measure of wall-clock time
+ */
+static int tsc_is_invariant(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0x80000000, NULL) < 0x80000007)
+		return 0;
+
+	__cpuid(0x80000007, eax, ebx, ecx, edx);
+
+	return (edx >> 8) & 0x1;
+}
+#endif
+
+/**
+ * Runs once, the fields are set before 'state' is released
+ */
+static void tsc_calibrate(void)
+{
+#ifdef NVM_TIMER_TSC_ENABLED
+	uint64_t ns_bgn, ns_end, tsc_bgn, tsc_end;
+
+	if (getenv("NVM_TIMER_NOTSC") || !tsc_is_invariant()) {
+		NVM_DEBUG("INFO: no invariant TSC, using CLOCK_MONOTONIC");
+		goto fallback;
+	}
+
+	ns_bgn = _clock_monotonic();
+	tsc_bgn = __rdtsc();
+	do {
+		ns_end = _clock_monotonic();
+	} while (ns_end - ns_bgn < NVM_TIMER_TSC_CALIBRATE_NSECS);
+	tsc_end = __rdtsc();
+
+	if (tsc_end <= tsc_bgn) {
+		NVM_DEBUG("FAILED: TSC is not monotonic");
+		goto fallback;
+	}
+
+	nvm_timer_tsc.nsecs_per_tick = (ns_end - ns_bgn) /
+				       (double)(tsc_end - tsc_bgn);
+	nvm_timer_tsc.hz = (tsc_end - tsc_bgn) * 1e9 / (ns_end - ns_bgn);
+	atomic_store_explicit(&nvm_timer_tsc.state, NVM_TIMER_TSC_INVARIANT,
+			      memory_order_release);
+
+	return;
+
+fallback:
+#endif
+	nvm_timer_tsc.nsecs_per_tick = 1.0;
+	nvm_timer_tsc.hz = 1000000000ULL;
+	atomic_store_explicit(&nvm_timer_tsc.state, NVM_TIMER_TSC_FALLBACK,
+			      memory_order_release);
+}
+
+int nvm_timer_tsc_calibrate(void)
+{
+	pthread_once(&tsc_once, tsc_calibrate);
+
+	return atomic_load_explicit(&nvm_timer_tsc.state,
+				    memory_order_acquire);
+}
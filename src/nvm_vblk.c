@@ -29,13 +29,66 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sched.h>
 #include <liblightnvm.h>
 #include <nvm_dev.h>
 #include <nvm_vblk.h>
-#include <nvm_omp.h>
+#include <nvm_pool.h>
 
 #define NVM_VBLK_CMD_OPTS (NVM_CMD_SYNC | NVM_CMD_VECTOR | NVM_CMD_PRP)
 
+#define NVM_VBLK_COPY_NSTRIPES 4	///< Stripes per window of a host copy
+
+#define NVM_VBLK_RA_NSEQ 2		///< Reads in a row starting read-ahead
+
+/**
+ * State of a synchronous vblk operation, the commands of the operation are
+ * executed on the worker-pool, one pool item per command
+ */
+struct vblk_job {
+	struct nvm_vblk *vblk;
+	struct nvm_vblk *dst;		///< Destination of copy
+	char *buf;
+	char *meta;
+	int pad;			///< Whether 'buf' is a padding buffer
+	size_t bgn;			///< First sector/spage/block of the operation
+	size_t end;			///< End sector/spage/block, exclusive
+	size_t cmd_n;			///< # of sectors/spages/blocks per command
+	int flags;			///< Command flags
+	char *parity;			///< Parity of each stripe, parity mode
+	int write;			///< Direction of an iovec job
+	const struct iovec *iov;	///< Segments of an iovec job
+	int iovcnt;
+	size_t *iov_ofz;		///< I/O offset of each segment, and end
+	size_t iov_unit;		///< Sectors per split of a stripe
+};
+
+/**
+ * Execute the commands of 'job' on the worker-pool and map the outcome to
+ * return value and errno of the vblk operation
+ */
+static inline int vblk_job_run(struct vblk_job *job, nvm_pool_func func,
+			       size_t nqueues, int nthreads, int flags)
+{
+	const size_t nitems = (job->end - job->bgn + job->cmd_n - 1) / job->cmd_n;
+	ssize_t nerr;
+
+	nerr = nvm_pool_run(func, job, nitems,
+			    NVM_MIN(nqueues, NVM_POOL_NQUEUES_MAX), nthreads,
+			    flags);
+	if (nerr < 0)
+		return -1;		// Propagate errno
+
+	if (nerr) {
+		NVM_DEBUG("FAILED: nerr(%zd)", nerr);
+		errno = EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
 int nvm_vblk_set_async(struct nvm_vblk *vblk, uint32_t depth)
 {
 	vblk->flags &= ~NVM_CMD_SYNC;
@@ -68,6 +121,58 @@ int nvm_vblk_set_scalar(struct nvm_vblk *vblk)
 	return 0;
 }
 
+/**
+ * Returns the alignment, in bytes, of writes to the given vblk
+ */
+static inline size_t vblk_write_align(struct nvm_vblk *vblk)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+
+	switch (nvm_dev_get_verid(vblk->dev)) {
+	case NVM_SPEC_VERID_12:
+		return geo->nplanes * geo->nsectors * geo->sector_nbytes;
+
+	default:
+		if (vblk->parity)	// Parity is computed over whole stripes
+			return nvm_dev_get_ws_opt(vblk->dev) * geo->l.nbytes *
+			       (vblk->nblks - 1);
+
+		return nvm_dev_get_ws_opt(vblk->dev) * geo->l.nbytes;
+	}
+}
+
+int nvm_vblk_set_wbuf(struct nvm_vblk *vblk, size_t nbytes)
+{
+	const size_t align = vblk_write_align(vblk);
+	char *wbuf;
+
+	if (vblk->wbuf_len) {
+		NVM_DEBUG("FAILED: write buffer holds data, flush it first");
+		errno = EBUSY;
+		return -1;
+	}
+
+	if (!nbytes)	// Default to a stripe across all blocks
+		nbytes = align * vblk->nblks;
+	nbytes = ((nbytes + align - 1) / align) * align;
+
+	wbuf = nvm_buf_alloc(vblk->dev, nbytes, NULL);
+	if (!wbuf) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	nvm_buf_free(vblk->dev, vblk->wbuf);
+	vblk->wbuf = wbuf;
+	vblk->wbuf_nbytes = nbytes;
+
+	return 0;
+}
+
+static int vblk_ra_drop(struct nvm_vblk *vblk);
+static ssize_t vblk_ra_read(struct nvm_vblk *vblk, void *buf, size_t count);
+
 static void vblk_async_callback(struct nvm_ret *ret, void *opaque)
 {
 	struct nvm_vblk_async_cb_state *state = opaque;
@@ -138,6 +243,11 @@ struct nvm_vblk* nvm_vblk_alloc(struct nvm_dev *dev, struct nvm_addr addrs[],
 		return NULL;
 	}
 
+	for (int i = 0; i < 128; ++i) {
+		pthread_mutex_init(&vblk->append[i].lock, NULL);
+		pthread_cond_init(&vblk->append[i].turn, NULL);
+	}
+
 	return vblk;
 }
 
@@ -185,7 +295,7 @@ struct nvm_vblk *nvm_vblk_alloc_line(struct nvm_dev *dev, int ch_bgn,
 
 	default:
 		NVM_DEBUG("FAILED: unsupported verid: %d", verid);
-		nvm_buf_free(dev, vblk);
+		nvm_vblk_free(vblk);
 		errno = ENOSYS;
 		return NULL;
 	}
@@ -193,7 +303,7 @@ struct nvm_vblk *nvm_vblk_alloc_line(struct nvm_dev *dev, int ch_bgn,
 	for (int i = 0; i < vblk->nblks; ++i) {
 		if (nvm_addr_check(vblk->blks[i], dev)) {
 			NVM_DEBUG("FAILED: nvm_addr_check");
-			free(vblk);
+			nvm_vblk_free(vblk);
 			errno = EINVAL;
 			return NULL;
 		}
@@ -202,8 +312,148 @@ struct nvm_vblk *nvm_vblk_alloc_line(struct nvm_dev *dev, int ch_bgn,
 	return vblk;
 }
 
+/**
+ * Whether block 'blk' on the parallel unit of 'addr' is healthy, when
+ * substituting on 2.0, the chunk must also be free
+ */
+static int _line_blk_ok(struct nvm_dev *dev, const struct nvm_spec_rprt *rprt,
+			const struct nvm_bbt *bbt, struct nvm_addr addr,
+			int blk, int subst)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+
+	if (rprt) {
+		const struct nvm_spec_rprt_descr *descr;
+
+		addr.l.chunk = blk;
+		descr = &rprt->descr[nvm_addr_gen2lpo(dev, addr) /
+				     sizeof(*descr)];
+
+		if (subst)
+			return descr->cs == NVM_CHUNK_STATE_FREE;
+
+		return descr->cs != NVM_CHUNK_STATE_OFFLINE;
+	}
+
+	for (size_t pl = 0; pl < geo->nplanes; ++pl) {
+		if (bbt->blks[blk * geo->nplanes + pl] != NVM_BBT_FREE)
+			return 0;
+	}
+
+	return 1;
+}
+
+struct nvm_vblk *nvm_vblk_alloc_line_healthy(struct nvm_dev *dev, int ch_bgn,
+					     int ch_end, int lun_bgn,
+					     int lun_end, int blk, int flags)
+{
+	const int verid = nvm_dev_get_verid(dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_spec_rprt *rprt = NULL;
+	struct nvm_vblk *vblk;
+	int nblks_max, nblks = 0;
+
+	vblk = nvm_vblk_alloc_line(dev, ch_bgn, ch_end, lun_bgn, lun_end, blk);
+	if (!vblk)
+		return NULL;	// Propagate errno
+
+	if (verid == NVM_SPEC_VERID_20) {
+		nblks_max = geo->l.nchunk;
+
+		rprt = nvm_cmd_rprt(dev, NULL, 0x0, NULL);
+		if (!rprt) {
+			NVM_DEBUG("FAILED: nvm_cmd_rprt");
+			nvm_vblk_free(vblk);
+			return NULL;	// Propagate errno
+		}
+	} else {
+		nblks_max = geo->nblocks;
+	}
+
+	for (int i = 0; i < vblk->nblks; ++i) {
+		struct nvm_addr addr = vblk->blks[i];
+		const struct nvm_bbt *bbt = NULL;
+		int subst = -1;
+
+		if (!rprt) {
+			bbt = nvm_bbt_get(dev, addr, NULL);
+			if (!bbt) {
+				NVM_DEBUG("FAILED: nvm_bbt_get");
+				nvm_vblk_free(vblk);
+				return NULL;	// Propagate errno
+			}
+		}
+
+		if (_line_blk_ok(dev, rprt, bbt, addr, blk, 0)) {
+			vblk->blks[nblks++] = addr;
+			continue;
+		}
+
+		// Nearest healthy block, below before above
+		for (int d = 1; (flags & NVM_VBLK_LINE_SUBST) && (d < nblks_max) &&
+		     (subst < 0); ++d) {
+			if ((blk - d >= 0) &&
+			    _line_blk_ok(dev, rprt, bbt, addr, blk - d, 1))
+				subst = blk - d;
+			else if ((blk + d < nblks_max) &&
+				 _line_blk_ok(dev, rprt, bbt, addr, blk + d, 1))
+				subst = blk + d;
+		}
+
+		if (subst < 0) {
+			NVM_DEBUG("INFO: leaving out unhealthy block");
+			continue;
+		}
+
+		NVM_DEBUG("INFO: substituting blk: %d with blk: %d", blk, subst);
+		if (rprt)
+			addr.l.chunk = subst;
+		else
+			addr.g.blk = subst;
+
+		vblk->blks[nblks++] = addr;
+	}
+
+	nvm_buf_free(dev, rprt);
+
+	if (!nblks) {
+		NVM_DEBUG("FAILED: no healthy blocks");
+		nvm_vblk_free(vblk);
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	vblk->nbytes = vblk->nbytes / vblk->nblks * nblks;
+	vblk->nblks = nblks;
+
+	return vblk;
+}
+
 void nvm_vblk_free(struct nvm_vblk *vblk)
 {
+	if (!vblk)
+		return;
+
+	if (vblk->ra_nwins && vblk_ra_drop(vblk)) {
+		NVM_DEBUG("FAILED: vblk_ra_drop");
+	}
+	if (vblk->nreqs && nvm_vblk_async_wait(vblk)) {
+		NVM_DEBUG("FAILED: nvm_vblk_async_wait");
+	}
+
+	if (vblk->wbuf) {
+		if (nvm_vblk_flush(vblk) < 0) {
+			NVM_DEBUG("FAILED: nvm_vblk_flush, buffered data lost");
+		}
+		nvm_buf_free(vblk->dev, vblk->wbuf);
+	}
+	nvm_buf_free(vblk->dev, vblk->ra_buf);
+
+	for (int i = 0; i < 128; ++i) {
+		pthread_mutex_destroy(&vblk->append[i].lock);
+		pthread_cond_destroy(&vblk->append[i].turn);
+	}
+
 	free(vblk);
 }
 
@@ -216,77 +466,96 @@ static inline int cmd_nblks(int nblks, int cmd_nblks_max)
 	return count;
 }
 
-static inline ssize_t vblk_erase_s12(struct nvm_vblk *vblk)
+static int vblk_erase_s12_cmd(void *arg, size_t item)
 {
-	size_t nerr = 0;
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
 	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	struct nvm_ret ret = { 0 };
 
 	const int BLK_NADDRS = geo->nplanes;
-	const int CMD_NBLKS = cmd_nblks(vblk->nblks,
-			nvm_dev_get_erase_naddrs_max(vblk->dev) / BLK_NADDRS);
 
-	const int pmode = nvm_dev_get_pmode(vblk->dev);
+	const int off = job->bgn + item * job->cmd_n;
+	const int nblks = NVM_MIN(job->cmd_n, job->end - off);
+	const int naddrs = nblks * BLK_NADDRS;
 
-	for (int off = 0; off < vblk->nblks; off += CMD_NBLKS) {
-		ssize_t err;
-		struct nvm_ret ret = { 0 };
+	struct nvm_addr addrs[naddrs];
 
-		const int nblks = NVM_MIN(CMD_NBLKS, vblk->nblks - off);
-		const int naddrs = nblks * BLK_NADDRS;
+	for (int i = 0; i < naddrs; ++i) {
+		const int idx = off + (i / BLK_NADDRS);
 
-		struct nvm_addr addrs[naddrs];
+		addrs[i].ppa = vblk->blks[idx].ppa;
+		addrs[i].g.pl = i % geo->nplanes;
+	}
 
-		for (int i = 0; i < naddrs; ++i) {
-			const int idx = off + (i / BLK_NADDRS);
+	return nvm_cmd_erase(vblk->dev, addrs, naddrs, NULL,
+			     job->flags | NVM_VBLK_CMD_OPTS, &ret) ? 1 : 0;
+}
 
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pl = i % geo->nplanes;
-		}
+static inline ssize_t vblk_erase_s12(struct nvm_vblk *vblk)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
 
-		err = nvm_cmd_erase(vblk->dev, addrs, naddrs, NULL,
-				    pmode | NVM_VBLK_CMD_OPTS, &ret);
-		if (err)
-			++nerr;
-	}
+	const int BLK_NADDRS = geo->nplanes;
+	const int CMD_NBLKS = cmd_nblks(vblk->nblks,
+			nvm_dev_get_erase_naddrs_max(vblk->dev) / BLK_NADDRS);
+	const int NTHREADS = vblk->nblks / CMD_NBLKS;
 
-	if (nerr) {
-		errno = EIO;
-		return -1;
-	}
+	struct vblk_job job = {
+		.vblk = vblk,
+		.bgn = 0,
+		.end = vblk->nblks,
+		.cmd_n = CMD_NBLKS,
+		.flags = nvm_dev_get_pmode(vblk->dev),
+	};
+
+	if (vblk_job_run(&job, vblk_erase_s12_cmd, NTHREADS, NTHREADS, 0))
+		return -1;		// Propagate errno
 
 	vblk->pos_write = 0;
 	vblk->pos_read = 0;
+	vblk->wbuf_len = 0;	// Buffered data went with the erase
 
 	return vblk->nbytes;
 }
 
-static inline ssize_t vblk_erase_s20(struct nvm_vblk *vblk)
+static int vblk_erase_s20_cmd(void *arg, size_t item)
 {
-	size_t nerr = 0;
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
+	struct nvm_ret ret = { 0 };
 
-	const int CMD_NBLKS = cmd_nblks(vblk->nblks,
-				nvm_dev_get_erase_naddrs_max(vblk->dev));
+	const int off = job->bgn + item * job->cmd_n;
+	const int naddrs = NVM_MIN(job->cmd_n, job->end - off);
 
-	for (int off = 0; off < vblk->nblks; off += CMD_NBLKS) {
-		const int naddrs = NVM_MIN(CMD_NBLKS, vblk->nblks - off);
-		struct nvm_ret ret = { 0 };
+	struct nvm_addr addrs[naddrs];
 
-		struct nvm_addr addrs[naddrs];
+	for (int i = 0; i < naddrs; ++i)
+		addrs[i].ppa = vblk->blks[off + i].ppa;
 
-		for (int i = 0; i < naddrs; ++i)
-			addrs[i].ppa = vblk->blks[off + i].ppa;
+	return nvm_cmd_erase(vblk->dev, addrs, naddrs, NULL, 0x0, &ret) ? 1 : 0;
+}
 
-		if (nvm_cmd_erase(vblk->dev, addrs, naddrs, NULL, 0x0, &ret))
-			++nerr;
-	}
+static inline ssize_t vblk_erase_s20(struct nvm_vblk *vblk)
+{
+	const int CMD_NBLKS = cmd_nblks(vblk->nblks,
+				nvm_dev_get_erase_naddrs_max(vblk->dev));
+	const int NTHREADS = vblk->nblks / CMD_NBLKS;
 
-	if (nerr) {
-		errno = EIO;
-		return -1;
-	}
+	struct vblk_job job = {
+		.vblk = vblk,
+		.bgn = 0,
+		.end = vblk->nblks,
+		.cmd_n = CMD_NBLKS,
+	};
+
+	if (vblk_job_run(&job, vblk_erase_s20_cmd, NTHREADS, NTHREADS, 0))
+		return -1;		// Propagate errno
 
 	vblk->pos_write = 0;
 	vblk->pos_read = 0;
+	vblk->wbuf_len = 0;	// Buffered data went with the erase
+	memset(vblk->chunk_failed, 0, sizeof(vblk->chunk_failed));
 
 	return vblk->nbytes;
 }
@@ -295,12 +564,28 @@ ssize_t nvm_vblk_erase(struct nvm_vblk *vblk)
 {
 	const int verid = nvm_dev_get_verid(nvm_vblk_get_dev(vblk));
 
+	if (vblk->ra_nwins && vblk_ra_drop(vblk))
+		return -1;		// Propagate errno
+
 	switch (verid) {
 	case NVM_SPEC_VERID_12:
 		return vblk_erase_s12(vblk);
 
 	case NVM_SPEC_VERID_20:
-		return vblk_erase_s20(vblk);
+	{
+		ssize_t res = vblk_erase_s20(vblk);
+
+		if (res >= 0) {
+			for (int i = 0; i < vblk->nblks; ++i) {
+				atomic_store(&vblk->append[i].wp, 0);
+				atomic_store(&vblk->append[i].wp_submitted, 0);
+				atomic_store(&vblk->append[i].failed, 0);
+			}
+			atomic_store(&vblk->parity_degraded, 0);
+		}
+
+		return res;
+	}
 
 	default:
 		NVM_DEBUG("FAILED: unsupported verid: %d", verid);
@@ -358,11 +643,12 @@ static inline int vblk_io_async(struct nvm_vblk *vblk, const size_t vsectr_bgn,
 		.vblk = vblk,
 	};
 
-	size_t cnk_bgn = (vsectr_bgn / stripe_nsectrs) % vblk->nblks;
-	NVM_DEBUG("cnk_bgn: %ld", cnk_bgn);
+	size_t stripe_bgn = vsectr_bgn / stripe_nsectrs;
+	NVM_DEBUG("stripe_bgn: %zu", stripe_bgn);
 	for (size_t stripe = 0; stripe < nstripes; stripe++) {
-		size_t cnk_idx = (cnk_bgn + stripe) % vblk->nblks;
-		size_t cnk_off = (stripe / vblk->nblks) * stripe_nsectrs;
+		size_t cnk_idx = (stripe_bgn + stripe) % vblk->nblks;
+		size_t cnk_off = ((stripe_bgn + stripe) / vblk->nblks) *
+				 stripe_nsectrs;
 
 		char *bufp = pad_buf ? pad_buf :
 			(char *)buf + (sectr_nbytes * stripe_nsectrs * stripe);
@@ -436,6 +722,45 @@ static inline int vblk_io_async(struct nvm_vblk *vblk, const size_t vsectr_bgn,
 	return nerr;
 }
 
+/**
+ * Allocate the meta buffer of a write command of 'nsectr' sectors, filled
+ * according to the meta mode of the device
+ *
+ * @returns The buffer, NULL when the meta mode is NVM_META_MODE_NONE or on
+ * error with `errno` set
+ */
+static char *vblk_meta_alloc(struct nvm_vblk *vblk, size_t nsectr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const size_t meta_tbytes = nsectr * geo->l.nbytes_oob;
+	const int meta_mode = nvm_dev_get_meta_mode(vblk->dev);
+	char *meta_buf;
+
+	if (meta_mode == NVM_META_MODE_NONE)
+		return NULL;
+
+	meta_buf = nvm_buf_alloc(vblk->dev, meta_tbytes, NULL);
+	if (!meta_buf) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc(meta)");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	switch(meta_mode) {			// Fill it
+		case NVM_META_MODE_ALPHA:
+			nvm_buf_fill(meta_buf, meta_tbytes);
+			break;
+		case NVM_META_MODE_CONST:
+			for (size_t i = 0; i < meta_tbytes; ++i)
+				meta_buf[i] = 65 + (meta_tbytes % 20);
+			break;
+		case NVM_META_MODE_NONE:
+			break;
+	}
+
+	return meta_buf;
+}
+
 static inline ssize_t vblk_async_pwrite_s20(struct nvm_vblk *vblk,
 					    const void *buf,
 					    size_t count, size_t offset)
@@ -453,7 +778,6 @@ static inline ssize_t vblk_async_pwrite_s20(struct nvm_vblk *vblk,
 
 	const size_t cmd_nsectr = WS_OPT;
 
-	const size_t meta_tbytes = cmd_nsectr * geo->l.nbytes_oob;
 	char *meta_buf = NULL;
 
 	const size_t pad_nbytes = cmd_nsectr * nsectr * geo->l.nbytes;
@@ -483,26 +807,10 @@ static inline ssize_t vblk_async_pwrite_s20(struct nvm_vblk *vblk,
 		nvm_buf_fill(pad_buf, pad_nbytes);
 	}
 
-	if (meta_mode != NVM_META_MODE_NONE) {		// Meta buffer
-		meta_buf = nvm_buf_alloc(vblk->dev, meta_tbytes, NULL);
-		if (!meta_buf) {
-			nvm_buf_free(vblk->dev, pad_buf);
-			NVM_DEBUG("FAILED: nvm_buf_alloc(meta)");
-			errno = ENOMEM;
-			return -1;
-		}
-
-		switch(meta_mode) {			// Fill it
-			case NVM_META_MODE_ALPHA:
-				nvm_buf_fill(meta_buf, meta_tbytes);
-				break;
-			case NVM_META_MODE_CONST:
-				for (size_t i = 0; i < meta_tbytes; ++i)
-					meta_buf[i] = 65 + (meta_tbytes % 20);
-				break;
-			case NVM_META_MODE_NONE:
-				break;
-		}
+	meta_buf = vblk_meta_alloc(vblk, cmd_nsectr);
+	if (meta_mode != NVM_META_MODE_NONE && !meta_buf) {
+		nvm_buf_free(vblk->dev, pad_buf);
+		return -1;		// Propagate errno
 	}
 
 	nerr = vblk_io_async(vblk, vsectr_bgn, count, (void *) buf, meta_buf,
@@ -556,11 +864,42 @@ static inline ssize_t vblk_async_pread_s20(struct nvm_vblk *vblk, void *buf,
 	return count;
 }
 
+static int vblk_sync_pread_s20_cmd(void *arg, size_t item)
+{
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const size_t nchunks = vblk->nblks;
+
+	const size_t sectr_ofz = job->bgn + item * job->cmd_n;
+	const size_t cmd_nsectr = NVM_MIN(job->cmd_n, job->end - sectr_ofz);
+	char *buf_off = job->buf + (sectr_ofz - job->bgn) * geo->l.nbytes;
+
+	struct nvm_addr addrs[cmd_nsectr];
+
+	for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
+		const size_t sectr = sectr_ofz + idx;
+		const size_t wunit = sectr / WS_OPT;
+		const size_t rnd = wunit / nchunks;
+
+		const size_t chunk = wunit % nchunks;
+		const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+
+		addrs[idx].val = vblk->blks[chunk].val;
+		addrs[idx].l.sectr = chunk_sectr;
+
+		if (job->flags & NVM_CMD_SCALAR) break;
+	}
+
+	return nvm_cmd_read(vblk->dev, addrs, cmd_nsectr, buf_off, NULL,
+			    job->flags, NULL) ? 1 : 0;
+}
+
 static inline ssize_t vblk_sync_pread_s20(struct nvm_vblk *vblk, void *buf,
 					  size_t count, size_t offset)
 {
-	size_t nerr = 0;
-
 	const uint32_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
 
 	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
@@ -570,12 +909,20 @@ static inline ssize_t vblk_sync_pread_s20(struct nvm_vblk *vblk, void *buf,
 	const size_t nsectr = count / sectr_nbytes;
 
 	const size_t sectr_bgn = offset / sectr_nbytes;
-	const size_t sectr_end = sectr_bgn + (count / sectr_nbytes) - 1;
 
 	const size_t cmd_nsectr = vblk->flags & NVM_CMD_VECTOR ? NVM_NADDR_MAX : WS_OPT;
 
 	const int NTHREADS = NVM_MIN(nchunks, nsectr / WS_OPT);
 
+	struct vblk_job job = {
+		.vblk = vblk,
+		.buf = buf,
+		.bgn = sectr_bgn,
+		.end = sectr_bgn + nsectr,
+		.cmd_n = cmd_nsectr,
+		.flags = vblk->flags,
+	};
+
 	if (nsectr % WS_OPT) {
 		NVM_DEBUG("FAILED: unaligned nsectr: %zu", nsectr);
 		errno = EINVAL;
@@ -587,49 +934,56 @@ static inline ssize_t vblk_sync_pread_s20(struct nvm_vblk *vblk, void *buf,
 		return -1;
 	}
 
-	const int VBLK_FLAGS = vblk->flags;
+	// Reads are not ordered, queues are per chunk for the ws_opt commands
+	if (vblk_job_run(&job, vblk_sync_pread_s20_cmd, nchunks, NTHREADS, 0)) {
+		NVM_DEBUG("FAILED: nvm_cmd_read");
+		return -1;		// Propagate errno
+	}
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t sectr_ofz = sectr_bgn; sectr_ofz <= sectr_end; sectr_ofz += cmd_nsectr) {
-		struct nvm_addr addrs[cmd_nsectr];
-		char *buf_off = (char*)buf + (sectr_ofz - sectr_bgn) * sectr_nbytes;
+	return count;
+}
+
+static int vblk_sync_pwrite_s20_cmd(void *arg, size_t item)
+{
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	struct nvm_ret ret = { 0 };
 
-		for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
-			const size_t sectr = sectr_ofz + idx;
-			const size_t wunit = sectr / WS_OPT;
-			const size_t rnd = wunit / nchunks;
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const size_t nchunks = vblk->nblks;
 
-			const size_t chunk = wunit % nchunks;
-			const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+	const size_t sectr_ofz = job->bgn + item * job->cmd_n;
+	const size_t cmd_nsectr = job->cmd_n;
 
-			addrs[idx].val = vblk->blks[chunk].val;
-			addrs[idx].l.sectr = chunk_sectr;
+	struct nvm_addr addrs[cmd_nsectr];
+	char *buf_off;
 
-			if (VBLK_FLAGS & NVM_CMD_SCALAR) break;
-		}
+	if (job->pad)
+		buf_off = job->buf;
+	else
+		buf_off = job->buf + (sectr_ofz - job->bgn) * geo->l.nbytes;
 
-		const ssize_t err = nvm_cmd_read(vblk->dev, addrs, cmd_nsectr,
-						 buf_off, NULL,
-						 VBLK_FLAGS, NULL);
-		if (err)
-			++nerr;
-	}
+	for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
+		const size_t sectr = sectr_ofz + idx;
+		const size_t wunit = sectr / WS_OPT;
+		const size_t rnd = wunit / nchunks;
 
-	if (nerr) {
-		NVM_DEBUG("FAILED: nvm_cmd_read, nerr(%zu)", nerr);
-		errno = EIO;
-		return -1;
+		const size_t chunk = wunit % nchunks;
+		const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+
+		addrs[idx].ppa = vblk->blks[chunk].ppa;
+		addrs[idx].l.sectr = chunk_sectr;
 	}
 
-	return count;
+	return nvm_cmd_write(vblk->dev, addrs, cmd_nsectr, buf_off, job->meta,
+			     job->flags, &ret) ? 1 : 0;
 }
 
 static inline ssize_t vblk_sync_pwrite_s20(struct nvm_vblk *vblk,
 					   const void *buf, size_t count,
 					   size_t offset)
 {
-	size_t nerr = 0;
-
 	const uint32_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
 
 	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
@@ -639,11 +993,9 @@ static inline ssize_t vblk_sync_pwrite_s20(struct nvm_vblk *vblk,
 	const size_t nsectr = count / sectr_nbytes;
 
 	const size_t sectr_bgn = offset / sectr_nbytes;
-	const size_t sectr_end = sectr_bgn + (count / sectr_nbytes) - 1;
 
 	const size_t cmd_nsectr = WS_OPT;
 
-	const size_t meta_tbytes = cmd_nsectr * geo->l.nbytes_oob;
 	char *meta_buf = NULL;
 
 	const size_t pad_nbytes = cmd_nsectr * nsectr * geo->l.nbytes;
@@ -653,6 +1005,16 @@ static inline ssize_t vblk_sync_pwrite_s20(struct nvm_vblk *vblk,
 
 	const int meta_mode = nvm_dev_get_meta_mode(vblk->dev);
 
+	struct vblk_job job = {
+		.vblk = vblk,
+		.buf = (char *)buf,
+		.bgn = sectr_bgn,
+		.end = sectr_bgn + nsectr,
+		.cmd_n = cmd_nsectr,
+		.flags = vblk->flags,
+	};
+	int err;
+
 	if (nsectr % WS_OPT) {
 		NVM_DEBUG("FAILED: unaligned nsectr: %zu", nsectr);
 		errno = EINVAL;
@@ -675,80 +1037,72 @@ static inline ssize_t vblk_sync_pwrite_s20(struct nvm_vblk *vblk,
 		nvm_buf_fill(pad_buf, pad_nbytes);
 	}
 
-	if (meta_mode != NVM_META_MODE_NONE) {		// Meta buffer
-		meta_buf = nvm_buf_alloc(vblk->dev, meta_tbytes, NULL);
-		if (!meta_buf) {
-			nvm_buf_free(vblk->dev, pad_buf);
-			NVM_DEBUG("FAILED: nvm_buf_alloc(meta)");
-			errno = ENOMEM;
-			return -1;
-		}
+	meta_buf = vblk_meta_alloc(vblk, cmd_nsectr);
+	if (meta_mode != NVM_META_MODE_NONE && !meta_buf) {
+		nvm_buf_free(vblk->dev, pad_buf);
+		return -1;		// Propagate errno
+	}
 
-		switch(meta_mode) {			// Fill it
-			case NVM_META_MODE_ALPHA:
-				nvm_buf_fill(meta_buf, meta_tbytes);
-				break;
-			case NVM_META_MODE_CONST:
-				for (size_t i = 0; i < meta_tbytes; ++i)
-					meta_buf[i] = 65 + (meta_tbytes % 20);
-				break;
-			case NVM_META_MODE_NONE:
-				break;
-		}
+	if (pad_buf) {
+		job.buf = pad_buf;
+		job.pad = 1;
 	}
+	job.meta = meta_buf;
 
-	const int VBLK_FLAGS = vblk->flags;
+	// One ordered queue per chunk, keeping the writes to a chunk sequential
+	err = vblk_job_run(&job, vblk_sync_pwrite_s20_cmd, nchunks, NTHREADS,
+			   NVM_POOL_ORDERED);
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t sectr_ofz = sectr_bgn; sectr_ofz <= sectr_end; sectr_ofz += cmd_nsectr) {
-		struct nvm_ret ret = { 0 };
+	nvm_buf_free(vblk->dev, pad_buf);
+	nvm_buf_free(vblk->dev, meta_buf);
 
-		struct nvm_addr addrs[cmd_nsectr];
-		char *buf_off;
+	if (err) {
+		NVM_DEBUG("FAILED: nvm_cmd_write");
+		return -1;		// Propagate errno
+	}
 
-		if (pad_buf)
-			buf_off = pad_buf;
-		else
-			buf_off = (char*)buf + (sectr_ofz - sectr_bgn) * sectr_nbytes;
+	return count;
+}
+
+static int vblk_pwrite_s12_cmd(void *arg, size_t item)
+{
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	struct nvm_ret ret = { 0 };
 
-		for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
-			const size_t sectr = sectr_ofz + idx;
-			const size_t wunit = sectr / WS_OPT;
-			const size_t rnd = wunit / nchunks;
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
 
-			const size_t chunk = wunit % nchunks;
-			const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+	const size_t off = job->bgn + item * job->cmd_n;
+	const int nspages = NVM_MIN(job->cmd_n, job->end - off);
+	const int naddrs = nspages * SPAGE_NADDRS;
 
-			addrs[idx].ppa = vblk->blks[chunk].ppa;
-			addrs[idx].l.sectr = chunk_sectr;
-		}
+	struct nvm_addr addrs[naddrs];
+	const char *buf_off;
 
-		const ssize_t err = nvm_cmd_write(vblk->dev, addrs, cmd_nsectr,
-						  buf_off, meta_buf,
-						  VBLK_FLAGS, &ret);
-		if (err)
-			++nerr;
+	if (job->pad)
+		buf_off = job->buf;
+	else
+		buf_off = job->buf + (off - job->bgn) * geo->sector_nbytes * SPAGE_NADDRS;
 
-		#pragma omp ordered
-		{}
+	for (int i = 0; i < naddrs; ++i) {
+		const int spg = off + (i / SPAGE_NADDRS);
+		const int idx = spg % vblk->nblks;
+		const int pg = (spg / vblk->nblks) % geo->npages;
+
+		addrs[i].ppa = vblk->blks[idx].ppa;
+		addrs[i].g.pg = pg;
+		addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+		addrs[i].g.sec = i % geo->nsectors;
 	}
 
-	nvm_buf_free(vblk->dev, pad_buf);
-	nvm_buf_free(vblk->dev, meta_buf);
-
-	if (nerr) {
-		NVM_DEBUG("FAILED: nvm_cmd_write, nerr(%zu)", nerr);
-		errno = EIO;
-		return -1;
-	}
-
-	return count;
-}
+	return nvm_cmd_write(vblk->dev, addrs, naddrs, buf_off, job->meta,
+			     job->flags, &ret) ? 1 : 0;
+}
 
 static inline ssize_t vblk_pwrite_s12(struct nvm_vblk *vblk, const void *buf,
 				      size_t count, size_t offset)
 {
-	size_t nerr = 0;
 	const int PMODE = nvm_dev_get_pmode(vblk->dev);
 	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
 
@@ -769,6 +1123,16 @@ static inline ssize_t vblk_pwrite_s12(struct nvm_vblk *vblk, const void *buf,
 
 	const int meta_mode = nvm_dev_get_meta_mode(vblk->dev);
 
+	struct vblk_job job = {
+		.vblk = vblk,
+		.buf = (char *)buf,
+		.bgn = bgn,
+		.end = end,
+		.cmd_n = CMD_NSPAGES,
+		.flags = PMODE,
+	};
+	int err;
+
 	if (offset + count > vblk->nbytes) {		// Check bounds
 		errno = EINVAL;
 		return -1;
@@ -812,316 +1176,2358 @@ static inline ssize_t vblk_pwrite_s12(struct nvm_vblk *vblk, const void *buf,
 		}
 	}
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
-		struct nvm_ret ret = { 0 };
+	if (padding_buf) {
+		job.buf = padding_buf;
+		job.pad = 1;
+	}
+	job.meta = meta;
 
-		const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
-		const int naddrs = nspages * SPAGE_NADDRS;
+	// Commands 'NTHREADS' apart hit the same blocks, one ordered queue each
+	err = vblk_job_run(&job, vblk_pwrite_s12_cmd, NTHREADS, NTHREADS,
+			   NVM_POOL_ORDERED);
 
-		struct nvm_addr addrs[naddrs];
-		const char *buf_off;
+	nvm_buf_free(vblk->dev, padding_buf);
+	nvm_buf_free(vblk->dev, meta);
 
-		if (padding_buf)
-			buf_off = padding_buf;
-		else
-			buf_off = (const char*)buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
+	if (err)
+		return -1;		// Propagate errno
 
-		for (int i = 0; i < naddrs; ++i) {
-			const int spg = off + (i / SPAGE_NADDRS);
-			const int idx = spg % vblk->nblks;
-			const int pg = (spg / vblk->nblks) % geo->npages;
+	return count;
+}
 
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pg = pg;
-			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
-			addrs[i].g.sec = i % geo->nsectors;
-		}
 
-		const ssize_t err = nvm_cmd_write(vblk->dev, addrs, naddrs,
-						   buf_off, meta, PMODE, &ret);
-		if (err)
-			++nerr;
+int nvm_vblk_set_parity(struct nvm_vblk *vblk, int parity)
+{
+	if (nvm_dev_get_verid(vblk->dev) != NVM_SPEC_VERID_20) {
+		NVM_DEBUG("FAILED: only supported for 2.0");
+		errno = ENOSYS;
+		return -1;
+	}
 
-		#pragma omp ordered
-		{}
+	switch (parity) {
+	case 0:
+	case 1:
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
 	}
 
-	nvm_buf_free(vblk->dev, padding_buf);
-	nvm_buf_free(vblk->dev, meta);
+	if (parity == vblk->parity)
+		return 0;
 
-	if (nerr) {
-		errno = EIO;
+	if (parity && vblk->nblks < 2) {
+		NVM_DEBUG("FAILED: parity needs two or more blocks");
+		errno = EINVAL;
+		return -1;
+	}
+	if (vblk->pos_write || vblk->wbuf_len) {
+		NVM_DEBUG("FAILED: vblk is being written");
+		errno = EBUSY;
 		return -1;
 	}
 
-	return count;
+	// The capacity of a chunk goes to parity
+	vblk->nbytes = parity ? vblk->nbytes / vblk->nblks * (vblk->nblks - 1) :
+				vblk->nbytes / (vblk->nblks - 1) * vblk->nblks;
+	vblk->parity = parity;
+	atomic_store(&vblk->parity_degraded, 0);
+
+	// Windows of the read-ahead ring are stripes, which parity changes
+	if (vblk->ra_nwins && nvm_vblk_set_readahead(vblk, vblk->ra_nwins)) {
+		NVM_DEBUG("FAILED: nvm_vblk_set_readahead");
+		return -1;		// Propagate errno
+	}
+
+	return 0;
 }
 
+typedef uint64_t vblk_xor_vec16 __attribute__((vector_size(16)));
 
-ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
-			size_t offset)
+/**
+ * dst ^= src over whole 16-byte vectors, SSE2 on x86-64, the buffers need not
+ * be aligned
+ *
+ * @returns The number of bytes covered
+ */
+static size_t vblk_xor_sse2(char *dst, const char *src, size_t nbytes)
 {
-	const int verid = nvm_dev_get_verid(nvm_vblk_get_dev(vblk));
+	size_t i;
 
-	switch (verid) {
-	case NVM_SPEC_VERID_12:
-		return vblk_pwrite_s12(vblk, buf, count, offset);
+	for (i = 0; i + sizeof(vblk_xor_vec16) <= nbytes;
+	     i += sizeof(vblk_xor_vec16)) {
+		vblk_xor_vec16 d, x;
 
-	case NVM_SPEC_VERID_20:
-		if (vblk->flags & NVM_CMD_ASYNC) {
-			return vblk_async_pwrite_s20(vblk, buf, count, offset);
-		} else {
-			return vblk_sync_pwrite_s20(vblk, buf, count, offset);
-		}
+		memcpy(&d, dst + i, sizeof(d));
+		memcpy(&x, src + i, sizeof(x));
+		d ^= x;
+		memcpy(dst + i, &d, sizeof(d));
+	}
 
-	default:
-		NVM_DEBUG("FAILED: unsupported verid: %d", verid);
-		errno = ENOSYS;
-		return -1;
+	return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+typedef uint64_t vblk_xor_vec32 __attribute__((vector_size(32)));
+
+/**
+ * As vblk_xor_sse2, over 32-byte vectors compiled to AVX2, only to be called
+ * when the CPU supports it
+ */
+__attribute__((target("avx2")))
+static size_t vblk_xor_avx2(char *dst, const char *src, size_t nbytes)
+{
+	size_t i;
+
+	for (i = 0; i + sizeof(vblk_xor_vec32) <= nbytes;
+	     i += sizeof(vblk_xor_vec32)) {
+		vblk_xor_vec32 d, x;
+
+		memcpy(&d, dst + i, sizeof(d));
+		memcpy(&x, src + i, sizeof(x));
+		d ^= x;
+		memcpy(dst + i, &d, sizeof(d));
 	}
+
+	return i;
 }
+#endif
 
-ssize_t nvm_vblk_write(struct nvm_vblk *vblk, const void *buf, size_t count)
+/**
+ * dst ^= src, 'nbytes' is a multiple of the sector size
+ *
+ * Uses AVX2 when the CPU supports it, otherwise 16-byte vectors, which is SSE2
+ * on x86-64.
+ */
+static inline void vblk_xor(char *dst, const char *src, size_t nbytes)
 {
-	ssize_t nbytes = nvm_vblk_pwrite(vblk, buf, count, vblk->pos_write);
+	size_t i;
 
-	if (nbytes < 0)
-		return nbytes;		// Propagate errno
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2"))
+		i = vblk_xor_avx2(dst, src, nbytes);
+	else
+#endif
+		i = vblk_xor_sse2(dst, src, nbytes);
 
-	vblk->pos_write += nbytes;	// All is good, increment write position
+	for (; i < nbytes; ++i)
+		dst[i] ^= src[i];
+}
 
-	return nbytes;			// Return number of bytes written
+/**
+ * Chunk holding the parity of stripe 'rnd', rotating over the chunks
+ */
+static inline size_t vblk_parity_chunk(struct nvm_vblk *vblk, size_t rnd)
+{
+	return rnd % vblk->nblks;
 }
 
-ssize_t nvm_vblk_pad(struct nvm_vblk *vblk)
+/**
+ * Chunk holding data write-unit 'wunit', the units of a stripe follow its
+ * parity chunk
+ */
+static inline size_t vblk_parity_data_chunk(struct nvm_vblk *vblk,
+					    size_t wunit)
 {
-	return nvm_vblk_write(vblk, NULL, vblk->nbytes - vblk->pos_write);
+	const size_t rnd = wunit / (vblk->nblks - 1);
+
+	return (vblk_parity_chunk(vblk, rnd) + 1 +
+		wunit % (vblk->nblks - 1)) % vblk->nblks;
 }
 
-static inline ssize_t vblk_pread_s12(struct nvm_vblk *vblk, void *buf,
-				     size_t count, size_t offset)
+/**
+ * Write the write-unit of a stripe to one chunk, one item per chunk of each
+ * stripe, the item of the parity chunk computes the parity of the stripe while
+ * the data of the stripe is written by the other items
+ */
+static int vblk_parity_pwrite_cmd(void *arg, size_t item)
 {
-	size_t nerr = 0;
-	const int PMODE = nvm_dev_get_pmode(vblk->dev);
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
 	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	struct nvm_ret ret = { 0 };
 
-	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
-	const int CMD_NSPAGES = _cmd_nspages(vblk->nblks,
-			nvm_dev_get_read_naddrs_max(vblk->dev) / SPAGE_NADDRS);
+	const size_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const size_t unit_nbytes = WS_OPT * geo->l.nbytes;
+	const size_t ndata = vblk->nblks - 1;
 
-	const int ALIGN = SPAGE_NADDRS * geo->sector_nbytes;
-	const int NTHREADS = vblk->nblks < CMD_NSPAGES ? 1 : vblk->nblks / CMD_NSPAGES;
+	const size_t rnd = (job->bgn + item) / vblk->nblks;
+	const size_t rnd_idx = item / vblk->nblks;
+	const size_t chunk = (job->bgn + item) % vblk->nblks;
 
-	const size_t bgn = offset / ALIGN;
-	const size_t end = bgn + (count / ALIGN);
+	struct nvm_addr addrs[WS_OPT];
+	char *buf_off;
 
-	if (offset + count > vblk->nbytes) {		// Check bounds
-		errno = EINVAL;
-		return -1;
+	if (chunk == vblk_parity_chunk(vblk, rnd)) {
+		buf_off = job->parity + rnd_idx * unit_nbytes;
+
+		memset(buf_off, 0, unit_nbytes);
+		for (size_t unit = 0; unit < ndata; ++unit) {
+			vblk_xor(buf_off, job->pad ? job->buf : job->buf +
+				 (rnd_idx * ndata + unit) * unit_nbytes,
+				 unit_nbytes);
+		}
+	} else {
+		const size_t unit = (chunk + vblk->nblks -
+				     vblk_parity_chunk(vblk, rnd) - 1) %
+				    vblk->nblks;
+
+		buf_off = job->pad ? job->buf : job->buf +
+			  (rnd_idx * ndata + unit) * unit_nbytes;
 	}
 
-	if ((count % ALIGN) || (offset % ALIGN)) {	// Check align
-		errno = EINVAL;
-		return -1;
+	for (size_t idx = 0; idx < WS_OPT; ++idx) {
+		addrs[idx].val = vblk->blks[chunk].val;
+		addrs[idx].l.sectr = rnd * WS_OPT + idx;
 	}
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
-		struct nvm_ret ret = { 0 };
+	return nvm_cmd_write(vblk->dev, addrs, WS_OPT, buf_off, NULL,
+			     job->flags, &ret) ? 1 : 0;
+}
+
+static inline ssize_t vblk_parity_pwrite(struct nvm_vblk *vblk,
+					 const void *buf, size_t count,
+					 size_t offset)
+{
+	const size_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const size_t unit_nbytes = WS_OPT * geo->l.nbytes;
+	const size_t stripe_nbytes = unit_nbytes * (vblk->nblks - 1);
+	const size_t nrnds = count / stripe_nbytes;
 
-		const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
-		const int naddrs = nspages * SPAGE_NADDRS;
+	const int NTHREADS = NVM_MIN(vblk->nblks, nrnds * vblk->nblks);
 
-		struct nvm_addr addrs[naddrs];
-		char *buf_off;
+	// One item per chunk of every stripe
+	struct vblk_job job = {
+		.vblk = vblk,
+		.buf = (char *)buf,
+		.bgn = (offset / stripe_nbytes) * vblk->nblks,
+		.end = (offset / stripe_nbytes + nrnds) * vblk->nblks,
+		.cmd_n = 1,
+		.flags = (vblk->flags & ~NVM_CMD_ASYNC) | NVM_CMD_SYNC,
+	};
+	int err;
 
-		buf_off = (char*)buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
+	if ((count % stripe_nbytes) || (offset % stripe_nbytes)) {
+		NVM_DEBUG("FAILED: unaligned count: %zu or offset: %zu",
+			  count, offset);
+		errno = EINVAL;
+		return -1;
+	}
+	if (offset + count > vblk->nbytes) {
+		NVM_DEBUG("FAILED: out of bounds");
+		errno = EINVAL;
+		return -1;
+	}
+	if (nvm_dev_get_meta_mode(vblk->dev) != NVM_META_MODE_NONE) {
+		NVM_DEBUG("FAILED: sector metadata is not written with parity");
+		errno = EINVAL;
+		return -1;
+	}
+	if (!nrnds)
+		return 0;
 
-		for (int i = 0; i < naddrs; ++i) {
-			const int spg = off + (i / SPAGE_NADDRS);
-			const int idx = spg % vblk->nblks;
-			const int pg = (spg / vblk->nblks) % geo->npages;
+	job.parity = nvm_buf_alloc(vblk->dev, nrnds * unit_nbytes, NULL);
+	if (!job.parity) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc(parity)");
+		errno = ENOMEM;
+		return -1;
+	}
 
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pg = pg;
-			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
-			addrs[i].g.sec = i % geo->nsectors;
+	if (!buf) {	// Allocate and use a padding buffer
+		job.buf = nvm_buf_alloc(vblk->dev, unit_nbytes, NULL);
+		if (!job.buf) {
+			nvm_buf_free(vblk->dev, job.parity);
+			NVM_DEBUG("FAILED: nvm_buf_alloc(pad)");
+			errno = ENOMEM;
+			return -1;
 		}
+		nvm_buf_fill(job.buf, unit_nbytes);
+		job.pad = 1;
+	}
 
-		const ssize_t err = nvm_cmd_read(vblk->dev, addrs, naddrs,
-						 buf_off, NULL, PMODE, &ret);
-		if (err)
-			++nerr;
+	// One ordered queue per chunk, keeping the writes to a chunk sequential
+	err = vblk_job_run(&job, vblk_parity_pwrite_cmd, vblk->nblks, NTHREADS,
+			   NVM_POOL_ORDERED);
 
-		#pragma omp ordered
-		{}
-	}
+	if (job.pad)
+		nvm_buf_free(vblk->dev, job.buf);
+	nvm_buf_free(vblk->dev, job.parity);
 
-	if (nerr) {
-		errno = EIO;
-		return -1;
+	if (err) {
+		NVM_DEBUG("FAILED: nvm_cmd_write");
+		return -1;		// Propagate errno
 	}
 
 	return count;
 }
 
-ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
-		       size_t offset)
+/**
+ * Reconstruct data write-unit 'wunit' into 'buf' from the other chunks of its
+ * stripe
+ */
+static int vblk_parity_rebuild(struct nvm_vblk *vblk, size_t wunit, char *buf,
+			       int flags)
 {
-	const int verid = nvm_dev_get_verid(nvm_vblk_get_dev(vblk));
+	const size_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const size_t unit_nbytes = WS_OPT * geo->l.nbytes;
+	const size_t rnd = wunit / (vblk->nblks - 1);
+	const size_t lost = vblk_parity_data_chunk(vblk, wunit);
+	struct nvm_addr addrs[WS_OPT];
+	char *unit_buf;
+	int err = 0;
+
+	unit_buf = nvm_buf_alloc(vblk->dev, unit_nbytes, NULL);
+	if (!unit_buf) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return -1;
+	}
 
-	switch (verid) {
-	case NVM_SPEC_VERID_12:
-		return vblk_pread_s12(vblk, buf, count, offset);
+	memset(buf, 0, unit_nbytes);
+	for (int chunk = 0; (!err) && (chunk < vblk->nblks); ++chunk) {
+		if ((size_t)chunk == lost)
+			continue;
 
-	case NVM_SPEC_VERID_20:
-		if (vblk->flags & NVM_CMD_ASYNC) {
-			return vblk_async_pread_s20(vblk, buf, count, offset);
-		} else {
-			return vblk_sync_pread_s20(vblk, buf, count, offset);
+		for (size_t idx = 0; idx < WS_OPT; ++idx) {
+			addrs[idx].val = vblk->blks[chunk].val;
+			addrs[idx].l.sectr = rnd * WS_OPT + idx;
 		}
 
-	default:
-		NVM_DEBUG("FAILED: unsupported verid: %d", verid);
-		errno = ENOSYS;
+		err = nvm_cmd_read(vblk->dev, addrs, WS_OPT, unit_buf, NULL,
+				   flags, NULL);
+		if (!err)
+			vblk_xor(buf, unit_buf, unit_nbytes);
+	}
+
+	nvm_buf_free(vblk->dev, unit_buf);
+
+	if (err) {
+		NVM_DEBUG("FAILED: more than one chunk of stripe: %zu", rnd);
+		errno = EIO;
 		return -1;
 	}
+
+	return 0;
 }
 
-ssize_t nvm_vblk_read(struct nvm_vblk *vblk, void *buf, size_t count)
+/**
+ * Read one data write-unit, reconstructing it from the stripe when the read
+ * fails, after a failure the chunk is read by reconstruction until that fails
+ */
+static int vblk_parity_pread_cmd(void *arg, size_t item)
 {
-	ssize_t nbytes = nvm_vblk_pread(vblk, buf, count, vblk->pos_read);
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
 
-	if (nbytes < 0)
-		return nbytes;		// Propagate `errno`
+	const size_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const size_t wunit = job->bgn + item;
+	const size_t chunk = vblk_parity_data_chunk(vblk, wunit);
+	const size_t rnd = wunit / (vblk->nblks - 1);
+	char *buf_off = job->buf + item * WS_OPT * geo->l.nbytes;
 
-	vblk->pos_read += nbytes;	// All is good, increment read position
+	struct nvm_addr addrs[WS_OPT];
+	int degraded = (int)chunk + 1;
 
-	return nbytes;			// Return number of bytes read
-}
+	for (size_t idx = 0; idx < WS_OPT; ++idx) {
+		addrs[idx].val = vblk->blks[chunk].val;
+		addrs[idx].l.sectr = rnd * WS_OPT + idx;
+	}
 
-static inline ssize_t vblk_copy_s20(struct nvm_vblk *src, struct nvm_vblk *dst)
-{
-	size_t nerr = 0;
+	if (atomic_load(&vblk->parity_degraded) != degraded) {
+		if (!nvm_cmd_read(vblk->dev, addrs, WS_OPT, buf_off, NULL,
+				  job->flags, NULL))
+			return 0;
 
-	const size_t offset = 0;
-	const size_t count = src->nbytes;
+		NVM_DEBUG("FAILED: nvm_cmd_read, chunk: %zu, rebuilding",
+			  chunk);
+		atomic_store(&vblk->parity_degraded, degraded);
 
-	const uint32_t WS_MIN = nvm_dev_get_ws_min(src->dev);
+		return vblk_parity_rebuild(vblk, wunit, buf_off,
+					   job->flags) ? 1 : 0;
+	}
 
-	const struct nvm_geo *geo = nvm_dev_get_geo(src->dev);
-	const size_t nchunks = src->nblks;
+	if (!vblk_parity_rebuild(vblk, wunit, buf_off, job->flags))
+		return 0;
 
-	const size_t sectr_nbytes = geo->l.nbytes;
-	const size_t nsectr = count / sectr_nbytes;
+	// Another chunk of the stripe failed, the degraded one may read again
+	if (nvm_cmd_read(vblk->dev, addrs, WS_OPT, buf_off, NULL, job->flags,
+			 NULL))
+		return 1;
 
-	const size_t sectr_bgn = offset / sectr_nbytes;
-	const size_t sectr_end = sectr_bgn + (count / sectr_nbytes) - 1;
+	atomic_compare_exchange_strong(&vblk->parity_degraded, &degraded, 0);
 
-	const size_t cmd_nsectr_max = (NVM_NADDR_MAX / WS_MIN) * WS_MIN;
+	return 0;
+}
 
-	if (nsectr % WS_MIN) {
-		NVM_DEBUG("FAILED: unaligned nsectr: %zu", nsectr);
+static inline ssize_t vblk_parity_pread(struct nvm_vblk *vblk, void *buf,
+					size_t count, size_t offset)
+{
+	const size_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const size_t unit_nbytes = WS_OPT * geo->l.nbytes;
+	const size_t nunits = count / unit_nbytes;
+
+	const int NTHREADS = NVM_MIN(vblk->nblks, nunits);
+
+	// One item per data write-unit
+	struct vblk_job job = {
+		.vblk = vblk,
+		.buf = buf,
+		.bgn = offset / unit_nbytes,
+		.end = offset / unit_nbytes + nunits,
+		.cmd_n = 1,
+		.flags = (vblk->flags & ~NVM_CMD_ASYNC) | NVM_CMD_SYNC,
+	};
+
+	if ((count % unit_nbytes) || (offset % unit_nbytes)) {
+		NVM_DEBUG("FAILED: unaligned count: %zu or offset: %zu",
+			  count, offset);
 		errno = EINVAL;
 		return -1;
 	}
-	if (sectr_bgn % WS_MIN) {
-		NVM_DEBUG("FAILED: unaligned sectr_bgn: %zu", sectr_bgn);
+	if (offset + count > vblk->nbytes) {
+		NVM_DEBUG("FAILED: out of bounds");
 		errno = EINVAL;
 		return -1;
 	}
+	if (!nunits)
+		return 0;
 
-	for (size_t sectr_ofz = sectr_bgn; sectr_ofz <= sectr_end; sectr_ofz += cmd_nsectr_max) {
-		struct nvm_ret ret = { 0 };
+	if (vblk_job_run(&job, vblk_parity_pread_cmd, vblk->nblks, NTHREADS,
+			 0)) {
+		NVM_DEBUG("FAILED: nvm_cmd_read");
+		return -1;		// Propagate errno
+	}
 
-		const size_t cmd_nsectr = NVM_MIN(sectr_end - sectr_ofz + 1, cmd_nsectr_max);
+	return count;
+}
 
-		struct nvm_addr addrs_src[cmd_nsectr];
-		struct nvm_addr addrs_dst[cmd_nsectr];
+ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
+			size_t offset)
+{
+	const int verid = nvm_dev_get_verid(nvm_vblk_get_dev(vblk));
 
-		for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
-			const size_t sectr = sectr_ofz + idx;
-			const size_t wunit = sectr / WS_MIN;
-			const size_t rnd = wunit / nchunks;
+	if (vblk->ra_nwins && vblk_ra_drop(vblk))
+		return -1;		// Propagate errno
 
-			const size_t chunk = wunit % nchunks;
-			const size_t chunk_sectr = sectr % WS_MIN + rnd * WS_MIN;
+	if (vblk->parity)
+		return vblk_parity_pwrite(vblk, buf, count, offset);
 
-			addrs_src[idx].val = src->blks[chunk].val;
-			addrs_src[idx].l.sectr = chunk_sectr;
+	switch (verid) {
+	case NVM_SPEC_VERID_12:
+		return vblk_pwrite_s12(vblk, buf, count, offset);
 
-			addrs_dst[idx].val = dst->blks[chunk].val;
-			addrs_dst[idx].l.sectr = chunk_sectr;
+	case NVM_SPEC_VERID_20:
+		if (vblk->flags & NVM_CMD_ASYNC) {
+			return vblk_async_pwrite_s20(vblk, buf, count, offset);
+		} else {
+			return vblk_sync_pwrite_s20(vblk, buf, count, offset);
 		}
 
-		const ssize_t err = nvm_cmd_copy(src->dev, addrs_src,
-						 addrs_dst, cmd_nsectr,
-						 NVM_VBLK_CMD_OPTS, &ret);
-		if (err)
-			++nerr;
-	}
-
-	if (nerr) {
-		NVM_DEBUG("FAILED: nvm_cmd_write, nerr(%zu)", nerr);
-		errno = EIO;
+	default:
+		NVM_DEBUG("FAILED: unsupported verid: %d", verid);
+		errno = ENOSYS;
 		return -1;
 	}
+}
 
-	return count;
+/**
+ * Write the whole multiples of the write alignment held by the write buffer,
+ * moving the remainder to the front of the buffer
+ */
+static inline int vblk_wbuf_emit(struct nvm_vblk *vblk, size_t align)
+{
+	const size_t nbytes = (vblk->wbuf_len / align) * align;
+
+	if (!nbytes)
+		return 0;
+
+	if (nvm_vblk_pwrite(vblk, vblk->wbuf, nbytes, vblk->pos_write) < 0)
+		return -1;		// Propagate errno
+
+	vblk->pos_write += nbytes;
+	vblk->wbuf_len -= nbytes;
+	memmove(vblk->wbuf, vblk->wbuf + nbytes, vblk->wbuf_len);
+
+	return 0;
 }
 
-ssize_t nvm_vblk_copy(struct nvm_vblk *src, struct nvm_vblk *dst,
-		      int NVM_UNUSED(flags))
+static inline ssize_t vblk_wbuf_write(struct nvm_vblk *vblk, const void *buf,
+				      size_t count)
 {
-	const int verid = nvm_dev_get_verid(nvm_vblk_get_dev(src));
+	const size_t align = vblk_write_align(vblk);
+	size_t done = 0;
 
-	if (src->dev != dst->dev) {
-		NVM_DEBUG("FAILED: unsupported cross device copy");
-		errno = ENOSYS;
+	if (vblk->pos_write + vblk->wbuf_len + count > vblk->nbytes) {
+		NVM_DEBUG("FAILED: out of bounds, count: %zu", count);
+		errno = EINVAL;
 		return -1;
 	}
 
-	if (src->nblks != dst->nblks) {
-		NVM_DEBUG("FAILED: unbalanced vblks");
-		errno = ENOSYS;
-		return -1;
-	}
+	// The stream is aligned, pass the aligned part through without copying
+	if ((!vblk->wbuf_len) && (count >= align)) {
+		done = (count / align) * align;
 
-	if (src->nbytes != dst->nbytes) {
-		NVM_DEBUG("FAILED: unbalanced vblks");
-		errno = ENOSYS;
-		return -1;
+		if (nvm_vblk_pwrite(vblk, buf, done, vblk->pos_write) < 0)
+			return -1;	// Propagate errno
+
+		vblk->pos_write += done;
 	}
 
-	switch (verid) {
-	case NVM_SPEC_VERID_20:
-		return vblk_copy_s20(src, dst);
+	while (done < count) {
+		const size_t room = vblk->wbuf_nbytes - vblk->wbuf_len;
+		const size_t nbytes = (count - done) < room ? count - done : room;
 
-	case NVM_SPEC_VERID_12:
-		NVM_DEBUG("FAILED: not implemented, verid: %d", verid);
-		errno = ENOSYS;
-		return -1;
+		memcpy(vblk->wbuf + vblk->wbuf_len, (const char *)buf + done,
+		       nbytes);
+		vblk->wbuf_len += nbytes;
 
-	default:
-		NVM_DEBUG("FAILED: unsupported, verid: %d", verid);
-		errno = ENOSYS;
-		return -1;
+		// Only the bytes taken before the failing write are accounted
+		// for, the write position and buffer stay consistent with them
+		if (vblk_wbuf_emit(vblk, align)) {
+			vblk->wbuf_len -= nbytes;
+			NVM_DEBUG("FAILED: vblk_wbuf_emit, done: %zu", done);
+			return done ? (ssize_t)done : -1;
+		}
+
+		done += nbytes;
 	}
-}
 
-struct nvm_addr *nvm_vblk_get_addrs(struct nvm_vblk *vblk)
-{
-	return vblk->blks;
+	return count;
 }
 
-int nvm_vblk_get_naddrs(struct nvm_vblk *vblk)
+ssize_t nvm_vblk_flush(struct nvm_vblk *vblk)
 {
-	return vblk->nblks;
-}
+	const size_t align = vblk_write_align(vblk);
+	size_t pad_nbytes;
 
-size_t nvm_vblk_get_nbytes(struct nvm_vblk *vblk)
-{
+	if (!vblk->wbuf_len)
+		return 0;
+
+	pad_nbytes = align - vblk->wbuf_len;
+	memset(vblk->wbuf + vblk->wbuf_len, 0, pad_nbytes);
+
+	if (nvm_vblk_pwrite(vblk, vblk->wbuf, align, vblk->pos_write) < 0)
+		return -1;		// Propagate errno
+
+	vblk->pos_write += align;
+	vblk->wbuf_len = 0;
+
+	return pad_nbytes;
+}
+
+ssize_t nvm_vblk_write(struct nvm_vblk *vblk, const void *buf, size_t count)
+{
+	ssize_t nbytes;
+
+	if (vblk->wbuf) {
+		if (buf)
+			return vblk_wbuf_write(vblk, buf, count);
+
+		if (nvm_vblk_flush(vblk) < 0)	// Padding starts after the
+			return -1;		// buffered data
+	}
+
+	nbytes = nvm_vblk_pwrite(vblk, buf, count, vblk->pos_write);
+
+	if (nbytes < 0)
+		return nbytes;		// Propagate errno
+
+	vblk->pos_write += nbytes;	// All is good, increment write position
+
+	return nbytes;			// Return number of bytes written
+}
+
+ssize_t nvm_vblk_pad(struct nvm_vblk *vblk)
+{
+	if (nvm_vblk_flush(vblk) < 0)
+		return -1;		// Propagate errno
+
+	return nvm_vblk_write(vblk, NULL, vblk->nbytes - vblk->pos_write);
+}
+
+static int vblk_pread_s12_cmd(void *arg, size_t item)
+{
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	struct nvm_ret ret = { 0 };
+
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
+
+	const size_t off = job->bgn + item * job->cmd_n;
+	const int nspages = NVM_MIN(job->cmd_n, job->end - off);
+	const int naddrs = nspages * SPAGE_NADDRS;
+
+	struct nvm_addr addrs[naddrs];
+	char *buf_off;
+
+	buf_off = job->buf + (off - job->bgn) * geo->sector_nbytes * SPAGE_NADDRS;
+
+	for (int i = 0; i < naddrs; ++i) {
+		const int spg = off + (i / SPAGE_NADDRS);
+		const int idx = spg % vblk->nblks;
+		const int pg = (spg / vblk->nblks) % geo->npages;
+
+		addrs[i].ppa = vblk->blks[idx].ppa;
+		addrs[i].g.pg = pg;
+		addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+		addrs[i].g.sec = i % geo->nsectors;
+	}
+
+	return nvm_cmd_read(vblk->dev, addrs, naddrs, buf_off, NULL,
+			    job->flags, &ret) ? 1 : 0;
+}
+
+static inline ssize_t vblk_pread_s12(struct nvm_vblk *vblk, void *buf,
+				     size_t count, size_t offset)
+{
+	const int PMODE = nvm_dev_get_pmode(vblk->dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
+	const int CMD_NSPAGES = _cmd_nspages(vblk->nblks,
+			nvm_dev_get_read_naddrs_max(vblk->dev) / SPAGE_NADDRS);
+
+	const int ALIGN = SPAGE_NADDRS * geo->sector_nbytes;
+	const int NTHREADS = vblk->nblks < CMD_NSPAGES ? 1 : vblk->nblks / CMD_NSPAGES;
+
+	const size_t bgn = offset / ALIGN;
+	const size_t end = bgn + (count / ALIGN);
+
+	struct vblk_job job = {
+		.vblk = vblk,
+		.buf = buf,
+		.bgn = bgn,
+		.end = end,
+		.cmd_n = CMD_NSPAGES,
+		.flags = PMODE,
+	};
+
+	if (offset + count > vblk->nbytes) {		// Check bounds
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((count % ALIGN) || (offset % ALIGN)) {	// Check align
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (vblk_job_run(&job, vblk_pread_s12_cmd, NTHREADS, NTHREADS, 0))
+		return -1;		// Propagate errno
+
+	return count;
+}
+
+ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
+		       size_t offset)
+{
+	const int verid = nvm_dev_get_verid(nvm_vblk_get_dev(vblk));
+
+	if (vblk->parity)
+		return vblk_parity_pread(vblk, buf, count, offset);
+
+	switch (verid) {
+	case NVM_SPEC_VERID_12:
+		return vblk_pread_s12(vblk, buf, count, offset);
+
+	case NVM_SPEC_VERID_20:
+		if (vblk->flags & NVM_CMD_ASYNC) {
+			return vblk_async_pread_s20(vblk, buf, count, offset);
+		} else {
+			return vblk_sync_pread_s20(vblk, buf, count, offset);
+		}
+
+	default:
+		NVM_DEBUG("FAILED: unsupported verid: %d", verid);
+		errno = ENOSYS;
+		return -1;
+	}
+}
+
+ssize_t nvm_vblk_read(struct nvm_vblk *vblk, void *buf, size_t count)
+{
+	ssize_t nbytes = vblk->ra_nwins ? vblk_ra_read(vblk, buf, count) :
+			 nvm_vblk_pread(vblk, buf, count, vblk->pos_read);
+
+	if (nbytes < 0)
+		return nbytes;		// Propagate `errno`
+
+	vblk->pos_read += nbytes;	// All is good, increment read position
+
+	return nbytes;			// Return number of bytes read
+}
+
+/**
+ * Returns the index of the segment of the job holding byte 'pos' of the I/O
+ */
+static inline int vblk_iov_seg(const struct vblk_job *job, size_t pos)
+{
+	int lo = 0, hi = job->iovcnt - 1;
+
+	while (lo < hi) {		// Last segment starting at or before 'pos'
+		const int mid = (lo + hi + 1) / 2;
+
+		if (job->iov_ofz[mid] <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	while (job->iov_ofz[lo + 1] <= pos)	// Skip empty segments
+		++lo;
+
+	return lo;
+}
+
+/**
+ * Copy 'nbytes' between 'buf' and the segments of the job at byte 'pos' of the
+ * I/O, into the segments when 'to_iov' is set
+ */
+static inline void vblk_iov_copy(const struct vblk_job *job, size_t pos,
+				 char *buf, size_t nbytes, int to_iov)
+{
+	for (int seg = vblk_iov_seg(job, pos); nbytes; ++seg) {
+		char *base = (char *)job->iov[seg].iov_base + pos -
+			     job->iov_ofz[seg];
+		const size_t n = NVM_MIN(nbytes, job->iov_ofz[seg + 1] - pos);
+
+		if (to_iov)
+			memcpy(base, buf, n);
+		else
+			memcpy(buf, base, n);
+
+		buf += n;
+		pos += n;
+		nbytes -= n;
+	}
+}
+
+/**
+ * Describe the 'nbytes' of the segments of the job at byte 'pos' of the I/O by
+ * an SGL
+ *
+ * @returns The SGL on success, NULL on error
+ */
+static struct nvm_sgl *vblk_iov_sgl(const struct vblk_job *job, size_t pos,
+				    size_t nbytes)
+{
+	struct nvm_dev *dev = job->vblk->dev;
+	struct nvm_sgl *sgl = nvm_sgl_create(dev, 1);
+
+	if (!sgl)
+		return NULL;
+
+	for (int seg = vblk_iov_seg(job, pos); nbytes; ++seg) {
+		char *base = (char *)job->iov[seg].iov_base + pos -
+			     job->iov_ofz[seg];
+		const size_t n = NVM_MIN(nbytes, job->iov_ofz[seg + 1] - pos);
+
+		if (!n)
+			continue;
+
+		if (nvm_sgl_add(dev, sgl, base, n)) {
+			nvm_sgl_destroy(dev, sgl);
+			return NULL;
+		}
+
+		pos += n;
+		nbytes -= n;
+	}
+
+	return sgl;
+}
+
+/**
+ * Execute the command of a stripe of an iovec job
+ *
+ * With NVM_CMD_SGL the stripe is a single command described by an SGL.
+ * Otherwise the stripe is split at segment boundaries into commands of whole
+ * units, minimum writes or sectors, a unit straddling a boundary goes via a
+ * bounce buffer.
+ */
+static int vblk_iov_cmd(void *arg, size_t item)
+{
+	struct vblk_job *job = arg;
+	struct nvm_vblk *vblk = job->vblk;
+	struct nvm_dev *dev = vblk->dev;
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(dev);
+	const size_t sectr_nbytes = geo->l.nbytes;
+	const size_t stripe = job->bgn / WS_OPT + item;
+	const size_t chunk = stripe % vblk->nblks;
+	const size_t chunk_sectr = (stripe / vblk->nblks) * WS_OPT;
+	const size_t stripe_pos = item * WS_OPT * sectr_nbytes;
+	const size_t unit = job->iov_unit * sectr_nbytes;
+
+	struct nvm_addr addrs[WS_OPT];
+	char *bounce = NULL;
+	int err = 0;
+
+	for (size_t idx = 0; idx < WS_OPT; ++idx) {
+		addrs[idx].ppa = vblk->blks[chunk].ppa;
+		addrs[idx].l.sectr = chunk_sectr + idx;
+	}
+
+	if (job->flags & NVM_CMD_SGL) {
+		struct nvm_sgl *sgl;
+
+		sgl = vblk_iov_sgl(job, stripe_pos, WS_OPT * sectr_nbytes);
+		if (sgl) {
+			err = job->write ?
+				nvm_cmd_write(dev, addrs, WS_OPT, sgl, job->meta,
+					      job->flags, NULL) :
+				nvm_cmd_read(dev, addrs, WS_OPT, sgl, NULL,
+					     job->flags, NULL);
+			nvm_sgl_destroy(dev, sgl);
+
+			return err ? 1 : 0;
+		}
+
+		NVM_DEBUG("FAILED: vblk_iov_sgl, splitting");
+	}
+
+	for (size_t done = 0; done < WS_OPT * sectr_nbytes && !err;) {
+		const size_t pos = stripe_pos + done;
+		const int seg = vblk_iov_seg(job, pos);
+		const size_t avail = NVM_MIN(job->iov_ofz[seg + 1] - pos,
+					     WS_OPT * sectr_nbytes - done);
+		const int flags = job->flags & ~NVM_CMD_MASK_PLOD;
+		size_t nbytes = (avail / unit) * unit;
+		char *buf = (char *)job->iov[seg].iov_base + pos -
+			    job->iov_ofz[seg];
+
+		if (!nbytes) {		// The unit straddles segments
+			if (!bounce)
+				bounce = nvm_buf_alloc(dev, unit, NULL);
+			if (!bounce) {
+				NVM_DEBUG("FAILED: nvm_buf_alloc(bounce)");
+				err = -1;
+				break;
+			}
+			if (job->write)
+				vblk_iov_copy(job, pos, bounce, unit, 0);
+
+			buf = bounce;
+			nbytes = unit;
+		}
+
+		err = job->write ?
+			nvm_cmd_write(dev, addrs + done / sectr_nbytes,
+				      nbytes / sectr_nbytes, buf, job->meta,
+				      flags | NVM_CMD_PRP, NULL) :
+			nvm_cmd_read(dev, addrs + done / sectr_nbytes,
+				     nbytes / sectr_nbytes, buf, NULL,
+				     flags | NVM_CMD_PRP, NULL);
+
+		if (!err && !job->write && buf == bounce)
+			vblk_iov_copy(job, pos, bounce, unit, 1);
+
+		done += nbytes;
+	}
+
+	nvm_buf_free(dev, bounce);
+
+	return err ? 1 : 0;
+}
+
+/**
+ * Copy the segments into a contiguous buffer and write/read it with
+ * nvm_vblk_pwrite/nvm_vblk_pread, for virtual blocks whose commands do not
+ * map onto stripes of a single chunk
+ */
+static inline ssize_t vblk_iov_bounce(struct nvm_vblk *vblk,
+				      struct vblk_job *job, size_t count,
+				      size_t offset)
+{
+	char *buf = nvm_buf_alloc(vblk->dev, count, NULL);
+	ssize_t nbytes;
+
+	if (!buf) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (job->write) {
+		vblk_iov_copy(job, 0, buf, count, 0);
+		nbytes = nvm_vblk_pwrite(vblk, buf, count, offset);
+	} else {
+		nbytes = nvm_vblk_pread(vblk, buf, count, offset);
+		if (nbytes > 0)
+			vblk_iov_copy(job, 0, buf, count, 1);
+	}
+
+	nvm_buf_free(vblk->dev, buf);
+
+	return nbytes;		// Propagate errno
+}
+
+static ssize_t vblk_iov_io(struct nvm_vblk *vblk, const struct iovec *iov,
+			   int iovcnt, size_t offset, int write)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const uint32_t WS_MIN = nvm_dev_get_ws_min(vblk->dev);
+	const size_t sectr_nbytes = geo->l.nbytes;
+	const size_t nchunks = vblk->nblks;
+
+	struct vblk_job job = {
+		.vblk = vblk,
+		.write = write,
+		.iov = iov,
+		.iovcnt = iovcnt,
+		.flags = (vblk->flags & ~(NVM_CMD_MASK_IOMD | NVM_CMD_MASK_PLOD)) |
+			 NVM_CMD_SYNC |
+			 ((vblk->dev->cmd_opts & NVM_CMD_SGL) ? NVM_CMD_SGL :
+			  NVM_CMD_PRP),
+	};
+	size_t count = 0;
+	size_t nsectr;
+	ssize_t res = -1;
+	ssize_t err;
+
+	if (iovcnt < 0 || (iovcnt && !iov)) {
+		NVM_DEBUG("FAILED: invalid iov/iovcnt");
+		errno = EINVAL;
+		return -1;
+	}
+
+	job.iov_ofz = malloc((iovcnt + 1) * sizeof(*job.iov_ofz));
+	if (!job.iov_ofz) {
+		NVM_DEBUG("FAILED: malloc");
+		errno = ENOMEM;
+		return -1;
+	}
+	for (int seg = 0; seg < iovcnt; ++seg) {
+		job.iov_ofz[seg] = count;
+		count += iov[seg].iov_len;
+	}
+	job.iov_ofz[iovcnt] = count;
+
+	if (!count) {
+		res = 0;
+		goto out;
+	}
+
+	if (vblk->parity || nvm_dev_get_verid(vblk->dev) != NVM_SPEC_VERID_20) {
+		res = vblk_iov_bounce(vblk, &job, count, offset);
+		goto out;
+	}
+
+	nsectr = count / sectr_nbytes;
+	if ((count % sectr_nbytes) || (nsectr % WS_OPT)) {
+		NVM_DEBUG("FAILED: unaligned count: %zu", count);
+		errno = EINVAL;
+		goto out;
+	}
+	if ((offset % sectr_nbytes) || ((offset / sectr_nbytes) % WS_OPT)) {
+		NVM_DEBUG("FAILED: unaligned offset: %zu", offset);
+		errno = EINVAL;
+		goto out;
+	}
+	if (offset + count > vblk->nbytes) {
+		NVM_DEBUG("FAILED: out of bounds");
+		errno = EINVAL;
+		goto out;
+	}
+	// The LBD backend opens the device O_DIRECT, segments go to it as-is
+	if (nvm_dev_get_be_id(vblk->dev) == NVM_BE_LBD) {
+		for (int seg = 0; seg < iovcnt; ++seg) {
+			if (((uintptr_t)iov[seg].iov_base % sectr_nbytes) ||
+			    (iov[seg].iov_len % sectr_nbytes)) {
+				NVM_DEBUG("FAILED: unaligned iov[%d]", seg);
+				errno = EINVAL;
+				goto out;
+			}
+		}
+	}
+
+	job.bgn = offset / sectr_nbytes;
+	job.end = job.bgn + nsectr;
+	// Commands are split in units of the minimum write, or sector for reads
+	job.iov_unit = !write ? 1 : (WS_MIN && !(WS_OPT % WS_MIN)) ? WS_MIN :
+		       WS_OPT;
+
+	if (write) {
+		job.meta = vblk_meta_alloc(vblk, WS_OPT);
+		if (nvm_dev_get_meta_mode(vblk->dev) != NVM_META_MODE_NONE &&
+		    !job.meta)
+			goto out;	// Propagate errno
+	}
+
+	// One item per stripe, writes ordered per chunk like vblk_sync_pwrite
+	err = nvm_pool_run(vblk_iov_cmd, &job, nsectr / WS_OPT,
+			   NVM_MIN(nchunks, NVM_POOL_NQUEUES_MAX),
+			   NVM_MIN(nchunks, nsectr / WS_OPT),
+			   write ? NVM_POOL_ORDERED : 0);
+	nvm_buf_free(vblk->dev, job.meta);
+	if (err < 0)
+		goto out;	// Propagate errno
+	if (err) {
+		NVM_DEBUG("FAILED: nerr(%zd)", err);
+		errno = EIO;
+		goto out;
+	}
+
+	res = count;
+
+out:
+	free(job.iov_ofz);
+
+	return res;
+}
+
+ssize_t nvm_vblk_pwritev(struct nvm_vblk *vblk, const struct iovec *iov,
+			 int iovcnt, size_t offset)
+{
+	if (vblk->ra_nwins && vblk_ra_drop(vblk))
+		return -1;		// Propagate errno
+
+	return vblk_iov_io(vblk, iov, iovcnt, offset, 1);
+}
+
+ssize_t nvm_vblk_preadv(struct nvm_vblk *vblk, const struct iovec *iov,
+			int iovcnt, size_t offset)
+{
+	return vblk_iov_io(vblk, iov, iovcnt, offset, 0);
+}
+
+static void vblk_req_callback(struct nvm_ret *ret, void *opaque);
+
+/**
+ * Fail the stripes of the chunk of a failed write which are not yet submitted,
+ * they cannot be written in order, neither can those of later requests
+ */
+static inline void vblk_req_fail_chunk(struct nvm_vblk_req *req, size_t chunk)
+{
+	req->vblk->chunk_failed[chunk] = 1;
+
+	while (req->chunk_next[chunk] < req->nstripes) {
+		req->chunk_next[chunk] += req->vblk->nblks;
+		req->ncompleted += 1;
+		req->nerr += 1;
+	}
+}
+
+/**
+ * Submit stripe 's' of the request
+ *
+ * @returns 0 when submitted, 1 when the queue is full, -1 when the submission
+ * failed, the stripe is then accounted as completed with error
+ */
+static int vblk_req_submit_stripe(struct nvm_vblk_req *req, size_t s)
+{
+	struct nvm_vblk *vblk = req->vblk;
+	const size_t WS_OPT = nvm_dev_get_ws_opt(vblk->dev);
+	const size_t sectr_nbytes = nvm_dev_get_geo(vblk->dev)->l.nbytes;
+	const size_t stripe = req->stripe_bgn + s;
+	const size_t chunk = stripe % vblk->nblks;
+	const size_t chunk_off = (stripe / vblk->nblks) * WS_OPT;
+	char *bufp = req->buf + s * WS_OPT * sectr_nbytes;
+	struct nvm_ret *ret = &req->rets[s];
+	struct nvm_addr addrs[WS_OPT];
+	int err;
+
+	for (size_t i = 0; i < WS_OPT; ++i) {
+		addrs[i].val = vblk->blks[chunk].val;
+		addrs[i].l.sectr = chunk_off + i;
+	}
+
+	memset(ret, 0, sizeof(*ret));
+	ret->async.ctx = vblk->async_ctx;
+	ret->async.cb = vblk_req_callback;
+	ret->async.cb_arg = req;
+
+	err = req->write ?
+		nvm_cmd_write(vblk->dev, addrs, WS_OPT, bufp, NULL,
+			      vblk->flags, ret) :
+		nvm_cmd_read(vblk->dev, addrs, WS_OPT, bufp, NULL,
+			     vblk->flags, ret);
+	if (!err)
+		return 0;
+
+	if (errno == EAGAIN)
+		return 1;
+
+	NVM_DEBUG("FAILED: nvm_cmd_%s, errno: %d",
+		  req->write ? "write" : "read", errno);
+	req->ncompleted += 1;
+	req->nerr += 1;
+
+	return -1;
+}
+
+/**
+ * Whether a write request older than 'req' has stripes left for 'chunk'
+ */
+static inline int vblk_req_chunk_preceded(struct nvm_vblk_req *req, int chunk)
+{
+	for (struct nvm_vblk_req *older = req->vblk->reqs_write; older != req;
+	     older = older->wnext) {
+		if (older->chunk_next[chunk] < older->nstripes)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Submit what the queue and the write-order allows, stalls the request on the
+ * vblk when stripes are left which the queue or the order did not allow
+ */
+static void vblk_req_submit(struct nvm_vblk_req *req)
+{
+	struct nvm_vblk *vblk = req->vblk;
+	int stall = 0;
+
+	if (req->write) {
+		for (int chunk = 0; chunk < vblk->nblks; ++chunk) {
+			const size_t s = req->chunk_next[chunk];
+			int res;
+
+			if (s >= req->nstripes)
+				continue;
+			if (vblk->chunk_failed[chunk]) {
+				vblk_req_fail_chunk(req, chunk);
+				continue;
+			}
+			if (vblk->chunk_busy[chunk] ||
+			    vblk_req_chunk_preceded(req, chunk)) {
+				stall = 1;
+				continue;
+			}
+
+			res = vblk_req_submit_stripe(req, s);
+			if (res > 0) {
+				stall = 1;
+				break;
+			}
+
+			req->chunk_next[chunk] += vblk->nblks;
+			if (res < 0)
+				vblk_req_fail_chunk(req, chunk);
+			else
+				vblk->chunk_busy[chunk] = 1;
+		}
+	} else {
+		while (req->nsubmitted < req->nstripes) {
+			if (vblk_req_submit_stripe(req, req->nsubmitted) > 0) {
+				stall = 1;
+				break;
+			}
+			req->nsubmitted += 1;
+		}
+	}
+
+	if (stall && !req->stalled) {
+		req->stalled = 1;
+		req->next = vblk->reqs_stalled;
+		vblk->reqs_stalled = req;
+	}
+}
+
+static void vblk_req_unlink(struct nvm_vblk_req *req)
+{
+	struct nvm_vblk_req **link = &req->vblk->reqs_write;
+
+	while (*link && *link != req)
+		link = &(*link)->wnext;
+	if (*link)
+		*link = req->wnext;
+}
+
+/**
+ * Submit and, when every stripe has completed, finish the request, the user
+ * callback may free it
+ */
+static void vblk_req_progress(struct nvm_vblk_req *req)
+{
+	if (req->ncompleted < req->nstripes)
+		vblk_req_submit(req);
+
+	if (req->ncompleted < req->nstripes || req->done)
+		return;
+
+	req->done = 1;
+	req->vblk->nreqs -= 1;
+	if (req->write)
+		vblk_req_unlink(req);
+
+	if (req->cb)
+		req->cb(req, req->cb_arg);
+}
+
+/**
+ * Retry the requests which found the queue full
+ */
+static void vblk_req_kick(struct nvm_vblk *vblk)
+{
+	struct nvm_vblk_req *req = vblk->reqs_stalled;
+
+	vblk->reqs_stalled = NULL;
+
+	while (req) {
+		struct nvm_vblk_req *next = req->next;
+
+		req->stalled = 0;
+		vblk_req_progress(req);
+
+		req = next;
+	}
+}
+
+static void vblk_req_callback(struct nvm_ret *ret, void *opaque)
+{
+	struct nvm_vblk_req *req = opaque;
+	struct nvm_vblk *vblk = req->vblk;
+	const size_t s = ret - req->rets;
+	const size_t chunk = (req->stripe_bgn + s) % vblk->nblks;
+	const int stalled = req->stalled;
+
+	req->ncompleted += 1;
+	if (ret->status) {
+		NVM_DEBUG("FAILED: stripe: %zu, status: %u", s, ret->status);
+		req->nerr += 1;
+		if (req->write)
+			vblk_req_fail_chunk(req, chunk);
+	}
+	if (req->write)
+		vblk->chunk_busy[chunk] = 0;
+
+	// A stalled request is progressed, and possibly freed, by the kick
+	vblk_req_kick(vblk);
+	if (!stalled)
+		vblk_req_progress(req);
+}
+
+static struct nvm_vblk_req *vblk_req_alloc(struct nvm_vblk *vblk, int write,
+					   const void *buf, size_t count,
+					   size_t offset, nvm_vblk_req_cb cb,
+					   void *cb_arg)
+{
+	const size_t stripe_nbytes = nvm_dev_get_ws_opt(vblk->dev) *
+				     nvm_dev_get_geo(vblk->dev)->l.nbytes;
+	struct nvm_vblk_req *req;
+
+	if (nvm_dev_get_verid(vblk->dev) != NVM_SPEC_VERID_20) {
+		NVM_DEBUG("FAILED: unsupported verid");
+		errno = ENOSYS;
+		return NULL;
+	}
+	if (vblk->parity) {
+		NVM_DEBUG("FAILED: not supported with parity");
+		errno = ENOSYS;
+		return NULL;
+	}
+	if (!vblk->async_ctx) {
+		NVM_DEBUG("FAILED: no async. context, see nvm_vblk_set_async");
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!buf || !count || (count % stripe_nbytes) ||
+	    (offset % stripe_nbytes) || (offset + count > vblk->nbytes)) {
+		NVM_DEBUG("FAILED: buf: %p, count: %zu, offset: %zu",
+			  buf, count, offset);
+		errno = EINVAL;
+		return NULL;
+	}
+	if (write && vblk->wbuf_len) {
+		NVM_DEBUG("FAILED: write buffer holds data");
+		errno = EBUSY;
+		return NULL;
+	}
+
+	req = calloc(1, sizeof(*req));
+	if (!req) {
+		NVM_DEBUG("FAILED: calloc, errno: %d", errno);
+		return NULL;
+	}
+
+	req->vblk = vblk;
+	req->write = write;
+	req->buf = (char *)buf;
+	req->stripe_bgn = offset / stripe_nbytes;
+	req->nstripes = count / stripe_nbytes;
+	req->cb = cb;
+	req->cb_arg = cb_arg;
+
+	req->rets = calloc(req->nstripes, sizeof(*req->rets));
+	if (write)
+		req->chunk_next = calloc(vblk->nblks, sizeof(*req->chunk_next));
+	if (!req->rets || (write && !req->chunk_next)) {
+		NVM_DEBUG("FAILED: calloc, errno: %d", errno);
+		req->done = 1;
+		nvm_vblk_req_free(req);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	// First stripe of the request on each chunk
+	for (int chunk = 0; write && chunk < vblk->nblks; ++chunk) {
+		req->chunk_next[chunk] = (chunk + vblk->nblks -
+					  (req->stripe_bgn % vblk->nblks)) %
+					 vblk->nblks;
+	}
+
+	return req;
+}
+
+static struct nvm_vblk_req *vblk_req_start(struct nvm_vblk_req *req)
+{
+	struct nvm_vblk *vblk = req->vblk;
+
+	vblk->nreqs += 1;
+	if (req->write) {
+		struct nvm_vblk_req **link = &vblk->reqs_write;
+
+		while (*link)
+			link = &(*link)->wnext;
+		*link = req;
+	}
+
+	vblk_req_submit(req);
+
+	// Every submission failed, report it here rather than by callback
+	if (req->ncompleted == req->nstripes) {
+		vblk->nreqs -= 1;
+		if (req->write)
+			vblk_req_unlink(req);
+		req->done = 1;
+		nvm_vblk_req_free(req);
+		errno = EIO;
+		return NULL;
+	}
+
+	return req;
+}
+
+struct nvm_vblk_req *nvm_vblk_pwrite_async(struct nvm_vblk *vblk,
+					   const void *buf, size_t count,
+					   size_t offset, nvm_vblk_req_cb cb,
+					   void *cb_arg)
+{
+	struct nvm_vblk_req *req = vblk_req_alloc(vblk, 1, buf, count, offset,
+						  cb, cb_arg);
+
+	if (!req)
+		return NULL;	// Propagate errno
+
+	return vblk_req_start(req);
+}
+
+struct nvm_vblk_req *nvm_vblk_pread_async(struct nvm_vblk *vblk, void *buf,
+					  size_t count, size_t offset,
+					  nvm_vblk_req_cb cb, void *cb_arg)
+{
+	struct nvm_vblk_req *req = vblk_req_alloc(vblk, 0, buf, count, offset,
+						  cb, cb_arg);
+
+	if (!req)
+		return NULL;	// Propagate errno
+
+	return vblk_req_start(req);
+}
+
+int nvm_vblk_req_is_done(struct nvm_vblk_req *req)
+{
+	return req->done;
+}
+
+size_t nvm_vblk_req_get_nerr(struct nvm_vblk_req *req)
+{
+	return req->nerr;
+}
+
+int nvm_vblk_req_free(struct nvm_vblk_req *req)
+{
+	if (!req)
+		return 0;
+
+	if (!req->done) {
+		NVM_DEBUG("FAILED: request in flight");
+		errno = EBUSY;
+		return -1;
+	}
+
+	free(req->rets);
+	free(req->chunk_next);
+	free(req);
+
+	return 0;
+}
+
+int nvm_vblk_async_poke(struct nvm_vblk *vblk, uint32_t max)
+{
+	int nevents;
+
+	if (!vblk->async_ctx) {
+		NVM_DEBUG("FAILED: no async. context");
+		errno = EINVAL;
+		return -1;
+	}
+
+	nevents = nvm_async_poke(vblk->dev, vblk->async_ctx, max);
+	if (nevents < 0) {
+		NVM_DEBUG("FAILED: nvm_async_poke");
+		return -1;
+	}
+
+	vblk_req_kick(vblk);
+
+	return nevents;
+}
+
+int nvm_vblk_async_wait(struct nvm_vblk *vblk)
+{
+	if (!vblk->async_ctx) {
+		NVM_DEBUG("FAILED: no async. context");
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (vblk->nreqs) {
+		if (nvm_async_wait(vblk->dev, vblk->async_ctx) < 0) {
+			NVM_DEBUG("FAILED: nvm_async_wait");
+			return -1;
+		}
+
+		vblk_req_kick(vblk);
+	}
+
+	return 0;
+}
+
+/**
+ * Returns the bytes of a window of the read-ahead ring, a stripe across the
+ * blocks of the vblk
+ */
+static inline size_t vblk_ra_win(struct nvm_vblk *vblk)
+{
+	if (vblk->parity)	// The write alignment is a stripe already
+		return vblk_write_align(vblk);
+
+	return vblk_write_align(vblk) * vblk->nblks;
+}
+
+/**
+ * Whether windows of the read-ahead ring are read ahead by requests
+ */
+static inline int vblk_ra_async(struct nvm_vblk *vblk)
+{
+	return (vblk->flags & NVM_CMD_ASYNC) && vblk->async_ctx &&
+	       (!vblk->parity) &&
+	       (nvm_dev_get_verid(vblk->dev) == NVM_SPEC_VERID_20);
+}
+
+/**
+ * Returns the end of the windows the ring may hold, the write position rounded
+ * down to a window when the vblk is written by nvm_vblk_write, otherwise the
+ * vblk
+ */
+static inline size_t vblk_ra_extent(struct nvm_vblk *vblk)
+{
+	const size_t extent = vblk->pos_write ? vblk->pos_write : vblk->nbytes;
+
+	return (extent / vblk->ra_win) * vblk->ra_win;
+}
+
+/**
+ * Poke the async. context until the request reading window 'slot' is done,
+ * and free it; a failed read-ahead leaves the window empty, to be read on
+ * demand
+ */
+static int vblk_ra_reap(struct nvm_vblk *vblk, int slot)
+{
+	struct nvm_vblk_req *req = vblk->ra_reqs[slot];
+	size_t nerr;
+
+	while (!nvm_vblk_req_is_done(req)) {
+		const int nevents = nvm_vblk_async_poke(vblk, 0);
+
+		if (nevents < 0) {
+			NVM_DEBUG("FAILED: nvm_vblk_async_poke");
+			return -1;
+		}
+		if (!nevents)
+			sched_yield();
+	}
+
+	nerr = nvm_vblk_req_get_nerr(req);
+	nvm_vblk_req_free(req);
+
+	vblk->ra_reqs[slot] = NULL;
+	vblk->ra_state[slot] = nerr ? NVM_VBLK_RA_EMPTY : NVM_VBLK_RA_FULL;
+
+	if (nerr) {
+		NVM_DEBUG("INFO: read-ahead missed, slot: %d, nerr: %zu",
+			  slot, nerr);
+	}
+
+	return 0;
+}
+
+/**
+ * Drop the content of the read-ahead ring, reaping the requests in flight
+ */
+static int vblk_ra_drop(struct nvm_vblk *vblk)
+{
+	int err = 0;
+
+	for (int slot = 0; slot < vblk->ra_nwins; ++slot) {
+		if (vblk->ra_state[slot] == NVM_VBLK_RA_BUSY)
+			vblk_ra_reap(vblk, slot);
+
+		// A request which could not be reaped keeps its window
+		if (vblk->ra_reqs[slot]) {
+			err = 1;
+			continue;
+		}
+
+		vblk->ra_state[slot] = NVM_VBLK_RA_EMPTY;
+	}
+
+	vblk->ra_off = SIZE_MAX;
+	vblk->ra_head = 0;
+
+	return err ? -1 : 0;
+}
+
+/**
+ * Submit requests reading ahead into the empty windows of the ring, up to the
+ * extent, a window which fails to submit is left empty
+ */
+static void vblk_ra_issue(struct nvm_vblk *vblk)
+{
+	const size_t extent = vblk_ra_extent(vblk);
+
+	if (!vblk_ra_async(vblk))
+		return;
+
+	for (int i = 0; i < vblk->ra_nwins; ++i) {
+		const int slot = (vblk->ra_head + i) % vblk->ra_nwins;
+		const size_t off = vblk->ra_off + i * vblk->ra_win;
+
+		if (off + vblk->ra_win > extent)
+			break;
+		if (vblk->ra_state[slot] != NVM_VBLK_RA_EMPTY)
+			continue;
+
+		vblk->ra_reqs[slot] = nvm_vblk_pread_async(vblk,
+					vblk->ra_buf + slot * vblk->ra_win,
+					vblk->ra_win, off, NULL, NULL);
+		if (!vblk->ra_reqs[slot]) {
+			NVM_DEBUG("FAILED: nvm_vblk_pread_async");
+			break;
+		}
+
+		vblk->ra_state[slot] = NVM_VBLK_RA_BUSY;
+	}
+}
+
+/**
+ * Make the head window of the ring hold its stripe, reading it on demand when
+ * it was not read ahead
+ */
+static int vblk_ra_fill(struct nvm_vblk *vblk)
+{
+	const int head = vblk->ra_head;
+
+	if ((vblk->ra_state[head] == NVM_VBLK_RA_BUSY) &&
+	    vblk_ra_reap(vblk, head))
+		return -1;		// Propagate errno
+
+	if (vblk->ra_state[head] == NVM_VBLK_RA_FULL)
+		return 0;
+
+	if (nvm_vblk_pread(vblk, vblk->ra_buf + head * vblk->ra_win,
+			   vblk->ra_win, vblk->ra_off) < 0) {
+		NVM_DEBUG("FAILED: nvm_vblk_pread");
+		return -1;		// Propagate errno
+	}
+
+	vblk->ra_state[head] = NVM_VBLK_RA_FULL;
+
+	return 0;
+}
+
+/**
+ * Release the head window of the ring, it is read ahead again by
+ * vblk_ra_issue
+ */
+static int vblk_ra_advance(struct nvm_vblk *vblk)
+{
+	const int head = vblk->ra_head;
+
+	if ((vblk->ra_state[head] == NVM_VBLK_RA_BUSY) &&
+	    vblk_ra_reap(vblk, head))
+		return -1;		// Propagate errno
+
+	vblk->ra_state[head] = NVM_VBLK_RA_EMPTY;
+	vblk->ra_head = (head + 1) % vblk->ra_nwins;
+	vblk->ra_off += vblk->ra_win;
+
+	return 0;
+}
+
+/**
+ * Read without the ring, through a buffer holding the aligned span of the read
+ * when it is not aligned
+ */
+static ssize_t vblk_ra_bypass(struct nvm_vblk *vblk, void *buf, size_t count,
+			      size_t pos)
+{
+	const size_t align = vblk_write_align(vblk);
+	const size_t bgn = (pos / align) * align;
+	const size_t end = ((pos + count + align - 1) / align) * align;
+	ssize_t nbytes;
+	char *span;
+
+	if ((bgn == pos) && (end == pos + count))
+		return nvm_vblk_pread(vblk, buf, count, pos);
+
+	span = nvm_buf_alloc(vblk->dev, end - bgn, NULL);
+	if (!span) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	nbytes = nvm_vblk_pread(vblk, span, end - bgn, bgn);
+	if (nbytes >= 0) {
+		memcpy(buf, span + (pos - bgn), count);
+		nbytes = count;
+	}
+
+	nvm_buf_free(vblk->dev, span);
+
+	return nbytes;		// Propagate errno
+}
+
+/**
+ * nvm_vblk_read with read-ahead, returns 'count' or -1, the caller moves the
+ * read position
+ *
+ * The ring serves the reads of a stream, NVM_VBLK_RA_NSEQ reads in a row each
+ * starting where the one before it ended, and reads it holds already. Other
+ * reads bypass it.
+ */
+static ssize_t vblk_ra_read(struct nvm_vblk *vblk, void *buf, size_t count)
+{
+	const size_t ring_nbytes = vblk->ra_nwins * vblk->ra_win;
+	const size_t pos = vblk->pos_read;
+	const int cached = (vblk->ra_off != SIZE_MAX) && (pos >= vblk->ra_off) &&
+			   (pos - vblk->ra_off < ring_nbytes);
+	size_t done = 0;
+
+	if ((pos > vblk->nbytes) || (count > vblk->nbytes - pos)) {
+		NVM_DEBUG("FAILED: pos: %zu, count: %zu", pos, count);
+		errno = EINVAL;
+		return -1;
+	}
+
+	vblk->ra_nseq = (pos == vblk->ra_next) ?
+			NVM_MIN(vblk->ra_nseq + 1, NVM_VBLK_RA_NSEQ) : 0;
+	vblk->ra_next = SIZE_MAX;
+
+	// Not a stream, beyond the extent, or aligned spanning the ring
+	if ((!cached && ((vblk->ra_nseq < NVM_VBLK_RA_NSEQ) ||
+			 ((count >= ring_nbytes) && !(pos % vblk->ra_win) &&
+			  !(count % vblk->ra_win)))) ||
+	    (pos + count > vblk_ra_extent(vblk))) {
+		if (vblk_ra_bypass(vblk, buf, count, pos) < 0)
+			return -1;	// Propagate errno
+
+		vblk->ra_next = pos + count;
+
+		return count;
+	}
+
+	if (!cached) {
+		if (vblk_ra_drop(vblk))
+			return -1;	// Propagate errno
+
+		vblk->ra_off = (pos / vblk->ra_win) * vblk->ra_win;
+	}
+
+	while (done < count) {
+		const size_t off = pos + done;
+		size_t nbytes;
+
+		while (off - vblk->ra_off >= vblk->ra_win) {
+			if (vblk_ra_advance(vblk))
+				goto failed;
+		}
+		if (vblk_ra_fill(vblk))
+			goto failed;
+
+		nbytes = vblk->ra_off + vblk->ra_win - off;
+		if (nbytes > count - done)
+			nbytes = count - done;
+
+		memcpy((char *)buf + done,
+		       vblk->ra_buf + vblk->ra_head * vblk->ra_win +
+		       (off - vblk->ra_off), nbytes);
+		done += nbytes;
+	}
+
+	if (vblk->ra_nseq >= NVM_VBLK_RA_NSEQ)
+		vblk_ra_issue(vblk);
+
+	vblk->ra_next = pos + count;
+
+	return count;
+
+failed:
+	{
+		const int err = errno;
+
+		NVM_DEBUG("FAILED: read-ahead at off: %zu", pos + done);
+		vblk_ra_drop(vblk);
+		errno = err ? err : EIO;
+	}
+
+	return -1;
+}
+
+int nvm_vblk_set_readahead(struct nvm_vblk *vblk, int nstripes)
+{
+	const size_t win = vblk_ra_win(vblk);
+	char *buf = NULL;
+
+	if ((nstripes < 0) || (nstripes > NVM_VBLK_RA_NSTRIPES_MAX)) {
+		NVM_DEBUG("FAILED: nstripes: %d", nstripes);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (vblk_ra_drop(vblk))
+		return -1;		// Propagate errno
+
+	if (nstripes) {
+		buf = nvm_buf_alloc(vblk->dev, nstripes * win, NULL);
+		if (!buf) {
+			NVM_DEBUG("FAILED: nvm_buf_alloc");
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	nvm_buf_free(vblk->dev, vblk->ra_buf);
+	vblk->ra_buf = buf;
+	vblk->ra_win = win;
+	vblk->ra_nwins = nstripes;
+	vblk->ra_next = SIZE_MAX;
+	vblk->ra_nseq = 0;
+
+	return 0;
+}
+
+static inline void vblk_copy_s20_addrs(struct vblk_job *job,
+				       size_t sectr_ofz, size_t nsectr,
+				       struct nvm_addr addrs_src[],
+				       struct nvm_addr addrs_dst[])
+{
+	struct nvm_vblk *src = job->vblk;
+	struct nvm_vblk *dst = job->dst;
+
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(src->dev);
+	const size_t nchunks = src->nblks;
+
+	for (size_t idx = 0; idx < nsectr; ++idx) {
+		const size_t sectr = sectr_ofz + idx;
+		const size_t wunit = sectr / WS_OPT;
+		const size_t rnd = wunit / nchunks;
+
+		const size_t chunk = wunit % nchunks;
+		const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+
+		addrs_src[idx].val = src->blks[chunk].val;
+		addrs_src[idx].l.sectr = chunk_sectr;
+
+		addrs_dst[idx].val = dst->blks[chunk].val;
+		addrs_dst[idx].l.sectr = chunk_sectr;
+	}
+}
+
+/**
+ * A stripe of the copy goes out as commands of at most 'cmd_n' sectors, the
+ * tail of the stripe in a command of its own, such that command 'k' of every
+ * stripe covers the same chunks. Returns the command of 'sectr', counted from
+ * the start of the vblk.
+ */
+static inline size_t vblk_copy_s20_seg(const struct vblk_job *job,
+				       size_t sectr, size_t *nsegs)
+{
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(job->vblk->dev);
+	const size_t nchunks = job->vblk->nblks;
+	const size_t cmd_nwunits = job->cmd_n / WS_OPT;
+	const size_t wunit = sectr / WS_OPT;
+
+	*nsegs = (nchunks + cmd_nwunits - 1) / cmd_nwunits;
+
+	return wunit / nchunks * *nsegs + wunit % nchunks / cmd_nwunits;
+}
+
+/**
+ * Number of copy commands of 'job', commands 'nsegs' apart hit the same chunks
+ */
+static inline size_t vblk_copy_s20_ncmds(const struct vblk_job *job,
+					 size_t *nsegs)
+{
+	if (job->end <= job->bgn) {
+		vblk_copy_s20_seg(job, job->bgn, nsegs);
+		return 0;
+	}
+
+	return vblk_copy_s20_seg(job, job->end - 1, nsegs) -
+	       vblk_copy_s20_seg(job, job->bgn, nsegs) + 1;
+}
+
+/**
+ * Sectors of copy command 'item' of 'job', returns the first sector and sets
+ * 'nsectr'
+ */
+static inline size_t vblk_copy_s20_range(const struct vblk_job *job,
+					 size_t item, size_t *nsectr)
+{
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(job->vblk->dev);
+	const size_t nchunks = job->vblk->nblks;
+	const size_t cmd_nwunits = job->cmd_n / WS_OPT;
+
+	size_t nsegs;
+	const size_t seg = vblk_copy_s20_seg(job, job->bgn, &nsegs) + item;
+	const size_t stripe = seg / nsegs;
+
+	const size_t wunit_bgn = stripe * nchunks + seg % nsegs * cmd_nwunits;
+	const size_t wunit_end = wunit_bgn + cmd_nwunits < (stripe + 1) * nchunks ?
+				 wunit_bgn + cmd_nwunits : (stripe + 1) * nchunks;
+
+	const size_t bgn = wunit_bgn * WS_OPT > job->bgn ?
+			   wunit_bgn * WS_OPT : job->bgn;
+	const size_t end = wunit_end * WS_OPT < job->end ?
+			   wunit_end * WS_OPT : job->end;
+
+	*nsectr = end - bgn;
+
+	return bgn;
+}
+
+static int vblk_copy_s20_cmd(void *arg, size_t item)
+{
+	struct vblk_job *job = arg;
+	struct nvm_ret ret = { 0 };
+
+	size_t cmd_nsectr;
+	const size_t sectr_ofz = vblk_copy_s20_range(job, item, &cmd_nsectr);
+
+	struct nvm_addr addrs_src[cmd_nsectr];
+	struct nvm_addr addrs_dst[cmd_nsectr];
+
+	vblk_copy_s20_addrs(job, sectr_ofz, cmd_nsectr, addrs_src, addrs_dst);
+
+	return nvm_cmd_copy(job->vblk->dev, addrs_src, addrs_dst, cmd_nsectr,
+			    NVM_VBLK_CMD_OPTS, &ret) ? 1 : 0;
+}
+
+/**
+ * Submit the copy commands of 'job' on the async. context of the source
+ *
+ * A command revisiting a chunk is not submitted until the commands before it
+ * have completed, keeping the writes to a destination chunk in order.
+ */
+static inline int vblk_copy_s20_async(struct vblk_job *job)
+{
+	struct nvm_vblk *src = job->vblk;
+
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(src->dev);
+	const uint32_t depth = nvm_async_get_depth(src->async_ctx);
+	const uint16_t flags = (NVM_VBLK_CMD_OPTS & ~NVM_CMD_SYNC) |
+			       NVM_CMD_ASYNC;
+
+	uint64_t nerr = 0;
+	size_t nwunits = 0;	// Submitted since the chunks were last drained
+	int err = 0;
+
+	struct nvm_vblk_async_cb_state state = {
+		.nerr = &nerr,
+		.vblk = src,
+	};
+
+	size_t nsegs;
+	const size_t ncmds = vblk_copy_s20_ncmds(job, &nsegs);
+
+	for (size_t item = 0; item < ncmds; ++item) {
+		size_t cmd_nsectr;
+		const size_t sectr_ofz = vblk_copy_s20_range(job, item,
+							     &cmd_nsectr);
+		const size_t cmd_nwunits = cmd_nsectr / WS_OPT;
+
+		struct nvm_addr addrs_src[cmd_nsectr];
+		struct nvm_addr addrs_dst[cmd_nsectr];
+		struct nvm_ret *ret;
+
+		if (nwunits && (nwunits + cmd_nwunits > (size_t)src->nblks)) {
+			err = nvm_async_wait(src->dev, src->async_ctx) < 0;
+			if (err) {
+				NVM_DEBUG("FAILED: nvm_async_wait");
+				break;
+			}
+			nwunits = 0;
+		}
+		nwunits += cmd_nwunits;
+
+		if (src->retsp == (depth - 1)) {
+			err = _vblk_async_greedy_reap(src) < 0;
+			if (err) {
+				NVM_DEBUG("FAILED: _vblk_async_greedy_reap");
+				break;
+			}
+		}
+
+		ret = src->rets[src->retsp++];
+		ret->async.ctx = src->async_ctx;
+		ret->async.cb = vblk_async_callback;
+		ret->async.cb_arg = &state;
+
+		vblk_copy_s20_addrs(job, sectr_ofz, cmd_nsectr, addrs_src,
+				    addrs_dst);
+
+		while ((err = nvm_cmd_copy(src->dev, addrs_src, addrs_dst,
+					   cmd_nsectr, flags, ret))) {
+			if ((errno != EAGAIN) ||
+			    (_vblk_async_greedy_reap(src) < 0))
+				break;
+		}
+		if (err) {
+			NVM_DEBUG("FAILED: nvm_cmd_copy");
+			memset(ret, 0, sizeof(*ret));
+			src->rets[--(src->retsp)] = ret;
+			break;
+		}
+	}
+
+	// Callbacks reference 'state', drain before leaving, also on error
+	if (nvm_async_wait(src->dev, src->async_ctx) < 0) {
+		NVM_DEBUG("FAILED: nvm_async_wait");
+		err = 1;
+	}
+
+	if (err)
+		return -1;	// Propagate errno
+
+	if (nerr) {
+		NVM_DEBUG("FAILED: nvm_cmd_copy, nerr(%"PRIu64")", nerr);
+		errno = EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * State of a copy through host memory, the source is read in windows of
+ * sectors and the writes of a window are in flight with the reads of the next
+ */
+struct vblk_xfer {
+	struct vblk_job rd;		///< Read of a window from the source
+	struct vblk_job wr;		///< Write of a window to the destination
+	size_t nrd;			///< # of read commands
+	size_t nwr;			///< # of write commands
+};
+
+static int vblk_xfer_cmd(void *arg, size_t item)
+{
+	struct vblk_xfer *xfer = arg;
+
+	if (item < xfer->nwr)
+		return vblk_sync_pwrite_s20_cmd(&xfer->wr, item);
+
+	return vblk_sync_pread_s20_cmd(&xfer->rd, item - xfer->nwr);
+}
+
+static inline size_t _gcd(size_t a, size_t b)
+{
+	while (b) {
+		const size_t t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+static inline ssize_t vblk_copy_s20_host(struct nvm_vblk *src,
+					 struct nvm_vblk *dst,
+					 size_t sectr_bgn, size_t nsectr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(src->dev);
+	const size_t sectr_nbytes = geo->l.nbytes;
+
+	const uint32_t WS_SRC = nvm_dev_get_ws_opt(src->dev);
+	const uint32_t WS_DST = nvm_dev_get_ws_opt(dst->dev);
+
+	// Windows are whole write-units of both source and destination
+	const size_t unit = WS_SRC / _gcd(WS_SRC, WS_DST) * WS_DST;
+	const size_t stripe = NVM_MAX(src->nblks * WS_SRC,
+				      dst->nblks * WS_DST);
+	const size_t win_nsectr = (NVM_VBLK_COPY_NSTRIPES * stripe + unit - 1) /
+				  unit * unit;
+	const size_t nwins = (nsectr + win_nsectr - 1) / win_nsectr;
+
+	const int rd_flags = (src->flags & ~NVM_CMD_ASYNC) | NVM_CMD_SYNC;
+	const int wr_flags = (dst->flags & ~NVM_CMD_ASYNC) | NVM_CMD_SYNC;
+	const size_t rd_cmd_n = rd_flags & NVM_CMD_VECTOR ? NVM_NADDR_MAX :
+							    WS_SRC;
+
+	const size_t nqueues = NVM_MIN(dst->nblks, NVM_POOL_NQUEUES_MAX);
+	const int nthreads = NVM_MAX(src->nblks, dst->nblks);
+
+	char *bufs[2] = { NULL, NULL };
+	ssize_t nerr = 0;
+
+	if (nsectr % WS_SRC || nsectr % WS_DST) {
+		NVM_DEBUG("FAILED: unaligned nsectr: %zu", nsectr);
+		errno = EINVAL;
+		return -1;
+	}
+	if (sectr_bgn % WS_SRC || sectr_bgn % WS_DST) {
+		NVM_DEBUG("FAILED: unaligned sectr_bgn: %zu", sectr_bgn);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		bufs[i] = nvm_buf_alloc(src->dev, win_nsectr * sectr_nbytes,
+					NULL);
+		if (!bufs[i]) {
+			NVM_DEBUG("FAILED: nvm_buf_alloc");
+			nvm_buf_free(src->dev, bufs[0]);
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	// Window 'w' is read while window 'w - 1' is written
+	for (size_t w = 0; (w <= nwins) && (!nerr); ++w) {
+		struct vblk_xfer xfer = { 0 };
+
+		if (w < nwins) {
+			xfer.rd.vblk = src;
+			xfer.rd.buf = bufs[w % 2];
+			xfer.rd.bgn = sectr_bgn + w * win_nsectr;
+			xfer.rd.end = NVM_MIN(xfer.rd.bgn + win_nsectr,
+					      sectr_bgn + nsectr);
+			xfer.rd.cmd_n = rd_cmd_n;
+			xfer.rd.flags = rd_flags;
+			xfer.nrd = (xfer.rd.end - xfer.rd.bgn + rd_cmd_n - 1) /
+				   rd_cmd_n;
+		}
+
+		if (w) {
+			xfer.wr.vblk = dst;
+			xfer.wr.buf = bufs[(w - 1) % 2];
+			xfer.wr.bgn = sectr_bgn + (w - 1) * win_nsectr;
+			xfer.wr.end = NVM_MIN(xfer.wr.bgn + win_nsectr,
+					      sectr_bgn + nsectr);
+			xfer.wr.cmd_n = WS_DST;
+			xfer.wr.flags = wr_flags;
+			xfer.nwr = (xfer.wr.end - xfer.wr.bgn) / WS_DST;
+		}
+
+		// One ordered queue per destination chunk, as for pwrite
+		nerr = nvm_pool_run(vblk_xfer_cmd, &xfer, xfer.nwr + xfer.nrd,
+				    nqueues, nthreads, NVM_POOL_ORDERED);
+	}
+
+	nvm_buf_free(src->dev, bufs[0]);
+	nvm_buf_free(src->dev, bufs[1]);
+
+	if (nerr < 0)
+		return -1;		// Propagate errno
+
+	if (nerr) {
+		NVM_DEBUG("FAILED: nerr(%zd)", nerr);
+		errno = EIO;
+		return -1;
+	}
+
+	return nsectr * sectr_nbytes;
+}
+
+static inline ssize_t vblk_copy_s20(struct nvm_vblk *src, struct nvm_vblk *dst,
+				    size_t count, size_t offset)
+{
+	const uint32_t WS_OPT = nvm_dev_get_ws_opt(src->dev);
+
+	const struct nvm_geo *geo = nvm_dev_get_geo(src->dev);
+
+	const size_t sectr_nbytes = geo->l.nbytes;
+	const size_t nsectr = count / sectr_nbytes;
+
+	const size_t sectr_bgn = offset / sectr_nbytes;
+
+	const size_t cmd_nsectr_max = (NVM_NADDR_MAX / WS_OPT) * WS_OPT;
+
+	struct vblk_job job = {
+		.vblk = src,
+		.dst = dst,
+		.bgn = sectr_bgn,
+		.end = sectr_bgn + nsectr,
+		.cmd_n = cmd_nsectr_max,
+	};
+	size_t ncmds, nqueues, cmd0_nsectr;
+	ssize_t nerr;
+
+	// Across devices and layouts, the data goes through host memory
+	if ((src->dev != dst->dev) || (src->nblks != dst->nblks))
+		return vblk_copy_s20_host(src, dst, sectr_bgn, nsectr);
+
+	if (nsectr % WS_OPT) {
+		NVM_DEBUG("FAILED: unaligned nsectr: %zu", nsectr);
+		errno = EINVAL;
+		return -1;
+	}
+	if (sectr_bgn % WS_OPT) {
+		NVM_DEBUG("FAILED: unaligned sectr_bgn: %zu", sectr_bgn);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!nsectr)
+		return 0;
+
+	// The first command probes for backend support of vector-copy
+	if (vblk_copy_s20_cmd(&job, 0)) {
+		if (errno == ENOSYS)
+			return vblk_copy_s20_host(src, dst, sectr_bgn, nsectr);
+
+		NVM_DEBUG("FAILED: nvm_cmd_copy");
+		return -1;		// Propagate errno
+	}
+	job.bgn = vblk_copy_s20_range(&job, 0, &cmd0_nsectr) + cmd0_nsectr;
+
+	if (src->flags & NVM_CMD_ASYNC) {
+		if (vblk_copy_s20_async(&job))
+			return -1;	// Propagate errno
+
+		return count;
+	}
+
+	// Commands of a queue revisit the same chunks, in order
+	ncmds = vblk_copy_s20_ncmds(&job, &nqueues);
+	nerr = nvm_pool_run(vblk_copy_s20_cmd, &job, ncmds,
+			    NVM_MIN(nqueues, NVM_POOL_NQUEUES_MAX), nqueues,
+			    NVM_POOL_ORDERED);
+	if (nerr < 0)
+		return -1;		// Propagate errno
+	if (nerr) {
+		NVM_DEBUG("FAILED: nvm_cmd_copy, nerr(%zd)", nerr);
+		errno = EIO;
+		return -1;
+	}
+
+	return count;
+}
+
+ssize_t nvm_vblk_pcopy(struct nvm_vblk *src, struct nvm_vblk *dst,
+		       size_t count, size_t offset)
+{
+	const int verid = nvm_dev_get_verid(nvm_vblk_get_dev(src));
+
+	if (verid != nvm_dev_get_verid(nvm_vblk_get_dev(dst))) {
+		NVM_DEBUG("FAILED: mixed verid");
+		errno = ENOSYS;
+		return -1;
+	}
+
+	if (src->parity || dst->parity) {
+		NVM_DEBUG("FAILED: not supported in parity mode");
+		errno = ENOSYS;
+		return -1;
+	}
+
+	if (nvm_dev_get_geo(src->dev)->l.nbytes !=
+	    nvm_dev_get_geo(dst->dev)->l.nbytes) {
+		NVM_DEBUG("FAILED: mismatching sector size");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((offset + count > src->nbytes) || (offset + count > dst->nbytes)) {
+		NVM_DEBUG("FAILED: out of bounds");
+		errno = EINVAL;
+		return -1;
+	}
+
+	switch (verid) {
+	case NVM_SPEC_VERID_20:
+		return vblk_copy_s20(src, dst, count, offset);
+
+	case NVM_SPEC_VERID_12:
+		NVM_DEBUG("FAILED: not implemented, verid: %d", verid);
+		errno = ENOSYS;
+		return -1;
+
+	default:
+		NVM_DEBUG("FAILED: unsupported, verid: %d", verid);
+		errno = ENOSYS;
+		return -1;
+	}
+}
+
+ssize_t nvm_vblk_copy(struct nvm_vblk *src, struct nvm_vblk *dst,
+		      int NVM_UNUSED(flags))
+{
+	return nvm_vblk_pcopy(src, dst, src->nbytes, 0);
+}
+
+/**
+ * Reserve 'nsectr' sectors in a chunk of 'vblk', starting at the chunk
+ * after the one the previous append started at
+ *
+ * The reservation is a compare-and-swap on the host-side write pointer of the
+ * chunk, a reservation never spans the end of a chunk, a chunk too full for it
+ * is passed over.
+ *
+ * @return Index of the chunk and the first sector in 'sectr'. On error, -1 and
+ * `errno` set.
+ */
+static int vblk_append_reserve(struct nvm_vblk *vblk, uint32_t nsectr,
+			       uint32_t *sectr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const uint32_t bgn = atomic_fetch_add(&vblk->append_cursor, 1);
+
+	for (int i = 0; i < vblk->nblks; ++i) {
+		const int cnk = (bgn + i) % vblk->nblks;
+		struct nvm_vblk_append *app = &vblk->append[cnk];
+		unsigned int wp = atomic_load(&app->wp);
+
+		while (!atomic_load(&app->failed) &&
+		       (wp + nsectr <= geo->l.nsectr)) {
+			if (atomic_compare_exchange_weak(&app->wp, &wp,
+							 wp + nsectr)) {
+				*sectr = wp;
+				return cnk;
+			}
+		}
+	}
+
+	NVM_DEBUG("FAILED: no chunk with room for nsectr: %"PRIu32, nsectr);
+	errno = ENOSPC;
+	return -1;
+}
+
+ssize_t nvm_vblk_append(struct nvm_vblk *vblk, const void *buf, size_t count,
+			struct nvm_addr *addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const uint32_t WS_MIN = nvm_dev_get_ws_min(vblk->dev);
+	const size_t sectr_nbytes = geo->l.nbytes;
+	const size_t nsectr = count / sectr_nbytes;
+	const size_t cmd_nsectr_max = (NVM_NADDR_MAX / WS_MIN) * WS_MIN;
+	const int flags = (vblk->flags & ~NVM_CMD_ASYNC) | NVM_CMD_SYNC;
+	const int meta_mode = nvm_dev_get_meta_mode(vblk->dev);
+
+	struct nvm_vblk_append *app;
+	char *meta_buf;
+	uint32_t sectr;
+	int cnk, err = 0;
+
+	if ((nvm_dev_get_verid(vblk->dev) != NVM_SPEC_VERID_20) ||
+	    vblk->parity) {
+		NVM_DEBUG("FAILED: only supported for 2.0, without parity");
+		errno = ENOSYS;
+		return -1;
+	}
+	if ((!nsectr) || (count % sectr_nbytes) || (nsectr % WS_MIN)) {
+		NVM_DEBUG("FAILED: unaligned count: %zu", count);
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Allocated before reserving, a reservation must always be published
+	meta_buf = vblk_meta_alloc(vblk, NVM_MIN(cmd_nsectr_max, nsectr));
+	if (meta_mode != NVM_META_MODE_NONE && !meta_buf)
+		return -1;	// Propagate errno
+
+	cnk = vblk_append_reserve(vblk, nsectr, &sectr);
+	if (cnk < 0) {
+		nvm_buf_free(vblk->dev, meta_buf);
+		return -1;	// Propagate errno
+	}
+	app = &vblk->append[cnk];
+
+	// Appends to a chunk reach the device in the order of reservation,
+	// sleep until the appends reserved before this one are submitted
+	if (atomic_load(&app->wp_submitted) != sectr) {
+		pthread_mutex_lock(&app->lock);
+		while (atomic_load(&app->wp_submitted) != sectr)
+			pthread_cond_wait(&app->turn, &app->lock);
+		pthread_mutex_unlock(&app->lock);
+	}
+
+	for (size_t done = 0; (!err) && (done < nsectr);) {
+		const size_t cmd_nsectr = NVM_MIN(cmd_nsectr_max, nsectr - done);
+		struct nvm_addr addrs[cmd_nsectr];
+		struct nvm_ret ret = { 0 };
+
+		for (size_t i = 0; i < cmd_nsectr; ++i) {
+			addrs[i].val = vblk->blks[cnk].val;
+			addrs[i].l.sectr = sectr + done + i;
+		}
+
+		err = atomic_load(&app->failed) ||
+		      nvm_cmd_write(vblk->dev, addrs, cmd_nsectr,
+				    (const char *)buf + done * sectr_nbytes,
+				    meta_buf, flags, &ret);
+		done += cmd_nsectr;
+	}
+
+	// On error, the chunk is passed over by later appends, those already
+	// reserved in it fail without writing
+	if (err)
+		atomic_store(&app->failed, 1);
+
+	pthread_mutex_lock(&app->lock);
+	atomic_store(&app->wp_submitted, sectr + nsectr);
+	pthread_cond_broadcast(&app->turn);
+	pthread_mutex_unlock(&app->lock);
+
+	nvm_buf_free(vblk->dev, meta_buf);
+
+	if (err) {
+		NVM_DEBUG("FAILED: nvm_cmd_write");
+		errno = EIO;
+		return -1;
+	}
+
+	if (addr) {
+		addr->val = vblk->blks[cnk].val;
+		addr->l.sectr = sectr;
+	}
+
+	return count;
+}
+
+struct nvm_addr *nvm_vblk_get_addrs(struct nvm_vblk *vblk)
+{
+	return vblk->blks;
+}
+
+int nvm_vblk_get_naddrs(struct nvm_vblk *vblk)
+{
+	return vblk->nblks;
+}
+
+size_t nvm_vblk_get_nbytes(struct nvm_vblk *vblk)
+{
 	return vblk->nbytes;
 }
 
@@ -1132,7 +3538,7 @@ size_t nvm_vblk_get_pos_read(struct nvm_vblk *vblk)
 
 size_t nvm_vblk_get_pos_write(struct nvm_vblk *vblk)
 {
-	return vblk->pos_write;
+	return vblk->pos_write + vblk->wbuf_len;
 }
 
 struct nvm_dev *nvm_vblk_get_dev(struct nvm_vblk *vblk)
@@ -1150,6 +3556,9 @@ int nvm_vblk_set_pos_read(struct nvm_vblk *vblk, size_t pos)
 		return -1;
 	}
 
+	if ((pos != vblk->pos_read) && vblk->ra_nwins && vblk_ra_drop(vblk))
+		return -1;		// Propagate errno
+
 	vblk->pos_read = pos;
 
 	return 0;
@@ -1162,6 +3571,12 @@ int nvm_vblk_set_pos_write(struct nvm_vblk *vblk, size_t pos)
 		return -1;
 	}
 
+	if (vblk->wbuf_len) {
+		NVM_DEBUG("FAILED: write buffer holds data, flush it first");
+		errno = EBUSY;
+		return -1;
+	}
+
 	vblk->pos_write = pos;
 
 	return 0;
@@ -1176,5 +3591,7 @@ void nvm_vblk_pr(struct nvm_vblk *vblk)
 	printf("  pos_write: %zu\n", vblk->pos_write);
 	printf("  pos_read: %zu\n", vblk->pos_read);
 	printf("  flags: 0x08%x\n", vblk->flags);
+	printf("  parity: %d\n", vblk->parity);
+	printf("  readahead: %d\n", vblk->ra_nwins);
         nvm_addr_prn(vblk->blks, vblk->nblks, vblk->dev);
 }
@@ -33,6 +33,39 @@ static void test_BUF(void) {
 	}
 }
 
+static void test_BUF_ARENA(void) {
+	struct nvm_buf_arena *arena = NULL;
+	void *bufs[16] = { NULL };
+
+	arena = nvm_buf_arena_create(DEV);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(arena);
+
+	for (size_t i = 0; i < 16; ++i) {
+		size_t nbytes = KB << (i % 11);
+
+		bufs[i] = nvm_buf_arena_alloc(arena, nbytes, NULL);
+		CU_ASSERT_PTR_NOT_NULL(bufs[i]);
+		if (bufs[i])
+			memset(bufs[i], (int)i, nbytes);
+	}
+	for (size_t i = 0; i < 16; ++i)
+		nvm_buf_arena_free(arena, bufs[i]);
+
+	// A freed block is handed out again for the same size class
+	bufs[0] = nvm_buf_arena_alloc(arena, 4 * KB, NULL);
+	CU_ASSERT_PTR_NOT_NULL(bufs[0]);
+	nvm_buf_arena_free(arena, bufs[0]);
+	bufs[1] = nvm_buf_arena_alloc(arena, 4 * KB, NULL);
+	CU_ASSERT_PTR_EQUAL(bufs[0], bufs[1]);
+	nvm_buf_arena_free(arena, bufs[1]);
+
+	// Larger than a chunk: the arena declines
+	CU_ASSERT_PTR_NULL(nvm_buf_arena_alloc(arena, 4 * MB, NULL));
+
+	nvm_buf_arena_reset(arena);
+	nvm_buf_arena_destroy(arena);
+}
+
 static void test_BUF_SET(void) {
 
 	for (size_t i = 0; i < nbsizes; ++i) {
@@ -58,6 +91,9 @@ int main(int argc, char **argv)
 	if (!CU_add_test(pSuite, "BUF", test_BUF))
 		goto out;
 
+	if (!CU_add_test(pSuite, "BUF_ARENA", test_BUF_ARENA))
+		goto out;
+
 	if (!CU_add_test(pSuite, "BUF_SET", test_BUF_SET))
 		goto out;
 
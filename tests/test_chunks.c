@@ -0,0 +1,99 @@
+#include "test_intf.c"
+
+static int npus(void)
+{
+	if (nvm_dev_get_verid(DEV) == NVM_SPEC_VERID_20)
+		return GEO->l.npugrp * GEO->l.npunit;
+
+	return GEO->g.nchannels * GEO->g.nluns;
+}
+
+void test_CHUNKS_GET_PUT(void)
+{
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_chunks *chunks = NULL;
+	uint32_t nfree;
+	int naddrs;
+
+	chunks = nvm_chunks_alloc(DEV);
+	if (!chunks) {
+		CU_FAIL("FAILED: nvm_chunks_alloc");
+		return;
+	}
+
+	if (CU_BRM_VERBOSE == RMODE)
+		nvm_chunks_pr(chunks);
+
+	nfree = nvm_chunks_get_nfree(chunks);
+
+	naddrs = nvm_chunks_get_line(chunks, addrs);
+	if (naddrs != npus()) {
+		CU_FAIL("FAILED: nvm_chunks_get_line");
+		goto out;
+	}
+	CU_ASSERT(nvm_chunks_get_nfree(chunks) == nfree - naddrs);
+
+	// Every chunk of the line is on a distinct parallel unit
+	for (int i = 0; i < naddrs; ++i) {
+		for (int j = 0; j < i; ++j) {
+			if (nvm_dev_get_verid(DEV) == NVM_SPEC_VERID_20) {
+				CU_ASSERT(addrs[i].l.pugrp != addrs[j].l.pugrp ||
+					  addrs[i].l.punit != addrs[j].l.punit);
+			} else {
+				CU_ASSERT(addrs[i].g.ch != addrs[j].g.ch ||
+					  addrs[i].g.lun != addrs[j].g.lun);
+			}
+		}
+	}
+
+	CU_ASSERT(!nvm_chunks_put(chunks, addrs, naddrs));
+	CU_ASSERT(nvm_chunks_get_nfree(chunks) == nfree);
+
+	// Releasing chunks which are not in use fails
+	CU_ASSERT(nvm_chunks_put(chunks, addrs, 1));
+
+	CU_ASSERT(nvm_chunks_get(chunks, npus() + 1, addrs));
+
+	if (nvm_chunks_get(chunks, 1, addrs)) {
+		CU_FAIL("FAILED: nvm_chunks_get");
+		goto out;
+	}
+	CU_ASSERT(!nvm_chunks_retire(chunks, addrs, 1));
+	CU_ASSERT(nvm_chunks_get_nfree(chunks) == nfree - 1);
+
+out:
+	nvm_chunks_free(chunks);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_test_chunks", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "CHUNKS GET/PUT", test_CHUNKS_GET_PUT))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -139,6 +139,45 @@ void test_CMD_RPRT_ALL(void)
 	cmd_rprt(NULL);
 }
 
+void test_CMD_RPRT_INTO(void)
+{
+	SPEC_20_ONLY
+
+	struct nvm_addr punit_addr = { .val=0 };
+	struct nvm_spec_rprt *rprt = NULL, *into = NULL;
+	struct nvm_ret ret = { 0 };
+	size_t nbytes;
+
+	punit_addr.l.pugrp = GEO->l.npugrp / 2;
+	punit_addr.l.punit = GEO->l.npunit / 2;
+
+	nbytes = nvm_cmd_rprt_nbytes(DEV, &punit_addr);
+	into = malloc(nbytes);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(into);
+
+	// Too small a buffer is rejected
+	CU_ASSERT(nvm_cmd_rprt_into(DEV, &punit_addr, 0x0, into, nbytes - 1,
+				    &ret) == -1);
+
+	rprt = nvm_cmd_rprt(DEV, &punit_addr, 0x0, &ret);
+	CU_ASSERT_PTR_NOT_NULL(rprt);
+	if (!rprt)
+		goto out;
+
+	// Polling into the same buffer matches the allocated report
+	for (int i = 0; i < 10; ++i) {
+		CU_ASSERT(!nvm_cmd_rprt_into(DEV, &punit_addr, 0x0, into,
+					     nbytes, &ret));
+		CU_ASSERT(into->ndescr == GEO->l.nchunk);
+		CU_ASSERT(!memcmp(into->descr, rprt->descr,
+				  into->ndescr * sizeof(*into->descr)));
+	}
+
+out:
+	nvm_buf_free(DEV, rprt);
+	free(into);
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
@@ -151,6 +190,8 @@ int main(int argc, char **argv)
 		goto out;
 	if (!CU_add_test(pSuite, "nvm_cmd_rprt_all", test_CMD_RPRT_ALL))
 		goto out;
+	if (!CU_add_test(pSuite, "nvm_cmd_rprt_into", test_CMD_RPRT_INTO))
+		goto out;
 
 	switch(RMODE) {
 	case NVM_TEST_RMODE_AUTO:
@@ -1,3 +1,7 @@
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "test_intf.c"
 
 #define NBYTES_QRK 4
@@ -569,6 +573,408 @@ out:
 	nvm_buf_free(DEV, erase_meta);
 }
 
+/**
+ * Strategies by which ewr_s20_async collects the completions of its reads
+ */
+enum ewr_async_strategy {
+	EWR_ASYNC_REAP = 0,	///< Reap with nvm_async_reap, without callbacks
+	EWR_ASYNC_WAIT_HYBRID,	///< Wait by the hybrid policy, on the eventfd
+};
+
+/**
+ * Write the chunk at 'chunk_addr' from 'buf' with synchronous commands of
+ * naddrs sectors each
+ */
+static int ewr_s20_write_chunk(struct nvm_addr chunk_addr, int naddrs,
+			       const char *buf)
+{
+	const size_t cmd_nbytes = naddrs * GEO->l.nbytes;
+	struct nvm_addr addrs[naddrs];
+	struct nvm_ret ret;
+
+	for (size_t cmd = 0; cmd < GEO->l.nsectr / naddrs; ++cmd) {
+		for (int i = 0; i < naddrs; ++i) {
+			addrs[i].val = chunk_addr.val;
+			addrs[i].l.sectr = cmd * naddrs + i;
+		}
+		if (nvm_cmd_write(DEV, addrs, naddrs, buf + cmd * cmd_nbytes,
+				  NULL, 0x0, &ret))
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Initialize the context for the given strategy, with an eventfd for the
+ * hybrid wait when the backend provides one
+ */
+static struct nvm_async_ctx *ewr_s20_async_init(uint16_t ctx_flags,
+						enum ewr_async_strategy strategy)
+{
+	struct nvm_async_ctx *ctx;
+
+	if (strategy == EWR_ASYNC_REAP)
+		return nvm_async_init(DEV, 0, ctx_flags);
+
+	ctx = nvm_async_init(DEV, 0, ctx_flags | NVM_ASYNC_EVENTFD);
+	if (!ctx && errno == ENOSYS) {
+		ctx = nvm_async_init(DEV, 0, ctx_flags);
+		CU_ASSERT(ctx && nvm_async_get_fd(ctx) < 0);
+	} else if (ctx) {
+		CU_ASSERT(nvm_async_get_fd(ctx) >= 0);
+	}
+	if (ctx)
+		CU_ASSERT(!nvm_async_set_wait(ctx, NVM_ASYNC_WAIT_HYBRID));
+
+	return ctx;
+}
+
+/**
+ * Write a chunk, then read it back with asynchronous commands, collecting
+ * their completions by the given strategy, and verify that every command
+ * completes exactly once
+ */
+static void ewr_s20_async(uint16_t ctx_flags, enum ewr_async_strategy strategy)
+{
+	const int naddrs = nvm_dev_get_ws_min(DEV);
+	const size_t ncmds = GEO->l.nsectr / naddrs;
+	struct nvm_addr addrs[naddrs];
+	struct nvm_addr chunk_addr = { .val = 0 };
+	struct nvm_async_ctx *ctx = NULL;
+	struct nvm_ret *rets = NULL;
+	struct nvm_ret **out = NULL;
+	struct nvm_ret ret;
+	int *nreaps = NULL;
+	char *buf_w = NULL, *buf_r = NULL;
+	const size_t nbytes = GEO->l.nsectr * GEO->l.nbytes;
+	const size_t cmd_nbytes = naddrs * GEO->l.nbytes;
+	size_t nsubmitted = 0, ncompleted = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &chunk_addr)) {
+		CU_FAIL("nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	ctx = ewr_s20_async_init(ctx_flags, strategy);
+	if (!ctx) {
+		CU_FAIL("nvm_async_init");
+		return;
+	}
+
+	buf_w = nvm_buf_alloc(DEV, nbytes, NULL);
+	buf_r = nvm_buf_alloc(DEV, nbytes, NULL);
+	rets = calloc(ncmds, sizeof(*rets));
+	out = calloc(ncmds, sizeof(*out));
+	nreaps = calloc(ncmds, sizeof(*nreaps));
+	if (!buf_w || !buf_r || !rets || !out || !nreaps) {
+		CU_FAIL("allocation");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, nbytes);
+	memset(buf_r, 0, nbytes);
+
+	if (ewr_s20_write_chunk(chunk_addr, naddrs, buf_w)) {
+		CU_FAIL("Write failure");
+		goto out;
+	}
+
+	while (ncompleted < ncmds) {			///< Read and complete
+		int nevents;
+
+		while (nsubmitted < ncmds) {
+			struct nvm_ret *cmd_ret = &rets[nsubmitted];
+
+			for (int i = 0; i < naddrs; ++i) {
+				addrs[i].val = chunk_addr.val;
+				addrs[i].l.sectr = nsubmitted * naddrs + i;
+			}
+
+			cmd_ret->async.ctx = ctx;
+			if (nvm_cmd_read(DEV, addrs, naddrs,
+					 buf_r + nsubmitted * cmd_nbytes, NULL,
+					 NVM_CMD_ASYNC, cmd_ret)) {
+				if (errno == EAGAIN && nsubmitted > ncompleted)
+					break;
+
+				CU_FAIL("Read failure: submission");
+				goto out;
+			}
+			++nsubmitted;
+		}
+
+		switch (strategy) {
+		case EWR_ASYNC_REAP:
+			nevents = nvm_async_reap(DEV, ctx, out, ncmds);
+			if (nevents < 0) {
+				CU_FAIL("nvm_async_reap");
+				goto out;
+			}
+			for (int i = 0; i < nevents; ++i) {
+				if (out[i] < rets || out[i] >= rets + ncmds) {
+					CU_FAIL("nvm_async_reap: foreign ret");
+					continue;
+				}
+				++nreaps[out[i] - rets];
+			}
+			ncompleted += nevents;
+			break;
+
+		case EWR_ASYNC_WAIT_HYBRID:
+			if (nvm_async_get_fd(ctx) >= 0) {
+				struct pollfd pfd = {
+					.fd = nvm_async_get_fd(ctx),
+					.events = POLLIN
+				};
+
+				// Commands are outstanding, one completes
+				CU_ASSERT(poll(&pfd, 1, 1000) == 1);
+				CU_ASSERT(pfd.revents & POLLIN);
+			}
+
+			if (nvm_async_wait(DEV, ctx) < 0) {
+				CU_FAIL("nvm_async_wait");
+				goto out;
+			}
+			CU_ASSERT(!nvm_async_get_outstanding(ctx));
+			for (size_t cmd = ncompleted; cmd < nsubmitted; ++cmd)
+				++nreaps[cmd];
+			ncompleted = nsubmitted;
+			break;
+		}
+	}
+
+	CU_ASSERT(!nvm_async_get_outstanding(ctx));
+	for (size_t cmd = 0; cmd < ncmds; ++cmd) {
+		CU_ASSERT(nreaps[cmd] == 1);
+		CU_ASSERT(!rets[cmd].status);
+	}
+	CU_ASSERT(!nvm_buf_diff(buf_w, buf_r, nbytes));
+
+	if (nvm_cmd_erase(DEV, &chunk_addr, 1, NULL, 0x0, &ret))
+		CU_FAIL("Erase failure");
+
+out:
+	if (nsubmitted > ncompleted)
+		nvm_async_wait(DEV, ctx);
+	nvm_async_term(DEV, ctx);
+	nvm_buf_free(DEV, buf_w);
+	nvm_buf_free(DEV, buf_r);
+	free(rets);
+	free(out);
+	free(nreaps);
+}
+
+void test_EWR_S20_ASYNC_REAP(void)
+{
+	ewr_s20_async(0x0, EWR_ASYNC_REAP);
+}
+
+void test_EWR_S20_ASYNC_REAP_SHARED(void)
+{
+	ewr_s20_async(NVM_ASYNC_SHARED, EWR_ASYNC_REAP);
+}
+
+void test_EWR_S20_ASYNC_WAIT_HYBRID(void)
+{
+	ewr_s20_async(0x0, EWR_ASYNC_WAIT_HYBRID);
+}
+
+#define EWR_ASYNC_NSUBMITTERS 4
+#define EWR_ASYNC_NREAPERS 2
+
+/**
+ * State shared by the submitting and reaping threads of
+ * test_EWR_S20_ASYNC_REAP_SHARED_MT
+ */
+struct ewr_async_mt {
+	struct nvm_async_ctx *ctx;
+	struct nvm_addr chunk_addr;
+	int naddrs;
+	size_t ncmds;
+	char *buf;
+	struct nvm_ret *rets;
+	atomic_int *nreaps;		///< Completions reaped per command
+	atomic_size_t next;		///< Next command to submit
+	atomic_size_t nsubmitted;
+	atomic_size_t nreaped;
+	atomic_int nsubmitters;		///< Submitting threads yet to finish
+	atomic_int nforeign;		///< Reaped rets not of any command
+	atomic_int nerr;
+};
+
+/**
+ * Claim commands from the shared cursor and submit each as an asynchronous
+ * read of its sectors, retrying while the context is full
+ */
+static void *ewr_async_mt_submit(void *arg)
+{
+	struct ewr_async_mt *mt = arg;
+	const size_t cmd_nbytes = mt->naddrs * GEO->l.nbytes;
+	struct nvm_addr addrs[mt->naddrs];
+	size_t cmd;
+
+	while ((cmd = atomic_fetch_add(&mt->next, 1)) < mt->ncmds) {
+		for (int i = 0; i < mt->naddrs; ++i) {
+			addrs[i].val = mt->chunk_addr.val;
+			addrs[i].l.sectr = cmd * mt->naddrs + i;
+		}
+
+		mt->rets[cmd].async.ctx = mt->ctx;
+		while (nvm_cmd_read(DEV, addrs, mt->naddrs,
+				    mt->buf + cmd * cmd_nbytes, NULL,
+				    NVM_CMD_ASYNC, &mt->rets[cmd])) {
+			if (errno != EAGAIN) {
+				atomic_fetch_add(&mt->nerr, 1);
+				goto out;
+			}
+			sched_yield();
+		}
+		atomic_fetch_add(&mt->nsubmitted, 1);
+	}
+
+out:
+	atomic_fetch_sub(&mt->nsubmitters, 1);
+
+	return NULL;
+}
+
+/**
+ * Reap completions until every submitted command is reaped, by this or by
+ * another reaping thread, and all submitters are done
+ */
+static void *ewr_async_mt_reap(void *arg)
+{
+	struct ewr_async_mt *mt = arg;
+	struct nvm_ret *out[mt->ncmds];
+
+	while (1) {
+		const int nsubmitters = atomic_load(&mt->nsubmitters);
+		int nevents;
+
+		if (!nsubmitters && atomic_load(&mt->nreaped) ==
+				    atomic_load(&mt->nsubmitted))
+			break;
+
+		nevents = nvm_async_reap(DEV, mt->ctx, out, mt->ncmds);
+		if (nevents < 0) {
+			atomic_fetch_add(&mt->nerr, 1);
+			break;
+		}
+		for (int i = 0; i < nevents; ++i) {
+			if (out[i] < mt->rets || out[i] >= mt->rets + mt->ncmds) {
+				atomic_fetch_add(&mt->nforeign, 1);
+				continue;
+			}
+			if (out[i]->status)
+				atomic_fetch_add(&mt->nerr, 1);
+			atomic_fetch_add(&mt->nreaps[out[i] - mt->rets], 1);
+		}
+		atomic_fetch_add(&mt->nreaped, nevents);
+		if (!nevents)
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+/**
+ * Read a chunk with several threads submitting on a shared context while
+ * others reap concurrently, and verify that every command is reaped exactly
+ * once
+ */
+void test_EWR_S20_ASYNC_REAP_SHARED_MT(void)
+{
+	const size_t nbytes = GEO->l.nsectr * GEO->l.nbytes;
+	pthread_t submitters[EWR_ASYNC_NSUBMITTERS];
+	pthread_t reapers[EWR_ASYNC_NREAPERS];
+	struct ewr_async_mt mt = { .chunk_addr = { .val = 0 } };
+	char *buf_w = NULL;
+	struct nvm_ret ret;
+	int nsubmitters = 0, nreapers = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &mt.chunk_addr)) {
+		CU_FAIL("nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	mt.naddrs = nvm_dev_get_ws_min(DEV);
+	mt.ncmds = GEO->l.nsectr / mt.naddrs;
+
+	// A shallow context, such that submitters contend for its slots
+	mt.ctx = nvm_async_init(DEV, EWR_ASYNC_NSUBMITTERS, NVM_ASYNC_SHARED);
+	if (!mt.ctx) {
+		CU_FAIL("nvm_async_init");
+		return;
+	}
+
+	buf_w = nvm_buf_alloc(DEV, nbytes, NULL);
+	mt.buf = nvm_buf_alloc(DEV, nbytes, NULL);
+	mt.rets = calloc(mt.ncmds, sizeof(*mt.rets));
+	mt.nreaps = calloc(mt.ncmds, sizeof(*mt.nreaps));
+	if (!buf_w || !mt.buf || !mt.rets || !mt.nreaps) {
+		CU_FAIL("allocation");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, nbytes);
+	memset(mt.buf, 0, nbytes);
+
+	if (ewr_s20_write_chunk(mt.chunk_addr, mt.naddrs, buf_w)) {
+		CU_FAIL("Write failure");
+		goto out;
+	}
+
+	atomic_init(&mt.nsubmitters, EWR_ASYNC_NSUBMITTERS);
+	for (; nsubmitters < EWR_ASYNC_NSUBMITTERS; ++nsubmitters) {
+		if (pthread_create(&submitters[nsubmitters], NULL,
+				   ewr_async_mt_submit, &mt)) {
+			CU_FAIL("pthread_create");
+			atomic_fetch_sub(&mt.nsubmitters,
+					 EWR_ASYNC_NSUBMITTERS - nsubmitters);
+			break;
+		}
+	}
+	for (; nreapers < EWR_ASYNC_NREAPERS; ++nreapers) {
+		if (pthread_create(&reapers[nreapers], NULL, ewr_async_mt_reap,
+				   &mt)) {
+			CU_FAIL("pthread_create");
+			break;
+		}
+	}
+	if (!nreapers)
+		ewr_async_mt_reap(&mt);
+
+	for (int i = 0; i < nsubmitters; ++i)
+		pthread_join(submitters[i], NULL);
+	for (int i = 0; i < nreapers; ++i)
+		pthread_join(reapers[i], NULL);
+
+	CU_ASSERT(!atomic_load(&mt.nerr));
+	CU_ASSERT(!atomic_load(&mt.nforeign));
+	CU_ASSERT(atomic_load(&mt.nsubmitted) == mt.ncmds);
+	CU_ASSERT(atomic_load(&mt.nreaped) == mt.ncmds);
+	CU_ASSERT(!nvm_async_get_outstanding(mt.ctx));
+	for (size_t cmd = 0; cmd < mt.ncmds; ++cmd)
+		CU_ASSERT(atomic_load(&mt.nreaps[cmd]) == 1);
+	CU_ASSERT(!nvm_buf_diff(buf_w, mt.buf, nbytes));
+
+	if (nvm_cmd_erase(DEV, &mt.chunk_addr, 1, NULL, 0x0, &ret))
+		CU_FAIL("Erase failure");
+
+out:
+	nvm_async_term(DEV, mt.ctx);
+	nvm_buf_free(DEV, buf_w);
+	nvm_buf_free(DEV, mt.buf);
+	free(mt.rets);
+	free(mt.nreaps);
+}
+
 void test_EWR_S20_RWMETA0_EMETA0(void)
 {
 	switch(nvm_dev_get_verid(DEV)) {
@@ -650,6 +1056,14 @@ int main(int argc, char **argv)
 		goto out;
 	if (!CU_add_test(pSuite, "EWR_S20_RWMETA1_EMETA1", test_EWR_S20_RWMETA1_EMETA1))
 		goto out;
+	if (!CU_add_test(pSuite, "EWR_S20_ASYNC_REAP", test_EWR_S20_ASYNC_REAP))
+		goto out;
+	if (!CU_add_test(pSuite, "EWR_S20_ASYNC_REAP_SHARED", test_EWR_S20_ASYNC_REAP_SHARED))
+		goto out;
+	if (!CU_add_test(pSuite, "EWR_S20_ASYNC_REAP_SHARED_MT", test_EWR_S20_ASYNC_REAP_SHARED_MT))
+		goto out;
+	if (!CU_add_test(pSuite, "EWR_S20_ASYNC_WAIT_HYBRID", test_EWR_S20_ASYNC_WAIT_HYBRID))
+		goto out;
 
 	if (!CU_add_test(pSuite, "EWR S12 - META NADDR QUAD", test_EWR_S12_NADDR_META0_QUAD))
 		goto out;
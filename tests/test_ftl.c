@@ -0,0 +1,351 @@
+#include "test_intf.c"
+
+#define FTL_NCHUNKS 6
+
+static struct nvm_ftl *ftl_alloc(void)
+{
+	struct nvm_ftl *ftl;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return NULL;	// Only supported for 2.0
+
+	ftl = nvm_ftl_alloc(DEV, 0, FTL_NCHUNKS, 0);
+	if (!ftl) {
+		CU_FAIL("FAILED: nvm_ftl_alloc");
+		return NULL;
+	}
+
+	if (CU_BRM_VERBOSE == RMODE)
+		nvm_ftl_pr(ftl);
+
+	return ftl;
+}
+
+static void ftl_async_cb(struct nvm_ret *ret, void *opaque)
+{
+	int *nerr = opaque;
+
+	if (ret->status)
+		++(*nerr);
+}
+
+int ftl_wr(size_t nlbas, int mode)
+{
+	const size_t nbytes = nlbas * GEO->l.nbytes;
+	struct nvm_async_ctx *ctx = NULL;
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_ftl *ftl = NULL;
+	struct nvm_ret ret = { 0 };
+	int nerr = 0;
+	int err = -1;
+
+	ftl = ftl_alloc();
+	if (!ftl)
+		goto out;
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (mode & NVM_CMD_ASYNC) {
+		ctx = nvm_async_init(DEV, 0, 0);
+		if (!ctx) {
+			CU_FAIL("FAILED: nvm_async_init");
+			goto out;
+		}
+		ret.async.ctx = ctx;
+		ret.async.cb = ftl_async_cb;
+		ret.async.cb_arg = &nerr;
+	}
+
+	// Twice, such that the second write overwrites mapped LBAs
+	for (int i = 0; i < 2; ++i) {
+		if (nvm_ftl_write(ftl, 1, nlbas, bufs->write, mode, &ret)) {
+			CU_FAIL("FAILED: nvm_ftl_write");
+			goto out;
+		}
+		if (ctx && nvm_async_wait(DEV, ctx) < 0) {
+			CU_FAIL("FAILED: nvm_async_wait");
+			goto out;
+		}
+	}
+
+	if (nvm_ftl_read(ftl, 1, nlbas, bufs->read, mode, &ret)) {
+		CU_FAIL("FAILED: nvm_ftl_read");
+		goto out;
+	}
+	if (ctx && nvm_async_wait(DEV, ctx) < 0) {
+		CU_FAIL("FAILED: nvm_async_wait");
+		goto out;
+	}
+
+	CU_ASSERT(!nerr);
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes)) {
+		CU_FAIL("FAILED: nvm_buf_diff");
+		goto out;
+	}
+
+	err = nerr ? -1 : 0;
+
+out:
+	if (ctx)
+		nvm_async_term(DEV, ctx);
+	nvm_ftl_free(ftl);
+	nvm_buf_set_free(bufs);
+
+	return err;
+}
+
+void test_FTL_WR_SYNC(void)
+{
+	CU_ASSERT(!ftl_wr(WS_OPT * GEO->l.npugrp * GEO->l.npunit + 1,
+			  NVM_CMD_SYNC));
+}
+
+void test_FTL_WR_ASYNC(void)
+{
+	CU_ASSERT(!ftl_wr(WS_OPT * GEO->l.npugrp * GEO->l.npunit + 1,
+			  NVM_CMD_ASYNC));
+}
+
+/**
+ * A synchronous write behind an asynchronous write to the same line, the
+ * latter not reaped, must not wait on it forever
+ */
+void test_FTL_WR_ASYNC_SYNC(void)
+{
+	const size_t nlbas = WS_OPT * GEO->l.npugrp * GEO->l.npunit;
+	const size_t nbytes = nlbas * GEO->l.nbytes;
+	struct nvm_async_ctx *ctx = NULL;
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_ftl *ftl = NULL;
+	struct nvm_ret ret = { 0 };
+	int nerr = 0;
+
+	ftl = ftl_alloc();
+	if (!ftl)
+		goto out;
+
+	bufs = nvm_buf_set_alloc(DEV, 2 * nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	ctx = nvm_async_init(DEV, 0, 0);
+	if (!ctx) {
+		CU_FAIL("FAILED: nvm_async_init");
+		goto out;
+	}
+	ret.async.ctx = ctx;
+	ret.async.cb = ftl_async_cb;
+	ret.async.cb_arg = &nerr;
+
+	// A round of write-units on every chunk, then the round after it
+	if (nvm_ftl_write(ftl, 0, nlbas, bufs->write, NVM_CMD_ASYNC, &ret)) {
+		CU_FAIL("FAILED: nvm_ftl_write(ASYNC)");
+		goto out;
+	}
+	if (nvm_ftl_write(ftl, nlbas, nlbas, bufs->write + nbytes,
+			  NVM_CMD_SYNC, NULL)) {
+		CU_FAIL("FAILED: nvm_ftl_write(SYNC)");
+		goto out;
+	}
+	if (nvm_async_wait(DEV, ctx) < 0) {
+		CU_FAIL("FAILED: nvm_async_wait");
+		goto out;
+	}
+	CU_ASSERT(!nerr);
+
+	if (nvm_ftl_read(ftl, 0, 2 * nlbas, bufs->read, NVM_CMD_SYNC, NULL)) {
+		CU_FAIL("FAILED: nvm_ftl_read");
+		goto out;
+	}
+	CU_ASSERT(!nvm_buf_diff(bufs->write, bufs->read, 2 * nbytes));
+
+out:
+	if (ctx)
+		nvm_async_term(DEV, ctx);
+	nvm_ftl_free(ftl);
+	nvm_buf_set_free(bufs);
+}
+
+void test_FTL_TRIM(void)
+{
+	const size_t nbytes = WS_OPT * GEO->l.nbytes;
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_ftl *ftl = NULL;
+	char *zero = NULL;
+
+	ftl = ftl_alloc();
+	if (!ftl)
+		goto out;
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	zero = calloc(1, nbytes);
+	if (!bufs || !zero) {
+		CU_FAIL("FAILED: Allocating buffers");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_ftl_write(ftl, 0, WS_OPT, bufs->write, NVM_CMD_SYNC, NULL)) {
+		CU_FAIL("FAILED: nvm_ftl_write");
+		goto out;
+	}
+	if (nvm_ftl_trim(ftl, 0, WS_OPT)) {
+		CU_FAIL("FAILED: nvm_ftl_trim");
+		goto out;
+	}
+	if (nvm_ftl_read(ftl, 0, WS_OPT, bufs->read, NVM_CMD_SYNC, NULL)) {
+		CU_FAIL("FAILED: nvm_ftl_read");
+		goto out;
+	}
+
+	CU_ASSERT(!nvm_buf_diff(zero, bufs->read, nbytes));
+
+	CU_ASSERT(nvm_ftl_read(ftl, nvm_ftl_get_nlbas(ftl), 1, bufs->read,
+			       NVM_CMD_SYNC, NULL));
+
+out:
+	nvm_ftl_free(ftl);
+	nvm_buf_set_free(bufs);
+	free(zero);
+}
+
+/**
+ * Fill 'buf' with the data of version 'ver' of range 'range', each sector is
+ * stamped with the range, version and its index, such that data read back from
+ * another range or version differs
+ */
+static void ftl_gc_fill(char *buf, size_t nlbas, uint32_t range, uint32_t ver)
+{
+	nvm_buf_fill(buf, nlbas * GEO->l.nbytes);
+
+	for (uint32_t i = 0; i < nlbas; ++i) {
+		const uint32_t stamp[3] = { range, ver, i };
+
+		memcpy(buf + i * GEO->l.nbytes, stamp, sizeof(stamp));
+	}
+}
+
+void test_FTL_GC(void)
+{
+	const size_t nlbas = WS_OPT * GEO->l.npugrp * GEO->l.npunit;
+	const size_t nbytes = nlbas * GEO->l.nbytes;
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_ftl *ftl = NULL;
+	uint32_t *vers = NULL;
+	size_t nranges;
+
+	ftl = ftl_alloc();
+	if (!ftl)
+		goto out;
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+
+	nranges = nvm_ftl_get_nlbas(ftl) / nlbas;
+	vers = calloc(nranges, sizeof(*vers));
+	if (!vers) {
+		CU_FAIL("FAILED: calloc");
+		goto out;
+	}
+
+	// Write every range, then overwrite every other range twice, leaving
+	// closed lines with both valid and invalid sectors
+	for (uint32_t pass = 0; pass < 3; ++pass) {
+		for (uint32_t range = 0; range < nranges; ++range) {
+			if (pass && (range % 2))
+				continue;
+
+			vers[range] = pass;
+			ftl_gc_fill(bufs->write, nlbas, range, pass);
+			if (nvm_ftl_write(ftl, range * nlbas, nlbas, bufs->write,
+					  NVM_CMD_SYNC, NULL)) {
+				CU_FAIL("FAILED: nvm_ftl_write");
+				goto out;
+			}
+		}
+	}
+
+	CU_ASSERT_EQUAL(nvm_ftl_gc(ftl, 1), 1);
+
+	if (CU_BRM_VERBOSE == RMODE)
+		nvm_ftl_pr(ftl);
+
+	// Every range reads back its own last version, also when relocated
+	for (uint32_t range = 0; range < nranges; ++range) {
+		ftl_gc_fill(bufs->write, nlbas, range, vers[range]);
+		if (nvm_ftl_read(ftl, range * nlbas, nlbas, bufs->read,
+				 NVM_CMD_SYNC, NULL)) {
+			CU_FAIL("FAILED: nvm_ftl_read");
+			goto out;
+		}
+		if (nvm_buf_diff(bufs->write, bufs->read, nbytes)) {
+			CU_FAIL("FAILED: nvm_buf_diff");
+			goto out;
+		}
+	}
+
+out:
+	free(vers);
+	nvm_ftl_free(ftl);
+	nvm_buf_set_free(bufs);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_test_ftl", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	switch (BE_ID) {
+		case NVM_BE_NOCD:
+		case NVM_BE_SPDK:
+		case NVM_BE_LBD:
+			if (!CU_add_test(pSuite, "FTL WR ASYNC", test_FTL_WR_ASYNC))
+				goto out;
+			if (!CU_add_test(pSuite, "FTL WR ASYNC SYNC", test_FTL_WR_ASYNC_SYNC))
+				goto out;
+			/* fallthrough */
+		case NVM_BE_IOCTL:
+			if (!CU_add_test(pSuite, "FTL WR SYNC", test_FTL_WR_SYNC))
+				goto out;
+			if (!CU_add_test(pSuite, "FTL TRIM", test_FTL_TRIM))
+				goto out;
+			if (!CU_add_test(pSuite, "FTL GC", test_FTL_GC))
+				goto out;
+	}
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
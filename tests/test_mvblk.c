@@ -0,0 +1,130 @@
+#include "test_intf.c"
+
+#define NMEMBERS 2
+
+void test_MVBLK_EWR(void)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_vblk *vblks[NMEMBERS] = { NULL };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_mvblk *mvblk = NULL;
+	size_t nbytes = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Only supported for 2.0
+
+	// Members on the one device under test, on distinct chunks
+	for (int i = 0; i < NMEMBERS; ++i) {
+		struct nvm_addr *mbr = addrs + i * naddrs;
+		int taken = 1;
+
+		for (int retry = 0; taken && (retry < 32); ++retry) {
+			if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE,
+					      naddrs, mbr)) {
+				CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+				return;
+			}
+
+			taken = 0;
+			for (size_t j = 0; j < i * naddrs; ++j) {
+				for (size_t k = 0; k < naddrs; ++k)
+					taken |= addrs[j].val == mbr[k].val;
+			}
+		}
+		if (taken) {
+			CU_FAIL("FAILED: no distinct chunks for member");
+			return;
+		}
+	}
+
+	for (int i = 0; i < NMEMBERS; ++i) {
+		vblks[i] = nvm_vblk_alloc(DEV, addrs + i * naddrs, naddrs);
+		if (!vblks[i]) {
+			CU_FAIL("FAILED: nvm_vblk_alloc");
+			goto out;
+		}
+	}
+
+	mvblk = nvm_mvblk_alloc(vblks, NMEMBERS);
+	if (!mvblk) {
+		CU_FAIL("FAILED: nvm_mvblk_alloc");
+		goto out;
+	}
+
+	if (CU_BRM_VERBOSE == RMODE)
+		nvm_mvblk_pr(mvblk);
+
+	nbytes = nvm_mvblk_get_nbytes(mvblk);
+	CU_ASSERT_EQUAL(nbytes, NMEMBERS * nvm_vblk_get_nbytes(vblks[0]));
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_mvblk_erase(mvblk) < 0) {
+		CU_FAIL("FAILED: nvm_mvblk_erase");
+		goto out;
+	}
+
+	if (nvm_mvblk_write(mvblk, bufs->write, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_mvblk_write");
+		goto out;
+	}
+
+	if (nvm_mvblk_read(mvblk, bufs->read, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_mvblk_read");
+		goto out;
+	}
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	if (nvm_mvblk_erase(mvblk) < 0)
+		CU_FAIL("FAILED: nvm_mvblk_erase");
+
+out:
+	if (mvblk) {
+		nvm_mvblk_free(mvblk);
+	} else {
+		for (int i = 0; i < NMEMBERS; ++i)
+			nvm_vblk_free(vblks[i]);
+	}
+	nvm_buf_set_free(bufs);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_test_mvblk", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "MVBLK EWR S20", test_MVBLK_EWR))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -132,6 +132,70 @@ static void _test_sgl(size_t nsectr_w, size_t nsectr_r, uint16_t flags)
 MAKE_TESTS(ws_opt, WS_OPT + MW_CUNITS, WS_OPT)
 MAKE_TESTS(nsectr, NSECTR, NSECTR)
 
+/**
+ * Write WS_OPT sectors gathered from 64 byte pieces of alternating halves of
+ * a buffer, the pieces take more descriptors than fit a segment, followed by
+ * MW_CUNITS sectors such that the first WS_OPT can be read back
+ */
+static void test_sgl_chained(void)
+{
+	const size_t nbytes = WS_OPT * SECTOR_SIZE;
+	const size_t piece = 64;
+	struct nvm_addr addrs[WS_OPT];
+	struct nvm_sgl *sgl_w = NULL, *sgl_r = NULL;
+	char *buf_w, *buf_r, *expected;
+	struct nvm_addr addr;
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &addr)) {
+		CU_FAIL("nvm_cmd_rprt_arbs");
+		return;
+	}
+	nvm_addr_fill_crange(addrs, addr, WS_OPT);
+
+	buf_w = nvm_buf_alloc(DEV, nbytes, NULL);
+	buf_r = nvm_buf_alloc(DEV, nbytes, NULL);
+	expected = malloc(nbytes);
+	CU_ASSERT_FATAL(buf_w && buf_r && expected);
+	nvm_buf_fill(buf_w, nbytes);
+
+	sgl_w = nvm_sgl_create(DEV, 0);
+	sgl_r = nvm_sgl_create(DEV, 0);
+	CU_ASSERT_FATAL(sgl_w && sgl_r);
+
+	for (size_t i = 0; i < nbytes / piece; ++i) {
+		char *src = buf_w + (i % 2) * (nbytes / 2) + (i / 2) * piece;
+
+		memcpy(expected + i * piece, src, piece);
+		CU_ASSERT_FATAL(!nvm_sgl_add(DEV, sgl_w, src, piece));
+	}
+	CU_ASSERT_FATAL(!nvm_sgl_add(DEV, sgl_r, buf_r, nbytes));
+
+	CU_ASSERT(!nvm_cmd_write(DEV, addrs, WS_OPT, sgl_w, NULL,
+				 NVM_CMD_VECTOR | NVM_CMD_SGL, NULL));
+	for (size_t sectr = WS_OPT; sectr < WS_OPT + MW_CUNITS;
+	     sectr += WS_OPT) {
+		struct nvm_addr pad = addr;
+
+		pad.l.sectr = sectr;
+		nvm_addr_fill_crange(addrs, pad, WS_OPT);
+		CU_ASSERT(!nvm_cmd_write(DEV, addrs, WS_OPT, buf_w, NULL,
+					 NVM_CMD_VECTOR, NULL));
+	}
+
+	nvm_addr_fill_crange(addrs, addr, WS_OPT);
+	CU_ASSERT(!nvm_cmd_read(DEV, addrs, WS_OPT, sgl_r, NULL,
+				NVM_CMD_VECTOR | NVM_CMD_SGL, NULL));
+	CU_ASSERT(!memcmp(buf_r, expected, nbytes));
+
+	CU_ASSERT(!nvm_cmd_erase(DEV, &addr, 1, NULL, NVM_CMD_VECTOR, NULL));
+
+	nvm_sgl_destroy(DEV, sgl_w);
+	nvm_sgl_destroy(DEV, sgl_r);
+	nvm_buf_free(DEV, buf_w);
+	nvm_buf_free(DEV, buf_r);
+	free(expected);
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
@@ -152,6 +216,9 @@ int main(int argc, char **argv)
 			goto out;
 		if (!CU_add_test(pSuite, "simple: {mode: VECTOR; nsectr: NSECTR; metadata: ON}", test_sgl_vector_nsectr_meta))
 			goto out;
+
+		if (!CU_add_test(pSuite, "chained: {mode: VECTOR; nsectr: WS_OPT; metadata: OFF}", test_sgl_chained))
+			goto out;
 	}
 
 	switch(RMODE) {
@@ -1,4 +1,7 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include "test_intf.c"
+#include <nvm_vblk.h>
 
 int vblk_ewr(struct nvm_addr *addrs, int naddrs, int mode)
 {
@@ -152,6 +155,975 @@ void test_VBLK_EWR_SCALAR_ASYNC(void)
 	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_SCALAR | NVM_CMD_ASYNC));
 }
 
+void test_VBLK_PCOPY(void)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *src = NULL;
+	struct nvm_vblk *dst = NULL;
+	size_t nbytes, half;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Only supported for 2.0
+
+	// Source and destination on distinct chunks, at most a chunk per PU
+	// and call of nvm_cmd_rprt_arbs
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+	for (int taken = 1, retry = 0; taken; ++retry) {
+		if ((retry == 32) ||
+		    nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs,
+				      addrs + naddrs)) {
+			CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+			return;
+		}
+
+		taken = 0;
+		for (size_t i = 0; i < naddrs; ++i) {
+			for (size_t j = 0; j < naddrs; ++j)
+				taken |= addrs[i].val == addrs[naddrs + j].val;
+		}
+	}
+
+	src = nvm_vblk_alloc(DEV, addrs, naddrs);
+	dst = nvm_vblk_alloc(DEV, addrs + naddrs, naddrs);
+	if (!src || !dst) {
+		CU_FAIL("FAILED: Allocating vblk");
+		goto out;
+	}
+	nbytes = nvm_vblk_get_nbytes(src);
+	half = nbytes / 2 / (WS_OPT * GEO->l.nbytes) * WS_OPT * GEO->l.nbytes;
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_write(src, bufs->write, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_write");
+		goto out;
+	}
+
+	// In two ranges, exercising partial copies
+	if (nvm_vblk_pcopy(src, dst, half, 0) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_pcopy");
+		goto out;
+	}
+	if (nvm_vblk_pcopy(src, dst, nbytes - half, half) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_pcopy");
+		goto out;
+	}
+
+	if (nvm_vblk_read(dst, bufs->read, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_read");
+		goto out;
+	}
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	CU_ASSERT(nvm_vblk_pcopy(src, dst, nbytes, half) < 0);
+
+	if (nvm_vblk_erase(src) < 0 || nvm_vblk_erase(dst) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(src);
+	nvm_vblk_free(dst);
+	nvm_buf_set_free(bufs);
+}
+
+void test_VBLK_LINE_HEALTHY(void)
+{
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	struct nvm_addr addr = { 0 };
+	size_t nbytes = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Uses a free chunk index, 2.0 only
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &addr)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	vblk = nvm_vblk_alloc_line_healthy(DEV, 0, GEO->l.npugrp - 1, 0,
+					   GEO->l.npunit - 1, addr.l.chunk,
+					   NVM_VBLK_LINE_SUBST);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc_line_healthy");
+		goto out;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	if (CU_BRM_VERBOSE == RMODE)
+		nvm_vblk_pr(vblk);
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+
+	if (nvm_vblk_write(vblk, bufs->write, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_write");
+		goto out;
+	}
+
+	if (nvm_vblk_read(vblk, bufs->read, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_read");
+		goto out;
+	}
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+}
+
+/**
+ * Check that the 'nunits' appends of 'unit' bytes at 'addrs' are disjoint and
+ * cover the vblk, then read them back to 'read' and compare with 'write'
+ */
+static void vblk_append_verify(struct nvm_vblk *vblk, char *write, char *read,
+			       size_t unit, size_t nunits,
+			       struct nvm_addr addrs[])
+{
+	const size_t nsectr = unit / GEO->l.nbytes;
+	const int naddrs = nvm_vblk_get_naddrs(vblk);
+	struct nvm_addr *chunks = nvm_vblk_get_addrs(vblk);
+	char *written = calloc(naddrs * GEO->l.nsectr, 1);
+
+	if (!written) {
+		CU_FAIL("FAILED: calloc");
+		return;
+	}
+
+	for (size_t u = 0; u < nunits; ++u) {
+		struct nvm_addr sectrs[nsectr];
+		struct nvm_addr key = addrs[u];
+		int c;
+
+		key.l.sectr = 0;
+		for (c = 0; (c < naddrs) && (chunks[c].val != key.val); ++c)
+			;
+		if ((c == naddrs) ||
+		    (addrs[u].l.sectr + nsectr > GEO->l.nsectr)) {
+			CU_FAIL("FAILED: append outside of the vblk");
+			goto out;
+		}
+
+		for (size_t i = 0; i < nsectr; ++i) {
+			char *sectr = &written[c * GEO->l.nsectr +
+					       addrs[u].l.sectr + i];
+
+			if (*sectr) {
+				CU_FAIL("FAILED: appends overlap");
+				goto out;
+			}
+			*sectr = 1;
+
+			sectrs[i].val = addrs[u].val;
+			sectrs[i].l.sectr = addrs[u].l.sectr + i;
+		}
+
+		if (nvm_cmd_read(DEV, sectrs, nsectr, read + u * unit, NULL,
+				 0x0, NULL)) {
+			CU_FAIL("FAILED: nvm_cmd_read");
+			goto out;
+		}
+	}
+
+	// Disjoint appends of the size of the vblk cover it
+	CU_ASSERT(nunits * unit == nvm_vblk_get_nbytes(vblk));
+
+	if (nvm_buf_diff(write, read, nunits * unit))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+out:
+	free(written);
+}
+
+struct vblk_append_arg {
+	struct nvm_vblk *vblk;
+	char *write;
+	size_t unit;
+	size_t nunits;
+	atomic_size_t *next;		///< Next unit of 'write' to append
+	struct nvm_addr *addrs;		///< Address of every unit appended
+	int nerr;
+};
+
+static void *vblk_append_worker(void *opaque)
+{
+	struct vblk_append_arg *arg = opaque;
+
+	for (;;) {
+		const size_t u = atomic_fetch_add(arg->next, 1);
+
+		if (u >= arg->nunits)
+			break;
+
+		if (nvm_vblk_append(arg->vblk, arg->write + u * arg->unit,
+				    arg->unit, &arg->addrs[u]) < 0) {
+			++arg->nerr;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Fill the vblk by appends of the minimum write size from 'nthreads' threads,
+ * then verify the appends after it is full, the device serves a sector once
+ * mw_cunits sectors are written after it
+ */
+static void vblk_append(int nthreads)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	const size_t unit = nvm_dev_get_ws_min(DEV) * GEO->l.nbytes;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct vblk_append_arg args[nthreads];
+	pthread_t threads[nthreads];
+	struct nvm_addr *appended = NULL;
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	atomic_size_t next = 0;
+	size_t nbytes = 0;
+	int nstarted = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Only supported for 2.0
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	vblk = nvm_vblk_alloc(DEV, addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		return;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	appended = calloc(nbytes / unit, sizeof(*appended));
+	if (!bufs || !appended) {
+		CU_FAIL("FAILED: Allocating buffers");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+
+	for (int i = 0; i < nthreads; ++i) {
+		args[i] = (struct vblk_append_arg) {
+			.vblk = vblk,
+			.write = bufs->write,
+			.unit = unit,
+			.nunits = nbytes / unit,
+			.next = &next,
+			.addrs = appended,
+		};
+	}
+
+	if (nthreads == 1) {
+		vblk_append_worker(&args[0]);
+		nstarted = 1;
+	} else {
+		for (; nstarted < nthreads; ++nstarted) {
+			if (pthread_create(&threads[nstarted], NULL,
+					   vblk_append_worker, &args[nstarted]))
+				break;
+		}
+		for (int i = 0; i < nstarted; ++i)
+			pthread_join(threads[i], NULL);
+	}
+
+	for (int i = 0; i < nthreads; ++i)
+		CU_ASSERT(!args[i].nerr);
+	if (nstarted != nthreads) {
+		CU_FAIL("FAILED: pthread_create");
+		goto out;
+	}
+
+	// The vblk is full
+	CU_ASSERT(nvm_vblk_append(vblk, bufs->write, unit, NULL) < 0);
+
+	vblk_append_verify(vblk, bufs->write, bufs->read, unit, nbytes / unit,
+			   appended);
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+	free(appended);
+}
+
+void test_VBLK_APPEND(void)
+{
+	vblk_append(1);
+}
+
+void test_VBLK_APPEND_MT(void)
+{
+	vblk_append(4);
+}
+
+void test_VBLK_WBUF(void)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	const size_t align = WS_OPT * GEO->l.nbytes;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	size_t nbytes = 0, offset = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Uses free chunks, 2.0 only
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	vblk = nvm_vblk_alloc(DEV, addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		return;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+
+	if (nvm_vblk_set_wbuf(vblk, 0)) {
+		CU_FAIL("FAILED: nvm_vblk_set_wbuf");
+		goto out;
+	}
+
+	// Writes of odd sizes, short of the last half of an aligned write
+	while (offset < nbytes - align / 2) {
+		size_t count = NVM_MIN(align / 3 + offset % align,
+				       nbytes - align / 2 - offset);
+
+		if (nvm_vblk_write(vblk, bufs->write + offset, count) < 0) {
+			CU_FAIL("FAILED: nvm_vblk_write");
+			goto out;
+		}
+		offset += count;
+
+		CU_ASSERT_EQUAL(nvm_vblk_get_pos_write(vblk), offset);
+	}
+
+	// Moving the write cursor would discard the buffered data
+	errno = 0;
+	CU_ASSERT(nvm_vblk_set_pos_write(vblk, 0) < 0);
+	CU_ASSERT_EQUAL(errno, EBUSY);
+
+	CU_ASSERT_EQUAL(nvm_vblk_flush(vblk), (ssize_t)(nbytes - offset));
+	CU_ASSERT_EQUAL(nvm_vblk_get_pos_write(vblk), nbytes);
+
+	if (nvm_vblk_read(vblk, bufs->read, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_read");
+		goto out;
+	}
+
+	if (nvm_buf_diff(bufs->write, bufs->read, offset))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+}
+
+static void vblk_readahead(int async)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	const size_t align = WS_OPT * GEO->l.nbytes;
+	const size_t steps[] = { 1, 511, GEO->l.nbytes, align + 7 };
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	size_t nbytes = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Uses free chunks, 2.0 only
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	vblk = nvm_vblk_alloc(DEV, addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		return;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	// Windows are read by requests, see nvm_vblk_pread_async
+	if (async && nvm_vblk_set_async(vblk, 0)) {
+		CU_FAIL("FAILED: nvm_vblk_set_async");
+		goto out;
+	}
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+	if (nvm_vblk_write(vblk, bufs->write, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_write");
+		goto out;
+	}
+
+	CU_ASSERT_EQUAL(nvm_vblk_set_readahead(vblk,
+					       NVM_VBLK_RA_NSTRIPES_MAX + 1), -1);
+	if (nvm_vblk_set_readahead(vblk, 4)) {
+		CU_FAIL("FAILED: nvm_vblk_set_readahead");
+		goto out;
+	}
+
+	// Sequential reads of odd sizes, served by the read-ahead ring
+	for (size_t i = 0; i < sizeof(steps) / sizeof(*steps); ++i) {
+		size_t offset = 0;
+
+		memset(bufs->read, 0, nbytes);
+
+		while (offset < nbytes) {
+			size_t count = NVM_MIN(steps[i], nbytes - offset);
+
+			if (nvm_vblk_read(vblk, bufs->read + offset, count) < 0) {
+				CU_FAIL("FAILED: nvm_vblk_read");
+				goto out;
+			}
+			offset += count;
+		}
+
+		CU_ASSERT_EQUAL(nvm_vblk_get_pos_read(vblk), nbytes);
+		if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+			CU_FAIL("FAILED: nvm_buf_diff");
+
+		// The seek drops the ring, an unaligned read restarts it
+		memset(bufs->read, 0, nbytes);
+		if (nvm_vblk_set_pos_read(vblk, nbytes / 2 + 511)) {
+			CU_FAIL("FAILED: nvm_vblk_set_pos_read");
+			goto out;
+		}
+		if (nvm_vblk_read(vblk, bufs->read, steps[i]) < 0) {
+			CU_FAIL("FAILED: nvm_vblk_read");
+			goto out;
+		}
+		if (nvm_buf_diff(bufs->write + nbytes / 2 + 511, bufs->read,
+				 steps[i]))
+			CU_FAIL("FAILED: nvm_buf_diff");
+
+		if (nvm_vblk_set_pos_read(vblk, 0)) {
+			CU_FAIL("FAILED: nvm_vblk_set_pos_read");
+			goto out;
+		}
+	}
+
+	// Random reads bypass the ring, reading their aligned span only
+	for (size_t i = 0; i < 64; ++i) {
+		const size_t count = steps[i % (sizeof(steps) / sizeof(*steps))];
+		const size_t offset = (size_t)rand() % (nbytes - count);
+
+		if (nvm_vblk_set_pos_read(vblk, offset) ||
+		    (nvm_vblk_read(vblk, bufs->read, count) < 0)) {
+			CU_FAIL("FAILED: random nvm_vblk_read");
+			goto out;
+		}
+		if (nvm_buf_diff(bufs->write + offset, bufs->read, count))
+			CU_FAIL("FAILED: nvm_buf_diff");
+	}
+
+	// Half written, windows are not read past the write position
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+	if (nvm_vblk_set_pos_write(vblk, 0) ||
+	    (nvm_vblk_write(vblk, bufs->write, nbytes / 2) < 0)) {
+		CU_FAIL("FAILED: nvm_vblk_write");
+		goto out;
+	}
+	if (nvm_vblk_set_pos_read(vblk, 0)) {
+		CU_FAIL("FAILED: nvm_vblk_set_pos_read");
+		goto out;
+	}
+	memset(bufs->read, 0, nbytes);
+	for (size_t offset = 0; offset < nbytes / 2; offset += steps[1]) {
+		const size_t count = NVM_MIN(steps[1], nbytes / 2 - offset);
+
+		if (nvm_vblk_read(vblk, bufs->read + offset, count) < 0) {
+			CU_FAIL("FAILED: nvm_vblk_read");
+			goto out;
+		}
+	}
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes / 2))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	if (nvm_vblk_set_readahead(vblk, 0))
+		CU_FAIL("FAILED: nvm_vblk_set_readahead");
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+}
+
+void test_VBLK_READAHEAD(void)
+{
+	vblk_readahead(0);
+}
+
+void test_VBLK_READAHEAD_ASYNC(void)
+{
+	vblk_readahead(1);
+}
+
+void test_VBLK_RCACHE(void)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	const size_t align = WS_OPT * GEO->l.nbytes;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	size_t nbytes = 0;
+	uint64_t nhits;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Only supported for 2.0
+	if (!nvm_dev_get_mw_cunits(DEV))
+		return;		// Nothing to cache
+
+	if (nvm_dev_set_rcache(DEV, 1)) {
+		CU_FAIL("FAILED: nvm_dev_set_rcache");
+		return;
+	}
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		goto out;
+	}
+
+	vblk = nvm_vblk_alloc(DEV, addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		goto out;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+	nhits = nvm_dev_get_rcache_nhits(DEV);
+
+	// Read back the unit just written, which the device cannot serve before
+	// mw_cunits more sectors are written to its chunk
+	for (size_t offset = 0; offset < nbytes; offset += align) {
+		if (nvm_vblk_pwrite(vblk, bufs->write + offset, align,
+				    offset) < 0) {
+			CU_FAIL("FAILED: nvm_vblk_pwrite");
+			goto out;
+		}
+
+		if (nvm_vblk_pread(vblk, bufs->read + offset, align,
+				   offset) < 0) {
+			CU_FAIL("FAILED: nvm_vblk_pread");
+			goto out;
+		}
+
+		if (nvm_buf_diff(bufs->write + offset, bufs->read + offset,
+				 align)) {
+			CU_FAIL("FAILED: nvm_buf_diff");
+			goto out;
+		}
+	}
+
+	// The last of the unit, up to mw_cunits sectors, is read from the cache
+	CU_ASSERT(nvm_dev_get_rcache_nhits(DEV) - nhits >= (nbytes / align) *
+		  NVM_MIN(nvm_dev_get_mw_cunits(DEV), WS_OPT));
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_dev_set_rcache(DEV, 0);
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+}
+
+/**
+ * Check the parity unit of every stripe against the XOR of the data units
+ * written, the parity of stripe 'rnd' is held by chunk 'rnd % nchunks'
+ */
+static void vblk_parity_verify(struct nvm_vblk *vblk, const char *write,
+			       size_t nbytes)
+{
+	const int nchunks = nvm_vblk_get_naddrs(vblk);
+	const size_t unit = WS_OPT * GEO->l.nbytes;
+	const size_t nrnds = nbytes / (unit * (nchunks - 1));
+	struct nvm_addr *chunks = nvm_vblk_get_addrs(vblk);
+	char *parity, *expected;
+
+	parity = nvm_buf_alloc(DEV, unit, NULL);
+	expected = malloc(unit);
+	if (!parity || !expected) {
+		CU_FAIL("FAILED: Allocating buffers");
+		goto out;
+	}
+
+	for (size_t rnd = 0; rnd < nrnds; ++rnd) {
+		const char *data = write + rnd * (nchunks - 1) * unit;
+		struct nvm_addr addrs[WS_OPT];
+
+		memset(expected, 0, unit);
+		for (int i = 0; i < nchunks - 1; ++i) {
+			for (size_t b = 0; b < unit; ++b)
+				expected[b] ^= data[i * unit + b];
+		}
+
+		for (size_t i = 0; i < WS_OPT; ++i) {
+			addrs[i].val = chunks[rnd % nchunks].val;
+			addrs[i].l.sectr = rnd * WS_OPT + i;
+		}
+		if (nvm_cmd_read(DEV, addrs, WS_OPT, parity, NULL, 0x0,
+				 NULL)) {
+			CU_FAIL("FAILED: nvm_cmd_read");
+			goto out;
+		}
+
+		if (nvm_buf_diff(expected, parity, unit)) {
+			CU_FAIL("FAILED: parity of stripe differs");
+			goto out;
+		}
+	}
+
+out:
+	nvm_buf_free(DEV, parity);
+	free(expected);
+}
+
+void test_VBLK_PARITY(void)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	size_t nbytes = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Only supported for 2.0
+	if (naddrs < 2)
+		return;		// Parity needs two or more chunks
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	vblk = nvm_vblk_alloc(DEV, addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		return;
+	}
+
+	nbytes = nvm_vblk_get_nbytes(vblk);
+	if (nvm_vblk_set_parity(vblk, 1)) {
+		CU_FAIL("FAILED: nvm_vblk_set_parity");
+		goto out;
+	}
+	// The capacity of a chunk goes to parity
+	CU_ASSERT_EQUAL(nvm_vblk_get_nbytes(vblk),
+			nbytes / naddrs * (naddrs - 1));
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+
+	if (nvm_vblk_write(vblk, bufs->write, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_write");
+		goto out;
+	}
+
+	if (nvm_vblk_read(vblk, bufs->read, nbytes) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_read");
+		goto out;
+	}
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	vblk_parity_verify(vblk, bufs->write, nbytes);
+
+	// Read with a data chunk marked failed, its units are rebuilt from the
+	// others of their stripe
+	atomic_store(&vblk->parity_degraded, 2);
+	memset(bufs->read, 0, nbytes);
+	if (nvm_vblk_pread(vblk, bufs->read, nbytes, 0) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_pread, degraded");
+		goto out;
+	}
+	CU_ASSERT_EQUAL(atomic_load(&vblk->parity_degraded), 2);
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+		CU_FAIL("FAILED: nvm_buf_diff, degraded");
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+}
+
+void test_VBLK_ASYNC_REQ(void)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_vblk_req *reqs[2] = { NULL };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	size_t nbytes = 0;
+	size_t half = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Only supported for 2.0
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	vblk = nvm_vblk_alloc(DEV, addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		return;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+	half = nbytes / 2;
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_set_async(vblk, 0)) {
+		CU_FAIL("FAILED: nvm_vblk_set_async");
+		goto out;
+	}
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+
+	// Both halves in flight at once, the second follows the first per chunk
+	reqs[0] = nvm_vblk_pwrite_async(vblk, bufs->write, half, 0, NULL, NULL);
+	if (!reqs[0]) {
+		CU_FAIL("FAILED: nvm_vblk_pwrite_async");
+		goto out;
+	}
+	reqs[1] = nvm_vblk_pwrite_async(vblk, bufs->write + half, nbytes - half,
+					half, NULL, NULL);
+	if (!reqs[1]) {
+		CU_FAIL("FAILED: nvm_vblk_pwrite_async");
+		goto out;
+	}
+
+	if (nvm_vblk_async_wait(vblk)) {
+		CU_FAIL("FAILED: nvm_vblk_async_wait");
+		goto out;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		CU_ASSERT(nvm_vblk_req_is_done(reqs[i]));
+		CU_ASSERT_EQUAL(nvm_vblk_req_get_nerr(reqs[i]), 0);
+		CU_ASSERT_EQUAL(nvm_vblk_req_free(reqs[i]), 0);
+		reqs[i] = NULL;
+	}
+
+	reqs[0] = nvm_vblk_pread_async(vblk, bufs->read, nbytes, 0, NULL, NULL);
+	if (!reqs[0]) {
+		CU_FAIL("FAILED: nvm_vblk_pread_async");
+		goto out;
+	}
+
+	if (nvm_vblk_async_wait(vblk)) {
+		CU_FAIL("FAILED: nvm_vblk_async_wait");
+		goto out;
+	}
+	CU_ASSERT_EQUAL(nvm_vblk_req_get_nerr(reqs[0]), 0);
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(vblk);
+	for (int i = 0; i < 2; ++i)
+		nvm_vblk_req_free(reqs[i]);
+	nvm_buf_set_free(bufs);
+}
+
+void test_VBLK_IOV(void)
+{
+	const size_t naddrs = GEO->l.npugrp * GEO->l.npunit;
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct iovec iov[64] = { 0 };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_vblk *vblk = NULL;
+	size_t nbytes = 0;
+	size_t seg_nbytes = 0;
+	int iovcnt = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20)
+		return;		// Only supported for 2.0
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs)) {
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	vblk = nvm_vblk_alloc(DEV, addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		return;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	bufs = nvm_buf_set_alloc(DEV, nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: Allocating nvm_buf_set");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	if (nvm_vblk_erase(vblk) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_erase");
+		goto out;
+	}
+
+	// Segments of three sectors, minimum writes straddle their boundaries
+	seg_nbytes = 3 * GEO->l.nbytes;
+	iovcnt = 0;
+	for (size_t pos = 0; pos < nbytes; pos += seg_nbytes) {
+		if (iovcnt == 64) {	// Last segment takes the rest
+			iov[63].iov_len += nbytes - pos;
+			break;
+		}
+		iov[iovcnt].iov_base = bufs->write + pos;
+		iov[iovcnt].iov_len = NVM_MIN(seg_nbytes, nbytes - pos);
+		++iovcnt;
+	}
+
+	if (nvm_vblk_pwritev(vblk, iov, iovcnt, 0) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_pwritev");
+		goto out;
+	}
+
+	// Read back into two segments
+	iov[0].iov_base = bufs->read;
+	iov[0].iov_len = nbytes / 2 + GEO->l.nbytes;
+	iov[1].iov_base = bufs->read + iov[0].iov_len;
+	iov[1].iov_len = nbytes - iov[0].iov_len;
+
+	if (nvm_vblk_preadv(vblk, iov, 2, 0) < 0) {
+		CU_FAIL("FAILED: nvm_vblk_preadv");
+		goto out;
+	}
+
+	if (nvm_buf_diff(bufs->write, bufs->read, nbytes))
+		CU_FAIL("FAILED: nvm_buf_diff");
+
+	// O_DIRECT on LBD, a segment not on the sector size is rejected
+	if (BE_ID == NVM_BE_LBD) {
+		iov[0].iov_base = bufs->read + 1;
+		iov[0].iov_len = nbytes / 2;
+		iov[1].iov_base = bufs->read + nbytes / 2;
+		iov[1].iov_len = nbytes / 2;
+
+		errno = 0;
+		CU_ASSERT(nvm_vblk_preadv(vblk, iov, 2, 0) < 0);
+		CU_ASSERT_EQUAL(errno, EINVAL);
+	}
+
+	if (nvm_vblk_erase(vblk) < 0)
+		CU_FAIL("FAILED: nvm_vblk_erase");
+
+out:
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
@@ -169,12 +1141,34 @@ int main(int argc, char **argv)
 		case NVM_BE_LBD:
 			if (!CU_add_test(pSuite, "VBLK EWR S20 SCALAR/ASYNC", test_VBLK_EWR_SCALAR_ASYNC))
 				goto out;
+			if (!CU_add_test(pSuite, "VBLK ASYNC REQ S20", test_VBLK_ASYNC_REQ))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK READAHEAD S20 ASYNC", test_VBLK_READAHEAD_ASYNC))
+				goto out;
 			/* fallthrough */
 		case NVM_BE_IOCTL:
 			if (!CU_add_test(pSuite, "VBLK EWR S20 VECTOR/SYNC", test_VBLK_EWR_VECTOR_SYNC))
 				goto out;
 			if (!CU_add_test(pSuite, "VBLK EWR S20 SCALAR/SYNC", test_VBLK_EWR_SCALAR_SYNC))
 				goto out;
+			if (!CU_add_test(pSuite, "VBLK PCOPY S20", test_VBLK_PCOPY))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK LINE HEALTHY S20", test_VBLK_LINE_HEALTHY))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK APPEND S20", test_VBLK_APPEND))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK APPEND MT S20", test_VBLK_APPEND_MT))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK WBUF S20", test_VBLK_WBUF))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK RCACHE S20", test_VBLK_RCACHE))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK READAHEAD S20", test_VBLK_READAHEAD))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK PARITY S20", test_VBLK_PARITY))
+				goto out;
+			if (!CU_add_test(pSuite, "VBLK IOV S20", test_VBLK_IOV))
+				goto out;
 	}
 
 	switch(RMODE) {